@@ -102,6 +102,12 @@ GIT_BEGIN_DECL
  *   files or folders that fold to the same name on case insensitive
  *   filesystems.  This can cause files to retain their existing names
  *   and write through existing symbolic links.
+ *
+ * - GIT_CHECKOUT_PACK_ORDER writes files in the order their contents are
+ *   stored in the repository's packs instead of in path order, so that
+ *   delta bases are not decompressed again and again.  The progress
+ *   callback sees the files in that order too.  This is much faster for
+ *   large checkouts from packed repositories, e.g. just after a clone.
  */
 typedef enum {
 	GIT_CHECKOUT_NONE = 0, /**< default is a dry run, no actual updates */
@@ -165,6 +171,9 @@ typedef enum {
 	/** Normally checkout writes the index upon completion; this prevents that. */
 	GIT_CHECKOUT_DONT_WRITE_INDEX = (1u << 23),
 
+	/** Write files in pack order rather than path order */
+	GIT_CHECKOUT_PACK_ORDER = (1u << 24),
+
 	/**
 	 * THE FOLLOWING OPTIONS ARE NOT YET IMPLEMENTED
 	 */
@@ -217,6 +226,7 @@ typedef struct {
 	size_t mkdir_calls;
 	size_t stat_calls;
 	size_t chmod_calls;
+	size_t open_calls;
 } git_checkout_perfdata;
 
 /** Checkout notification callback function */
@@ -161,6 +161,18 @@ typedef struct git_clone_options {
 	 * This parameter is ignored unless remote_cb is non-NULL.
 	 */
 	void *remote_cb_payload;
+
+	/**
+	 * Set to non-zero to start the checkout while the pack is still
+	 * being received: as soon as the indexer knows the contents of the
+	 * files of the commit being checked out, they are written out on
+	 * background threads.  Checkout then only writes what is left, and
+	 * only reports those files to its progress callback.  Files which
+	 * need more than the built-in filters, and clones with checkout
+	 * options that ask for more than writing out the whole tree, are
+	 * always written by checkout.
+	 */
+	int pipeline_checkout;
 } git_clone_options;
 
 #define GIT_CLONE_OPTIONS_VERSION 1
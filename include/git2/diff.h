@@ -197,6 +197,14 @@ typedef enum {
 	 */
 	GIT_DIFF_SHOW_UNMODIFIED = (1u << 26),
 
+	/** When generating patches (e.g. with `git_diff_foreach` or
+	 *  `git_diff_print`), load the content and compute the hunks of
+	 *  several files at once on worker threads.  Callbacks are still
+	 *  issued in delta order from the calling thread.  This has no effect
+	 *  when either side of the diff is the working directory.
+	 */
+	GIT_DIFF_PARALLEL_PATCHES = (1u << 27),
+
 	/** Use the "patience diff" algorithm */
 	GIT_DIFF_PATIENCE = (1u << 28),
 	/** Take extra time to find minimal diff */
@@ -53,6 +53,7 @@ typedef enum {
 
 	GIT_PASSTHROUGH     = -30,	/**< Internal only */
 	GIT_ITEROVER        = -31,	/**< Signals end of iteration with iterator */
+	GIT_DELAYED         = -32,	/**< Internal only */
 } git_error_code;
 
 /**
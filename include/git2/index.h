@@ -362,6 +362,10 @@ GIT_EXTERN(int) git_index_write_tree_to(git_oid *out, git_index *index, git_repo
 /**
  * Get the count of entries currently in the index
  *
+ * With a sparse index (`index.sparse`), each directory entirely outside
+ * of the sparse checkout cone counts as a single entry, until a path
+ * inside of it is looked up or changed.
+ *
  * @param index an existing index object
  * @return integer of count of current entries
  */
@@ -385,6 +389,10 @@ GIT_EXTERN(int) git_index_clear(git_index *index);
  * `git_index_entry` struct is a publicly defined struct, you should
  * be able to make your own permanent copy of the data if necessary.
  *
+ * With a sparse index, a directory outside of the sparse checkout cone
+ * may be a single entry whose path ends in a slash, with the mode
+ * `GIT_FILEMODE_TREE` and the id of its tree.
+ *
  * @param index an existing index object
  * @param n the position of the entry
  * @return a pointer to the entry; NULL if out of bounds
@@ -399,6 +407,10 @@ GIT_EXTERN(const git_index_entry *) git_index_get_byindex(
  * `git_index_entry` struct is a publicly defined struct, you should
  * be able to make your own permanent copy of the data if necessary.
  *
+ * With a sparse index, a directory outside of the sparse checkout cone
+ * may be a single entry whose path ends in a slash, with the mode
+ * `GIT_FILEMODE_TREE` and the id of its tree.
+ *
  * @param index an existing index object
  * @param path path to search
  * @param stage stage to search
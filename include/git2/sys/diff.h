@@ -68,10 +68,12 @@ typedef struct {
 	unsigned int version;
 	size_t stat_calls; /**< Number of stat() calls performed */
 	size_t oid_calculations; /**< Number of ID calculations */
+	/** Number of stat() calls not needed; only set in version 2 and up */
+	size_t stat_calls_avoided;
 } git_diff_perfdata;
 
-#define GIT_DIFF_PERFDATA_VERSION 1
-#define GIT_DIFF_PERFDATA_INIT {GIT_DIFF_PERFDATA_VERSION,0,0}
+#define GIT_DIFF_PERFDATA_VERSION 2
+#define GIT_DIFF_PERFDATA_INIT {GIT_DIFF_PERFDATA_VERSION,0,0,0}
 
 /**
  * Get performance data for a diff object.
@@ -28,6 +28,7 @@ GIT_EXTERN(git_filter *) git_filter_lookup(const char *name);
 
 #define GIT_FILTER_CRLF  "crlf"
 #define GIT_FILTER_IDENT "ident"
+#define GIT_FILTER_PROCESS "process"
 
 /**
  * This is priority that the internal CRLF filter will be registered with
@@ -46,6 +47,12 @@ GIT_EXTERN(git_filter *) git_filter_lookup(const char *name);
  */
 #define GIT_FILTER_DRIVER_PRIORITY 200
 
+/**
+ * This is priority that the internal filter which runs the processes
+ * configured with `filter.<driver>.process` will be registered with
+ */
+#define GIT_FILTER_PROCESS_PRIORITY GIT_FILTER_DRIVER_PRIORITY
+
 /**
  * Create a new empty filter list
  *
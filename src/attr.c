@@ -91,6 +91,22 @@ typedef struct {
 	git_attr_assignment *found;
 } attr_get_many_info;
 
+static int attr_session_dir(
+	git_attr_session_dir **out,
+	git_repository *repo,
+	git_attr_session *attr_session,
+	uint32_t flags,
+	const char *pathname,
+	const git_attr_path *path);
+
+static int attr_dir_load(
+	git_attr_session_dir *dir,
+	git_repository *repo,
+	git_attr_session *attr_session,
+	uint32_t flags,
+	const char *pathname,
+	const git_attr_path *path);
+
 int git_attr_get_many_with_session(
 	const char **values,
 	git_repository *repo,
@@ -102,8 +118,9 @@ int git_attr_get_many_with_session(
 {
 	int error;
 	git_attr_path path;
-	git_vector files = GIT_VECTOR_INIT;
-	size_t i, j, k;
+	git_attr_session_dir local_dir = { NULL }, *dir = &local_dir;
+	git_buf scratch = GIT_BUF_INIT;
+	size_t i, k;
 	git_attr_file *file;
 	git_attr_rule *rule;
 	attr_get_many_info *info = NULL;
@@ -114,18 +131,30 @@ int git_attr_get_many_with_session(
 
 	assert(values && repo && names);
 
-	if (git_attr_path__init(&path, pathname, git_repository_workdir(repo), GIT_DIR_FLAG_UNKNOWN) < 0)
+	/* whether the path is a directory only matters to some rules */
+	if (git_attr_path__init(&path, pathname, git_repository_workdir(repo), GIT_DIR_FLAG_FALSE) < 0)
 		return -1;
 
-	if ((error = collect_attr_files(repo, attr_session, flags, pathname, &files)) < 0)
+	if (attr_session)
+		error = attr_session_dir(
+			&dir, repo, attr_session, flags, pathname, &path);
+	else
+		error = attr_dir_load(dir, repo, NULL, flags, pathname, &path);
+
+	if (error < 0)
 		goto cleanup;
 
+	if (dir->needs_is_dir)
+		path.is_dir = (int)git_path_isdir(path.full.ptr);
+
 	info = git__calloc(num_attr, sizeof(attr_get_many_info));
 	GITERR_CHECK_ALLOC(info);
 
-	git_vector_foreach(&files, i, file) {
+	git_vector_foreach(&dir->files, i, file) {
+		size_t rule_pos = file->rules.length;
 
-		git_attr_file__foreach_matching_rule(file, &path, j, rule) {
+		while (git_attr_file__find_rule(&rule_pos, file, &path, &scratch)) {
+			rule = git_vector_get(&file->rules, rule_pos);
 
 			for (k = 0; k < num_attr; k++) {
 				size_t pos;
@@ -156,7 +185,11 @@ int git_attr_get_many_with_session(
 	}
 
 cleanup:
-	release_attr_files(&files);
+	if (dir == &local_dir) {
+		release_attr_files(&local_dir.files);
+		git__free(local_dir.path);
+	}
+	git_buf_free(&scratch);
 	git_attr_path__free(&path);
 	git__free(info);
 
@@ -542,3 +575,75 @@ static int collect_attr_files(
 
 	return error;
 }
+
+static int attr_dir_load(
+	git_attr_session_dir *dir,
+	git_repository *repo,
+	git_attr_session *attr_session,
+	uint32_t flags,
+	const char *pathname,
+	const git_attr_path *path)
+{
+	git_attr_file *file;
+	size_t i;
+	int error;
+
+	dir->path_len = path->basename - path->path;
+	dir->path = git__strndup(path->path, dir->path_len);
+	GITERR_CHECK_ALLOC(dir->path);
+
+	dir->flags = flags;
+
+	if ((error = collect_attr_files(
+			repo, attr_session, flags, pathname, &dir->files)) < 0)
+		return error;
+
+	/* only look at the filesystem for paths that rules care about */
+	git_vector_foreach(&dir->files, i, file) {
+		if (!file->rule_index || file->rule_index->has_dir_rules)
+			dir->needs_is_dir = 1;
+	}
+
+	return 0;
+}
+
+static int attr_session_dir(
+	git_attr_session_dir **out,
+	git_repository *repo,
+	git_attr_session *attr_session,
+	uint32_t flags,
+	const char *pathname,
+	const git_attr_path *path)
+{
+	git_attr_session_dir *dir;
+	size_t dir_len = path->basename - path->path;
+	int error;
+
+	/* leave the directories that this path is not in */
+	while ((dir = git_vector_last(&attr_session->dirs)) != NULL) {
+		if (dir->flags == flags && dir->path_len <= dir_len &&
+			!memcmp(dir->path, path->path, dir->path_len)) {
+			if (dir->path_len == dir_len) {
+				*out = dir;
+				return 0;
+			}
+			break;
+		}
+
+		git_vector_pop(&attr_session->dirs);
+		git_attr_session_dir__free(dir);
+	}
+
+	dir = git__calloc(1, sizeof(git_attr_session_dir));
+	GITERR_CHECK_ALLOC(dir);
+
+	if ((error = attr_dir_load(
+			dir, repo, attr_session, flags, pathname, path)) < 0 ||
+		(error = git_vector_insert(&attr_session->dirs, dir)) < 0) {
+		git_attr_session_dir__free(dir);
+		return error;
+	}
+
+	*out = dir;
+	return 0;
+}
@@ -8,6 +8,10 @@
 #include "index.h"
 #include <ctype.h>
 
+GIT__USE_STRMAP
+
+static void attr_file_index_free(git_attr_file_index *index);
+
 static void attr_file_free(git_attr_file *file)
 {
 	bool unlock = !git_mutex_lock(&file->lock);
@@ -57,6 +61,9 @@ int git_attr_file__clear_rules(git_attr_file *file, bool need_lock)
 		git_attr_rule__free(rule);
 	git_vector_free(&file->rules);
 
+	attr_file_index_free(file->rule_index);
+	file->rule_index = NULL;
+
 	if (need_lock)
 		git_mutex_unlock(&file->lock);
 
@@ -274,12 +281,346 @@ int git_attr_file__parse_buffer(
 		}
 	}
 
+	if (!error)
+		error = git_attr_file__build_index(attrs);
+
 	git_mutex_unlock(&attrs->lock);
 	git_attr_rule__free(rule);
 
 	return error;
 }
 
+/*
+ * Large rule files are mostly literal names ("Makefile"), extensions
+ * ("*.o") and paths under some directory ("build/out").  Instead of
+ * trying every rule on every path, a file's rules are put in buckets
+ * keyed by the one part of a path each kind of rule can match, and only
+ * the rules in the path's buckets, plus the ones with wildcards in
+ * awkward places, are tried.  Buckets hold rule positions in ascending
+ * order so that the last matching rule can still be found first.
+ */
+
+static void attr_file_index_free_buckets(git_strmap *map)
+{
+	git_attr_file_bucket *bucket;
+
+	if (!map)
+		return;
+
+	git_strmap_foreach_value(map, bucket, {
+		git_array_clear(*bucket);
+		git__free(bucket);
+	});
+	git_strmap_free(map);
+}
+
+static void attr_file_index_free(git_attr_file_index *index)
+{
+	if (!index)
+		return;
+
+	attr_file_index_free_buckets(index->literal);
+	attr_file_index_free_buckets(index->extension);
+	attr_file_index_free_buckets(index->prefix);
+	git_array_clear(index->wild);
+	git_pool_clear(&index->pool);
+	git__free(index);
+}
+
+static bool attr_file_index_is_literal(const char *str, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (git__iswildcard(str[i]) || str[i] == '\\')
+			return false;
+	}
+
+	return true;
+}
+
+static int attr_file_bucket_add(git_attr_file_bucket *bucket, size_t pos)
+{
+	size_t *slot = git_array_alloc(*bucket);
+	GITERR_CHECK_ALLOC(slot);
+
+	*slot = pos;
+	return 0;
+}
+
+static int attr_file_index_add(
+	git_attr_file_index *index,
+	git_strmap *map,
+	const char *key,
+	size_t key_len,
+	size_t pos)
+{
+	git_attr_file_bucket *bucket;
+	khiter_t slot;
+	char *k;
+	int error;
+
+	if ((k = git_pool_strndup(&index->pool, key, key_len)) == NULL)
+		return -1;
+
+	if (index->ignore_case)
+		git__strtolower(k);
+
+	slot = git_strmap_lookup_index(map, k);
+
+	if (git_strmap_valid_index(map, slot)) {
+		bucket = git_strmap_value_at(map, slot);
+	} else {
+		bucket = git__calloc(1, sizeof(git_attr_file_bucket));
+		GITERR_CHECK_ALLOC(bucket);
+
+		git_strmap_insert(map, k, bucket, error);
+		if (error < 0) {
+			git__free(bucket);
+			return -1;
+		}
+	}
+
+	return attr_file_bucket_add(bucket, pos);
+}
+
+static int attr_file_index_add_rule(
+	git_attr_file_index *index, git_attr_fnmatch *match, size_t pos)
+{
+	const char *slash, *dot;
+
+	if (match->flags & GIT_ATTR_FNMATCH_NEGATIVE)
+		index->has_negative = 1;
+	if (match->flags &
+		(GIT_ATTR_FNMATCH_NEGATIVE | GIT_ATTR_FNMATCH_DIRECTORY))
+		index->has_dir_rules = 1;
+
+	/* rules from another directory only get checked the slow way, as
+	 * do negated attribute rules, which match what they don't name */
+	if (match->containing_dir_length != index->containing_dir_length ||
+		(match->containing_dir &&
+		 strcmp(match->containing_dir, index->containing_dir) != 0) ||
+		(match->flags & (GIT_ATTR_FNMATCH_NEGATIVE |
+			GIT_ATTR_FNMATCH_IGNORE)) == GIT_ATTR_FNMATCH_NEGATIVE)
+		return attr_file_bucket_add(&index->wild, pos);
+
+	/* a full path rule only matches below its first component */
+	if (match->flags & GIT_ATTR_FNMATCH_FULLPATH) {
+		slash = strchr(match->pattern, '/');
+		if (!slash)
+			slash = match->pattern + match->length;
+
+		if (attr_file_index_is_literal(match->pattern, slash - match->pattern))
+			return attr_file_index_add(index, index->prefix,
+				match->pattern, slash - match->pattern, pos);
+	}
+
+	/* a name only matches that basename, or a leading directory of
+	 * that name for directory rules */
+	else if (attr_file_index_is_literal(match->pattern, match->length))
+		return attr_file_index_add(index, index->literal,
+			match->pattern, match->length, pos);
+
+	/* "*.ext" only matches basenames that end with ".ext" */
+	else if (!(match->flags & GIT_ATTR_FNMATCH_DIRECTORY) &&
+		match->pattern[0] == '*' &&
+		attr_file_index_is_literal(match->pattern + 1, match->length - 1) &&
+		(dot = strrchr(match->pattern, '.')) != NULL)
+		return attr_file_index_add(index, index->extension,
+			dot, match->length - (dot - match->pattern), pos);
+
+	return attr_file_bucket_add(&index->wild, pos);
+}
+
+int git_attr_file__build_index(git_attr_file *file)
+{
+	git_attr_file_index *index;
+	git_attr_fnmatch *match;
+	size_t i;
+
+	attr_file_index_free(file->rule_index);
+	file->rule_index = NULL;
+
+	index = git__calloc(1, sizeof(git_attr_file_index));
+	GITERR_CHECK_ALLOC(index);
+
+	git_pool_init(&index->pool, 1);
+
+	if (git_strmap_alloc(&index->literal) < 0 ||
+		git_strmap_alloc(&index->extension) < 0 ||
+		git_strmap_alloc(&index->prefix) < 0)
+		goto on_error;
+
+	/* all the rules of one file share the file's directory, apart from
+	 * the optimized match-all ones */
+	git_vector_foreach(&file->rules, i, match) {
+		if ((match->flags & GIT_ATTR_FNMATCH_MATCH_ALL) == 0) {
+			index->containing_dir = match->containing_dir;
+			index->containing_dir_length = match->containing_dir_length;
+			index->ignore_case =
+				((match->flags & GIT_ATTR_FNMATCH_ICASE) != 0);
+			break;
+		}
+	}
+
+	git_vector_foreach(&file->rules, i, match) {
+		if (attr_file_index_add_rule(index, match, i) < 0)
+			goto on_error;
+	}
+
+	file->rule_index = index;
+	return 0;
+
+on_error:
+	attr_file_index_free(index);
+	return -1;
+}
+
+static bool attr_file_rule_matches(
+	git_attr_fnmatch *match, git_attr_path *path)
+{
+	/* an ignore rule says whether it matched, negated or not */
+	if (match->flags & GIT_ATTR_FNMATCH_IGNORE)
+		return git_attr_fnmatch__match(match, path);
+
+	return git_attr_rule__match((git_attr_rule *)match, path);
+}
+
+static git_attr_file_bucket *attr_file_index_bucket(
+	git_strmap *map, const char *key)
+{
+	khiter_t pos = git_strmap_lookup_index(map, key);
+
+	return git_strmap_valid_index(map, pos) ?
+		git_strmap_value_at(map, pos) : NULL;
+}
+
+/* the number of the bucket's rules that come before `end` */
+static size_t attr_file_bucket_count_before(
+	git_attr_file_bucket *bucket, size_t end)
+{
+	size_t lo = 0, hi = git_array_size(*bucket);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (bucket->ptr[mid] < end)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static bool attr_file_find_rule_in_all(
+	size_t *pos, git_attr_file *file, git_attr_path *path)
+{
+	while (*pos > 0) {
+		if (attr_file_rule_matches(
+				git_vector_get(&file->rules, --(*pos)), path))
+			return true;
+	}
+
+	return false;
+}
+
+#define ATTR_FILE_MAX_BUCKETS 5
+
+bool git_attr_file__find_rule(
+	size_t *pos, git_attr_file *file, git_attr_path *path, git_buf *scratch)
+{
+	git_attr_file_index *index = file->rule_index;
+	git_attr_file_bucket *buckets[ATTR_FILE_MAX_BUCKETS];
+	size_t next[ATTR_FILE_MAX_BUCKETS], nbuckets = 0, relpath_len, seg_len, i;
+	const char *relpath = path->path, *basename, *ext, *seg, *seg_end;
+	int prefixed;
+
+	if (!index)
+		return attr_file_find_rule_in_all(pos, file, path);
+
+	if (index->containing_dir) {
+		prefixed = index->ignore_case ?
+			!git__strncasecmp(relpath,
+				index->containing_dir, index->containing_dir_length) :
+			!strncmp(relpath,
+				index->containing_dir, index->containing_dir_length);
+
+		if (!prefixed)
+			goto wild;
+
+		relpath += index->containing_dir_length;
+	}
+
+	/* make (case folded) copies of the relative path and its first
+	 * component to look the buckets up with */
+	relpath_len = strlen(relpath);
+	seg_end = strchr(relpath, '/');
+	seg_len = seg_end ? (size_t)(seg_end - relpath) : relpath_len;
+
+	git_buf_clear(scratch);
+	if (git_buf_put(scratch, relpath, relpath_len) < 0 ||
+		git_buf_putc(scratch, '\0') < 0 ||
+		git_buf_put(scratch, relpath, seg_len) < 0) {
+		giterr_clear();
+		return attr_file_find_rule_in_all(pos, file, path);
+	}
+
+	if (index->ignore_case)
+		git__strntolower(scratch->ptr, scratch->size);
+
+	basename = scratch->ptr + (path->basename - relpath);
+	seg = scratch->ptr + relpath_len + 1;
+
+	buckets[nbuckets] = attr_file_index_bucket(index->literal, basename);
+	nbuckets += (buckets[nbuckets] != NULL);
+
+	if ((ext = strrchr(basename, '.')) != NULL) {
+		buckets[nbuckets] = attr_file_index_bucket(index->extension, ext);
+		nbuckets += (buckets[nbuckets] != NULL);
+	}
+
+	buckets[nbuckets] = attr_file_index_bucket(index->prefix, seg);
+	nbuckets += (buckets[nbuckets] != NULL);
+
+	/* a directory rule also matches files anywhere beneath it */
+	if (!path->is_dir && seg_end && strcmp(seg, basename) != 0) {
+		buckets[nbuckets] = attr_file_index_bucket(index->literal, seg);
+		nbuckets += (buckets[nbuckets] != NULL);
+	}
+
+wild:
+	buckets[nbuckets++] = &index->wild;
+
+	for (i = 0; i < nbuckets; i++)
+		next[i] = attr_file_bucket_count_before(buckets[i], *pos);
+
+	/* try the candidates from the last rule backwards, as a full scan
+	 * would */
+	while (1) {
+		size_t best = nbuckets, candidate = 0;
+
+		for (i = 0; i < nbuckets; i++) {
+			if (next[i] > 0 && (best == nbuckets ||
+				buckets[i]->ptr[next[i] - 1] > candidate)) {
+				best = i;
+				candidate = buckets[i]->ptr[next[i] - 1];
+			}
+		}
+
+		if (best == nbuckets)
+			return false;
+
+		next[best]--;
+
+		if (attr_file_rule_matches(
+				git_vector_get(&file->rules, candidate), path)) {
+			*pos = candidate;
+			return true;
+		}
+	}
+}
+
 uint32_t git_attr_file__name_hash(const char *name)
 {
 	uint32_t h = 5381;
@@ -409,7 +750,8 @@ bool git_attr_fnmatch__match(
 		if (samename)
 			return false;
 
-		return (p_fnmatch(match->pattern, relpath, flags) != FNM_NOMATCH);
+		return (git_wildmatch_match(
+			match->wildmatch, relpath, flags) != FNM_NOMATCH);
 	}
 
 	/* if path is a directory prefix of a negated pattern, then match */
@@ -424,7 +766,8 @@ bool git_attr_fnmatch__match(
 			return true;
 	}
 
-	return (p_fnmatch(match->pattern, filename, flags) != FNM_NOMATCH);
+	return (git_wildmatch_match(
+		match->wildmatch, filename, flags) != FNM_NOMATCH);
 }
 
 bool git_attr_rule__match(
@@ -559,8 +902,13 @@ int git_attr_fnmatch__parse(
 
 	assert(spec && base && *base);
 
-	if (parse_optimized_patterns(spec, pool, *base))
-		return 0;
+	spec->wildmatch = NULL;
+
+	if (parse_optimized_patterns(spec, pool, *base)) {
+		GITERR_CHECK_ALLOC(spec->pattern);
+		return git_wildmatch_compile(
+			&spec->wildmatch, pool, spec->pattern, 0);
+	}
 
 	spec->flags = (spec->flags & GIT_ATTR_FNMATCH__INCOMING);
 	allow_space = ((spec->flags & GIT_ATTR_FNMATCH_ALLOWSPACE) != 0);
@@ -658,7 +1006,7 @@ int git_attr_fnmatch__parse(
 		/* TODO: convert remaining '\' into '/' for POSIX ??? */
 	}
 
-	return 0;
+	return git_wildmatch_compile(&spec->wildmatch, pool, spec->pattern, 0);
 }
 
 static bool parse_optimized_patterns(
@@ -853,11 +1201,33 @@ int git_attr_session__init(git_attr_session *session, git_repository *repo)
 	return 0;
 }
 
+void git_attr_session_dir__free(git_attr_session_dir *dir)
+{
+	size_t i;
+	git_attr_file *file;
+
+	if (!dir)
+		return;
+
+	git_vector_foreach(&dir->files, i, file)
+		git_attr_file__free(file);
+	git_vector_free(&dir->files);
+	git__free(dir->path);
+	git__free(dir);
+}
+
 void git_attr_session__free(git_attr_session *session)
 {
+	size_t i;
+	git_attr_session_dir *dir;
+
 	if (!session)
 		return;
 
+	git_vector_foreach(&session->dirs, i, dir)
+		git_attr_session_dir__free(dir);
+	git_vector_free(&session->dirs);
+
 	git_buf_free(&session->sysdir);
 	git_buf_free(&session->tmp);
 
@@ -11,8 +11,11 @@
 #include "git2/attr.h"
 #include "vector.h"
 #include "pool.h"
+#include "strmap.h"
+#include "array.h"
 #include "buffer.h"
 #include "fileops.h"
+#include "wildmatch.h"
 
 #define GIT_ATTR_FILE			".gitattributes"
 #define GIT_ATTR_FILE_INREPO	"info/attributes"
@@ -55,6 +58,7 @@ typedef struct {
 	char *containing_dir;
 	size_t containing_dir_length;
 	unsigned int flags;
+	git_wildmatch *wildmatch;
 } git_attr_fnmatch;
 
 typedef struct {
@@ -83,6 +87,7 @@ typedef struct {
 	git_attr_file_entry *entry;
 	git_attr_file_source source;
 	git_vector rules;			/* vector of <rule*> or <fnmatch*> */
+	struct git_attr_file_index *rule_index;
 	git_pool pool;
 	unsigned int nonexistent:1;
 	int session_key;
@@ -92,6 +97,24 @@ typedef struct {
 	} cache_data;
 } git_attr_file;
 
+/* The rules of a file bucketed by the one part of a path that each kind
+ * of rule can match, so that a lookup only has to try a few of them.
+ */
+typedef git_array_t(size_t) git_attr_file_bucket;
+
+typedef struct git_attr_file_index {
+	git_pool pool;                  /* case folded keys */
+	git_strmap *literal;            /* basename -> rules without wildcards */
+	git_strmap *extension;          /* ".ext" -> "*.ext" rules */
+	git_strmap *prefix;             /* first component -> full path rules */
+	git_attr_file_bucket wild;      /* rules tried against every path */
+	const char *containing_dir;
+	size_t containing_dir_length;
+	unsigned int ignore_case:1,
+		has_negative:1,
+		has_dir_rules:1;        /* rules that care if a path is a dir */
+} git_attr_file_index;
+
 struct git_attr_file_entry {
 	git_attr_file *file[GIT_ATTR_FILE_NUM_SOURCES];
 	const char *path; /* points into fullpath */
@@ -109,17 +132,32 @@ typedef struct {
  * invalidation during a single operation instance (like checkout).
  */
 
+/* The attribute files that apply to the paths in one directory, highest
+ * precedence first.  A session keeps them for the directories it is in,
+ * so siblings don't have to look them up again.
+ */
+typedef struct {
+	char *path;		/* relative to the workdir, with a trailing slash */
+	size_t path_len;
+	uint32_t flags;
+	git_vector files;	/* vector of <git_attr_file*>, held */
+	unsigned int needs_is_dir:1;
+} git_attr_session_dir;
+
 typedef struct {
 	int key;
 	unsigned int init_setup:1,
 		init_sysdir:1;
 	git_buf sysdir;
 	git_buf tmp;
+	git_vector dirs;	/* stack of <git_attr_session_dir*>, outermost first */
 } git_attr_session;
 
 extern int git_attr_session__init(git_attr_session *attr_session, git_repository *repo);
 extern void git_attr_session__free(git_attr_session *session);
 
+extern void git_attr_session_dir__free(git_attr_session_dir *dir);
+
 extern int git_attr_get_many_with_session(
 	const char **values_out,
 	git_repository *repo,
@@ -165,6 +203,16 @@ int git_attr_file__parse_buffer(
 int git_attr_file__clear_rules(
 	git_attr_file *file, bool need_lock);
 
+/* Index the rules of a file, for git_attr_file__find_rule; the file's
+ * lock must be held */
+int git_attr_file__build_index(git_attr_file *file);
+
+/* Find the last of the file's rules before position `*pos` that matches
+ * the path, and update `*pos` to it.  `scratch` is used to build keys.
+ */
+bool git_attr_file__find_rule(
+	size_t *pos, git_attr_file *file, git_attr_path *path, git_buf *scratch);
+
 int git_attr_file__lookup_one(
 	git_attr_file *file,
 	git_attr_path *path,
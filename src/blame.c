@@ -151,6 +151,7 @@ void git_blame_free(git_blame *blame)
 
 	git__free(blame->path);
 	git_blob_free(blame->final_blob);
+	git_xdiff_cache_free(blame->line_cache);
 	git__free(blame);
 }
 
@@ -249,28 +250,25 @@ static git_blame_hunk *split_hunk_in_vector(
 static int index_blob_lines(git_blame *blame)
 {
     const char *buf = blame->final_buf;
-    git_off_t len = blame->final_buf_size;
-    int num = 0, incomplete = 0, bol = 1;
+    const char *end = buf + blame->final_buf_size;
+    const char *scan = buf, *eol;
+    int num = 0;
     size_t *i;
 
-    if (len && buf[len-1] != '\n')
-        incomplete++; /* incomplete line at the end */
-    while (len--) {
-        if (bol) {
-            i = git_array_alloc(blame->line_index);
-            GITERR_CHECK_ALLOC(i);
-            *i = buf - blame->final_buf;
-            bol = 0;
-        }
-        if (*buf++ == '\n') {
-            num++;
-            bol = 1;
-        }
+    /* an incomplete line at the end counts as well */
+    while (scan < end) {
+        i = git_array_alloc(blame->line_index);
+        GITERR_CHECK_ALLOC(i);
+        *i = scan - buf;
+        num++;
+
+        eol = memchr(scan, '\n', (size_t)(end - scan));
+        scan = eol ? eol + 1 : end;
     }
     i = git_array_alloc(blame->line_index);
     GITERR_CHECK_ALLOC(i);
-    *i = buf - blame->final_buf;
-    blame->num_lines = num + incomplete;
+    *i = scan - buf;
+    blame->num_lines = num;
     return blame->num_lines;
 }
 
@@ -6,6 +6,7 @@
 #include "vector.h"
 #include "diff.h"
 #include "array.h"
+#include "diff_xdiff.h"
 #include "git2/oid.h"
 
 /*
@@ -83,6 +84,8 @@ struct git_blame {
 	int num_lines;
 	const char *final_buf;
 	git_off_t final_buf_size;
+
+	git_xdiff_cache *line_cache;
 };
 
 git_blame *git_blame__alloc(
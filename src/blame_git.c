@@ -11,6 +11,8 @@
 #include "xdiff/xinclude.h"
 #include "diff_xdiff.h"
 
+#define GIT_BLAME_LINE_CACHE_SIZE (16 * 1024 * 1024)
+
 /*
  * Origin is refcounted and usually we keep the blob contents to be
  * reused.
@@ -349,7 +351,10 @@ static void trim_common_tail(mmfile_t *a, mmfile_t *b, long ctx)
 	b->size -= trimmed - recovered;
 }
 
-static int diff_hunks(mmfile_t file_a, mmfile_t file_b, void *cb_data)
+static int diff_hunks(
+	mmfile_t file_a, mmfile_t file_b,
+	const xdlines_t *lines_a, const xdlines_t *lines_b,
+	void *cb_data)
 {
 	xpparam_t xpp = {0};
 	xdemitconf_t xecfg = {0};
@@ -358,6 +363,12 @@ static int diff_hunks(mmfile_t file_a, mmfile_t file_b, void *cb_data)
 	xecfg.hunk_func = my_emit;
 	ecb.priv = cb_data;
 
+	/* the cached lines cover whole blobs; xdiff only uses those that
+	 * are still inside the trimmed buffers
+	 */
+	xpp.lines1 = lines_a;
+	xpp.lines2 = lines_b;
+
 	trim_common_tail(&file_a, &file_b, 0);
 
 	if (file_a.size > GIT_XDIFF_MAX_SIZE ||
@@ -378,6 +389,28 @@ static void fill_origin_blob(git_blame__origin *o, mmfile_t *file)
 	}
 }
 
+/* Most blobs are diffed twice, once against their parent and once as the
+ * parent of the next origin, so keep their lines around.
+ */
+static int origin_lines(
+	const xdlines_t **out,
+	git_blame *blame,
+	git_blame__origin *o,
+	mmfile_t *file)
+{
+	*out = NULL;
+
+	if (!o->blob || !file->size || file->size > GIT_XDIFF_MAX_SIZE)
+		return 0;
+
+	if (!blame->line_cache &&
+		git_xdiff_cache_new(&blame->line_cache, GIT_BLAME_LINE_CACHE_SIZE) < 0)
+		return -1;
+
+	return git_xdiff_cache_lines(
+		out, blame->line_cache, git_blob_id(o->blob), file, 0);
+}
+
 static int pass_blame_to_parent(
 		git_blame *blame,
 		git_blame__origin *target,
@@ -385,7 +418,9 @@ static int pass_blame_to_parent(
 {
 	size_t last_in_target;
 	mmfile_t file_p, file_o;
+	const xdlines_t *lines_p = NULL, *lines_o = NULL;
 	blame_chunk_cb_data d = { blame, target, parent, 0, 0 };
+	int error;
 
 	if (!find_last_in_target(&last_in_target, blame, target))
 		return 1; /* nothing remains for this target */
@@ -393,13 +428,18 @@ static int pass_blame_to_parent(
 	fill_origin_blob(parent, &file_p);
 	fill_origin_blob(target, &file_o);
 
-	if (diff_hunks(file_p, file_o, &d) < 0)
-		return -1;
+	if ((error = origin_lines(&lines_p, blame, parent, &file_p)) < 0 ||
+		(error = origin_lines(&lines_o, blame, target, &file_o)) < 0 ||
+		(error = diff_hunks(file_p, file_o, lines_p, lines_o, &d)) < 0)
+		goto done;
 
 	/* The reset (i.e. anything after tlno) are the same as the parent */
 	blame_chunk(blame, d.tlno, d.plno, last_in_target, target, parent);
 
-	return 0;
+done:
+	git_xdiff_cache_release(lines_p);
+	git_xdiff_cache_release(lines_o);
+	return error < 0 ? -1 : 0;
 }
 
 static int paths_on_dup(void **old, void *new)
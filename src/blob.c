@@ -15,6 +15,11 @@
 #include "blob.h"
 #include "filter.h"
 #include "buf_text.h"
+#include "pack.h"
+#include "zstream.h"
+#include "oidmap.h"
+
+GIT__USE_OIDMAP
 
 const void *git_blob_rawcontent(const git_blob *blob)
 {
@@ -243,6 +248,322 @@ done:
 	return error;
 }
 
+#define BLOB_BATCH_MAX_THREADS 8
+#define BLOB_BATCH_WINDOW 256
+#define BLOB_BATCH_SIZE 4
+#define BLOB_BATCH_MAX_FILE_SIZE (32 * 1024 * 1024)
+
+typedef struct {
+	const char *workdir;
+	git_blob_batch_entry *entries;
+} blob_batch_data;
+
+static int blob_batch_read(
+	git_buf *out, git_blob_batch_entry *entry, const char *full_path)
+{
+	git_buf raw = GIT_BUF_INIT;
+	ssize_t read_len;
+	int fd, error;
+
+	if (S_ISLNK(entry->st.st_mode)) {
+		if ((error = git_buf_grow(out, (size_t)entry->st.st_size + 1)) < 0)
+			return error;
+
+		read_len = p_readlink(full_path, out->ptr, (size_t)entry->st.st_size);
+
+		if (read_len != (ssize_t)entry->st.st_size) {
+			giterr_set(GITERR_OS, "Failed to read symlink '%s'", full_path);
+			return -1;
+		}
+
+		out->size = (size_t)read_len;
+		return 0;
+	}
+
+	if ((fd = git_futils_open_ro(full_path)) < 0)
+		return fd;
+
+	error = git_futils_readbuffer_fd(
+		entry->fl ? &raw : out, fd, (size_t)entry->st.st_size);
+	p_close(fd);
+
+	if (!error && entry->fl)
+		error = git_filter_list_apply_to_data(out, entry->fl, &raw);
+
+	git_buf_free(&raw);
+	return error;
+}
+
+/* read, filter, hash and compress a single entry into a pack entry */
+static int blob_batch_pack_entry(
+	git_blob_batch_entry *entry, const char *workdir)
+{
+	git_buf path = GIT_BUF_INIT, data = GIT_BUF_INIT;
+	unsigned char hdr[10];
+	size_t hdr_len;
+	int error;
+
+	if ((error = git_buf_joinpath(&path, workdir, entry->path)) < 0 ||
+		(error = git_path_lstat(path.ptr, &entry->st)) < 0)
+		goto done;
+
+	/* directories (submodules) and huge files take the regular path */
+	if (S_ISDIR(entry->st.st_mode) ||
+		entry->st.st_size > BLOB_BATCH_MAX_FILE_SIZE) {
+		entry->serial = 1;
+		goto done;
+	}
+
+	if ((error = blob_batch_read(&data, entry, path.ptr)) < 0 ||
+		(error = git_odb_hash(
+			&entry->id, data.ptr, data.size, GIT_OBJ_BLOB)) < 0)
+		goto done;
+
+	hdr_len = git_packfile__object_header(hdr, data.size, GIT_OBJ_BLOB);
+
+	if ((error = git_buf_put(&entry->packed, (char *)hdr, hdr_len)) < 0)
+		goto done;
+
+	error = git_zstream_deflatebuf(&entry->packed, data.ptr, data.size);
+
+done:
+	git_buf_free(&data);
+	git_buf_free(&path);
+	return error;
+}
+
+static int blob_batch_pack_entries(size_t start, size_t end, void *payload)
+{
+	blob_batch_data *data = payload;
+	git_blob_batch_entry *entry;
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		entry = &data->entries[i];
+
+		if (entry->serial)
+			continue;
+
+		/* leave it to the regular path to report any problem */
+		if (blob_batch_pack_entry(entry, data->workdir) < 0) {
+			giterr_clear();
+			git_buf_free(&entry->packed);
+			entry->serial = 1;
+		}
+	}
+
+	return 0;
+}
+
+static int blob_batch_write_all(int fd, const git_buf *buf)
+{
+	if (p_write(fd, buf->ptr, buf->size) < 0) {
+		giterr_set(GITERR_OS, "Failed to write temporary pack data");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int blob_batch_append(
+	git_odb_writepack *writepack,
+	git_hash_ctx *ctx,
+	const void *data,
+	size_t size,
+	git_transfer_progress *stats)
+{
+	int error;
+
+	if ((error = git_hash_update(ctx, data, size)) < 0)
+		return error;
+
+	return writepack->append(writepack, data, size, stats);
+}
+
+/* stream the collected entries into the odb as a single pack */
+static int blob_batch_commit(
+	git_odb_writepack *writepack, int fd, uint32_t count)
+{
+	struct git_pack_header hdr;
+	git_transfer_progress stats;
+	git_hash_ctx ctx;
+	git_oid trailer;
+	char buffer[FILEIO_BUFSIZE];
+	ssize_t read_len;
+	int error;
+
+	memset(&stats, 0, sizeof(stats));
+
+	hdr.hdr_signature = htonl(PACK_SIGNATURE);
+	hdr.hdr_version = htonl(PACK_VERSION);
+	hdr.hdr_entries = htonl(count);
+
+	if ((error = git_hash_ctx_init(&ctx)) < 0)
+		return error;
+
+	if ((error = blob_batch_append(
+			writepack, &ctx, &hdr, sizeof(hdr), &stats)) < 0)
+		goto done;
+
+	if (p_lseek(fd, 0, SEEK_SET) < 0) {
+		giterr_set(GITERR_OS, "Failed to rewind temporary pack data");
+		error = -1;
+		goto done;
+	}
+
+	while ((read_len = p_read(fd, buffer, sizeof(buffer))) > 0) {
+		if ((error = blob_batch_append(
+				writepack, &ctx, buffer, (size_t)read_len, &stats)) < 0)
+			goto done;
+	}
+
+	if (read_len < 0) {
+		giterr_set(GITERR_OS, "Failed to read temporary pack data");
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_hash_final(&trailer, &ctx)) < 0 ||
+		(error = writepack->append(
+			writepack, trailer.id, GIT_OID_RAWSZ, &stats)) < 0)
+		goto done;
+
+	error = writepack->commit(writepack, &stats);
+
+done:
+	git_hash_ctx_cleanup(&ctx);
+	return error;
+}
+
+int git_blob__create_from_workdir_batch(
+	git_repository *repo, git_blob_batch_entry *entries, size_t count)
+{
+	git_odb *odb;
+	git_odb_writepack *writepack = NULL;
+	git_attr_session attr_session;
+	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
+	git_oidmap *written = NULL;
+	git_buf tmp_prefix = GIT_BUF_INIT, tmp_path = GIT_BUF_INIT;
+	git_blob_batch_entry *entry;
+	blob_batch_data data;
+	size_t start, end, i;
+	uint32_t packed = 0;
+	int fd = -1, nthreads, error, rval;
+	khiter_t pos;
+
+	if ((error = git_repository__ensure_not_bare(
+			repo, "create blobs from the workdir")) < 0 ||
+		(error = git_repository_odb__weakptr(&odb, repo)) < 0)
+		return error;
+
+	/* without a backend that takes packs, everything takes the regular path */
+	if (!git_odb__can_write_pack(odb)) {
+		for (i = 0; i < count; i++)
+			entries[i].serial = 1;
+
+		return 0;
+	}
+
+	if ((written = git_oidmap_alloc()) == NULL) {
+		giterr_set_oom();
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_buf_joinpath(&tmp_prefix,
+			git_repository_path(repo), "blob_batch")) < 0)
+		goto done;
+
+	if ((fd = git_futils_mktmp(&tmp_path, tmp_prefix.ptr, 0600)) < 0) {
+		error = fd;
+		goto done;
+	}
+
+	memset(&attr_session, 0, sizeof(attr_session));
+	git_attr_session__init(&attr_session, repo);
+	filter_opts.attr_session = &attr_session;
+
+	memset(&data, 0, sizeof(data));
+	data.workdir = git_repository_workdir(repo);
+
+	for (start = 0; start < count; start = end) {
+		end = min(start + BLOB_BATCH_WINDOW, count);
+
+		/* attribute lookups share a cache, so load the filters here */
+		for (i = start; i < end; i++) {
+			entry = &entries[i];
+
+			if (git_filter_list__load_ext(&entry->fl, repo, NULL,
+					entry->path, GIT_FILTER_TO_ODB, &filter_opts) < 0) {
+				giterr_clear();
+				entry->serial = 1;
+			} else if (!git_filter_list__builtin_only(entry->fl)) {
+				entry->serial = 1;
+			}
+		}
+
+		nthreads = (int)min((end - start) / BLOB_BATCH_SIZE,
+			BLOB_BATCH_MAX_THREADS);
+
+		data.entries = entries + start;
+		error = git_parallel_foreach(end - start, BLOB_BATCH_SIZE, nthreads,
+			blob_batch_pack_entries, &data);
+
+		for (i = start; !error && i < end; i++) {
+			entry = &entries[i];
+
+			if (entry->serial)
+				continue;
+
+			pos = git_oidmap_lookup_index(written, &entry->id);
+
+			/* the odb is only looked at from this thread */
+			if (git_oidmap_valid_index(written, pos) ||
+				git_odb_exists(odb, &entry->id))
+				continue;
+
+			git_oidmap_insert(written, &entry->id, entry, rval);
+
+			if (rval < 0 ||
+				(error = blob_batch_write_all(fd, &entry->packed)) < 0) {
+				error = -1;
+				break;
+			}
+
+			packed++;
+		}
+
+		for (i = start; i < end; i++) {
+			git_filter_list_free(entries[i].fl);
+			entries[i].fl = NULL;
+			git_buf_free(&entries[i].packed);
+		}
+
+		if (error < 0)
+			break;
+	}
+
+	git_attr_session__free(&attr_session);
+
+	/* only open the pack once there is something to put in it */
+	if (!error && packed &&
+		!(error = git_odb_write_pack(&writepack, odb, NULL, NULL)))
+		error = blob_batch_commit(writepack, fd, packed);
+
+done:
+	if (fd >= 0) {
+		p_close(fd);
+		p_unlink(tmp_path.ptr);
+	}
+
+	git_oidmap_free(written);
+	git_buf_free(&tmp_prefix);
+	git_buf_free(&tmp_path);
+	if (writepack)
+		writepack->free(writepack);
+	return error;
+}
+
 int git_blob_create_fromworkdir(
 	git_oid *id, git_repository *repo, const char *path)
 {
@@ -30,4 +30,29 @@ extern int git_blob__create_from_paths(
 	mode_t hint_mode,
 	bool apply_filters);
 
+typedef struct {
+	const char *path;      /* relative to the workdir */
+	git_oid id;
+	struct stat st;
+	unsigned int serial:1; /* use git_blob__create_from_paths instead */
+
+	/* private */
+	git_filter_list *fl;
+	git_buf packed;
+} git_blob_batch_entry;
+
+/*
+ * Create blobs for many workdir files at once.  The files are read,
+ * filtered, hashed and compressed on several threads and the new
+ * objects are written to the object database as a single pack.  Objects
+ * the database already has are not written again.
+ *
+ * On success, `id` and `st` are filled in for every entry, except for
+ * the ones marked as `serial` (directories, huge files, entries with
+ * custom filters or which could not be read) which the caller must
+ * handle itself, e.g. with `git_blob__create_from_paths`.
+ */
+extern int git_blob__create_from_workdir_batch(
+	git_repository *repo, git_blob_batch_entry *entries, size_t count);
+
 #endif
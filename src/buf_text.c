@@ -6,6 +6,15 @@
  */
 #include "buf_text.h"
 
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define GIT_BUF_TEXT_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define GIT_BUF_TEXT_SSE2
+#endif
+
 int git_buf_text_puts_escaped(
 	git_buf *buf,
 	const char *string,
@@ -182,10 +191,149 @@ int git_buf_text_common_prefix(git_buf *buf, const git_strarray *strings)
 	return 0;
 }
 
+/* Counts of the characters that text classification cares about; every
+ * other byte is printable.
+ */
+typedef struct {
+	size_t nul, cr, lf, crlf;
+	size_t tab_vt; /* printable in stats, but whitespace for is_binary */
+	size_t other; /* remaining control characters and DEL */
+} text_counts;
+
+#if defined(GIT_BUF_TEXT_AVX2) || defined(GIT_BUF_TEXT_SSE2)
+
+#ifdef GIT_BUF_TEXT_AVX2
+typedef __m256i text_vec;
+# define TEXT_VEC_WIDTH 32
+# define text_vec_load(p) _mm256_loadu_si256((const __m256i *)(p))
+# define text_vec_set1(c) _mm256_set1_epi8(c)
+# define text_vec_eq(a, b) _mm256_cmpeq_epi8(a, b)
+# define text_vec_min(a, b) _mm256_min_epu8(a, b)
+# define text_vec_sub(a, b) _mm256_sub_epi8(a, b)
+# define text_vec_and(a, b) _mm256_and_si256(a, b)
+# define text_vec_or(a, b) _mm256_or_si256(a, b)
+# define text_vec_andnot(a, b) _mm256_andnot_si256(a, b)
+# define text_vec_any(a) (_mm256_movemask_epi8(a) != 0)
+
+GIT_INLINE(size_t) text_vec_sum(text_vec acc)
+{
+	__m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+	__m128i half = _mm_add_epi64(
+		_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+
+	return (size_t)_mm_cvtsi128_si32(half) +
+		(size_t)_mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+}
+#else
+typedef __m128i text_vec;
+# define TEXT_VEC_WIDTH 16
+# define text_vec_load(p) _mm_loadu_si128((const __m128i *)(p))
+# define text_vec_set1(c) _mm_set1_epi8(c)
+# define text_vec_eq(a, b) _mm_cmpeq_epi8(a, b)
+# define text_vec_min(a, b) _mm_min_epu8(a, b)
+# define text_vec_sub(a, b) _mm_sub_epi8(a, b)
+# define text_vec_and(a, b) _mm_and_si128(a, b)
+# define text_vec_or(a, b) _mm_or_si128(a, b)
+# define text_vec_andnot(a, b) _mm_andnot_si128(a, b)
+# define text_vec_any(a) (_mm_movemask_epi8(a) != 0)
+
+GIT_INLINE(size_t) text_vec_sum(text_vec acc)
+{
+	__m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+
+	return (size_t)_mm_cvtsi128_si32(sums) +
+		(size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+#endif
+
+/* Per-lane byte counters are added up before they can wrap */
+#define TEXT_VEC_BLOCK 255
+
+/* Count whole vectors from the start of `scan`, leaving at least one byte
+ * unread so that a CR in the last lane can look at the byte after it.
+ * With `stop_at_nul`, give up as soon as a NUL is seen.  Returns the number
+ * of bytes counted; the caller classifies the rest one at a time.
+ */
+static size_t text_count_vectors(
+	text_counts *counts, const char *scan, const char *end, bool stop_at_nul)
+{
+	const char *start = scan;
+	const text_vec zero = text_vec_set1(0);
+	const text_vec lf = text_vec_set1('\n'), cr = text_vec_set1('\r');
+	const text_vec tab = text_vec_set1('\t'), vt = text_vec_set1('\v');
+	const text_vec bs = text_vec_set1('\b'), esc = text_vec_set1(0x1b);
+	const text_vec del = text_vec_set1(0x7f), us = text_vec_set1(0x1f);
+	const text_vec five = text_vec_set1(5);
+
+	while (end - scan > TEXT_VEC_WIDTH) {
+		text_vec n_nul = zero, n_cr = zero, n_lf = zero, n_crlf = zero;
+		text_vec n_tab_vt = zero, n_other = zero;
+		size_t i;
+
+		for (i = 0; i < TEXT_VEC_BLOCK && end - scan > TEXT_VEC_WIDTH;
+			i++, scan += TEXT_VEC_WIDTH) {
+			text_vec v = text_vec_load(scan);
+			text_vec next = text_vec_load(scan + 1);
+			text_vec is_nul = text_vec_eq(v, zero);
+			text_vec is_cr = text_vec_eq(v, cr);
+			text_vec is_ctrl = text_vec_eq(text_vec_min(v, us), v);
+			text_vec from_bs = text_vec_sub(v, bs);
+			text_vec is_known;
+
+			if (stop_at_nul && text_vec_any(is_nul)) {
+				counts->nul++;
+				return (size_t)(scan - start);
+			}
+
+			/* BS, TAB, LF, VT, FF and CR are 0x08 to 0x0d */
+			is_known = text_vec_or(
+				text_vec_eq(text_vec_min(from_bs, five), from_bs),
+				text_vec_or(text_vec_eq(v, esc), is_nul));
+
+			/* matching lanes are all ones, so subtracting counts them */
+			n_nul = text_vec_sub(n_nul, is_nul);
+			n_cr = text_vec_sub(n_cr, is_cr);
+			n_lf = text_vec_sub(n_lf, text_vec_eq(v, lf));
+			n_crlf = text_vec_sub(n_crlf,
+				text_vec_and(is_cr, text_vec_eq(next, lf)));
+			n_tab_vt = text_vec_sub(n_tab_vt,
+				text_vec_or(text_vec_eq(v, tab), text_vec_eq(v, vt)));
+			n_other = text_vec_sub(n_other, text_vec_or(
+				text_vec_andnot(is_known, is_ctrl), text_vec_eq(v, del)));
+		}
+
+		counts->nul += text_vec_sum(n_nul);
+		counts->cr += text_vec_sum(n_cr);
+		counts->lf += text_vec_sum(n_lf);
+		counts->crlf += text_vec_sum(n_crlf);
+		counts->tab_vt += text_vec_sum(n_tab_vt);
+		counts->other += text_vec_sum(n_other);
+	}
+
+	return (size_t)(scan - start);
+}
+
+#else
+
+static size_t text_count_vectors(
+	text_counts *counts, const char *scan, const char *end, bool stop_at_nul)
+{
+	GIT_UNUSED(counts);
+	GIT_UNUSED(scan);
+	GIT_UNUSED(end);
+	GIT_UNUSED(stop_at_nul);
+
+	return 0;
+}
+
+#endif
+
 bool git_buf_text_is_binary(const git_buf *buf)
 {
 	const char *scan = buf->ptr, *end = buf->ptr + buf->size;
 	git_bom_t bom;
+	text_counts counts = {0};
+	size_t counted;
 	int printable = 0, nonprintable = 0;
 
 	scan += git_buf_text_detect_bom(&bom, buf, 0);
@@ -193,6 +341,16 @@ bool git_buf_text_is_binary(const git_buf *buf)
 	if (bom > GIT_BOM_UTF8)
 		return 1;
 
+	counted = text_count_vectors(&counts, scan, end, true);
+
+	if (counts.nul)
+		return true;
+
+	scan += counted;
+	nonprintable = (int)counts.other;
+	printable = (int)(counted - counts.lf - counts.cr -
+		counts.tab_vt - counts.other);
+
 	while (scan < end) {
 		unsigned char c = *scan++;
 
@@ -265,22 +423,31 @@ int git_buf_text_detect_bom(git_bom_t *bom, const git_buf *buf, size_t offset)
 	return 0;
 }
 
-bool git_buf_text_gather_stats(
-	git_buf_text_stats *stats, const git_buf *buf, bool skip_bom)
+void git_buf_text_stats_add(
+	git_buf_text_stats *stats, const char *ptr, size_t len, char *last)
 {
-	const char *scan = buf->ptr, *end = buf->ptr + buf->size;
-	int skip;
+	const char *scan = ptr, *end = ptr + len;
+	text_counts counts = {0};
+	size_t counted;
 
-	memset(stats, 0, sizeof(*stats));
+	if (!len)
+		return;
 
-	/* BOM detection */
-	skip = git_buf_text_detect_bom(&stats->bom, buf, 0);
-	if (skip_bom)
-		scan += skip;
+	/* a CRLF split between the last piece and this one */
+	if (*last == '\r' && *scan == '\n')
+		stats->crlf++;
 
-	/* Ignore EOF character */
-	if (buf->size > 0 && end[-1] == '\032')
-		end--;
+	counted = text_count_vectors(&counts, scan, end, false);
+
+	stats->nul += (unsigned int)counts.nul;
+	stats->cr += (unsigned int)counts.cr;
+	stats->lf += (unsigned int)counts.lf;
+	stats->crlf += (unsigned int)counts.crlf;
+	stats->nonprintable += (unsigned int)(counts.nul + counts.other);
+	stats->printable += (unsigned int)(counted - counts.nul -
+		counts.cr - counts.lf - counts.other);
+
+	scan += counted;
 
 	/* Counting loop */
 	while (scan < end) {
@@ -310,6 +477,35 @@ bool git_buf_text_gather_stats(
 			}
 	}
 
+	*last = end[-1];
+}
+
+bool git_buf_text_stats_is_binary(const git_buf_text_stats *stats)
+{
 	return (stats->nul > 0 ||
 		((stats->printable >> 7) < stats->nonprintable));
 }
+
+bool git_buf_text_gather_stats(
+	git_buf_text_stats *stats, const git_buf *buf, bool skip_bom)
+{
+	const char *scan = buf->ptr, *end = buf->ptr + buf->size;
+	char last = '\0';
+	int skip;
+
+	memset(stats, 0, sizeof(*stats));
+
+	/* BOM detection */
+	skip = git_buf_text_detect_bom(&stats->bom, buf, 0);
+	if (skip_bom)
+		scan += skip;
+
+	/* Ignore EOF character */
+	if (buf->size > 0 && end[-1] == '\032')
+		end--;
+
+	if (scan < end)
+		git_buf_text_stats_add(stats, scan, (size_t)(end - scan), &last);
+
+	return git_buf_text_stats_is_binary(stats);
+}
@@ -119,4 +119,25 @@ extern int git_buf_text_detect_bom(
 extern bool git_buf_text_gather_stats(
 	git_buf_text_stats *stats, const git_buf *buf, bool skip_bom);
 
+/**
+ * Add the counts for the next piece of a text that arrives in pieces
+ *
+ * Unlike `git_buf_text_gather_stats`, this neither looks for a BOM nor
+ * skips a trailing EOF character, since it cannot know where the text
+ * ends.  `stats` should be zeroed before the first piece.
+ *
+ * @param stats Structure to add the counts to
+ * @param ptr Next piece of the text
+ * @param len Length of the piece
+ * @param last Last byte of the previous piece (start with '\0'), so that
+ *        a CRLF split between two pieces is counted; updated on return
+ */
+extern void git_buf_text_stats_add(
+	git_buf_text_stats *stats, const char *ptr, size_t len, char *last);
+
+/**
+ * Does text with the given stats heuristically look like binary data
+ */
+extern bool git_buf_text_stats_is_binary(const git_buf_text_stats *stats);
+
 #endif
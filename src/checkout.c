@@ -24,6 +24,7 @@
 #include "repository.h"
 #include "index.h"
 #include "filter.h"
+#include "filter_process.h"
 #include "blob.h"
 #include "diff.h"
 #include "pathspec.h"
@@ -33,6 +34,7 @@
 #include "attr.h"
 #include "pool.h"
 #include "strmap.h"
+#include "sparse.h"
 
 GIT__USE_STRMAP
 
@@ -48,6 +50,7 @@ enum {
 	CHECKOUT_ACTION__UPDATE_CONFLICT = 32,
 	CHECKOUT_ACTION__MAX = 32,
 	CHECKOUT_ACTION__DEFER_REMOVE = 64,
+	CHECKOUT_ACTION__SKIP_WORKTREE = 128,
 	CHECKOUT_ACTION__REMOVE_AND_UPDATE =
 		(CHECKOUT_ACTION__UPDATE_BLOB | CHECKOUT_ACTION__REMOVE),
 };
@@ -58,7 +61,7 @@ typedef struct {
 	git_diff *diff;
 	git_checkout_options opts;
 	bool opts_free_baseline;
-	char *pfx;
+	git_pathspec pathspec;
 	git_index *index;
 	git_pool pool;
 	git_vector removes;
@@ -76,7 +79,9 @@ typedef struct {
 	size_t completed_steps;
 	git_checkout_perfdata perfdata;
 	git_strmap *mkdir_map;
+	git_strmap *delayed; /* files whose content a filter process delayed */
 	git_attr_session attr_session;
+	git_sparse *sparse;
 } checkout_data;
 
 typedef struct {
@@ -258,6 +263,32 @@ static int checkout_action_common(
 	return checkout_notify(data, notify, delta, wd);
 }
 
+/* With a sparse checkout, files outside of the cone only live in the
+ * index (with the skip-worktree bit set) and not in the working directory.
+ */
+static bool checkout_is_outside_cone(
+	checkout_data *data, const git_diff_delta *delta)
+{
+	return data->sparse != NULL &&
+		delta->status != GIT_DELTA_DELETED &&
+		delta->new_file.mode != GIT_FILEMODE_TREE &&
+		!git_sparse__contains(data->sparse, delta->new_file.path);
+}
+
+static bool checkout_index_skips_worktree(
+	checkout_data *data, const git_diff_file *file)
+{
+	const git_index_entry *entry;
+
+	if (!data->sparse ||
+		(entry = git_index_get_bypath(data->index, file->path, 0)) == NULL)
+		return false;
+
+	return (entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0 &&
+		entry->mode == file->mode &&
+		git_oid_equal(&entry->id, &file->id);
+}
+
 static int checkout_action_no_wd(
 	int *action,
 	checkout_data *data,
@@ -267,6 +298,19 @@ static int checkout_action_no_wd(
 
 	*action = CHECKOUT_ACTION__NONE;
 
+	if (checkout_is_outside_cone(data, delta)) {
+		if (!checkout_index_skips_worktree(data, &delta->new_file))
+			*action = CHECKOUT_ACTION__SKIP_WORKTREE;
+		return 0;
+	}
+
+	/* a file that has just entered the cone is missing on purpose */
+	if (delta->status != GIT_DELTA_DELETED &&
+		checkout_index_skips_worktree(data, &delta->old_file)) {
+		*action = CHECKOUT_ACTION_IF(SAFE, UPDATE_BLOB, NONE);
+		return checkout_action_common(action, data, delta, NULL);
+	}
+
 	switch (delta->status) {
 	case GIT_DELTA_UNMODIFIED: /* case 12 */
 		error = checkout_notify(data, GIT_CHECKOUT_NOTIFY_DIRTY, delta, NULL);
@@ -325,7 +369,7 @@ static int checkout_action_wd_only(
 	const git_index_entry *wd = *wditem;
 
 	if (!git_pathspec__match(
-			pathspec, wd->path,
+			pathspec, data->pathspec.trie, wd->path,
 			(data->strategy & GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH) != 0,
 			git_iterator_ignore_case(workdir), NULL, NULL))
 		return git_iterator_advance(wditem, workdir);
@@ -443,6 +487,22 @@ static int checkout_action_with_wd(
 {
 	*action = CHECKOUT_ACTION__NONE;
 
+	/* remove clean files that are now outside of the cone; modified
+	 * files are kept and stay in the working directory
+	 */
+	if (checkout_is_outside_cone(data, delta) &&
+		delta->status != GIT_DELTA_TYPECHANGE) {
+		if (delta->status == GIT_DELTA_ADDED)
+			*action = CHECKOUT_ACTION__SKIP_WORKTREE;
+		else if (!checkout_is_workdir_modified(
+				data, &delta->old_file, &delta->new_file, wd))
+			*action = CHECKOUT_ACTION__REMOVE |
+				CHECKOUT_ACTION__SKIP_WORKTREE;
+
+		if (*action != CHECKOUT_ACTION__NONE)
+			return checkout_action_common(action, data, delta, wd);
+	}
+
 	switch (delta->status) {
 	case GIT_DELTA_UNMODIFIED: /* case 14/15 or 33 */
 		if (checkout_is_workdir_modified(data, &delta->old_file, &delta->new_file, wd)) {
@@ -781,17 +841,20 @@ GIT_INLINE(bool) conflict_pathspec_match(
 	const git_index_entry *theirs)
 {
 	/* if the pathspec matches ours *or* theirs, proceed */
-	if (ours && git_pathspec__match(pathspec, ours->path,
+	if (ours && git_pathspec__match(
+		pathspec, data->pathspec.trie, ours->path,
 		(data->strategy & GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH) != 0,
 		git_iterator_ignore_case(workdir), NULL, NULL))
 		return true;
 
-	if (theirs && git_pathspec__match(pathspec, theirs->path,
+	if (theirs && git_pathspec__match(
+		pathspec, data->pathspec.trie, theirs->path,
 		(data->strategy & GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH) != 0,
 		git_iterator_ignore_case(workdir), NULL, NULL))
 		return true;
 
-	if (ancestor && git_pathspec__match(pathspec, ancestor->path,
+	if (ancestor && git_pathspec__match(
+		pathspec, data->pathspec.trie, ancestor->path,
 		(data->strategy & GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH) != 0,
 		git_iterator_ignore_case(workdir), NULL, NULL))
 		return true;
@@ -1253,18 +1316,11 @@ static int checkout_get_actions(
 {
 	int error = 0, act;
 	const git_index_entry *wditem;
-	git_vector pathspec = GIT_VECTOR_INIT, *deltas;
-	git_pool pathpool;
+	git_vector *pathspec = &data->pathspec.pathspec, *deltas;
 	git_diff_delta *delta;
 	size_t i, *counts = NULL;
 	uint32_t *actions = NULL;
 
-	git_pool_init(&pathpool, 1);
-
-	if (data->opts.paths.count > 0 &&
-		git_pathspec__vinit(&pathspec, &data->opts.paths, &pathpool) < 0)
-		return -1;
-
 	if ((error = git_iterator_current(&wditem, workdir)) < 0 &&
 		error != GIT_ITEROVER)
 		goto fail;
@@ -1280,7 +1336,7 @@ static int checkout_get_actions(
 	}
 
 	git_vector_foreach(deltas, i, delta) {
-		if ((error = checkout_action(&act, data, delta, workdir, &wditem, &pathspec)) == 0)
+		if ((error = checkout_action(&act, data, delta, workdir, &wditem, pathspec)) == 0)
 			error = checkout_verify_paths(data->repo, act, delta);
 
 		if (error != 0)
@@ -1298,7 +1354,7 @@ static int checkout_get_actions(
 			counts[CHECKOUT_ACTION__CONFLICT]++;
 	}
 
-	error = checkout_remaining_wd_items(data, workdir, wditem, &pathspec);
+	error = checkout_remaining_wd_items(data, workdir, wditem, pathspec);
 	if (error)
 		goto fail;
 
@@ -1316,16 +1372,13 @@ static int checkout_get_actions(
 	}
 
 
-	if ((error = checkout_get_remove_conflicts(data, workdir, &pathspec)) < 0 ||
-		(error = checkout_get_update_conflicts(data, workdir, &pathspec)) < 0)
+	if ((error = checkout_get_remove_conflicts(data, workdir, pathspec)) < 0 ||
+		(error = checkout_get_update_conflicts(data, workdir, pathspec)) < 0)
 		goto fail;
 
 	counts[CHECKOUT_ACTION__REMOVE_CONFLICT] = git_vector_length(&data->remove_conflicts);
 	counts[CHECKOUT_ACTION__UPDATE_CONFLICT] = git_vector_length(&data->update_conflicts);
 
-	git_pathspec__vfree(&pathspec);
-	git_pool_clear(&pathpool);
-
 	return 0;
 
 fail:
@@ -1334,9 +1387,6 @@ fail:
 	*actions_ptr = NULL;
 	git__free(actions);
 
-	git_pathspec__vfree(&pathspec);
-	git_pool_clear(&pathpool);
-
 	return error;
 }
 
@@ -1417,16 +1467,36 @@ static int mkpath2file(
 struct checkout_stream {
 	git_writestream base;
 	const char *path;
+	int flags;
+	mode_t mode;
 	int fd;
 	int open;
 };
 
+/* The file is only opened once the filters hand over some content (or
+ * close the stream), so one whose content a filter delays is not
+ * created or truncated before the content is delivered.
+ */
+static int checkout_stream_open(struct checkout_stream *stream)
+{
+	if ((stream->fd = p_open(stream->path, stream->flags, stream->mode)) < 0) {
+		giterr_set(GITERR_OS, "Could not open '%s' for writing", stream->path);
+		return stream->fd;
+	}
+
+	stream->open = 1;
+	return 0;
+}
+
 static int checkout_stream_write(
 	git_writestream *s, const char *buffer, size_t len)
 {
 	struct checkout_stream *stream = (struct checkout_stream *)s;
 	int ret;
 
+	if (!stream->open && (ret = checkout_stream_open(stream)) < 0)
+		return ret;
+
 	if ((ret = p_write(stream->fd, buffer, len)) < 0)
 		giterr_set(GITERR_OS, "Could not write to '%s'", stream->path);
 
@@ -1436,7 +1506,13 @@ static int checkout_stream_write(
 static int checkout_stream_close(git_writestream *s)
 {
 	struct checkout_stream *stream = (struct checkout_stream *)s;
-	assert(stream && stream->open);
+	int error;
+
+	assert(stream);
+
+	/* an empty file is still a file */
+	if (!stream->open && (error = checkout_stream_open(stream)) < 0)
+		return error;
 
 	stream->open = 0;
 	return p_close(stream->fd);
@@ -1447,22 +1523,53 @@ static void checkout_stream_free(git_writestream *s)
 	GIT_UNUSED(s);
 }
 
+/* filter into and close the file; safe to call from any thread */
+static int checkout_write_file(
+	const checkout_data *data,
+	git_blob *blob,
+	git_filter_list *fl,
+	const char *path,
+	mode_t entry_filemode)
+{
+	struct checkout_stream writer;
+	int error;
+
+	/* setup the writer */
+	memset(&writer, 0, sizeof(struct checkout_stream));
+	writer.base.write = checkout_stream_write;
+	writer.base.close = checkout_stream_close;
+	writer.base.free = checkout_stream_free;
+	writer.path = path;
+	writer.flags = data->opts.file_open_flags;
+	writer.mode = data->opts.file_mode ?
+		data->opts.file_mode : entry_filemode;
+	writer.fd = -1;
+
+	if (writer.flags <= 0)
+		writer.flags = O_CREAT | O_TRUNC | O_WRONLY;
+	if (!writer.mode)
+		writer.mode = GIT_FILEMODE_BLOB;
+
+	error = git_filter_list_stream_blob(fl, blob, &writer.base);
+
+	/* a filter that failed part way never closed it */
+	if (writer.open)
+		p_close(writer.fd);
+
+	return error;
+}
+
 static int blob_content_to_file(
 	checkout_data *data,
 	struct stat *st,
 	git_blob *blob,
 	const char *path,
 	const char *hint_path,
-	mode_t entry_filemode)
+	mode_t entry_filemode,
+	bool can_delay)
 {
-	int flags = data->opts.file_open_flags;
-	mode_t file_mode = data->opts.file_mode ?
-		data->opts.file_mode : entry_filemode;
 	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
-	struct checkout_stream writer;
-	mode_t mode;
 	git_filter_list *fl = NULL;
-	int fd;
 	int error = 0;
 
 	if (hint_path == NULL)
@@ -1471,37 +1578,21 @@ static int blob_content_to_file(
 	if ((error = mkpath2file(data, path, data->opts.dir_mode)) < 0)
 		return error;
 
-	if (flags <= 0)
-		flags = O_CREAT | O_TRUNC | O_WRONLY;
-	if (!(mode = file_mode))
-		mode = GIT_FILEMODE_BLOB;
-
-	if ((fd = p_open(path, flags, mode)) < 0) {
-		giterr_set(GITERR_OS, "Could not open '%s' for writing", path);
-		return fd;
-	}
-
 	filter_opts.attr_session = &data->attr_session;
 	filter_opts.temp_buf = &data->tmp;
 
+	if (can_delay)
+		filter_opts.flags |= GIT_FILTER__ALLOW_DELAY;
+
 	if (!data->opts.disable_filters &&
 		(error = git_filter_list__load_ext(
 			&fl, data->repo, blob, hint_path,
 			GIT_FILTER_TO_WORKTREE, &filter_opts)))
 		return error;
 
-	/* setup the writer */
-	memset(&writer, 0, sizeof(struct checkout_stream));
-	writer.base.write = checkout_stream_write;
-	writer.base.close = checkout_stream_close;
-	writer.base.free = checkout_stream_free;
-	writer.path = path;
-	writer.fd = fd;
-	writer.open = 1;
+	data->perfdata.open_calls++;
 
-	error = git_filter_list_stream_blob(fl, blob, &writer.base);
-
-	assert(writer.open == 0);
+	error = checkout_write_file(data, blob, fl, path, entry_filemode);
 
 	git_filter_list_free(fl);
 
@@ -1683,7 +1774,8 @@ static int checkout_write_content(
 	const char *full_path,
 	const char *hint_path,
 	unsigned int mode,
-	struct stat *st)
+	struct stat *st,
+	bool can_delay)
 {
 	int error = 0;
 	git_blob *blob;
@@ -1694,7 +1786,8 @@ static int checkout_write_content(
 	if (S_ISLNK(mode))
 		error = blob_content_to_link(data, st, blob, full_path);
 	else
-		error = blob_content_to_file(data, st, blob, full_path, hint_path, mode);
+		error = blob_content_to_file(
+			data, st, blob, full_path, hint_path, mode, can_delay);
 
 	git_blob_free(blob);
 
@@ -1730,8 +1823,17 @@ static int checkout_blob(
 			return rval;
 	}
 
-	error = checkout_write_content(
-		data, &file->id, git_buf_cstr(&data->path), NULL, file->mode, &st);
+	error = checkout_write_content(data,
+		&file->id, git_buf_cstr(&data->path), NULL, file->mode, &st, true);
+
+	/* a filter process will have the content later */
+	if (error == GIT_DELAYED) {
+		if (!data->delayed && git_strmap_alloc(&data->delayed) < 0)
+			return -1;
+
+		git_strmap_insert(data->delayed, file->path, (void *)file, error);
+		return (error < 0) ? -1 : 0;
+	}
 
 	/* update the index unless prevented */
 	if (!error && (data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0)
@@ -1744,6 +1846,50 @@ static int checkout_blob(
 	return error;
 }
 
+/* Write the files whose content was delayed by a filter process, as the
+ * processes make them available, until they have delivered them all.
+ */
+static int checkout_create_delayed(checkout_data *data)
+{
+	git_vector available = GIT_VECTOR_INIT;
+	const git_diff_file *file;
+	char *path;
+	khiter_t pos;
+	size_t i;
+	int error = 0;
+
+	while (!error && git_strmap_num_entries(data->delayed) > 0) {
+		if ((error = git_filter_process__available(
+				&available, data->repo)) < 0)
+			break;
+
+		if (git_vector_length(&available) == 0) {
+			giterr_set(GITERR_CHECKOUT,
+				"%d files delayed by a filter process were never delivered",
+				(int)git_strmap_num_entries(data->delayed));
+			error = -1;
+		}
+
+		git_vector_foreach(&available, i, path) {
+			pos = git_strmap_lookup_index(data->delayed, path);
+
+			if (!error && git_strmap_valid_index(data->delayed, pos)) {
+				file = git_strmap_value_at(data->delayed, pos);
+				git_strmap_delete_at(data->delayed, pos);
+
+				error = checkout_blob(data, file);
+			}
+
+			git__free(path);
+		}
+
+		git_vector_clear(&available);
+	}
+
+	git_vector_free(&available);
+	return error;
+}
+
 static int checkout_remove_the_old(
 	unsigned int *actions,
 	checkout_data *data)
@@ -1771,6 +1917,7 @@ static int checkout_remove_the_old(
 			report_progress(data, delta->old_file.path);
 
 			if ((actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) == 0 &&
+				(actions[i] & CHECKOUT_ACTION__SKIP_WORKTREE) == 0 &&
 				(data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0 &&
 				data->index != NULL)
 			{
@@ -1820,13 +1967,405 @@ static int checkout_deferred_remove(git_repository *repo, const char *path)
 #endif
 }
 
-static int checkout_create_the_new(
+/* Make the parent directories of every blob about to be written, in
+ * path order, before any of them is: files in the same directory are
+ * next to each other in the diff, so each directory is only looked at
+ * once, and everything written afterwards finds its parent in the
+ * mkdir cache.  Failures are left for the blob itself to report.
+ */
+static int checkout_create_the_dirs(
 	unsigned int *actions,
 	checkout_data *data)
 {
-	int error = 0;
 	git_diff_delta *delta;
+	git_buf last = GIT_BUF_INIT;
+	const char *path, *slash;
+	unsigned int flags =
+		(should_remove_existing(data) ?
+		 MKDIR_REMOVE_EXISTING : MKDIR_NORMAL) | GIT_MKDIR_SKIP_LAST;
+	size_t i, dirlen;
+	int error = 0;
+
+	/* files that do not exist are skipped, and so are their directories */
+	if ((data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0)
+		return 0;
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		if (!(actions[i] & CHECKOUT_ACTION__UPDATE_BLOB))
+			continue;
+
+		path = delta->new_file.path;
+
+		if ((slash = strrchr(path, '/')) == NULL)
+			continue;
+
+		dirlen = (size_t)(slash - path);
+
+		if (last.size == dirlen && memcmp(last.ptr, path, dirlen) == 0)
+			continue;
+
+		git_buf_truncate(&data->path, data->workdir_len);
+
+		if ((error = git_buf_set(&last, path, dirlen)) < 0 ||
+			(error = git_buf_puts(&data->path, path)) < 0)
+			break;
+
+		if (checkout_mkdir(data, data->path.ptr,
+				data->opts.target_directory, data->opts.dir_mode, flags) < 0)
+			giterr_clear();
+	}
+
+	git_buf_free(&last);
+	return error;
+}
+
+#define CHECKOUT_BLOB_MAX_THREADS 8
+#define CHECKOUT_BLOB_WINDOW 1024
+#define CHECKOUT_BLOB_BATCH_SIZE 4
+
+typedef struct {
+	const git_diff_file *file;
+	git_buf path;
+	git_filter_list *fl;
+	struct stat st;
+	unsigned int serial:1;  /* must take the regular path, in order */
+	unsigned int written:1; /* written (and stat'ed) by a worker */
+} checkout_blob_entry;
+
+typedef struct {
+	const checkout_data *data;
+	checkout_blob_entry **entries;
+} checkout_blob_window;
+
+static int checkout_blob_write_entries(size_t start, size_t end, void *payload)
+{
+	checkout_blob_window *window = payload;
+	checkout_blob_entry *entry;
+	git_blob *blob;
 	size_t i;
+	int error;
+
+	for (i = start; i < end; i++) {
+		entry = window->entries[i];
+
+		if (entry->serial)
+			continue;
+
+		if ((error = git_blob_lookup(
+				&blob, window->data->repo, &entry->file->id)) < 0)
+			goto failed;
+
+		error = checkout_write_file(window->data,
+			blob, entry->fl, entry->path.ptr, entry->file->mode);
+
+		git_blob_free(blob);
+
+		if (error < 0 || (error = p_stat(entry->path.ptr, &entry->st)) < 0)
+			goto failed;
+
+		entry->st.st_mode = entry->file->mode;
+		entry->written = 1;
+		continue;
+
+failed:
+		/* leave it to the regular path to report any problem */
+		giterr_clear();
+		entry->serial = 1;
+	}
+
+	return 0;
+}
+
+/* Prepare an entry for a worker: create its parent directories and load
+ * its filters here, since both share state with the rest of the checkout.
+ * Anything that cannot be written independently of its neighbours is
+ * left to the regular path.
+ */
+static int checkout_blob_prepare(
+	checkout_data *data,
+	checkout_blob_entry *entry,
+	checkout_blob_entry *prev,
+	int ignorecase)
+{
+	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
+	int error;
+
+	if (entry->serial ||
+		S_ISLNK(entry->file->mode) ||
+		(data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0 ||
+		(data->opts.file_open_flags > 0 &&
+		 (data->opts.file_open_flags & O_EXCL) != 0))
+		goto serial;
+
+	/* names that only differ in case are the same file here, and the
+	 * last one written has to win
+	 */
+	if (ignorecase && prev &&
+		strcasecmp(prev->file->path, entry->file->path) == 0) {
+		prev->serial = 1;
+		goto serial;
+	}
+
+	git_buf_clear(&entry->path);
+
+	if ((error = git_buf_put(&entry->path,
+			data->path.ptr, data->workdir_len)) < 0 ||
+		(error = git_buf_puts(&entry->path, entry->file->path)) < 0)
+		return error;
+
+	if (mkpath2file(data, entry->path.ptr, data->opts.dir_mode) < 0)
+		goto failed;
+
+	filter_opts.attr_session = &data->attr_session;
+
+	if (!data->opts.disable_filters &&
+		git_filter_list__load_ext(&entry->fl, data->repo, NULL,
+			entry->file->path, GIT_FILTER_TO_WORKTREE, &filter_opts) < 0)
+		goto failed;
+
+	if (!git_filter_list__builtin_only(entry->fl))
+		goto serial;
+
+	return 0;
+
+failed:
+	giterr_clear();
+serial:
+	entry->serial = 1;
+	return 0;
+}
+
+static int checkout_blob_finish(
+	checkout_data *data, checkout_blob_entry *entry)
+{
+	int error = 0;
+
+	data->perfdata.open_calls++;
+	data->perfdata.stat_calls++;
+
+	if ((data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0)
+		error = checkout_update_index(data, entry->file, &entry->st);
+
+	if (!error && strcmp(entry->file->path, ".gitmodules") == 0)
+		data->reload_submodules = true;
+
+	return error;
+}
+
+/* Write a window of blobs: directories are created and filters loaded on
+ * this thread in window order, the files are read, filtered and written
+ * on the worker threads, and the progress callback is then told about
+ * them in window order again.  Blobs written by the workers are added
+ * to the index here as well, unless `defer_index` is set.
+ */
+static int checkout_blob_write_window(
+	checkout_data *data,
+	checkout_blob_entry **entries,
+	size_t count,
+	int ignorecase,
+	bool defer_index)
+{
+	checkout_blob_window window;
+	checkout_blob_entry *entry, *prev = NULL;
+	size_t i, parallel = 0;
+	int nthreads, error = 0;
+
+	for (i = 0; i < count; i++) {
+		entry = entries[i];
+
+		if ((error = checkout_blob_prepare(
+				data, entry, prev, ignorecase)) < 0)
+			goto done;
+
+		prev = entry;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (entries[i]->serial) {
+			git_filter_list_free(entries[i]->fl);
+			entries[i]->fl = NULL;
+		} else {
+			parallel++;
+		}
+	}
+
+	if (parallel) {
+		nthreads = (int)min(parallel / CHECKOUT_BLOB_BATCH_SIZE,
+			CHECKOUT_BLOB_MAX_THREADS);
+
+		window.data = data;
+		window.entries = entries;
+
+		if ((error = git_parallel_foreach(count, CHECKOUT_BLOB_BATCH_SIZE,
+				nthreads, checkout_blob_write_entries, &window)) < 0)
+			goto done;
+	}
+
+	for (i = 0; i < count; i++) {
+		entry = entries[i];
+
+		if (!entry->written)
+			error = checkout_blob(data, entry->file);
+		else if (!defer_index)
+			error = checkout_blob_finish(data, entry);
+
+		if (error < 0)
+			goto done;
+
+		data->completed_steps++;
+		report_progress(data, entry->file->path);
+	}
+
+done:
+	for (i = 0; i < count; i++) {
+		git_filter_list_free(entries[i]->fl);
+		entries[i]->fl = NULL;
+	}
+
+	return error;
+}
+
+typedef struct {
+	checkout_blob_entry *entry;
+	struct git_pack_file *pack;
+	git_off_t offset;
+	size_t position;
+	unsigned int packed:1;
+} checkout_pack_order;
+
+static int checkout_pack_order_cmp(const void *a, const void *b, void *payload)
+{
+	const checkout_pack_order *oa = a, *ob = b;
+
+	GIT_UNUSED(payload);
+
+	/* packed blobs first, by pack and offset, then the rest in path order */
+	if (oa->packed != ob->packed)
+		return oa->packed ? -1 : 1;
+
+	if (oa->packed && oa->pack != ob->pack)
+		return (oa->pack < ob->pack) ? -1 : 1;
+
+	if (oa->packed && oa->offset != ob->offset)
+		return (oa->offset < ob->offset) ? -1 : 1;
+
+	return (oa->position < ob->position) ? -1 :
+		(oa->position > ob->position) ? 1 : 0;
+}
+
+/* Deltas in a pack follow their bases, so writing the blobs in the
+ * order of their offsets reads each pack front to back and finds most
+ * delta bases in the pack's cache, instead of inflating them again for
+ * every path that needs them.  The index is updated in path order once
+ * everything is written, as inserting in any other order is costly.
+ */
+static int checkout_create_the_new_in_pack_order(
+	checkout_blob_entry *entries,
+	size_t count,
+	checkout_data *data)
+{
+	checkout_pack_order *order;
+	checkout_blob_entry **window;
+	git_odb *odb;
+	size_t i, start, n;
+	int ignorecase = 0, error = 0;
+
+	if ((error = git_repository_odb__weakptr(&odb, data->repo)) < 0)
+		return error;
+
+	if (git_repository__cvar(&ignorecase, data->repo, GIT_CVAR_IGNORECASE) < 0)
+		giterr_clear();
+
+	order = git__calloc(count, sizeof(checkout_pack_order));
+	window = git__calloc(CHECKOUT_BLOB_WINDOW, sizeof(checkout_blob_entry *));
+
+	if (!order || !window) {
+		giterr_set_oom();
+		error = -1;
+		goto done;
+	}
+
+	for (i = 0; i < count; i++) {
+		order[i].entry = &entries[i];
+		order[i].position = i;
+
+		/* names that only differ in case are written last, in path order,
+		 * so that the last one still wins
+		 */
+		if (ignorecase && i > 0 && strcasecmp(
+				entries[i - 1].file->path, entries[i].file->path) == 0) {
+			entries[i - 1].serial = 1;
+			entries[i].serial = 1;
+			order[i - 1].packed = 0;
+			continue;
+		}
+
+		if (git_odb__pack_position(&order[i].pack,
+				&order[i].offset, odb, &entries[i].file->id) < 0)
+			giterr_clear();
+		else
+			order[i].packed = 1;
+	}
+
+	git__qsort_r(order, count, sizeof(checkout_pack_order),
+		checkout_pack_order_cmp, NULL);
+
+	for (start = 0; start < count && !error; start += n) {
+		n = min(count - start, CHECKOUT_BLOB_WINDOW);
+
+		for (i = 0; i < n; i++)
+			window[i] = order[start + i].entry;
+
+		error = checkout_blob_write_window(data, window, n, 0, true);
+
+		for (i = 0; i < n; i++)
+			git_buf_free(&window[i]->path);
+	}
+
+	for (i = 0; i < count && !error; i++) {
+		if (entries[i].written)
+			error = checkout_blob_finish(data, &entries[i]);
+	}
+
+done:
+	git__free(order);
+	git__free(window);
+	return error;
+}
+
+static int checkout_create_the_new(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	checkout_blob_entry *entries, *entry, **window = NULL;
+	git_diff_delta *delta;
+	size_t deltas = git_vector_length(&data->diff->deltas);
+	size_t i, count = 0, n;
+	bool pack_order = (data->strategy & GIT_CHECKOUT_PACK_ORDER) != 0;
+	int ignorecase = 0, error = 0;
+
+	/* without the pack order, a window of blobs is collected at a time */
+	n = pack_order ? deltas : min(deltas, CHECKOUT_BLOB_WINDOW);
+
+	entries = git__calloc(max(n, 1), sizeof(checkout_blob_entry));
+	GITERR_CHECK_ALLOC(entries);
+
+	if (!pack_order) {
+		window = git__calloc(max(n, 1), sizeof(checkout_blob_entry *));
+
+		if (!window) {
+			git__free(entries);
+			giterr_set_oom();
+			return -1;
+		}
+
+		for (i = 0; i < n; i++)
+			window[i] = &entries[i];
+
+		if (git_repository__cvar(
+				&ignorecase, data->repo, GIT_CVAR_IGNORECASE) < 0)
+			giterr_clear();
+	}
 
 	git_vector_foreach(&data->diff->deltas, i, delta) {
 		if (actions[i] & CHECKOUT_ACTION__DEFER_REMOVE) {
@@ -1835,20 +2374,39 @@ static int checkout_create_the_new(
 			 */
 			if ((error = checkout_deferred_remove(
 					data->repo, delta->old_file.path)) < 0)
-				return error;
+				goto done;
 		}
 
-		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) {
-			error = checkout_blob(data, &delta->new_file);
-			if (error < 0)
-				return error;
+		if (!(actions[i] & CHECKOUT_ACTION__UPDATE_BLOB))
+			continue;
 
-			data->completed_steps++;
-			report_progress(data, delta->new_file.path);
+		if (!pack_order && count == n) {
+			if ((error = checkout_blob_write_window(
+					data, window, count, ignorecase, false)) < 0)
+				goto done;
+
+			count = 0;
 		}
+
+		entry = &entries[count++];
+		entry->file = &delta->new_file;
+		entry->serial = 0;
+		entry->written = 0;
 	}
 
-	return 0;
+	if (pack_order)
+		error = checkout_create_the_new_in_pack_order(entries, count, data);
+	else
+		error = checkout_blob_write_window(
+			data, window, count, ignorecase, false);
+
+done:
+	for (i = 0; i < n; i++)
+		git_buf_free(&entries[i].path);
+
+	git__free(entries);
+	git__free(window);
+	return error;
 }
 
 static int checkout_create_submodules(
@@ -1882,6 +2440,86 @@ static int checkout_create_submodules(
 	return 0;
 }
 
+static int checkout_skip_worktree(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	git_diff_delta *delta;
+	git_index_entry entry;
+	size_t i;
+	int error;
+
+	if ((data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) != 0)
+		return 0;
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		if ((actions[i] & CHECKOUT_ACTION__SKIP_WORKTREE) == 0)
+			continue;
+
+		memset(&entry, 0, sizeof(entry));
+		entry.path = delta->new_file.path;
+		entry.mode = delta->new_file.mode;
+		entry.flags_extended = GIT_IDXENTRY_SKIP_WORKTREE;
+		git_oid_cpy(&entry.id, &delta->new_file.id);
+
+		if ((error = git_index_add(data->index, &entry)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+typedef struct {
+	checkout_data *data;
+	git_buf path;
+} checkout_sparse_trees;
+
+static int checkout_sparse_tree_cb(
+	const char *root, const git_tree_entry *entry, void *payload)
+{
+	checkout_sparse_trees *trees = payload;
+
+	if (git_tree_entry_type(entry) != GIT_OBJ_TREE)
+		return 0;
+
+	git_buf_clear(&trees->path);
+
+	if (git_buf_puts(&trees->path, root) < 0 ||
+		git_buf_puts(&trees->path, git_tree_entry_name(entry)) < 0)
+		return -1;
+
+	if (!git_sparse__dir_outside(trees->data->sparse, trees->path.ptr))
+		return 0;
+
+	if (git_index__sparse_remember_tree(
+			trees->data->index, trees->path.ptr, git_tree_entry_id(entry)) < 0)
+		return -1;
+
+	/* the directories below are outside of the cone, too */
+	return 1;
+}
+
+/* The index now has the entries of the target tree for the directories
+ * outside of the cone; tell it their tree ids so that a sparse index
+ * collapses them when it is written.
+ */
+static int checkout_sparse_remember_trees(
+	checkout_data *data, git_iterator *target)
+{
+	checkout_sparse_trees trees = { data, GIT_BUF_INIT };
+	git_tree *tree = git_iterator_get_tree(target);
+	int error;
+
+	if (tree == NULL || data->opts.paths.count > 0 ||
+		(data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) != 0)
+		return 0;
+
+	error = git_tree_walk(tree, GIT_TREEWALK_PRE, checkout_sparse_tree_cb, &trees);
+
+	git_buf_free(&trees.path);
+	return error;
+}
+
 static int checkout_lookup_head_tree(git_tree **out, git_repository *repo)
 {
 	int error = 0;
@@ -1978,7 +2616,8 @@ static int checkout_write_entry(
 		return error;
 
 	return checkout_write_content(data,
-		&side->id, git_buf_cstr(&data->path), hint_path, side->mode, &st);
+		&side->id, git_buf_cstr(&data->path), hint_path, side->mode, &st,
+		false);
 }
 
 static int checkout_write_entries(
@@ -2286,8 +2925,7 @@ static void checkout_data_clear(checkout_data *data)
 	git_vector_free_deep(&data->remove_conflicts);
 	git_vector_free_deep(&data->update_conflicts);
 
-	git__free(data->pfx);
-	data->pfx = NULL;
+	git_pathspec__clear(&data->pathspec);
 
 	git_strmap_free(data->mkdir_map);
 
@@ -2299,7 +2937,16 @@ static void checkout_data_clear(checkout_data *data)
 
 	git_strmap_free(data->mkdir_map);
 
+	/* whatever was not delivered by now is not wanted anymore */
+	if (data->delayed) {
+		git_filter_process__clear_delayed(data->repo);
+		git_strmap_free(data->delayed);
+	}
+
 	git_attr_session__free(&data->attr_session);
+
+	git_sparse__free(data->sparse);
+	data->sparse = NULL;
 }
 
 static int checkout_data_init(
@@ -2395,7 +3042,8 @@ static int checkout_data_init(
 	if (!data->opts.file_open_flags)
 		data->opts.file_open_flags = O_CREAT | O_TRUNC | O_WRONLY;
 
-	data->pfx = git_pathspec_prefix(&data->opts.paths);
+	if ((error = git_pathspec__init(&data->pathspec, &data->opts.paths)) < 0)
+		goto cleanup;
 
 	if ((error = git_repository__cvar(
 			 &data->can_symlink, repo, GIT_CVAR_SYMLINKS)) < 0)
@@ -2454,6 +3102,14 @@ static int checkout_data_init(
 
 	git_attr_session__init(&data->attr_session, data->repo);
 
+	/* a sparse checkout is only meaningful for the repository workdir */
+	if (data->index != NULL &&
+		(data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0 &&
+		git_repository_workdir(repo) != NULL &&
+		!strcmp(data->opts.target_directory, git_repository_workdir(repo)) &&
+		(error = git_sparse__load(&data->sparse, repo)) < 0)
+		goto cleanup;
+
 cleanup:
 	if (error < 0)
 		checkout_data_clear(data);
@@ -2475,6 +3131,7 @@ int git_checkout_iterator(
 		workdir_opts = GIT_ITERATOR_OPTIONS_INIT;
 	checkout_data data = {0};
 	git_diff_options diff_opts = GIT_DIFF_OPTIONS_INIT;
+	git_pathspec_trie *target_trie = target->pathspec_trie;
 	uint32_t *actions = NULL;
 	size_t *counts = NULL;
 
@@ -2503,10 +3160,17 @@ int git_checkout_iterator(
 	workdir_opts.flags = git_iterator_ignore_case(target) ?
 		GIT_ITERATOR_IGNORE_CASE : GIT_ITERATOR_DONT_IGNORE_CASE;
 	workdir_opts.flags |= GIT_ITERATOR_DONT_AUTOEXPAND;
-	workdir_opts.start = data.pfx;
-	workdir_opts.end = data.pfx;
+	workdir_opts.start = data.pathspec.prefix;
+	workdir_opts.end = data.pathspec.prefix;
+	workdir_opts.pathspec_trie = data.pathspec.trie;
 
-	if ((error = git_iterator_reset(target, data.pfx, data.pfx)) < 0 ||
+	/* skip what the pathspec cannot match in the target too, while it is
+	 * diffed against the baseline
+	 */
+	target->pathspec_trie = data.pathspec.trie;
+
+	if ((error = git_iterator_reset(
+			target, data.pathspec.prefix, data.pathspec.prefix)) < 0 ||
 		(error = git_iterator_for_workdir_ext(
 			&workdir, data.repo, data.opts.target_directory, index, NULL,
 			&workdir_opts)) < 0)
@@ -2514,8 +3178,9 @@ int git_checkout_iterator(
 
 	baseline_opts.flags = git_iterator_ignore_case(target) ?
 		GIT_ITERATOR_IGNORE_CASE : GIT_ITERATOR_DONT_IGNORE_CASE;
-	baseline_opts.start = data.pfx;
-	baseline_opts.end = data.pfx;
+	baseline_opts.start = data.pathspec.prefix;
+	baseline_opts.end = data.pathspec.prefix;
+	baseline_opts.pathspec_trie = data.pathspec.trie;
 
 	if (data.opts.baseline_index) {
 		if ((error = git_iterator_for_index(
@@ -2564,7 +3229,11 @@ int git_checkout_iterator(
 		goto cleanup;
 
 	if (counts[CHECKOUT_ACTION__UPDATE_BLOB] > 0 &&
-		(error = checkout_create_the_new(actions, &data)) < 0)
+		((error = checkout_create_the_dirs(actions, &data)) < 0 ||
+		 (error = checkout_create_the_new(actions, &data)) < 0))
+		goto cleanup;
+
+	if (data.delayed && (error = checkout_create_delayed(&data)) < 0)
 		goto cleanup;
 
 	if (counts[CHECKOUT_ACTION__UPDATE_SUBMODULE] > 0 &&
@@ -2575,6 +3244,11 @@ int git_checkout_iterator(
 		(error = checkout_create_conflicts(&data)) < 0)
 		goto cleanup;
 
+	if (data.sparse != NULL &&
+		((error = checkout_skip_worktree(actions, &data)) < 0 ||
+		 (error = checkout_sparse_remember_trees(&data, target)) < 0))
+		goto cleanup;
+
 	if (data.index != git_iterator_get_index(target) &&
 		(error = checkout_extensions_update_index(&data)) < 0)
 		goto cleanup;
@@ -2594,6 +3268,7 @@ cleanup:
 	git_iterator_free(baseline);
 	git__free(actions);
 	git__free(counts);
+	target->pathspec_trie = target_trie;
 	checkout_data_clear(&data);
 
 	return error;
@@ -23,6 +23,7 @@
 #include "path.h"
 #include "repository.h"
 #include "odb.h"
+#include "clone_pipeline.h"
 
 static int clone_local_into(git_repository *repo, git_remote *remote, const git_fetch_options *fetch_opts, const git_checkout_options *co_opts, const char *branch, int link);
 
@@ -304,7 +305,7 @@ static bool should_checkout(
 	return !git_repository_head_unborn(repo);
 }
 
-static int checkout_branch(git_repository *repo, git_remote *remote, const git_checkout_options *co_opts, const char *branch, const char *reflog_message)
+static int checkout_branch(git_repository *repo, git_remote *remote, const git_checkout_options *co_opts, const char *branch, const char *reflog_message, git_clone_pipeline *pipeline)
 {
 	int error;
 
@@ -315,18 +316,23 @@ static int checkout_branch(git_repository *repo, git_remote *remote, const git_c
 	else
 		error = update_head_to_remote(repo, remote, reflog_message);
 
-	if (!error && should_checkout(repo, git_repository_is_bare(repo), co_opts))
-		error = git_checkout_head(repo, co_opts);
+	if (!error && should_checkout(repo, git_repository_is_bare(repo), co_opts)) {
+		if (pipeline)
+			error = git_clone_pipeline__checkout(pipeline, co_opts);
+		else
+			error = git_checkout_head(repo, co_opts);
+	}
 
 	return error;
 }
 
-static int clone_into(git_repository *repo, git_remote *_remote, const git_fetch_options *opts, const git_checkout_options *co_opts, const char *branch)
+static int clone_into(git_repository *repo, git_remote *_remote, const git_fetch_options *opts, const git_checkout_options *co_opts, const char *branch, int pipeline_checkout)
 {
 	int error;
 	git_buf reflog_message = GIT_BUF_INIT;
 	git_fetch_options fetch_opts;
 	git_remote *remote;
+	git_clone_pipeline *pipeline = NULL;
 
 	assert(repo && _remote);
 
@@ -343,12 +349,22 @@ static int clone_into(git_repository *repo, git_remote *_remote, const git_fetch
 	fetch_opts.download_tags = GIT_REMOTE_DOWNLOAD_TAGS_ALL;
 	git_buf_printf(&reflog_message, "clone: from %s", git_remote_url(remote));
 
+	/* write files out as the pack comes in, which needs the remote that
+	 * is fetched from for its ref advertisement
+	 */
+	if (pipeline_checkout &&
+		(error = git_clone_pipeline__new(&pipeline, repo, remote, branch, co_opts)) < 0)
+		goto cleanup;
+
 	if ((error = git_remote_fetch(remote, NULL, &fetch_opts, git_buf_cstr(&reflog_message))) != 0)
 		goto cleanup;
 
-	error = checkout_branch(repo, remote, co_opts, branch, git_buf_cstr(&reflog_message));
+	git_clone_pipeline__stop(pipeline);
+
+	error = checkout_branch(repo, remote, co_opts, branch, git_buf_cstr(&reflog_message), pipeline);
 
 cleanup:
+	git_clone_pipeline__free(pipeline);
 	git_remote_free(remote);
 	git_buf_free(&reflog_message);
 
@@ -431,7 +447,7 @@ int git_clone(
 		else if (clone_local == 0)
 			error = clone_into(
 				repo, origin, &options.fetch_opts, &options.checkout_opts,
-				options.checkout_branch);
+				options.checkout_branch, options.pipeline_checkout);
 		else
 			error = -1;
 
@@ -554,7 +570,7 @@ static int clone_local_into(git_repository *repo, git_remote *remote, const git_
 	if ((error = git_remote_fetch(remote, NULL, fetch_opts, git_buf_cstr(&reflog_message))) != 0)
 		goto cleanup;
 
-	error = checkout_branch(repo, remote, co_opts, branch, git_buf_cstr(&reflog_message));
+	error = checkout_branch(repo, remote, co_opts, branch, git_buf_cstr(&reflog_message), NULL);
 
 cleanup:
 	git_buf_free(&reflog_message);
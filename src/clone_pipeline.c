@@ -0,0 +1,840 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "clone_pipeline.h"
+
+#include "git2/tree.h"
+#include "git2/sys/filter.h"
+
+#include "attr_file.h"
+#include "fileops.h"
+#include "filter.h"
+#include "index.h"
+#include "odb.h"
+#include "oidmap.h"
+#include "path.h"
+#include "pool.h"
+#include "refs.h"
+#include "repository.h"
+#include "sparse.h"
+#include "thread-utils.h"
+#include "vector.h"
+
+GIT__USE_OIDMAP
+
+#define PIPELINE_MAX_THREADS 4
+
+/* file contents waiting for a writer, before the indexer has to wait */
+#define PIPELINE_QUEUE_BYTES (16 * 1024 * 1024)
+
+/* trees and blobs kept in case something wants them later */
+#define PIPELINE_KEEP_BYTES (32 * 1024 * 1024)
+
+typedef struct pipeline_want pipeline_want;
+
+/* A path the pipeline wants an object for, either a tree to walk or a
+ * blob to write; the paths of trees end with a slash, except for the
+ * root's which is empty.  Several paths may want the same object.
+ */
+struct pipeline_want {
+	git_oid id;
+	pipeline_want *next;
+	uint16_t mode;
+	char path[GIT_FLEX_ARRAY];
+};
+
+/* A tree or blob the pipeline has seen */
+typedef struct {
+	git_oid id;
+	git_otype type;
+	size_t len;
+	char data[GIT_FLEX_ARRAY];
+} pipeline_kept;
+
+typedef struct pipeline_file pipeline_file;
+
+/* A file handed to the writers */
+struct pipeline_file {
+	pipeline_file *next;
+	git_oid id;
+	uint16_t mode;
+	git_filter_list *fl;
+	char *data;
+	size_t len;
+	struct stat st;
+	bool written;
+	char path[GIT_FLEX_ARRAY];
+};
+
+struct git_clone_pipeline {
+	git_repository *repo;
+	git_remote *remote;
+	git_odb *odb;
+	const char *workdir;
+	char *branch;
+	bool disable_filters;
+
+	/* only touched from the thread indexing the pack */
+	bool started;
+	bool failed;
+	git_oid target;
+	git_oidmap *wanted;
+	git_oidmap *kept;
+	size_t kept_bytes;
+	git_pool pool;
+	git_attr_session attr_session;
+	git_vector files;
+
+	git_mutex lock;
+	git_cond work;
+	git_cond done;
+	pipeline_file *head, *tail;
+	size_t queued_bytes;
+	git_thread *threads;
+	int nthreads;
+	bool threaded;
+	bool shutdown;
+	bool stopped;
+};
+
+static int pipeline_file_cmp(const void *a, const void *b)
+{
+	const pipeline_file *one = a, *two = b;
+	return strcmp(one->path, two->path);
+}
+
+/* Write a file out; safe to call from any thread */
+static void pipeline_write(git_clone_pipeline *pl, pipeline_file *file)
+{
+	git_buf path = GIT_BUF_INIT, in = GIT_BUF_INIT, out = GIT_BUF_INIT;
+	int fd, error;
+
+	git_buf_attach_notowned(&in, file->data, file->len);
+
+	if ((error = git_buf_joinpath(&path, pl->workdir, file->path)) < 0 ||
+		(error = git_filter_list_apply_to_data(&out, file->fl, &in)) < 0)
+		goto done;
+
+	/* the working directory of a new clone is empty; if a file is there
+	 * already, something else put it there and checkout will see to it
+	 */
+	if ((fd = p_open(path.ptr, O_CREAT | O_EXCL | O_WRONLY, file->mode)) < 0) {
+		error = fd;
+		goto done;
+	}
+
+	error = p_write(fd, out.ptr, out.size);
+
+	if (p_close(fd) < 0)
+		error = -1;
+
+	if (!error)
+		error = p_stat(path.ptr, &file->st);
+
+	if (error < 0)
+		(void)p_unlink(path.ptr);
+	else
+		file->written = true;
+
+done:
+	/* checkout writes whatever we could not, and reports the errors */
+	if (error < 0)
+		giterr_clear();
+
+	git_buf_free(&path);
+	git_buf_free(&out);
+
+	git__free(file->data);
+	file->data = NULL;
+
+	git_filter_list_free(file->fl);
+	file->fl = NULL;
+}
+
+static void *pipeline_worker(void *arg)
+{
+	git_clone_pipeline *pl = arg;
+	pipeline_file *file;
+	size_t len;
+
+	if (git_mutex_lock(&pl->lock) < 0)
+		return NULL;
+
+	while (1) {
+		while (!pl->shutdown && !pl->head)
+			git_cond_wait(&pl->work, &pl->lock);
+
+		/* write everything that was queued before stopping */
+		if (!pl->head)
+			break;
+
+		file = pl->head;
+		if ((pl->head = file->next) == NULL)
+			pl->tail = NULL;
+		len = file->len;
+
+		git_mutex_unlock(&pl->lock);
+
+		pipeline_write(pl, file);
+
+		git_mutex_lock(&pl->lock);
+
+		pl->queued_bytes -= len;
+		git_cond_broadcast(&pl->done);
+	}
+
+	git_mutex_unlock(&pl->lock);
+	return NULL;
+}
+
+static void pipeline_queue(git_clone_pipeline *pl, pipeline_file *file)
+{
+	if (!pl->nthreads) {
+		pipeline_write(pl, file);
+		return;
+	}
+
+	git_mutex_lock(&pl->lock);
+
+	while (pl->head && pl->queued_bytes + file->len > PIPELINE_QUEUE_BYTES)
+		git_cond_wait(&pl->done, &pl->lock);
+
+	if (pl->tail)
+		pl->tail->next = file;
+	else
+		pl->head = file;
+	pl->tail = file;
+	pl->queued_bytes += file->len;
+
+	git_cond_signal(&pl->work);
+	git_mutex_unlock(&pl->lock);
+}
+
+static void pipeline_start_threads(git_clone_pipeline *pl)
+{
+#ifdef GIT_THREADS
+	int i, nthreads = min(git_online_cpus(), PIPELINE_MAX_THREADS);
+
+	/* even a single writer lets disk writes overlap the download */
+	if (nthreads < 1)
+		nthreads = 1;
+
+	if ((pl->threads = git__calloc(nthreads, sizeof(git_thread))) == NULL) {
+		giterr_clear();
+		return;
+	}
+
+	if (git_mutex_init(&pl->lock) < 0 ||
+		git_cond_init(&pl->work) < 0 ||
+		git_cond_init(&pl->done) < 0) {
+		git__free(pl->threads);
+		pl->threads = NULL;
+		return;
+	}
+
+	pl->threaded = true;
+
+	/* make do with however many threads we can get */
+	for (i = 0; i < nthreads; i++) {
+		if (git_thread_create(&pl->threads[i], NULL,
+				pipeline_worker, pl) != 0)
+			break;
+
+		pl->nthreads++;
+	}
+#else
+	GIT_UNUSED(pl);
+#endif
+}
+
+static int pipeline_blob(
+	git_clone_pipeline *pl,
+	const git_oid *id,
+	uint16_t mode,
+	const char *path,
+	const void *data,
+	size_t len)
+{
+	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
+	git_filter_list *fl = NULL;
+	pipeline_file *file;
+	size_t pathlen = strlen(path), alloclen;
+
+	filter_opts.attr_session = &pl->attr_session;
+
+	if (!pl->disable_filters &&
+		git_filter_list__load_ext(&fl, pl->repo, NULL, path,
+			GIT_FILTER_TO_WORKTREE, &filter_opts) < 0)
+		return -1;
+
+	/* other filters may not run on the writers, and ident needs the
+	 * blob which is not in the repository yet
+	 */
+	if (!git_filter_list__builtin_only(fl) ||
+		git_filter_list_contains(fl, GIT_FILTER_IDENT)) {
+		git_filter_list_free(fl);
+		return 0;
+	}
+
+	GITERR_CHECK_ALLOC_ADD3(&alloclen, sizeof(pipeline_file), pathlen, 1);
+
+	if ((file = git__calloc(1, alloclen)) == NULL ||
+		(file->data = git__malloc(len ? len : 1)) == NULL ||
+		git_vector_insert(&pl->files, file) < 0) {
+		if (file)
+			git__free(file->data);
+		git__free(file);
+		git_filter_list_free(fl);
+		return -1;
+	}
+
+	git_oid_cpy(&file->id, id);
+	file->mode = mode;
+	file->fl = fl;
+	file->len = len;
+	memcpy(file->data, data, len);
+	memcpy(file->path, path, pathlen);
+
+	pipeline_queue(pl, file);
+	return 0;
+}
+
+/* Read the next entry of raw tree data; 0 at the end of the tree */
+static int pipeline_tree_next(
+	uint16_t *mode,
+	const char **name,
+	size_t *namelen,
+	git_oid *id,
+	const char **p,
+	const char *end)
+{
+	const char *c = *p, *nul;
+	uint32_t m = 0;
+
+	if (c >= end)
+		return 0;
+
+	while (c < end && *c >= '0' && *c <= '7' && m <= 0xffff)
+		m = (m << 3) + (*c++ - '0');
+
+	if (c >= end || *c++ != ' ' || m > 0xffff ||
+		(nul = memchr(c, '\0', end - c)) == NULL || nul == c ||
+		(size_t)(end - nul - 1) < GIT_OID_RAWSZ) {
+		giterr_set(GITERR_INVALID, "Corrupt tree in the pack");
+		return -1;
+	}
+
+	*mode = (uint16_t)m;
+	*name = c;
+	*namelen = nul - c;
+	git_oid_fromraw(id, (const unsigned char *)nul + 1);
+
+	*p = nul + 1 + GIT_OID_RAWSZ;
+	return 1;
+}
+
+static bool pipeline_tree_entry_is(
+	const char *name, size_t namelen, const char *expected)
+{
+	return namelen == strlen(expected) && !memcmp(name, expected, namelen);
+}
+
+static int pipeline_add_want(
+	git_clone_pipeline *pl, const git_oid *id, uint16_t mode, const char *path);
+
+static int pipeline_tree(
+	git_clone_pipeline *pl, const char *path, const char *data, size_t len)
+{
+	const char *p, *end = data + len, *name;
+	git_buf child = GIT_BUF_INIT;
+	size_t namelen;
+	uint16_t mode;
+	git_oid id;
+	int error;
+
+	/* attributes may ask for any filter for the files below them, so
+	 * leave all of those to checkout
+	 */
+	for (p = data; (error = pipeline_tree_next(
+			&mode, &name, &namelen, &id, &p, end)) > 0; ) {
+		if (pipeline_tree_entry_is(name, namelen, GIT_ATTR_FILE))
+			return 0;
+	}
+
+	if (error < 0)
+		return error;
+
+	if (*path) {
+		if ((error = git_buf_joinpath(&child, pl->workdir, path)) < 0)
+			return error;
+
+		/* checkout will have a look at whatever is in the way */
+		if (p_mkdir(child.ptr, GIT_DIR_MODE) < 0) {
+			git_buf_free(&child);
+			return 0;
+		}
+	}
+
+	for (p = data; (error = pipeline_tree_next(
+			&mode, &name, &namelen, &id, &p, end)) > 0; ) {
+		if (mode != GIT_FILEMODE_TREE &&
+			mode != GIT_FILEMODE_BLOB &&
+			mode != GIT_FILEMODE_BLOB_EXECUTABLE)
+			continue;
+
+		if (memchr(name, '/', namelen) != NULL ||
+			pipeline_tree_entry_is(name, namelen, ".gitmodules"))
+			continue;
+
+		git_buf_clear(&child);
+		git_buf_puts(&child, path);
+		git_buf_put(&child, name, namelen);
+
+		if ((error = git_buf_oom(&child) ? -1 : 0) < 0)
+			break;
+
+		if (!git_path_isvalid(pl->repo, child.ptr,
+				GIT_PATH_REJECT_DEFAULTS | GIT_PATH_REJECT_DOT_GIT))
+			continue;
+
+		if (mode == GIT_FILEMODE_TREE &&
+			(error = git_buf_putc(&child, '/')) < 0)
+			break;
+
+		if ((error = pipeline_add_want(pl, &id, mode, child.ptr)) < 0)
+			break;
+	}
+
+	git_buf_free(&child);
+	return error;
+}
+
+static int pipeline_object(
+	git_clone_pipeline *pl,
+	const git_oid *id,
+	uint16_t mode,
+	const char *path,
+	git_otype type,
+	const void *data,
+	size_t len)
+{
+	if (mode == GIT_FILEMODE_TREE)
+		return (type == GIT_OBJ_TREE) ?
+			pipeline_tree(pl, path, data, len) : 0;
+
+	return (type == GIT_OBJ_BLOB) ?
+		pipeline_blob(pl, id, mode, path, data, len) : 0;
+}
+
+static int pipeline_add_want(
+	git_clone_pipeline *pl, const git_oid *id, uint16_t mode, const char *path)
+{
+	pipeline_want *want, *first;
+	pipeline_kept *kept;
+	size_t pathlen = strlen(path), alloclen;
+	khiter_t pos;
+	int error;
+
+	pos = git_oidmap_lookup_index(pl->kept, id);
+
+	if (git_oidmap_valid_index(pl->kept, pos)) {
+		kept = git_oidmap_value_at(pl->kept, pos);
+		return pipeline_object(
+			pl, id, mode, path, kept->type, kept->data, kept->len);
+	}
+
+	GITERR_CHECK_ALLOC_ADD3(&alloclen, sizeof(pipeline_want), pathlen, 1);
+
+	if (!git__is_uint32(alloclen) ||
+		(want = git_pool_malloc(&pl->pool, (uint32_t)alloclen)) == NULL)
+		return -1;
+
+	git_oid_cpy(&want->id, id);
+	want->mode = mode;
+	memcpy(want->path, path, pathlen + 1);
+
+	pos = git_oidmap_lookup_index(pl->wanted, id);
+
+	if (git_oidmap_valid_index(pl->wanted, pos)) {
+		first = git_oidmap_value_at(pl->wanted, pos);
+		want->next = first->next;
+		first->next = want;
+		return 0;
+	}
+
+	want->next = NULL;
+	git_oidmap_insert(pl->wanted, &want->id, want, error);
+
+	return (error < 0) ? -1 : 0;
+}
+
+/* Keep a tree or blob around for paths that want it later */
+static int pipeline_keep(
+	git_clone_pipeline *pl,
+	const git_oid *id,
+	git_otype type,
+	const void *data,
+	size_t len)
+{
+	pipeline_kept *kept;
+	khiter_t pos;
+	int error;
+
+	if ((type != GIT_OBJ_TREE && type != GIT_OBJ_BLOB) ||
+		len > PIPELINE_KEEP_BYTES - pl->kept_bytes)
+		return 0;
+
+	pos = git_oidmap_lookup_index(pl->kept, id);
+	if (git_oidmap_valid_index(pl->kept, pos))
+		return 0;
+
+	kept = git__malloc(sizeof(pipeline_kept) + len);
+	GITERR_CHECK_ALLOC(kept);
+
+	git_oid_cpy(&kept->id, id);
+	kept->type = type;
+	kept->len = len;
+	memcpy(kept->data, data, len);
+
+	git_oidmap_insert(pl->kept, &kept->id, kept, error);
+
+	if (error < 0) {
+		git__free(kept);
+		return -1;
+	}
+
+	pl->kept_bytes += len;
+	return 0;
+}
+
+/* Find the commit being cloned in the ref advertisement */
+static int pipeline_find_target(git_clone_pipeline *pl)
+{
+	const git_remote_head **refs;
+	git_buf name = GIT_BUF_INIT;
+	size_t refs_len, i;
+	int error;
+
+	pl->started = true;
+	pl->failed = true;
+
+	if ((error = git_remote_ls(&refs, &refs_len, pl->remote)) < 0)
+		return error;
+
+	if (pl->branch)
+		error = git_buf_printf(&name, GIT_REFS_HEADS_DIR "%s", pl->branch);
+	else
+		error = git_buf_puts(&name, GIT_HEAD_FILE);
+
+	for (i = 0; !error && i < refs_len; i++) {
+		if (strcmp(refs[i]->name, name.ptr) == 0) {
+			git_oid_cpy(&pl->target, &refs[i]->oid);
+			pl->failed = false;
+			break;
+		}
+	}
+
+	git_buf_free(&name);
+	return error;
+}
+
+static int pipeline_take(
+	git_clone_pipeline *pl,
+	const git_oid *id,
+	git_otype type,
+	const void *data,
+	size_t len)
+{
+	pipeline_want *want;
+	git_oid tree_id;
+	khiter_t pos;
+	int error;
+
+	if (type == GIT_OBJ_COMMIT) {
+		if (!git_oid_equal(id, &pl->target))
+			return 0;
+
+		if (len < strlen("tree ") + GIT_OID_HEXSZ ||
+			memcmp(data, "tree ", strlen("tree ")) != 0 ||
+			git_oid_fromstrn(&tree_id,
+				(const char *)data + strlen("tree "), GIT_OID_HEXSZ) < 0) {
+			giterr_set(GITERR_INVALID, "Corrupt commit in the pack");
+			return -1;
+		}
+
+		return pipeline_add_want(pl, &tree_id, GIT_FILEMODE_TREE, "");
+	}
+
+	if ((error = pipeline_keep(pl, id, type, data, len)) < 0)
+		return error;
+
+	pos = git_oidmap_lookup_index(pl->wanted, id);
+	if (!git_oidmap_valid_index(pl->wanted, pos))
+		return 0;
+
+	want = git_oidmap_value_at(pl->wanted, pos);
+	git_oidmap_delete_at(pl->wanted, pos);
+
+	for (; want && !error; want = want->next)
+		error = pipeline_object(
+			pl, id, want->mode, want->path, type, data, len);
+
+	return error;
+}
+
+static void pipeline_indexed(
+	const git_oid *id,
+	git_otype type,
+	const void *data,
+	size_t len,
+	void *payload)
+{
+	git_clone_pipeline *pl = payload;
+
+	if (pl->failed)
+		return;
+
+	/* on any trouble stop, and leave what is left to checkout */
+	if ((!pl->started && pipeline_find_target(pl) < 0) ||
+		(!pl->failed && pipeline_take(pl, id, type, data, len) < 0)) {
+		giterr_clear();
+		pl->failed = true;
+	}
+}
+
+/* Whether checkout with these options writes files the way we do */
+static bool pipeline_supports(const git_checkout_options *opts)
+{
+	unsigned int strategy = opts->checkout_strategy;
+
+	return (strategy & (GIT_CHECKOUT_SAFE | GIT_CHECKOUT_FORCE)) != 0 &&
+		(strategy & (GIT_CHECKOUT_UPDATE_ONLY |
+			GIT_CHECKOUT_DONT_UPDATE_INDEX |
+			GIT_CHECKOUT_DONT_WRITE_INDEX |
+			GIT_CHECKOUT_NO_REFRESH)) == 0 &&
+		!opts->paths.count &&
+		!opts->baseline &&
+		!opts->baseline_index &&
+		!opts->target_directory &&
+		!opts->notify_cb &&
+		!opts->dir_mode &&
+		!opts->file_mode &&
+		!opts->file_open_flags;
+}
+
+int git_clone_pipeline__new(
+	git_clone_pipeline **out,
+	git_repository *repo,
+	git_remote *remote,
+	const char *branch,
+	const git_checkout_options *opts)
+{
+	git_clone_pipeline *pl;
+	git_sparse *sparse = NULL;
+	int ignorecase, error;
+
+	assert(out && repo && remote);
+
+	*out = NULL;
+
+	if (!opts || !pipeline_supports(opts) || git_repository_is_bare(repo))
+		return 0;
+
+	/* files may collide, or be left out of the working directory */
+	if ((error = git_repository__cvar(
+			&ignorecase, repo, GIT_CVAR_IGNORECASE)) < 0 ||
+		(error = git_sparse__load(&sparse, repo)) < 0)
+		return error;
+
+	if (ignorecase || sparse) {
+		git_sparse__free(sparse);
+		return 0;
+	}
+
+	pl = git__calloc(1, sizeof(git_clone_pipeline));
+	GITERR_CHECK_ALLOC(pl);
+
+	pl->repo = repo;
+	pl->remote = remote;
+	pl->workdir = git_repository_workdir(repo);
+	pl->disable_filters = !!opts->disable_filters;
+
+	git_pool_init(&pl->pool, 1);
+	git_attr_session__init(&pl->attr_session, repo);
+
+	if ((branch && (pl->branch = git__strdup(branch)) == NULL) ||
+		(error = git_repository_odb__weakptr(&pl->odb, repo)) < 0 ||
+		(error = git_vector_init(&pl->files, 0, pipeline_file_cmp)) < 0)
+		goto on_error;
+
+	if ((pl->wanted = git_oidmap_alloc()) == NULL ||
+		(pl->kept = git_oidmap_alloc()) == NULL) {
+		giterr_set_oom();
+		goto on_error;
+	}
+
+	pipeline_start_threads(pl);
+	git_odb__set_indexed_cb(pl->odb, pipeline_indexed, pl);
+
+	*out = pl;
+	return 0;
+
+on_error:
+	git_clone_pipeline__free(pl);
+	return -1;
+}
+
+void git_clone_pipeline__stop(git_clone_pipeline *pl)
+{
+	int i;
+
+	if (!pl || pl->stopped)
+		return;
+
+	pl->stopped = true;
+
+	if (pl->odb)
+		git_odb__set_indexed_cb(pl->odb, NULL, NULL);
+
+	if (!pl->threaded)
+		return;
+
+	git_mutex_lock(&pl->lock);
+	pl->shutdown = true;
+	git_cond_broadcast(&pl->work);
+	git_mutex_unlock(&pl->lock);
+
+	for (i = 0; i < pl->nthreads; i++)
+		git_thread_join(&pl->threads[i], NULL);
+}
+
+int git_clone_pipeline__checkout(
+	git_clone_pipeline *pl, const git_checkout_options *opts)
+{
+	git_checkout_options co_opts;
+	git_buf path = GIT_BUF_INIT;
+	git_tree *tree = NULL;
+	git_tree_entry *te;
+	git_index *index = NULL;
+	git_index_entry entry;
+	pipeline_file *file;
+	size_t i, indexed = 0;
+	bool matches;
+	int error;
+
+	assert(pl && opts);
+
+	git_clone_pipeline__stop(pl);
+
+	memcpy(&co_opts, opts, sizeof(git_checkout_options));
+
+	if ((error = git_repository_head_tree(&tree, pl->repo)) < 0 ||
+		(error = git_repository_index(&index, pl->repo)) < 0)
+		goto done;
+
+	/* add in path order, which keeps the index sorted as it grows */
+	git_vector_sort(&pl->files);
+
+	git_vector_foreach(&pl->files, i, file) {
+		if (!file->written)
+			continue;
+
+		matches = false;
+
+		if ((error = git_tree_entry_bypath(&te, tree, file->path)) == 0) {
+			matches = git_oid_equal(git_tree_entry_id(te), &file->id) &&
+				git_tree_entry_filemode(te) == file->mode;
+			git_tree_entry_free(te);
+		} else if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			error = 0;
+		} else {
+			goto done;
+		}
+
+		/* not what HEAD has after all; leave the path to checkout */
+		if (!matches) {
+			if ((error = git_buf_joinpath(
+					&path, pl->workdir, file->path)) < 0)
+				goto done;
+
+			if ((error = p_unlink(path.ptr)) < 0) {
+				giterr_set(GITERR_OS,
+					"Could not remove '%s'", path.ptr);
+				goto done;
+			}
+
+			continue;
+		}
+
+		memset(&entry, 0, sizeof(entry));
+		entry.path = file->path;
+		git_index_entry__init_from_stat(&entry, &file->st, true);
+		entry.mode = file->mode;
+		git_oid_cpy(&entry.id, &file->id);
+
+		if ((error = git_index_add(index, &entry)) < 0)
+			goto done;
+
+		indexed++;
+	}
+
+	/* checkout recreates missing files in a repository without an index
+	 * file; now that there is one it has to be asked to
+	 */
+	if (indexed) {
+		if ((error = git_index_write(index)) < 0)
+			goto done;
+
+		co_opts.checkout_strategy |= GIT_CHECKOUT_RECREATE_MISSING;
+	}
+
+	error = git_checkout_head(pl->repo, &co_opts);
+
+done:
+	git_index_free(index);
+	git_tree_free(tree);
+	git_buf_free(&path);
+	return error;
+}
+
+void git_clone_pipeline__free(git_clone_pipeline *pl)
+{
+	pipeline_file *file;
+	pipeline_kept *kept;
+	size_t i;
+
+	if (!pl)
+		return;
+
+	git_clone_pipeline__stop(pl);
+
+	if (pl->threaded) {
+		git_cond_free(&pl->work);
+		git_cond_free(&pl->done);
+		git_mutex_free(&pl->lock);
+	}
+
+	git_vector_foreach(&pl->files, i, file) {
+		git__free(file->data);
+		git_filter_list_free(file->fl);
+		git__free(file);
+	}
+	git_vector_free(&pl->files);
+
+	if (pl->kept) {
+		git_oidmap_foreach_value(pl->kept, kept, { git__free(kept); });
+		git_oidmap_free(pl->kept);
+	}
+	git_oidmap_free(pl->wanted);
+
+	git_pool_clear(&pl->pool);
+	git_attr_session__free(&pl->attr_session);
+	git__free(pl->threads);
+	git__free(pl->branch);
+	git__free(pl);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_clone_pipeline_h__
+#define INCLUDE_clone_pipeline_h__
+
+#include "common.h"
+#include "git2/checkout.h"
+#include "git2/remote.h"
+
+/*
+ * A clone pipeline writes the files of the commit a clone will check out
+ * while the pack holding them is still being received.
+ *
+ * The commit is the one the ref advertisement names for the branch being
+ * cloned.  As the indexer learns the contents of objects (whole objects
+ * as they are read, deltas as they are resolved) the pipeline walks from
+ * that commit down its trees, and hands each blob it reaches to writer
+ * threads.  Trees and blobs which arrive before the pipeline knows that
+ * it wants them are kept, up to a limit.
+ *
+ * Only what is certain to come out the same as checkout would write it
+ * goes through the pipeline: regular files that only need the built-in
+ * filters, outside of any directory with a `.gitattributes`.  Everything
+ * else is left to the checkout which follows the fetch, and which finds
+ * the pipelined files already in place in the index.
+ */
+typedef struct git_clone_pipeline git_clone_pipeline;
+
+/*
+ * Start a pipeline for a clone of `remote` into `repo`, checking out
+ * `branch` (or the remote's HEAD when NULL) with `opts`.  `*out` is set
+ * to NULL when the checkout options need checkout to write every file
+ * itself.
+ */
+extern int git_clone_pipeline__new(
+	git_clone_pipeline **out,
+	git_repository *repo,
+	git_remote *remote,
+	const char *branch,
+	const git_checkout_options *opts);
+
+/* Wait for the files already handed out to be written and stop taking
+ * objects from the indexer.
+ */
+extern void git_clone_pipeline__stop(git_clone_pipeline *pl);
+
+/*
+ * Check out HEAD with `opts`: the pipelined files which are part of it
+ * go in the index, and checkout writes the rest.
+ */
+extern int git_clone_pipeline__checkout(
+	git_clone_pipeline *pl, const git_checkout_options *opts);
+
+extern void git_clone_pipeline__free(git_clone_pipeline *pl);
+
+#endif
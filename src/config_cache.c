@@ -78,6 +78,11 @@ static struct map_data _cvar_maps[] = {
 	{"core.logallrefupdates", NULL, 0, GIT_LOGALLREFUPDATES_DEFAULT },
 	{"core.protecthfs", NULL, 0, GIT_PROTECTHFS_DEFAULT },
 	{"core.protectntfs", NULL, 0, GIT_PROTECTNTFS_DEFAULT },
+	{"core.preloadindex", NULL, 0, GIT_PRELOADINDEX_DEFAULT },
+	{"core.sparsecheckout", NULL, 0, GIT_SPARSECHECKOUT_DEFAULT },
+	{"index.sparse", NULL, 0, GIT_SPARSEINDEX_DEFAULT },
+	{"diff.windowsize", _cvar_map_int, 1, GIT_DIFFWINDOW_DEFAULT },
+	{"core.scanthreads", _cvar_map_int, 1, GIT_SCANTHREADS_DEFAULT },
 };
 
 int git_config__cvar(int *out, git_config *config, git_cvar_cached cvar)
@@ -118,71 +118,6 @@ static int has_cr_in_index(const git_filter_source *src)
 	return found_cr;
 }
 
-static int crlf_apply_to_odb(
-	struct crlf_attrs *ca,
-	git_buf *to,
-	const git_buf *from,
-	const git_filter_source *src)
-{
-	/* Empty file? Nothing to do */
-	if (!git_buf_len(from))
-		return 0;
-
-	/* Heuristics to see if we can skip the conversion.
-	 * Straight from Core Git.
-	 */
-	if (ca->crlf_action == GIT_CRLF_AUTO || ca->crlf_action == GIT_CRLF_GUESS) {
-		git_buf_text_stats stats;
-
-		/* Check heuristics for binary vs text - returns true if binary */
-		if (git_buf_text_gather_stats(&stats, from, false))
-			return GIT_PASSTHROUGH;
-
-		/* If there are no CR characters to filter out, then just pass */
-		if (!stats.cr)
-			return GIT_PASSTHROUGH;
-
-		/* If safecrlf is enabled, sanity-check the result. */
-		if (stats.cr != stats.crlf || stats.lf != stats.crlf) {
-			switch (ca->safe_crlf) {
-			case GIT_SAFE_CRLF_FAIL:
-				giterr_set(
-					GITERR_FILTER, "LF would be replaced by CRLF in '%s'",
-					git_filter_source_path(src));
-				return -1;
-			case GIT_SAFE_CRLF_WARN:
-				/* TODO: issue warning when warning API is available */;
-				break;
-			default:
-				break;
-			}
-		}
-
-		/*
-		 * We're currently not going to even try to convert stuff
-		 * that has bare CR characters. Does anybody do that crazy
-		 * stuff?
-		 */
-		if (stats.cr != stats.crlf)
-			return GIT_PASSTHROUGH;
-
-		if (ca->crlf_action == GIT_CRLF_GUESS) {
-			/*
-			 * If the file in the index has any CR in it, do not convert.
-			 * This is the new safer autocrlf handling.
-			 */
-			if (has_cr_in_index(src))
-				return GIT_PASSTHROUGH;
-		}
-
-		if (!stats.cr)
-			return GIT_PASSTHROUGH;
-	}
-
-	/* Actually drop the carriage returns */
-	return git_buf_text_crlf_to_lf(to, from);
-}
-
 static const char *line_ending(struct crlf_attrs *ca)
 {
 	switch (ca->crlf_action) {
@@ -222,52 +157,6 @@ line_ending_error:
 	return NULL;
 }
 
-static int crlf_apply_to_workdir(
-	struct crlf_attrs *ca, git_buf *to, const git_buf *from)
-{
-	git_buf_text_stats stats;
-	const char *workdir_ending = NULL;
-	bool is_binary;
-
-	/* Empty file? Nothing to do. */
-	if (git_buf_len(from) == 0)
-		return 0;
-
-	/* Determine proper line ending */
-	workdir_ending = line_ending(ca);
-	if (!workdir_ending)
-		return -1;
-
-	/* only LF->CRLF conversion is supported, do nothing on LF platforms */
-	if (strcmp(workdir_ending, "\r\n") != 0)
-		return GIT_PASSTHROUGH;
-
-	/* If there are no LFs, or all LFs are part of a CRLF, nothing to do */
-	is_binary = git_buf_text_gather_stats(&stats, from, false);
-
-	if (stats.lf == 0 || stats.lf == stats.crlf)
-		return GIT_PASSTHROUGH;
-
-	if (ca->crlf_action == GIT_CRLF_AUTO ||
-		ca->crlf_action == GIT_CRLF_GUESS) {
-
-		/* If we have any existing CR or CRLF line endings, do nothing */
-		if (ca->crlf_action == GIT_CRLF_GUESS &&
-			stats.cr > 0 && stats.crlf > 0)
-			return GIT_PASSTHROUGH;
-
-		/* If we have bare CR characters, do nothing */
-		if (stats.cr != stats.crlf)
-			return GIT_PASSTHROUGH;
-
-		/* Don't filter binary files */
-		if (is_binary)
-			return GIT_PASSTHROUGH;
-	}
-
-	return git_buf_text_lf_to_crlf(to, from);
-}
-
 static int crlf_check(
 	git_filter        *self,
 	void              **payload, /* points to NULL ptr on entry, may be set */
@@ -336,24 +225,355 @@ static int crlf_check(
 	return 0;
 }
 
-static int crlf_apply(
-	git_filter    *self,
-	void         **payload, /* may be read and/or set */
-	git_buf       *to,
-	const git_buf *from,
-	const git_filter_source *src)
+/*
+ * How a stream treats the content written to it.  Unless the attributes
+ * leave it to the content itself (`text=auto` or `core.autocrlf`), the
+ * line endings are converted piece by piece as they arrive.  Otherwise
+ * the content is held back, gathering stats as it comes, until those can
+ * decide: as soon as they show that it will be left alone (a NUL or a
+ * bare CR), or at the end when they show that it is text to convert.
+ */
+typedef enum {
+	CRLF_STREAM_PASSTHROUGH = 0,
+	CRLF_STREAM_CONVERT,
+	CRLF_STREAM_BUFFER,
+} crlf_stream_state;
+
+struct crlf_stream {
+	git_writestream parent;
+	git_writestream *next;
+	struct crlf_attrs *ca;
+	const git_filter_source *src;
+	git_filter_mode_t mode;
+	crlf_stream_state state;
+	git_buf_text_stats stats;
+	char last; /* last byte of the previous piece */
+	bool pending_cr; /* a CR held back until the byte after it is known */
+	git_buf buffered;
+	git_buf converted;
+};
+
+static int crlf_stream_state_for(
+	crlf_stream_state *out, struct crlf_attrs *ca, git_filter_mode_t mode)
+{
+	const char *workdir_ending;
+	bool from_content;
+
+	/* `check` found nothing to do */
+	if (!ca) {
+		*out = CRLF_STREAM_PASSTHROUGH;
+		return 0;
+	}
+
+	from_content = (ca->crlf_action == GIT_CRLF_AUTO ||
+		ca->crlf_action == GIT_CRLF_GUESS);
+
+	if (mode == GIT_FILTER_SMUDGE) {
+		/* Determine proper line ending */
+		if ((workdir_ending = line_ending(ca)) == NULL)
+			return -1;
+
+		/* only LF->CRLF conversion is supported, do nothing on LF platforms */
+		if (strcmp(workdir_ending, "\r\n") != 0) {
+			*out = CRLF_STREAM_PASSTHROUGH;
+			return 0;
+		}
+	}
+
+	*out = from_content ? CRLF_STREAM_BUFFER : CRLF_STREAM_CONVERT;
+	return 0;
+}
+
+/* Can content with the stats so far only ever be passed through? */
+static bool crlf_stream_decided(struct crlf_stream *s)
 {
+	git_buf_text_stats *stats = &s->stats;
+	unsigned int bare_cr = stats->cr - stats->crlf - (s->last == '\r');
+
+	/* Binary, and nothing else is looked at */
+	if (stats->nul)
+		return true;
+
+	/*
+	 * Bare CRs are left alone, but on the way into the odb safecrlf is
+	 * checked first, which fails unless the content turns out binary.
+	 */
+	if (bare_cr)
+		return (s->mode == GIT_FILTER_SMUDGE ||
+			s->ca->safe_crlf != GIT_SAFE_CRLF_FAIL);
+
+	/* If we have any existing CRLF line endings, do nothing */
+	return (s->mode == GIT_FILTER_SMUDGE &&
+		s->ca->crlf_action == GIT_CRLF_GUESS && stats->crlf > 0);
+}
+
+static int crlf_decide_odb(struct crlf_stream *s)
+{
+	git_buf_text_stats *stats = &s->stats;
+
+	/* Heuristics to see if we can skip the conversion.
+	 * Straight from Core Git.
+	 */
+
+	/* Check heuristics for binary vs text */
+	if (git_buf_text_stats_is_binary(stats))
+		return GIT_PASSTHROUGH;
+
+	/* If there are no CR characters to filter out (or the file is
+	 * empty), then just pass
+	 */
+	if (!stats->cr)
+		return GIT_PASSTHROUGH;
+
+	/* If safecrlf is enabled, sanity-check the result. */
+	if (stats->cr != stats->crlf || stats->lf != stats->crlf) {
+		switch (s->ca->safe_crlf) {
+		case GIT_SAFE_CRLF_FAIL:
+			giterr_set(
+				GITERR_FILTER, "LF would be replaced by CRLF in '%s'",
+				git_filter_source_path(s->src));
+			return -1;
+		case GIT_SAFE_CRLF_WARN:
+			/* TODO: issue warning when warning API is available */;
+			break;
+		default:
+			break;
+		}
+	}
+
+	/*
+	 * We're currently not going to even try to convert stuff
+	 * that has bare CR characters. Does anybody do that crazy
+	 * stuff?
+	 */
+	if (stats->cr != stats->crlf)
+		return GIT_PASSTHROUGH;
+
+	if (s->ca->crlf_action == GIT_CRLF_GUESS) {
+		/*
+		 * If the file in the index has any CR in it, do not convert.
+		 * This is the new safer autocrlf handling.
+		 */
+		if (has_cr_in_index(s->src))
+			return GIT_PASSTHROUGH;
+	}
+
+	return 0;
+}
+
+static int crlf_decide_workdir(struct crlf_stream *s)
+{
+	git_buf_text_stats *stats = &s->stats;
+
+	/* If there are no LFs, or all LFs are part of a CRLF, nothing to do */
+	if (stats->lf == 0 || stats->lf == stats->crlf)
+		return GIT_PASSTHROUGH;
+
+	/* If we have any existing CR or CRLF line endings, do nothing */
+	if (s->ca->crlf_action == GIT_CRLF_GUESS &&
+		stats->cr > 0 && stats->crlf > 0)
+		return GIT_PASSTHROUGH;
+
+	/* If we have bare CR characters, do nothing */
+	if (stats->cr != stats->crlf)
+		return GIT_PASSTHROUGH;
+
+	/* Don't filter binary files */
+	if (git_buf_text_stats_is_binary(stats))
+		return GIT_PASSTHROUGH;
+
+	return 0;
+}
+
+static int crlf_convert(struct crlf_stream *s, const char *ptr, size_t len)
+{
+	git_buf from = GIT_BUF_INIT;
+	int error;
+
+	if (s->mode == GIT_FILTER_SMUDGE) {
+		/* An LF right after a CR in the last piece is already a CRLF */
+		if (len && s->last == '\r' && *ptr == '\n') {
+			if ((error = s->next->write(s->next, ptr, 1)) < 0)
+				return error;
+			s->last = '\n';
+			ptr++;
+			len--;
+		}
+
+		if (!len)
+			return 0;
+
+		s->last = ptr[len - 1];
+
+		if (!memchr(ptr, '\n', len))
+			return s->next->write(s->next, ptr, len);
+
+		git_buf_attach_notowned(&from, ptr, len);
+		error = git_buf_text_lf_to_crlf(&s->converted, &from);
+	} else {
+		/* A CR is only dropped when an LF follows it */
+		if (len && s->pending_cr) {
+			s->pending_cr = false;
+
+			if (*ptr != '\n' &&
+				(error = s->next->write(s->next, "\r", 1)) < 0)
+				return error;
+		}
+
+		if (len && ptr[len - 1] == '\r') {
+			s->pending_cr = true;
+			len--;
+		}
+
+		if (!len)
+			return 0;
+
+		if (!memchr(ptr, '\r', len))
+			return s->next->write(s->next, ptr, len);
+
+		git_buf_attach_notowned(&from, ptr, len);
+		error = git_buf_text_crlf_to_lf(&s->converted, &from);
+	}
+
+	if (error < 0)
+		return error;
+
+	return s->next->write(s->next, s->converted.ptr, s->converted.size);
+}
+
+static int crlf_stream_flush(struct crlf_stream *s)
+{
+	const char *scan = s->buffered.ptr;
+	size_t remaining = s->buffered.size, len;
+	int error;
+
+	/* Ignore EOF character */
+	if (s->last == '\032')
+		s->stats.nonprintable--;
+
+	if (s->mode == GIT_FILTER_SMUDGE)
+		error = crlf_decide_workdir(s);
+	else
+		error = crlf_decide_odb(s);
+
+	if (error == GIT_PASSTHROUGH) {
+		s->state = CRLF_STREAM_PASSTHROUGH;
+		return s->next->write(s->next, scan, remaining);
+	} else if (error < 0) {
+		return error;
+	}
+
+	/* Convert in pieces, so as not to hold a second copy */
+	s->state = CRLF_STREAM_CONVERT;
+	s->last = '\0';
+
+	while (remaining) {
+		len = min(remaining, FILTERIO_BUFSIZE);
+
+		if ((error = crlf_convert(s, scan, len)) < 0)
+			return error;
+
+		scan += len;
+		remaining -= len;
+	}
+
+	return 0;
+}
+
+static int crlf_stream_write(
+	git_writestream *stream, const char *buffer, size_t len)
+{
+	struct crlf_stream *s = (struct crlf_stream *)stream;
+	int error;
+
+	switch (s->state) {
+	case CRLF_STREAM_CONVERT:
+		return crlf_convert(s, buffer, len);
+
+	case CRLF_STREAM_BUFFER:
+		git_buf_text_stats_add(&s->stats, buffer, len, &s->last);
+
+		if (!crlf_stream_decided(s))
+			return git_buf_put(&s->buffered, buffer, len);
+
+		s->state = CRLF_STREAM_PASSTHROUGH;
+
+		error = s->next->write(s->next, s->buffered.ptr, s->buffered.size);
+		git_buf_free(&s->buffered);
+
+		if (error < 0)
+			return error;
+
+		/* fall through */
+	default:
+		return s->next->write(s->next, buffer, len);
+	}
+}
+
+static int crlf_stream_close(git_writestream *stream)
+{
+	struct crlf_stream *s = (struct crlf_stream *)stream;
+	int error = 0;
+
+	if (s->state == CRLF_STREAM_BUFFER)
+		error = crlf_stream_flush(s);
+
+	git_buf_free(&s->buffered);
+
+	if (!error && s->pending_cr)
+		error = s->next->write(s->next, "\r", 1);
+
+	if (!error)
+		error = s->next->close(s->next);
+
+	return error;
+}
+
+static void crlf_stream_free(git_writestream *stream)
+{
+	struct crlf_stream *s = (struct crlf_stream *)stream;
+
+	git_buf_free(&s->buffered);
+	git_buf_free(&s->converted);
+	git__free(s);
+}
+
+static int crlf_stream(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
+{
+	struct crlf_stream *s;
+	crlf_stream_state state;
+	int error;
+
 	/* initialize payload in case `check` was bypassed */
 	if (!*payload) {
-		int error = crlf_check(self, payload, src, NULL);
+		error = crlf_check(self, payload, src, NULL);
 		if (error < 0 && error != GIT_PASSTHROUGH)
 			return error;
 	}
 
-	if (git_filter_source_mode(src) == GIT_FILTER_SMUDGE)
-		return crlf_apply_to_workdir(*payload, to, from);
-	else
-		return crlf_apply_to_odb(*payload, to, from, src);
+	if ((error = crlf_stream_state_for(
+			&state, *payload, git_filter_source_mode(src))) < 0)
+		return error;
+
+	s = git__calloc(1, sizeof(struct crlf_stream));
+	GITERR_CHECK_ALLOC(s);
+
+	s->parent.write = crlf_stream_write;
+	s->parent.close = crlf_stream_close;
+	s->parent.free = crlf_stream_free;
+	s->next = next;
+	s->ca = *payload;
+	s->src = src;
+	s->mode = git_filter_source_mode(src);
+	s->state = state;
+
+	*out = (git_writestream *)s;
+	return 0;
 }
 
 static void crlf_cleanup(
@@ -375,7 +595,7 @@ git_filter *git_crlf_filter_new(void)
 	f->f.initialize = NULL;
 	f->f.shutdown = git_filter_free;
 	f->f.check    = crlf_check;
-	f->f.apply    = crlf_apply;
+	f->f.stream   = crlf_stream;
 	f->f.cleanup  = crlf_cleanup;
 
 	return (git_filter *)f;
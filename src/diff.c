@@ -95,7 +95,8 @@ static bool diff_pathspec_match(
 	}
 
 	return git_pathspec__match(
-		&diff->pathspec, entry->path, disable_pathspec_match,
+		&diff->pathspec, diff->pathspec_trie, entry->path,
+		disable_pathspec_match,
 		DIFF_FLAG_IS_SET(diff, GIT_DIFF_IGNORE_CASE),
 		matched_pathspec, NULL);
 }
@@ -463,7 +464,8 @@ static int diff_list_apply_options(
 		DIFF_FLAG_SET(diff, GIT_DIFF_IGNORE_CASE, icase);
 
 		/* initialize pathspec from options */
-		if (git_pathspec__vinit(&diff->pathspec, &opts->pathspec, pool) < 0)
+		if (git_pathspec__vinit(&diff->pathspec, &opts->pathspec, pool) < 0 ||
+			git_pathspec__trie_new(&diff->pathspec_trie, &diff->pathspec) < 0)
 			return -1;
 	}
 
@@ -567,6 +569,7 @@ static void diff_list_free(git_diff *diff)
 	git_vector_free_deep(&diff->deltas);
 
 	git_pathspec__vfree(&diff->pathspec);
+	git_pathspec__trie_free(diff->pathspec_trie);
 	git_pool_clear(&diff->pool);
 
 	git__memzero(diff, sizeof(*diff));
@@ -1163,6 +1166,11 @@ static int handle_unmatched_old_item(
 	git_delta_t delta_type = GIT_DELTA_DELETED;
 	int error;
 
+	/* skip-worktree entries are not expected in the working directory */
+	if ((info->oitem->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0 &&
+		info->new_iter->type == GIT_ITERATOR_TYPE_WORKDIR)
+		return iterator_advance(&info->oitem, info->old_iter);
+
 	/* update delta_type if this item is conflicted */
 	if (git_index_entry_is_conflict(info->oitem))
 		delta_type = GIT_DELTA_CONFLICTED;
@@ -1195,6 +1203,35 @@ static int handle_unmatched_old_item(
 	return iterator_advance(&info->oitem, info->old_iter);
 }
 
+/* When neither iterator expands trees on its own, a tree that has the
+ * same id on both sides can be stepped over without reading it.  Any
+ * other tree is descended into so that its contents are compared.
+ */
+static int handle_tree_items(diff_in_progress *info, int cmp)
+{
+	bool old_is_tree = info->oitem && info->oitem->mode == GIT_FILEMODE_TREE;
+	bool new_is_tree = info->nitem && info->nitem->mode == GIT_FILEMODE_TREE;
+	int error;
+
+	if (cmp == 0 && old_is_tree && new_is_tree) {
+		if (!git_oid_iszero(&info->oitem->id) &&
+			git_oid_equal(&info->oitem->id, &info->nitem->id)) {
+			if (!(error = iterator_advance(&info->oitem, info->old_iter)))
+				error = iterator_advance(&info->nitem, info->new_iter);
+		} else {
+			if (!(error = iterator_advance_into(&info->oitem, info->old_iter)))
+				error = iterator_advance_into(&info->nitem, info->new_iter);
+		}
+
+		return error;
+	}
+
+	if (old_is_tree)
+		return iterator_advance_into(&info->oitem, info->old_iter);
+
+	return iterator_advance_into(&info->nitem, info->new_iter);
+}
+
 static int handle_matched_item(
 	git_diff *diff, diff_in_progress *info)
 {
@@ -1219,6 +1256,7 @@ int git_diff__from_iterators(
 	int error = 0;
 	diff_in_progress info;
 	git_diff *diff;
+	bool skip_trees;
 
 	*diff_ptr = NULL;
 
@@ -1244,6 +1282,12 @@ int git_diff__from_iterators(
 		(error = iterator_current(&info.nitem, new_iter)) < 0)
 		goto cleanup;
 
+	skip_trees =
+		(old_iter->flags & GIT_ITERATOR_DONT_AUTOEXPAND) != 0 &&
+		(new_iter->flags & GIT_ITERATOR_DONT_AUTOEXPAND) != 0 &&
+		old_iter->type != GIT_ITERATOR_TYPE_WORKDIR &&
+		new_iter->type != GIT_ITERATOR_TYPE_WORKDIR;
+
 	/* run iterators building diffs */
 	while (!error && (info.oitem || info.nitem)) {
 		int cmp;
@@ -1260,8 +1304,19 @@ int git_diff__from_iterators(
 		cmp = info.oitem ?
 			(info.nitem ? diff->entrycomp(info.oitem, info.nitem) : -1) : 1;
 
+		/* skip or expand trees when the iterators hand them out */
+		if (skip_trees &&
+			((info.oitem && info.oitem->mode == GIT_FILEMODE_TREE) ||
+			 (info.nitem && info.nitem->mode == GIT_FILEMODE_TREE)))
+			error = handle_tree_items(&info, cmp);
+
+		/* a sparse directory that is in the working directory after all
+		 * is compared entry by entry */
+		else if (cmp == 0 && git_index_entry__is_sparse_dir(info.oitem))
+			error = iterator_advance_into(&info.oitem, old_iter);
+
 		/* create DELETED records for old items not matched in new */
-		if (cmp < 0)
+		else if (cmp < 0)
 			error = handle_unmatched_old_item(diff, &info);
 
 		/* create ADDED, TRACKED, or IGNORED records for new items not
@@ -1278,6 +1333,8 @@ int git_diff__from_iterators(
 	}
 
 	diff->perf.stat_calls += old_iter->stat_calls + new_iter->stat_calls;
+	diff->perf.stat_calls_avoided +=
+		old_iter->stat_calls_avoided + new_iter->stat_calls_avoided;
 
 cleanup:
 	if (!error)
@@ -1290,28 +1347,39 @@ cleanup:
 
 #define DIFF_FROM_ITERATORS(MAKE_FIRST, FLAGS_FIRST, MAKE_SECOND, FLAGS_SECOND) do { \
 	git_iterator *a = NULL, *b = NULL; \
-	char *pfx = (opts && !(opts->flags & GIT_DIFF_DISABLE_PATHSPEC_MATCH)) ? \
-		git_pathspec_prefix(&opts->pathspec) : NULL; \
+	git_pathspec ps; \
 	git_iterator_options a_opts = GIT_ITERATOR_OPTIONS_INIT, \
 		b_opts = GIT_ITERATOR_OPTIONS_INIT; \
-	a_opts.flags = FLAGS_FIRST; \
-	a_opts.start = pfx; \
-	a_opts.end = pfx; \
-	b_opts.flags = FLAGS_SECOND; \
-	b_opts.start = pfx; \
-	b_opts.end = pfx; \
+	memset(&ps, 0, sizeof(ps)); \
 	GITERR_CHECK_VERSION(opts, GIT_DIFF_OPTIONS_VERSION, "git_diff_options"); \
 	if (opts && (opts->flags & GIT_DIFF_DISABLE_PATHSPEC_MATCH)) { \
 		a_opts.pathlist.strings = opts->pathspec.strings; \
 		a_opts.pathlist.count = opts->pathspec.count; \
 		b_opts.pathlist.strings = opts->pathspec.strings; \
 		b_opts.pathlist.count = opts->pathspec.count; \
-	} \
+	} else if (opts && !error) \
+		error = git_pathspec__init(&ps, &opts->pathspec); \
+	a_opts.flags = FLAGS_FIRST; \
+	a_opts.start = ps.prefix; \
+	a_opts.end = ps.prefix; \
+	a_opts.pathspec_trie = ps.trie; \
+	b_opts.flags = FLAGS_SECOND; \
+	b_opts.start = ps.prefix; \
+	b_opts.end = ps.prefix; \
+	b_opts.pathspec_trie = ps.trie; \
 	if (!error && !(error = MAKE_FIRST) && !(error = MAKE_SECOND)) \
 		error = git_diff__from_iterators(diff, repo, a, b, opts); \
-	git__free(pfx); git_iterator_free(a); git_iterator_free(b); \
+	git_iterator_free(a); git_iterator_free(b); git_pathspec__clear(&ps); \
 } while (0)
 
+/* Identical subtrees can only be skipped when the caller is not asking
+ * for a record of every unmodified file.
+ */
+static bool diff_can_skip_trees(const git_diff_options *opts)
+{
+	return !opts || (opts->flags & GIT_DIFF_INCLUDE_UNMODIFIED) == 0;
+}
+
 int git_diff_tree_to_tree(
 	git_diff **diff,
 	git_repository *repo,
@@ -1331,6 +1399,9 @@ int git_diff_tree_to_tree(
 	if (opts && (opts->flags & GIT_DIFF_IGNORE_CASE) != 0)
 		iflag = GIT_ITERATOR_IGNORE_CASE;
 
+	if (diff_can_skip_trees(opts))
+		iflag |= GIT_ITERATOR_DONT_AUTOEXPAND;
+
 	DIFF_FROM_ITERATORS(
 		git_iterator_for_tree(&a, old_tree, &a_opts), iflag,
 		git_iterator_for_tree(&b, new_tree, &b_opts), iflag
@@ -1369,6 +1440,11 @@ int git_diff_tree_to_index(
 
 	index_ignore_case = index->ignore_case;
 
+	/* sparse directories are stepped over like unchanged trees */
+	if (diff_can_skip_trees(opts))
+		iflag |= GIT_ITERATOR_DONT_AUTOEXPAND |
+			GIT_ITERATOR_INCLUDE_SPARSE_DIRS;
+
 	DIFF_FROM_ITERATORS(
 		git_iterator_for_tree(&a, old_tree, &a_opts), iflag,
 		git_iterator_for_index(&b, index, &b_opts), iflag
@@ -1387,19 +1463,28 @@ int git_diff_index_to_workdir(
 	git_index *index,
 	const git_diff_options *opts)
 {
-	int error = 0;
+	int error = 0, preload = 0;
+	bool ignored_wanted = opts && (opts->flags & GIT_DIFF_INCLUDE_IGNORED);
 
 	assert(diff && repo);
 
 	if (!index && (error = diff_load_index(&index, repo)) < 0)
 		return error;
 
+	if (git_repository__cvar(&preload, repo, GIT_CVAR_PRELOADINDEX) < 0)
+		giterr_clear();
+
+	/* sparse directories of the index are passed over as a whole, and
+	 * untracked, ignored files without looking at their stat data unless
+	 * they are to be listed */
 	DIFF_FROM_ITERATORS(
 		git_iterator_for_index(&a, index, &a_opts),
-		GIT_ITERATOR_INCLUDE_CONFLICTS,
+		GIT_ITERATOR_INCLUDE_CONFLICTS | GIT_ITERATOR_INCLUDE_SPARSE_DIRS,
 
 		git_iterator_for_workdir(&b, repo, index, NULL, &b_opts),
-		GIT_ITERATOR_DONT_AUTOEXPAND
+		GIT_ITERATOR_DONT_AUTOEXPAND |
+			(preload ? GIT_ITERATOR_PRELOAD_INDEX : 0) |
+			(ignored_wanted ? 0 : GIT_ITERATOR_SKIP_IGNORED_STAT)
 	);
 
 	if (!error && DIFF_FLAG_IS_SET(*diff, GIT_DIFF_UPDATE_INDEX) && (*diff)->index_updated)
@@ -1520,6 +1605,11 @@ int git_diff_get_perfdata(git_diff_perfdata *out, const git_diff *diff)
 	GITERR_CHECK_VERSION(out, GIT_DIFF_PERFDATA_VERSION, "git_diff_perfdata");
 	out->stat_calls = diff->perf.stat_calls;
 	out->oid_calculations = diff->perf.oid_calculations;
+
+	/* version 1 callers have no room for this */
+	if (out->version >= 2)
+		out->stat_calls_avoided = diff->perf.stat_calls_avoided;
+
 	return 0;
 }
 
@@ -18,6 +18,7 @@
 #include "repository.h"
 #include "pool.h"
 #include "odb.h"
+#include "pathspec.h"
 
 #define DIFF_OLD_PREFIX_DEFAULT "a/"
 #define DIFF_NEW_PREFIX_DEFAULT "b/"
@@ -57,6 +58,7 @@ struct git_diff {
 	git_repository   *repo;
 	git_diff_options opts;
 	git_vector       pathspec;
+	git_pathspec_trie *pathspec_trie;
 	git_vector       deltas;    /* vector of git_diff_delta */
 	git_pool pool;
 	git_iterator_type_t old_src;
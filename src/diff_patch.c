@@ -14,6 +14,7 @@
 #include "delta.h"
 #include "zstream.h"
 #include "fileops.h"
+#include "thread-utils.h"
 
 static void diff_output_init(
 	git_diff_output*, const git_diff_options*, git_diff_file_cb,
@@ -30,8 +31,10 @@ static void diff_patch_update_binary(git_patch *patch)
 		(patch->nfile.file->flags & GIT_DIFF_FLAG_BINARY) != 0)
 		patch->delta->flags |= GIT_DIFF_FLAG_BINARY;
 
-	else if (patch->ofile.file->size > GIT_XDIFF_MAX_SIZE ||
-			 patch->nfile.file->size > GIT_XDIFF_MAX_SIZE)
+	else if ((patch->ofile.file->size > GIT_XDIFF_MAX_SIZE ||
+			  patch->nfile.file->size > GIT_XDIFF_MAX_SIZE) &&
+			 !git_xdiff__windowed(patch->ofile.repo ?
+				patch->ofile.repo : patch->nfile.repo))
 		patch->delta->flags |= GIT_DIFF_FLAG_BINARY;
 
 	else if ((patch->ofile.file->flags & DIFF_FLAGS_NOT_BINARY) != 0 &&
@@ -75,14 +78,14 @@ static int diff_patch_normalize_options(
 	return 0;
 }
 
-static int diff_patch_init_from_diff(
-	git_patch *patch, git_diff *diff, size_t delta_index)
+static int diff_patch_init_from_delta(
+	git_patch *patch, git_diff *diff, git_diff_delta *delta, size_t delta_index)
 {
 	int error = 0;
 
 	memset(patch, 0, sizeof(*patch));
 	patch->diff  = diff;
-	patch->delta = git_vector_get(&diff->deltas, delta_index);
+	patch->delta = delta;
 	patch->delta_index = delta_index;
 
 	if ((error = diff_patch_normalize_options(
@@ -98,6 +101,13 @@ static int diff_patch_init_from_diff(
 	return 0;
 }
 
+static int diff_patch_init_from_diff(
+	git_patch *patch, git_diff *diff, size_t delta_index)
+{
+	return diff_patch_init_from_delta(patch, diff,
+		git_vector_get(&diff->deltas, delta_index), delta_index);
+}
+
 static int diff_patch_alloc_from_diff(
 	git_patch **out, git_diff *diff, size_t delta_index)
 {
@@ -401,6 +411,211 @@ static int diff_required(git_diff *diff, const char *action)
 	return -1;
 }
 
+#define PATCH_WINDOW 128
+#define PATCH_MAX_THREADS 8
+#define PATCH_NOT_GENERATED 1
+
+typedef struct {
+	git_patch *patches;
+	git_diff_delta *deltas;
+	int *results;
+	git_diff_output *output;
+} diff_patch_window;
+
+static int diff_patch_generate_window(size_t start, size_t end, void *payload)
+{
+	diff_patch_window *window = payload;
+	git_xdiff_output xo;
+	git_patch *patch;
+	size_t i;
+	int error = 0;
+
+	for (i = start; i < end && !error; ++i) {
+		patch = &window->patches[i];
+
+		if (!patch->delta)
+			continue;
+
+		/* record the hunks and lines in the patch, but only the ones
+		 * the caller is going to be told about
+		 */
+		memset(&xo, 0, sizeof(xo));
+		diff_output_to_patch(&xo.output, patch);
+		git_xdiff_init(&xo, &patch->diff_opts);
+
+		if (!window->output->binary_cb)
+			xo.output.binary_cb = NULL;
+
+		if (!window->output->hunk_cb && !window->output->data_cb) {
+			xo.output.hunk_cb = NULL;
+			xo.output.data_cb = NULL;
+		}
+
+		if (!(error = diff_patch_load(patch, &xo.output)))
+			error = diff_patch_generate(patch, &xo.output);
+
+		window->results[i] = error;
+	}
+
+	return error;
+}
+
+/* Hand the delta a window patch worked on back to the diff, so that the
+ * diff changes in the order it would without threads.
+ */
+static void diff_patch_adopt_delta(git_patch *patch, git_diff_delta *delta)
+{
+	memcpy(delta, patch->delta, sizeof(git_diff_delta));
+
+	patch->delta = delta;
+	patch->ofile.file = &delta->old_file;
+	patch->nfile.file = &delta->new_file;
+}
+
+static int diff_patch_replay(
+	git_patch *patch, int result, git_diff_output *output)
+{
+	size_t i, j;
+	int error;
+
+	/* without threads, content that fails to load is reported before
+	 * the file callback, and a failed diff after it
+	 */
+	if (result < 0 && (patch->flags & GIT_DIFF_PATCH_LOADED) == 0)
+		return result;
+
+	if ((error = diff_patch_invoke_file_callback(patch, output)) != 0)
+		return error;
+
+	if (result < 0 || (patch->flags & GIT_DIFF_PATCH_DIFFED) == 0)
+		return result;
+
+	if ((patch->delta->flags & GIT_DIFF_FLAG_BINARY) != 0) {
+		if (output->binary_cb)
+			error = giterr_set_after_callback_function(
+				output->binary_cb(patch->delta, &patch->binary, output->payload),
+				"git_patch");
+
+		return error;
+	}
+
+	for (i = 0; i < git_array_size(patch->hunks); ++i) {
+		diff_patch_hunk *h = git_array_get(patch->hunks, i);
+
+		if (output->hunk_cb &&
+			(error = output->hunk_cb(patch->delta, &h->hunk, output->payload)))
+			return error;
+
+		for (j = 0; output->data_cb && j < h->line_count; ++j) {
+			git_diff_line *l = git_array_get(patch->lines, h->line_start + j);
+
+			if ((error = output->data_cb(
+					patch->delta, &h->hunk, l, output->payload)))
+				return error;
+		}
+	}
+
+	return 0;
+}
+
+/* Patches are generated a window at a time: they are set up on this
+ * thread (driver and attribute lookups share caches), loaded and diffed
+ * on the worker threads, and then handed to the callbacks in order.
+ * They work on copies of their deltas, which only replace the diff's
+ * own as each patch is handed out, so callbacks see the same diff they
+ * would without threads.
+ */
+static int diff_foreach_parallel(git_diff *diff, git_diff_output *output)
+{
+	diff_patch_window window;
+	git_diff_delta *delta;
+	size_t deltas = git_vector_length(&diff->deltas), start, i, count;
+	int nthreads, generate_error, error = 0;
+
+	nthreads = min(git_online_cpus(), PATCH_MAX_THREADS);
+
+	window.output = output;
+	window.patches = git__calloc(min(deltas, PATCH_WINDOW), sizeof(git_patch));
+	window.deltas = git__calloc(min(deltas, PATCH_WINDOW), sizeof(git_diff_delta));
+	window.results = git__calloc(min(deltas, PATCH_WINDOW), sizeof(int));
+
+	if (!window.patches || !window.deltas || !window.results) {
+		giterr_set_oom();
+		error = -1;
+		goto done;
+	}
+
+	for (start = 0; start < deltas && !error; start += count) {
+		count = min(deltas - start, PATCH_WINDOW);
+
+		for (i = 0; i < count; ++i) {
+			memset(&window.patches[i], 0, sizeof(git_patch));
+			window.results[i] = 0;
+
+			delta = git_vector_get(&diff->deltas, start + i);
+
+			if (git_diff_delta__should_skip(&diff->opts, delta))
+				continue;
+
+			memcpy(&window.deltas[i], delta, sizeof(git_diff_delta));
+
+			if ((window.results[i] = diff_patch_init_from_delta(
+					&window.patches[i], diff, &window.deltas[i], start + i)) < 0) {
+				/* deliver everything before the failure, then stop */
+				memset(&window.patches[i], 0, sizeof(git_patch));
+				count = i + 1;
+				break;
+			}
+
+			window.results[i] = PATCH_NOT_GENERATED;
+		}
+
+		generate_error = git_parallel_foreach(
+			count, 1, nthreads, diff_patch_generate_window, &window);
+
+		for (i = 0; i < count && !error; ++i) {
+			if (window.results[i] == PATCH_NOT_GENERATED) {
+				error = generate_error;
+			} else if (!window.patches[i].delta) {
+				error = window.results[i];
+			} else {
+				diff_patch_adopt_delta(&window.patches[i],
+					git_vector_get(&diff->deltas, start + i));
+				error = diff_patch_replay(
+					&window.patches[i], window.results[i], output);
+			}
+		}
+
+		for (i = 0; i < count; ++i) {
+			if (window.patches[i].delta)
+				git_patch_free(&window.patches[i]);
+		}
+	}
+
+done:
+	git__free(window.patches);
+	git__free(window.deltas);
+	git__free(window.results);
+
+	return error;
+}
+
+static bool diff_foreach_in_parallel(git_diff *diff, git_diff_output *output)
+{
+	if ((diff->opts.flags & GIT_DIFF_PARALLEL_PATCHES) == 0)
+		return false;
+
+	/* without content there is nothing worth doing in parallel */
+	if (!output->binary_cb && !output->hunk_cb && !output->data_cb)
+		return false;
+
+	/* working directory content may need to go through filters, which
+	 * cannot be loaded from several threads at once
+	 */
+	return (diff->old_src != GIT_ITERATOR_TYPE_WORKDIR &&
+		diff->new_src != GIT_ITERATOR_TYPE_WORKDIR);
+}
+
 int git_diff_foreach(
 	git_diff *diff,
 	git_diff_file_cb file_cb,
@@ -423,6 +638,9 @@ int git_diff_foreach(
 		&xo.output, &diff->opts, file_cb, binary_cb, hunk_cb, data_cb, payload);
 	git_xdiff_init(&xo, &diff->opts);
 
+	if (diff_foreach_in_parallel(diff, &xo.output))
+		return diff_foreach_parallel(diff, &xo.output);
+
 	git_vector_foreach(&diff->deltas, idx, patch.delta) {
 
 		/* check flags against patch status */
@@ -785,6 +1003,45 @@ int git_patch_from_diff(
 	return error;
 }
 
+int git_patch__line_stats_init(
+	git_patch *patch, git_diff *diff, size_t delta_index)
+{
+	int error;
+
+	if ((error = diff_patch_init_from_diff(patch, diff, delta_index)) < 0) {
+		git__free((char *)patch->diff_opts.old_prefix);
+		git__free((char *)patch->diff_opts.new_prefix);
+		memset(patch, 0, sizeof(*patch));
+	}
+
+	return error;
+}
+
+int git_patch__line_stats(size_t *adds, size_t *dels, git_patch *patch)
+{
+	git_xdiff_output xo;
+	git_xdiff_line_counts counts = { 0 };
+	int error;
+
+	memset(&xo, 0, sizeof(xo));
+	git_xdiff_init_counting(&xo, &patch->diff_opts, &counts);
+
+	/* binary files count as no lines, as in git_patch_line_stats */
+	if (!(error = diff_patch_load(patch, NULL)) &&
+		(patch->flags & GIT_DIFF_PATCH_DIFFABLE) != 0 &&
+		(patch->delta->flags & GIT_DIFF_FLAG_BINARY) == 0)
+		error = xo.output.diff_cb(&xo.output, patch);
+
+	/* only the counts are kept, so let go of the content right away */
+	git_diff_file_content__unload(&patch->ofile);
+	git_diff_file_content__unload(&patch->nfile);
+
+	*adds = counts.adds;
+	*dels = counts.dels;
+
+	return error;
+}
+
 void git_patch_free(git_patch *patch)
 {
 	if (patch)
@@ -62,6 +62,18 @@ extern int git_patch__invoke_callbacks(
 	git_diff_line_cb line_cb,
 	void *payload);
 
+/* Count the lines a delta adds and removes without building hunk and
+ * line records.  `git_patch__line_stats_init` sets up a caller-owned
+ * (usually stack or array) patch and must be called on one thread at a
+ * time, as it does driver and attribute lookups; release the patch with
+ * `git_patch_free`.  For deltas whose content does not come from the
+ * working directory, `git_patch__line_stats` may then run on any thread.
+ */
+extern int git_patch__line_stats_init(
+	git_patch *patch, git_diff *diff, size_t delta_index);
+extern int git_patch__line_stats(
+	size_t *adds, size_t *dels, git_patch *patch);
+
 typedef struct git_diff_output git_diff_output;
 struct git_diff_output {
 	/* these callbacks are issued with the diff data */
@@ -8,10 +8,16 @@
 #include "vector.h"
 #include "diff.h"
 #include "diff_patch.h"
+#include "thread-utils.h"
 
 #define DIFF_RENAME_FILE_SEPARATOR " => "
 #define STATS_FULL_MIN_SCALE 7
 
+#define STATS_WINDOW 256
+#define STATS_BATCH_SIZE 4
+#define STATS_MAX_THREADS 8
+#define STATS_DELTAS_PER_THREAD 16
+
 typedef struct {
 	size_t insertions;
 	size_t deletions;
@@ -156,6 +162,86 @@ int git_diff_file_stats__summary_to_buf(
 	return 0;
 }
 
+typedef struct {
+	git_patch *patches;
+	diff_file_stats *filestats;
+} diff_stats_window;
+
+static int diff_stats_count_lines(size_t start, size_t end, void *payload)
+{
+	diff_stats_window *window = payload;
+	diff_file_stats *filestat;
+	size_t i;
+	int error = 0;
+
+	for (i = start; i < end && !error; ++i) {
+		/* skipped by the diff options */
+		if (!window->patches[i].delta)
+			continue;
+
+		filestat = &window->filestats[i];
+		error = git_patch__line_stats(
+			&filestat->insertions, &filestat->deletions, &window->patches[i]);
+	}
+
+	return error;
+}
+
+static int diff_stats_count_all(git_diff_stats *stats, git_diff *diff)
+{
+	diff_stats_window window;
+	git_patch *patches;
+	git_diff_delta *delta;
+	size_t deltas = git_diff_num_deltas(diff), start, end, i;
+	bool parallel;
+	int nthreads = 1, error = 0;
+
+	/* working directory content may need to go through filters, which
+	 * cannot be loaded from several threads at once
+	 */
+	parallel = diff->old_src != GIT_ITERATOR_TYPE_WORKDIR &&
+		diff->new_src != GIT_ITERATOR_TYPE_WORKDIR;
+
+	if (!deltas)
+		return 0;
+
+	patches = git__calloc(min(deltas, STATS_WINDOW), sizeof(git_patch));
+	GITERR_CHECK_ALLOC(patches);
+
+	window.patches = patches;
+
+	for (start = 0; start < deltas && !error; start = end) {
+		end = min(start + STATS_WINDOW, deltas);
+
+		/* driver and attribute lookups share caches, so do them here */
+		for (i = start; i < end; ++i) {
+			memset(&patches[i - start], 0, sizeof(git_patch));
+			delta = git_vector_get(&diff->deltas, i);
+
+			if (!error && !git_diff_delta__should_skip(&diff->opts, delta))
+				error = git_patch__line_stats_init(&patches[i - start], diff, i);
+		}
+
+		if (parallel)
+			nthreads = (int)min((end - start) / STATS_DELTAS_PER_THREAD,
+				STATS_MAX_THREADS);
+
+		window.filestats = stats->filestats + start;
+
+		if (!error)
+			error = git_parallel_foreach(end - start, STATS_BATCH_SIZE,
+				nthreads, diff_stats_count_lines, &window);
+
+		for (i = start; i < end; ++i) {
+			if (patches[i - start].delta)
+				git_patch_free(&patches[i - start]);
+		}
+	}
+
+	git__free(patches);
+	return error;
+}
+
 int git_diff_get_stats(
 	git_diff_stats **out,
 	git_diff *diff)
@@ -181,31 +267,21 @@ int git_diff_get_stats(
 	stats->diff = diff;
 	GIT_REFCOUNT_INC(diff);
 
-	for (i = 0; i < deltas && !error; ++i) {
-		git_patch *patch = NULL;
-		size_t add = 0, remove = 0, namelen;
-		const git_diff_delta *delta;
+	/* only the line counts are needed, so no patches are built */
+	error = diff_stats_count_all(stats, diff);
 
-		if ((error = git_patch_from_diff(&patch, diff, i)) < 0)
-			break;
+	for (i = 0; i < deltas && !error; ++i) {
+		const git_diff_delta *delta = git_diff_get_delta(diff, i);
+		size_t add = stats->filestats[i].insertions,
+			remove = stats->filestats[i].deletions, namelen;
 
 		/* keep a count of renames because it will affect formatting */
-		delta = git_patch_get_delta(patch);
-
 		namelen = strlen(delta->new_file.path);
 		if (strcmp(delta->old_file.path, delta->new_file.path) != 0) {
 			namelen += strlen(delta->old_file.path);
 			stats->renames++;
 		}
 
-		/* and, of course, count the line stats */
-		error = git_patch_line_stats(NULL, &add, &remove, patch);
-
-		git_patch_free(patch);
-
-		stats->filestats[i].insertions = add;
-		stats->filestats[i].deletions = remove;
-
 		total_insertions += add;
 		total_deletions += remove;
 
@@ -8,9 +8,10 @@
 
 #include "git2/config.h"
 #include "git2/blob.h"
-#include "git2/sys/hashsig.h"
 
 #include "diff.h"
+#include "hashsig.h"
+#include "hashsig_cache.h"
 #include "path.h"
 #include "fileops.h"
 #include "config.h"
@@ -481,6 +482,14 @@ static int similarity_sig(
 			&cache[info->idx], info->file,
 			info->data.ptr, opts->metric->payload);
 	} else {
+		error = git_hashsig_cache__lookup(
+			&cache[info->idx], info->repo, opts->metric, &file->id);
+
+		if (error != GIT_ENOTFOUND)
+			return error;
+
+		error = 0;
+
 		/* if we didn't initially know the size, we might have an odb_obj
 		 * around from earlier, so convert that, otherwise load the blob now
 		 */
@@ -506,6 +515,10 @@ static int similarity_sig(
 			error = opts->metric->buffer_signature(
 				&cache[info->idx], info->file,
 				git_blob_rawcontent(info->blob), sz, opts->metric->payload);
+
+			if (!error && cache[info->idx])
+				error = git_hashsig_cache__insert(info->repo,
+					opts->metric, &file->id, cache[info->idx]);
 		}
 	}
 
@@ -523,6 +536,40 @@ static void similarity_unload(similarity_info *info)
 		git_buf_free(&info->data);
 }
 
+static void similarity_load_id(git_diff *diff, size_t file_idx)
+{
+	git_diff_file *file = similarity_get_file(diff, file_idx);
+	git_iterator_type_t src = (file_idx & 1) ? diff->new_src : diff->old_src;
+
+	if (git_oid_iszero(&file->id) &&
+		src == GIT_ITERATOR_TYPE_WORKDIR &&
+		!git_diff__oid_for_file(
+			&file->id, diff, file->path, file->mode, file->size))
+		file->flags |= GIT_DIFF_FLAG_VALID_ID;
+}
+
+static int similarity_load_sig(
+	git_diff *diff,
+	const git_diff_find_options *opts,
+	void **cache,
+	size_t file_idx)
+{
+	similarity_info info;
+	int error;
+
+	if (cache[file_idx])
+		return 0;
+
+	memset(&info, 0, sizeof(info));
+
+	if (!(error = similarity_init(&info, diff, file_idx)))
+		error = similarity_sig(&info, opts, cache);
+
+	similarity_unload(&info);
+
+	return error;
+}
+
 #define FLAG_SET(opts,flag_name) (((opts)->flags & flag_name) != 0)
 
 /* - score < 0 means files cannot be compared
@@ -551,17 +598,8 @@ static int similarity_measure(
 
 	/* if exact match is requested, force calculation of missing OIDs now */
 	if (exact_match) {
-		if (git_oid_iszero(&a_file->id) &&
-			diff->old_src == GIT_ITERATOR_TYPE_WORKDIR &&
-			!git_diff__oid_for_file(&a_file->id,
-				diff, a_file->path, a_file->mode, a_file->size))
-			a_file->flags |= GIT_DIFF_FLAG_VALID_ID;
-
-		if (git_oid_iszero(&b_file->id) &&
-			diff->new_src == GIT_ITERATOR_TYPE_WORKDIR &&
-			!git_diff__oid_for_file(&b_file->id,
-				diff, b_file->path, b_file->mode, b_file->size))
-			b_file->flags |= GIT_DIFF_FLAG_VALID_ID;
+		similarity_load_id(diff, a_idx);
+		similarity_load_id(diff, b_idx);
 	}
 
 	/* check OID match as a quick test */
@@ -785,13 +823,298 @@ typedef struct {
 	uint16_t similarity;
 } diff_find_match;
 
+static void diff_find_match_update(
+	diff_find_match *tgt2src,
+	diff_find_match *src2tgt,
+	diff_find_match *tgt2src_copy,
+	size_t *num_bumped,
+	size_t s,
+	size_t t,
+	uint16_t similarity)
+{
+	/* is this a better rename? */
+	if (tgt2src[t].similarity < similarity &&
+		src2tgt[s].similarity < similarity)
+	{
+		/* eject old mapping */
+		if (src2tgt[s].similarity > 0) {
+			tgt2src[src2tgt[s].idx].similarity = 0;
+			(*num_bumped)++;
+		}
+		if (tgt2src[t].similarity > 0) {
+			src2tgt[tgt2src[t].idx].similarity = 0;
+			(*num_bumped)++;
+		}
+
+		/* write new mapping */
+		tgt2src[t].idx = s;
+		tgt2src[t].similarity = similarity;
+		src2tgt[s].idx = t;
+		src2tgt[s].similarity = similarity;
+	}
+
+	/* keep best absolute match for copies */
+	if (tgt2src_copy != NULL &&
+		tgt2src_copy[t].similarity < similarity)
+	{
+		tgt2src_copy[t].idx = s;
+		tgt2src_copy[t].similarity = similarity;
+	}
+}
+
+/* With many sources and targets, comparing every pair is too slow, so
+ * sources are indexed by id and by the smallest hashes of their
+ * similarity signatures, and each target is only compared against the
+ * sources that share one of these with it.  Hashes that are shared by
+ * too many sources (a common license header, say) are not used.
+ */
+#define FIND_CANDIDATES_MIN_PAIRS 10000
+#define FIND_CANDIDATE_HASHES 16
+#define FIND_CANDIDATE_MAX_BUCKET 32
+
+typedef struct {
+	uint32_t hash;
+	size_t src;
+} diff_find_hash;
+
+typedef struct {
+	git_diff *diff;
+	size_t limit;
+	size_t *by_id;
+	size_t by_id_len;
+	diff_find_hash *hashes;
+	size_t hashes_len;
+	size_t *seen;
+	size_t stamp;
+	git_array_t(size_t) found;
+} diff_find_candidates;
+
+static bool diff_find_candidates_usable(
+	const git_diff_find_options *opts, size_t num_srcs, size_t num_tgts)
+{
+	if (num_srcs * num_tgts < FIND_CANDIDATES_MIN_PAIRS)
+		return false;
+
+	/* only our own signatures can be indexed */
+	return FLAG_SET(opts, GIT_DIFF_FIND_EXACT_MATCH_ONLY) ||
+		opts->metric->similarity == git_diff_find_similar__calc_similarity;
+}
+
+static int diff_find_candidates_idx_cmp(const void *a, const void *b, void *p)
+{
+	size_t a_idx = *(const size_t *)a, b_idx = *(const size_t *)b;
+
+	GIT_UNUSED(p);
+	return (a_idx < b_idx) ? -1 : (a_idx > b_idx) ? 1 : 0;
+}
+
+static int diff_find_candidates_id_cmp(const void *a, const void *b, void *p)
+{
+	git_diff *diff = p;
+	git_diff_file *a_file = similarity_get_file(diff, 2 * *(const size_t *)a);
+	git_diff_file *b_file = similarity_get_file(diff, 2 * *(const size_t *)b);
+	int cmp = git_oid__cmp(&a_file->id, &b_file->id);
+
+	return cmp ? cmp : diff_find_candidates_idx_cmp(a, b, NULL);
+}
+
+static int diff_find_candidates_hash_cmp(const void *a, const void *b, void *p)
+{
+	const diff_find_hash *a_hash = a, *b_hash = b;
+
+	GIT_UNUSED(p);
+
+	if (a_hash->hash != b_hash->hash)
+		return (a_hash->hash < b_hash->hash) ? -1 : 1;
+
+	return diff_find_candidates_idx_cmp(&a_hash->src, &b_hash->src, NULL);
+}
+
+static void diff_find_candidates_free(diff_find_candidates *c)
+{
+	git__free(c->by_id);
+	git__free(c->hashes);
+	git__free(c->seen);
+	git_array_clear(c->found);
+}
+
+static int diff_find_candidates_init(
+	diff_find_candidates *c,
+	git_diff *diff,
+	const git_diff_find_options *opts,
+	void **cache,
+	size_t num_srcs)
+{
+	bool exact_match = FLAG_SET(opts, GIT_DIFF_FIND_EXACT_MATCH_ONLY);
+	uint32_t hashes[FIND_CANDIDATE_HASHES];
+	size_t s, i, count, alloc_len;
+	git_diff_delta *src;
+	int error;
+
+	c->diff = diff;
+	c->limit = opts->rename_limit;
+
+	c->by_id = git__calloc(num_srcs, sizeof(size_t));
+	GITERR_CHECK_ALLOC(c->by_id);
+	c->seen = git__calloc(diff->deltas.length, sizeof(size_t));
+	GITERR_CHECK_ALLOC(c->seen);
+
+	if (!exact_match) {
+		GITERR_CHECK_ALLOC_MULTIPLY(
+			&alloc_len, num_srcs, FIND_CANDIDATE_HASHES);
+		c->hashes = git__calloc(alloc_len, sizeof(diff_find_hash));
+		GITERR_CHECK_ALLOC(c->hashes);
+	}
+
+	git_vector_foreach(&diff->deltas, s, src) {
+		if ((src->flags & GIT_DIFF_FLAG__IS_RENAME_SOURCE) == 0)
+			continue;
+
+		if (exact_match)
+			similarity_load_id(diff, 2 * s);
+
+		c->by_id[c->by_id_len++] = s;
+
+		if (exact_match)
+			continue;
+
+		if ((error = similarity_load_sig(diff, opts, cache, 2 * s)) < 0)
+			return error;
+
+		if (!cache[2 * s])
+			continue;
+
+		count = git_hashsig__min_hashes(
+			hashes, FIND_CANDIDATE_HASHES, cache[2 * s]);
+
+		/* keep blank files together, they may still be similar */
+		if (!count)
+			hashes[count++] = 0;
+
+		for (i = 0; i < count; ++i) {
+			c->hashes[c->hashes_len].hash = hashes[i];
+			c->hashes[c->hashes_len].src = s;
+			c->hashes_len++;
+		}
+	}
+
+	git__qsort_r(c->by_id, c->by_id_len, sizeof(size_t),
+		diff_find_candidates_id_cmp, diff);
+	git__qsort_r(c->hashes, c->hashes_len, sizeof(diff_find_hash),
+		diff_find_candidates_hash_cmp, NULL);
+
+	return 0;
+}
+
+static int diff_find_candidates_add(
+	diff_find_candidates *c, size_t s, size_t t)
+{
+	size_t *found;
+
+	if (s == t || c->seen[s] == c->stamp ||
+		git_array_size(c->found) >= c->limit)
+		return 0;
+
+	c->seen[s] = c->stamp;
+
+	found = git_array_alloc(c->found);
+	GITERR_CHECK_ALLOC(found);
+	*found = s;
+
+	return 0;
+}
+
+/* Collect the sources worth comparing with target `t` in `c->found` */
+static int diff_find_candidates_for(
+	diff_find_candidates *c,
+	const git_diff_find_options *opts,
+	void **cache,
+	size_t t)
+{
+	git_diff_file *file = similarity_get_file(c->diff, 2 * t + 1);
+	git_diff_file *src_file;
+	uint32_t hashes[FIND_CANDIDATE_HASHES];
+	size_t lo, hi, mid, end, i, count;
+	int error;
+
+	git_array_clear(c->found);
+	c->stamp++;
+
+	if (FLAG_SET(opts, GIT_DIFF_FIND_EXACT_MATCH_ONLY))
+		similarity_load_id(c->diff, 2 * t + 1);
+
+	if (!git_oid_iszero(&file->id)) {
+		for (lo = 0, hi = c->by_id_len; lo < hi; ) {
+			mid = lo + (hi - lo) / 2;
+			src_file = similarity_get_file(c->diff, 2 * c->by_id[mid]);
+
+			if (git_oid__cmp(&src_file->id, &file->id) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (; lo < c->by_id_len; ++lo) {
+			src_file = similarity_get_file(c->diff, 2 * c->by_id[lo]);
+
+			if (git_oid__cmp(&src_file->id, &file->id) != 0)
+				break;
+			if ((error = diff_find_candidates_add(c, c->by_id[lo], t)) < 0)
+				return error;
+		}
+	}
+
+	if (!c->hashes)
+		goto done;
+
+	if ((error = similarity_load_sig(c->diff, opts, cache, 2 * t + 1)) < 0)
+		return error;
+
+	if (!cache[2 * t + 1])
+		goto done;
+
+	count = git_hashsig__min_hashes(
+		hashes, FIND_CANDIDATE_HASHES, cache[2 * t + 1]);
+
+	if (!count)
+		hashes[count++] = 0;
+
+	for (i = 0; i < count; ++i) {
+		for (lo = 0, hi = c->hashes_len; lo < hi; ) {
+			mid = lo + (hi - lo) / 2;
+
+			if (c->hashes[mid].hash < hashes[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (end = lo; end < c->hashes_len && c->hashes[end].hash == hashes[i]; )
+			++end;
+
+		if (end - lo > FIND_CANDIDATE_MAX_BUCKET)
+			continue;
+
+		for (; lo < end; ++lo) {
+			if ((error = diff_find_candidates_add(c, c->hashes[lo].src, t)) < 0)
+				return error;
+		}
+	}
+
+done:
+	/* compare in delta order, as the full scan would */
+	git__qsort_r(c->found.ptr, git_array_size(c->found), sizeof(size_t),
+		diff_find_candidates_idx_cmp, NULL);
+
+	return 0;
+}
+
 int git_diff_find_similar(
 	git_diff *diff,
 	const git_diff_find_options *given_opts)
 {
-	size_t s, t;
+	size_t s, t, i;
 	int error = 0, result;
-	uint16_t similarity;
 	git_diff_delta *src, *tgt;
 	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
 	size_t num_deltas, num_srcs = 0, num_tgts = 0;
@@ -803,8 +1126,11 @@ int git_diff_find_similar(
 	diff_find_match *src2tgt = NULL;
 	diff_find_match *tgt2src_copy = NULL;
 	diff_find_match *best_match;
+	diff_find_candidates candidates;
 	git_diff_file swap;
 
+	memset(&candidates, 0, sizeof(candidates));
+
 	if ((error = normalize_find_opts(diff, &opts, given_opts)) < 0)
 		return error;
 
@@ -852,6 +1178,11 @@ int git_diff_find_similar(
 		GITERR_CHECK_ALLOC(tgt2src_copy);
 	}
 
+	if (diff_find_candidates_usable(&opts, num_srcs, num_tgts) &&
+		(error = diff_find_candidates_init(
+			&candidates, diff, &opts, sigcache, num_srcs)) < 0)
+		goto cleanup;
+
 	/*
 	 * Find best-fit matches for rename / copy candidates
 	 */
@@ -864,6 +1195,29 @@ find_best_matches:
 		if ((tgt->flags & GIT_DIFF_FLAG__IS_RENAME_TARGET) == 0)
 			continue;
 
+		if (candidates.by_id != NULL) {
+			if ((error = diff_find_candidates_for(
+					&candidates, &opts, sigcache, t)) < 0)
+				goto cleanup;
+
+			for (i = 0; i < git_array_size(candidates.found); ++i) {
+				s = *git_array_get(candidates.found, i);
+
+				if ((error = similarity_measure(
+					&result, diff, &opts, sigcache, 2 * s, 2 * t + 1)) < 0)
+					goto cleanup;
+
+				if (result >= 0)
+					diff_find_match_update(tgt2src, src2tgt, tgt2src_copy,
+						&num_bumped, s, t, (uint16_t)result);
+			}
+
+			if (++tried_tgts >= num_tgts)
+				break;
+
+			continue;
+		}
+
 		tried_srcs = 0;
 
 		git_vector_foreach(&diff->deltas, s, src) {
@@ -880,36 +1234,9 @@ find_best_matches:
 
 			if (result < 0)
 				continue;
-			similarity = (uint16_t)result;
-
-			/* is this a better rename? */
-			if (tgt2src[t].similarity < similarity &&
-				src2tgt[s].similarity < similarity)
-			{
-				/* eject old mapping */
-				if (src2tgt[s].similarity > 0) {
-					tgt2src[src2tgt[s].idx].similarity = 0;
-					num_bumped++;
-				}
-				if (tgt2src[t].similarity > 0) {
-					src2tgt[tgt2src[t].idx].similarity = 0;
-					num_bumped++;
-				}
 
-				/* write new mapping */
-				tgt2src[t].idx = s;
-				tgt2src[t].similarity = similarity;
-				src2tgt[s].idx = t;
-				src2tgt[s].similarity = similarity;
-			}
-
-			/* keep best absolute match for copies */
-			if (tgt2src_copy != NULL &&
-				tgt2src_copy[t].similarity < similarity)
-			{
-				tgt2src_copy[t].idx = s;
-				tgt2src_copy[t].similarity = similarity;
-			}
+			diff_find_match_update(tgt2src, src2tgt, tgt2src_copy,
+				&num_bumped, s, t, (uint16_t)result);
 
 			if (++tried_srcs >= num_srcs)
 				break;
@@ -1086,6 +1413,11 @@ find_best_matches:
 			!FLAG_SET(&opts, GIT_DIFF_BREAK_REWRITES_FOR_RENAMES_ONLY));
 
 cleanup:
+	/* the signature cache is only a shortcut, don't fail the diff */
+	if (!error && git_hashsig_cache__flush(diff->repo) < 0)
+		giterr_clear();
+
+	diff_find_candidates_free(&candidates);
 	git__free(tgt2src);
 	git__free(src2tgt);
 	git__free(tgt2src_copy);
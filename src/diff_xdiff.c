@@ -10,6 +10,11 @@
 #include "diff_driver.h"
 #include "diff_patch.h"
 #include "diff_xdiff.h"
+#include "repository.h"
+#include "config.h"
+#include "oidmap.h"
+
+GIT__USE_OIDMAP
 
 static int git_xdiff_scan_int(const char **str, int *value)
 {
@@ -60,6 +65,7 @@ typedef struct {
 	git_diff_hunk hunk;
 	int old_lineno, new_lineno;
 	mmfile_t xd_old_data, xd_new_data;
+	long old_offset, new_offset; /* lines before the current window */
 } git_xdiff_info;
 
 static int diff_update_lines(
@@ -107,6 +113,37 @@ static int diff_update_lines(
 	return 0;
 }
 
+/* Hunks from a window of a file count lines from the start of the
+ * window; move them to where the window is in the file.
+ */
+static void git_xdiff_offset_hunk(
+	git_diff_hunk *hunk, long old_offset, long new_offset)
+{
+	const char *rest = strstr(hunk->header + 2, "@@");
+	char header[sizeof(hunk->header)];
+	char old_lines[16] = "", new_lines[16] = "";
+	int len;
+
+	hunk->old_start += (int)old_offset;
+	hunk->new_start += (int)new_offset;
+
+	if (hunk->old_lines != 1)
+		p_snprintf(old_lines, sizeof(old_lines), ",%d", hunk->old_lines);
+	if (hunk->new_lines != 1)
+		p_snprintf(new_lines, sizeof(new_lines), ",%d", hunk->new_lines);
+
+	len = p_snprintf(header, sizeof(header), "@@ -%d%s +%d%s %s",
+		hunk->old_start, old_lines, hunk->new_start, new_lines,
+		rest ? rest : "@@\n");
+
+	if (len < 0 || (size_t)len >= sizeof(header))
+		len = (int)sizeof(header) - 1;
+
+	memcpy(hunk->header, header, len);
+	hunk->header[len] = '\0';
+	hunk->header_len = len;
+}
+
 static int git_xdiff_cb(void *priv, mmbuffer_t *bufs, int len)
 {
 	git_xdiff_info *info = priv;
@@ -126,6 +163,9 @@ static int git_xdiff_cb(void *priv, mmbuffer_t *bufs, int len)
 		memcpy(info->hunk.header, bufs[0].ptr, info->hunk.header_len);
 		info->hunk.header[info->hunk.header_len] = '\0';
 
+		if (info->old_offset || info->new_offset)
+			git_xdiff_offset_hunk(&info->hunk, info->old_offset, info->new_offset);
+
 		if (output->hunk_cb != NULL &&
 			(output->error = output->hunk_cb(
 				delta, &info->hunk, output->payload)))
@@ -181,11 +221,369 @@ static int git_xdiff_cb(void *priv, mmbuffer_t *bufs, int len)
 	return output->error;
 }
 
+/* Only blobs from the object database are worth caching: workdir content
+ * may have been filtered and its id is often not known.
+ */
+static int git_xdiff_cached_lines(
+	const xdlines_t **out,
+	git_diff_file_content *fc,
+	mmfile_t *data,
+	unsigned long flags)
+{
+	git_xdiff_cache *cache;
+
+	*out = NULL;
+
+	if (!fc->repo || fc->src == GIT_ITERATOR_TYPE_WORKDIR ||
+		(fc->file->flags & GIT_DIFF_FLAG_VALID_ID) == 0 ||
+		(fc->flags & GIT_DIFF_FLAG__NO_DATA) != 0 || !data->size)
+		return 0;
+
+	if (git_xdiff_cache__for_repo(&cache, fc->repo) < 0)
+		return -1;
+
+	if (!cache)
+		return 0;
+
+	return git_xdiff_cache_lines(out, cache, &fc->file->id, data, flags);
+}
+
+/* Windowed diffs
+ *
+ * xdiff keeps a record of every line of both files, which for files of
+ * several gigabytes takes much more memory than their contents.  With
+ * `diff.windowSize` set, files larger than that are diffed a window of
+ * about that many bytes at a time.  Each window is first diffed without
+ * output to find an unchanged run of lines to cut it at, then the part
+ * before the cut is diffed again with output and the next window starts
+ * at the cut.  The result is a valid diff, though not always the same as
+ * the one xdiff would find for the whole files.
+ */
+
+/* How much of the rest of the file to search for a window's first line */
+#define GIT_XDIFF_RESYNC_WINDOWS 8
+
+typedef struct {
+	long old_start, old_lines, new_start, new_lines;
+} git_xdiff_window_hunk;
+
+typedef git_array_t(git_xdiff_window_hunk) git_xdiff_window_hunks;
+
+static int git_xdiff_window_hunk_cb(
+	long old_start, long old_lines, long new_start, long new_lines,
+	void *payload)
+{
+	git_xdiff_window_hunks *hunks = payload;
+	git_xdiff_window_hunk *hunk = git_array_alloc(*hunks);
+	GITERR_CHECK_ALLOC(hunk);
+
+	hunk->old_start = old_start;
+	hunk->old_lines = old_lines;
+	hunk->new_start = new_start;
+	hunk->new_lines = new_lines;
+
+	return 0;
+}
+
+/* Where a window starting at `start` ends: after the last complete line
+ * within `window` bytes, or after the first line if that is longer.
+ */
+static size_t git_xdiff_window_end(
+	const mmfile_t *data, size_t start, size_t window)
+{
+	const char *scan, *nl;
+
+	if ((size_t)data->size - start <= window)
+		return (size_t)data->size;
+
+	for (scan = data->ptr + start + window; scan > data->ptr + start; scan--) {
+		if (scan[-1] == '\n')
+			return (size_t)(scan - data->ptr);
+	}
+
+	nl = memchr(data->ptr + start + window, '\n',
+		(size_t)data->size - start - window);
+
+	return nl ? (size_t)(nl + 1 - data->ptr) : (size_t)data->size;
+}
+
+static long git_xdiff_window_lines(const mmfile_t *win)
+{
+	const char *scan = win->ptr, *end = win->ptr + win->size, *nl;
+	long lines = 0;
+
+	for (; scan < end; scan = nl ? nl + 1 : end, lines++)
+		nl = memchr(scan, '\n', (size_t)(end - scan));
+
+	return lines;
+}
+
+static size_t git_xdiff_window_bytes(const mmfile_t *win, long lines)
+{
+	const char *scan = win->ptr, *end = win->ptr + win->size, *nl;
+
+	for (; lines > 0 && scan < end; scan = nl ? nl + 1 : end, lines--)
+		nl = memchr(scan, '\n', (size_t)(end - scan));
+
+	return (size_t)(scan - win->ptr);
+}
+
+/* Find the last unchanged run in which the window can be cut, leaving
+ * enough context on either side of the cut for the hunks around it.
+ * Cuts in the last quarter of the window are avoided when possible,
+ * since what follows the window could change how its end is matched.
+ */
+static bool git_xdiff_window_cut(
+	long *cut_old, long *cut_new,
+	const git_xdiff_window_hunks *hunks,
+	long old_lines, long new_lines, long ctxlen, bool anywhere)
+{
+	long old_limit = anywhere ? old_lines : old_lines - old_lines / 4;
+	long new_limit = anywhere ? new_lines : new_lines - new_lines / 4;
+	long run_old = 0, run_new = 0, lo, hi;
+	bool found = false;
+	size_t i;
+
+	for (i = 0; i <= hunks->size; i++) {
+		const git_xdiff_window_hunk *hunk =
+			(i < hunks->size) ? &hunks->ptr[i] : NULL;
+		long end_old = hunk ? hunk->old_start : old_lines;
+
+		lo = run_old + (i > 0 ? ctxlen : 1);
+		hi = end_old - ctxlen;
+
+		if (hi > old_limit)
+			hi = old_limit;
+		if (hi - run_old + run_new > new_limit)
+			hi = new_limit - run_new + run_old;
+
+		/* cut as soon as the hunk before is done with, or a little way
+		 * into the run if there is none, so that the next window has
+		 * lines before its first hunk to look for a function name in
+		 */
+		if (lo <= hi) {
+			*cut_old = (i > 0) ? lo : max(lo, hi - old_lines / 8);
+			*cut_new = *cut_old - run_old + run_new;
+			found = true;
+		}
+
+		if (hunk) {
+			run_old = hunk->old_start + hunk->old_lines;
+			run_new = hunk->new_start + hunk->new_lines;
+		}
+	}
+
+	return found;
+}
+
+/* Does line `lineno` of `win` appear as a line of `data` within the
+ * given range?
+ */
+static bool git_xdiff_window_line_found(
+	const mmfile_t *win, long lineno,
+	const mmfile_t *data, size_t start, size_t end)
+{
+	const char *line = win->ptr + git_xdiff_window_bytes(win, lineno);
+	const char *win_end = win->ptr + win->size;
+	const char *line_end = memchr(line, '\n', (size_t)(win_end - line));
+	size_t line_len = line_end ?
+		(size_t)(line_end + 1 - line) : (size_t)(win_end - line);
+	const char *scan = data->ptr + start, *stop = data->ptr + end, *nl;
+
+	if (!line_len)
+		return false;
+
+	for (; scan < stop; scan = nl + 1) {
+		if ((size_t)(stop - scan) >= line_len &&
+			memcmp(scan, line, line_len) == 0)
+			return true;
+
+		if ((nl = memchr(scan, '\n', (size_t)(stop - scan))) == NULL)
+			break;
+	}
+
+	return false;
+}
+
+/* No unchanged run to cut at: see whether the first changed line on one
+ * side turns up again past the end of the other side's window.  If it
+ * does, the other side has more lines inserted than fit in a window, so
+ * take all of those as added and keep this side where it is.
+ */
+static void git_xdiff_window_resync(
+	long *cut_old, long *cut_new,
+	const git_xdiff_window_hunks *hunks,
+	const mmfile_t *old_data, size_t old_pos, const mmfile_t *old_win,
+	const mmfile_t *new_data, size_t new_pos, const mmfile_t *new_win,
+	long old_lines, long new_lines, size_t window)
+{
+	size_t search = GIT_XDIFF_RESYNC_WINDOWS * window;
+	size_t old_end = old_pos + old_win->size, new_end = new_pos + new_win->size;
+	const git_xdiff_window_hunk *first = git_array_get(*hunks, 0);
+
+	*cut_old = old_lines;
+	*cut_new = new_lines;
+
+	if (!first)
+		return;
+
+	if (first->old_start < old_lines &&
+		git_xdiff_window_line_found(old_win, first->old_start,
+			new_data, new_end, min((size_t)new_data->size, new_end + search)))
+		*cut_old = first->old_start;
+	else if (first->new_start < new_lines &&
+		git_xdiff_window_line_found(new_win, first->new_start,
+			old_data, old_end, min((size_t)old_data->size, old_end + search)))
+		*cut_new = first->new_start;
+}
+
+static int git_xdiff_windows(
+	git_xdiff_output *xo,
+	mmfile_t *old_data,
+	mmfile_t *new_data,
+	size_t window,
+	long *old_offset,
+	long *new_offset)
+{
+	git_xdiff_window_hunks hunks = GIT_ARRAY_INIT;
+	xdemitconf_t scan_config;
+	xdemitcb_t scan_callback;
+	size_t old_pos = 0, new_pos = 0;
+	mmfile_t old_win, new_win;
+	long old_lines, new_lines, cut_old, cut_new;
+	int error = 0;
+
+	memset(&scan_config, 0, sizeof(scan_config));
+	scan_config.hunk_func = git_xdiff_window_hunk_cb;
+	scan_callback.priv = &hunks;
+
+	*old_offset = *new_offset = 0;
+
+	while (!xo->output.error) {
+		old_win.ptr = old_data->ptr + old_pos;
+		old_win.size = (long)(git_xdiff_window_end(old_data, old_pos, window) - old_pos);
+		new_win.ptr = new_data->ptr + new_pos;
+		new_win.size = (long)(git_xdiff_window_end(new_data, new_pos, window) - new_pos);
+
+		/* the rest of both files fits in one window */
+		if (old_pos + old_win.size == (size_t)old_data->size &&
+			new_pos + new_win.size == (size_t)new_data->size) {
+			xdl_diff(&old_win, &new_win, &xo->params, &xo->config, &xo->callback);
+			break;
+		}
+
+		hunks.size = 0;
+
+		if (xdl_diff(&old_win, &new_win,
+				&xo->params, &scan_config, &scan_callback) < 0) {
+			giterr_set_oom();
+			error = -1;
+			break;
+		}
+
+		old_lines = git_xdiff_window_lines(&old_win);
+		new_lines = git_xdiff_window_lines(&new_win);
+
+		if (!git_xdiff_window_cut(&cut_old, &cut_new, &hunks,
+				old_lines, new_lines, xo->config.ctxlen, false) &&
+			!git_xdiff_window_cut(&cut_old, &cut_new, &hunks,
+				old_lines, new_lines, xo->config.ctxlen, true))
+			git_xdiff_window_resync(&cut_old, &cut_new, &hunks,
+				old_data, old_pos, &old_win, new_data, new_pos, &new_win,
+				old_lines, new_lines, window);
+
+		old_win.size = (long)git_xdiff_window_bytes(&old_win, cut_old);
+		new_win.size = (long)git_xdiff_window_bytes(&new_win, cut_new);
+
+		xdl_diff(&old_win, &new_win, &xo->params, &xo->config, &xo->callback);
+
+		old_pos += old_win.size;
+		new_pos += new_win.size;
+		*old_offset += cut_old;
+		*new_offset += cut_new;
+	}
+
+	git_array_clear(hunks);
+	return error;
+}
+
+/* The window size for diffs in `repo`, or 0 to diff whole files */
+static int git_xdiff_window_size(size_t *out, git_repository *repo)
+{
+	int window = 0;
+
+	*out = 0;
+
+	if (repo &&
+		git_repository__cvar(&window, repo, GIT_CVAR_DIFFWINDOW) < 0)
+		return -1;
+
+	if (window > 0)
+		*out = min((size_t)window, (size_t)(GIT_XDIFF_MAX_SIZE / 2));
+
+	return 0;
+}
+
+bool git_xdiff__windowed(git_repository *repo)
+{
+	size_t window;
+
+	if (git_xdiff_window_size(&window, repo) < 0) {
+		giterr_clear();
+		return false;
+	}
+
+	return window > 0;
+}
+
+static int git_xdiff_data(
+	git_xdiff_output *xo,
+	git_patch *patch,
+	mmfile_t *old_data,
+	mmfile_t *new_data,
+	long *old_offset,
+	long *new_offset)
+{
+	size_t window;
+	int error;
+
+	if ((error = git_xdiff_window_size(&window, patch->ofile.repo ?
+			patch->ofile.repo : patch->nfile.repo)) < 0)
+		return error;
+
+	if (window &&
+		((size_t)old_data->size > window || (size_t)new_data->size > window))
+		return git_xdiff_windows(
+			xo, old_data, new_data, window, old_offset, new_offset);
+
+	if (old_data->size > GIT_XDIFF_MAX_SIZE ||
+		new_data->size > GIT_XDIFF_MAX_SIZE) {
+		giterr_set(GITERR_INVALID, "files too large for diff");
+		return -1;
+	}
+
+	if ((error = git_xdiff_cached_lines(&xo->params.lines1,
+			&patch->ofile, old_data, xo->params.flags)) < 0 ||
+		(error = git_xdiff_cached_lines(&xo->params.lines2,
+			&patch->nfile, new_data, xo->params.flags)) < 0)
+		goto done;
+
+	xdl_diff(old_data, new_data, &xo->params, &xo->config, &xo->callback);
+
+done:
+	git_xdiff_cache_release(xo->params.lines1);
+	git_xdiff_cache_release(xo->params.lines2);
+	xo->params.lines1 = xo->params.lines2 = NULL;
+
+	return error;
+}
+
 static int git_xdiff(git_diff_output *output, git_patch *patch)
 {
 	git_xdiff_output *xo = (git_xdiff_output *)output;
 	git_xdiff_info info;
 	git_diff_find_context_payload findctxt;
+	int error;
 
 	memset(&info, 0, sizeof(info));
 	info.patch = patch;
@@ -209,18 +607,12 @@ static int git_xdiff(git_diff_output *output, git_patch *patch)
 	git_patch__old_data(&info.xd_old_data.ptr, &info.xd_old_data.size, patch);
 	git_patch__new_data(&info.xd_new_data.ptr, &info.xd_new_data.size, patch);
 
-	if (info.xd_old_data.size > GIT_XDIFF_MAX_SIZE ||
-		info.xd_new_data.size > GIT_XDIFF_MAX_SIZE) {
-		giterr_set(GITERR_INVALID, "files too large for diff");
-		return -1;
-	}
-
-	xdl_diff(&info.xd_old_data, &info.xd_new_data,
-		&xo->params, &xo->config, &xo->callback);
+	error = git_xdiff_data(xo, patch, &info.xd_old_data, &info.xd_new_data,
+		&info.old_offset, &info.new_offset);
 
 	git_diff_find_context_clear(&findctxt);
 
-	return xo->output.error;
+	return error ? error : xo->output.error;
 }
 
 void git_xdiff_init(git_xdiff_output *xo, const git_diff_options *opts)
@@ -246,3 +638,292 @@ void git_xdiff_init(git_xdiff_output *xo, const git_diff_options *opts)
 
 	xo->callback.outf = git_xdiff_cb;
 }
+
+static int git_xdiff_count_cb(void *priv, mmbuffer_t *bufs, int len)
+{
+	git_xdiff_line_counts *counts = priv;
+
+	/* the EOFNL marker in a third buffer is not a line of its own */
+	if (len == 2 || len == 3) {
+		if (*bufs[0].ptr == '+')
+			counts->adds++;
+		else if (*bufs[0].ptr == '-')
+			counts->dels++;
+	}
+
+	return 0;
+}
+
+static int git_xdiff_count(git_diff_output *output, git_patch *patch)
+{
+	git_xdiff_output *xo = (git_xdiff_output *)output;
+	mmfile_t old_data, new_data;
+	long old_offset, new_offset;
+	int error;
+
+	git_patch__old_data(&old_data.ptr, &old_data.size, patch);
+	git_patch__new_data(&new_data.ptr, &new_data.size, patch);
+
+	error = git_xdiff_data(xo, patch, &old_data, &new_data,
+		&old_offset, &new_offset);
+
+	return error ? error : xo->output.error;
+}
+
+void git_xdiff_init_counting(
+	git_xdiff_output *xo,
+	const git_diff_options *opts,
+	git_xdiff_line_counts *counts)
+{
+	git_xdiff_init(xo, opts);
+
+	xo->output.diff_cb = git_xdiff_count;
+
+	/* context lines are not counted, so don't make xdiff emit them */
+	xo->config.ctxlen = 0;
+	xo->config.interhunkctxlen = 0;
+	xo->config.flags &= ~XDL_EMIT_FUNCNAMES;
+
+	xo->callback.outf = git_xdiff_count_cb;
+	xo->callback.priv = counts;
+}
+
+#define XDIFF_CACHE_EVICT_COUNT 8
+
+typedef struct xdiff_cache_entry {
+	xdlines_t lines; /* must be first */
+	git_oid id;
+	git_atomic refcount;
+	size_t size;
+	struct xdiff_cache_entry *next; /* same blob, other flags */
+} xdiff_cache_entry;
+
+struct git_xdiff_cache {
+	git_mutex lock;
+	git_oidmap *map;
+	size_t used_memory;
+	size_t max_memory;
+};
+
+static void xdiff_cache_entry_decref(xdiff_cache_entry *entry)
+{
+	if (git_atomic_dec(&entry->refcount) == 0) {
+		xdl_free_lines(&entry->lines);
+		git__free(entry);
+	}
+}
+
+int git_xdiff_cache_new(git_xdiff_cache **out, size_t max_memory)
+{
+	git_xdiff_cache *cache = git__calloc(1, sizeof(git_xdiff_cache));
+	GITERR_CHECK_ALLOC(cache);
+
+	cache->max_memory = max_memory;
+
+	if (git_mutex_init(&cache->lock) < 0 ||
+		(cache->map = git_oidmap_alloc()) == NULL) {
+		git_xdiff_cache_free(cache);
+		giterr_set_oom();
+		return -1;
+	}
+
+	*out = cache;
+	return 0;
+}
+
+static void xdiff_cache_entries_decref(xdiff_cache_entry *entry)
+{
+	xdiff_cache_entry *next;
+
+	for (; entry; entry = next) {
+		next = entry->next;
+		xdiff_cache_entry_decref(entry);
+	}
+}
+
+void git_xdiff_cache_free(git_xdiff_cache *cache)
+{
+	xdiff_cache_entry *entry;
+
+	if (!cache)
+		return;
+
+	if (cache->map) {
+		git_oidmap_foreach_value(cache->map, entry, {
+			xdiff_cache_entries_decref(entry);
+		});
+		git_oidmap_free(cache->map);
+	}
+
+	git_mutex_free(&cache->lock);
+	git__free(cache);
+}
+
+int git_xdiff_cache__for_repo(git_xdiff_cache **out, git_repository *repo)
+{
+	git_xdiff_cache *cache;
+	git_config *cfg;
+	int max_memory;
+
+	if (!repo->xdiff_cache) {
+		if (git_repository_config__weakptr(&cfg, repo) < 0)
+			return -1;
+
+		max_memory = git_config__get_int_force(cfg, "diff.linecachesize", 0);
+
+		if (git_xdiff_cache_new(&cache,
+				(max_memory > 0) ? (size_t)max_memory : 0) < 0)
+			return -1;
+
+		cache = git__compare_and_swap(&repo->xdiff_cache, NULL, cache);
+
+		if (cache != NULL) /* if we race, free losing allocation */
+			git_xdiff_cache_free(cache);
+	}
+
+	*out = repo->xdiff_cache->max_memory ? repo->xdiff_cache : NULL;
+	return 0;
+}
+
+/* Called with lock */
+static void xdiff_cache_evict_entries(git_xdiff_cache *cache)
+{
+	uint32_t seed = rand();
+	size_t evict_count = XDIFF_CACHE_EVICT_COUNT;
+	xdiff_cache_entry *evict, *scan;
+
+	if (evict_count > kh_size(cache->map))
+		evict_count = kh_size(cache->map);
+
+	while (evict_count > 0) {
+		khiter_t pos = seed++ % kh_end(cache->map);
+
+		if (!kh_exist(cache->map, pos))
+			continue;
+
+		evict = kh_val(cache->map, pos);
+
+		for (scan = evict; scan; scan = scan->next)
+			cache->used_memory -= scan->size;
+
+		kh_del(oid, cache->map, pos);
+		xdiff_cache_entries_decref(evict);
+
+		evict_count--;
+	}
+}
+
+/* Called with lock */
+static xdiff_cache_entry *xdiff_cache_find(
+	git_xdiff_cache *cache, const git_oid *id, unsigned long flags)
+{
+	xdiff_cache_entry *entry = NULL;
+	khiter_t pos = kh_get(oid, cache->map, id);
+
+	if (git_oidmap_valid_index(cache->map, pos))
+		entry = kh_val(cache->map, pos);
+
+	while (entry && entry->lines.flags != flags)
+		entry = entry->next;
+
+	return entry;
+}
+
+/* Called with lock; the cache takes a reference to `entry` if it keeps it */
+static void xdiff_cache_add(git_xdiff_cache *cache, xdiff_cache_entry *entry)
+{
+	khiter_t pos;
+	int error;
+
+	if (entry->size > cache->max_memory)
+		return;
+
+	while (cache->used_memory + entry->size > cache->max_memory &&
+		kh_size(cache->map) > 0)
+		xdiff_cache_evict_entries(cache);
+
+	pos = kh_get(oid, cache->map, &entry->id);
+	entry->next = git_oidmap_valid_index(cache->map, pos) ?
+		kh_val(cache->map, pos) : NULL;
+
+	/* the new entry goes first, and its id becomes the key */
+	git_oidmap_insert(cache->map, &entry->id, entry, error);
+
+	if (error < 0) {
+		entry->next = NULL;
+		return;
+	}
+
+	git_atomic_inc(&entry->refcount);
+	cache->used_memory += entry->size;
+}
+
+int git_xdiff_cache_lines(
+	const xdlines_t **out,
+	git_xdiff_cache *cache,
+	const git_oid *id,
+	mmfile_t *data,
+	unsigned long flags)
+{
+	xdiff_cache_entry *entry, *found;
+
+	*out = NULL;
+	flags &= XDF_WHITESPACE_FLAGS;
+
+	if (git_mutex_lock(&cache->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock line cache");
+		return -1;
+	}
+
+	if ((entry = xdiff_cache_find(cache, id, flags)) != NULL)
+		git_atomic_inc(&entry->refcount);
+
+	git_mutex_unlock(&cache->lock);
+
+	if (entry) {
+		*out = &entry->lines;
+		return 0;
+	}
+
+	/* hash the lines without holding the lock */
+	entry = git__calloc(1, sizeof(xdiff_cache_entry));
+	GITERR_CHECK_ALLOC(entry);
+
+	if (xdl_prepare_lines(data, flags, &entry->lines) < 0) {
+		git__free(entry);
+		giterr_set_oom();
+		return -1;
+	}
+
+	git_oid_cpy(&entry->id, id);
+	git_atomic_set(&entry->refcount, 1);
+	entry->size = sizeof(xdiff_cache_entry) +
+		(entry->lines.nrec + 1) * sizeof(long) +
+		entry->lines.nrec * sizeof(unsigned long);
+
+	if (git_mutex_lock(&cache->lock) < 0) {
+		xdiff_cache_entry_decref(entry);
+		giterr_set(GITERR_OS, "Unable to lock line cache");
+		return -1;
+	}
+
+	/* someone else may have hashed the same blob in the meantime */
+	if ((found = xdiff_cache_find(cache, id, flags)) != NULL) {
+		git_atomic_inc(&found->refcount);
+		xdiff_cache_entry_decref(entry);
+		entry = found;
+	} else {
+		xdiff_cache_add(cache, entry);
+	}
+
+	git_mutex_unlock(&cache->lock);
+
+	*out = &entry->lines;
+	return 0;
+}
+
+void git_xdiff_cache_release(const xdlines_t *lines)
+{
+	if (lines)
+		xdiff_cache_entry_decref((xdiff_cache_entry *)lines);
+}
@@ -30,4 +30,51 @@ typedef struct {
 
 void git_xdiff_init(git_xdiff_output *xo, const git_diff_options *opts);
 
+/* Whether `diff.windowSize` lets files in `repo` that are too large for
+ * xdiff be diffed a window at a time.
+ */
+bool git_xdiff__windowed(git_repository *repo);
+
+/* Line counts gathered by an output set up with git_xdiff_init_counting().
+ * Such an output runs xdiff without context and only counts the lines it
+ * emits; no hunk or line callbacks are issued.
+ */
+typedef struct {
+	size_t adds;
+	size_t dels;
+} git_xdiff_line_counts;
+
+void git_xdiff_init_counting(
+	git_xdiff_output *xo,
+	const git_diff_options *opts,
+	git_xdiff_line_counts *counts);
+
+/* A cache of the lines of blobs as found and hashed by xdiff, so that a
+ * blob that is diffed against many others (by blame, or while walking
+ * history) is only scanned once.  Entries are keyed by blob id and the
+ * whitespace flags, and evicted at random once `max_memory` is used.
+ */
+typedef struct git_xdiff_cache git_xdiff_cache;
+
+int git_xdiff_cache_new(git_xdiff_cache **out, size_t max_memory);
+void git_xdiff_cache_free(git_xdiff_cache *cache);
+
+/* The repository's own cache, sized by `diff.lineCacheSize`, or NULL
+ * when that is not set.
+ */
+int git_xdiff_cache__for_repo(git_xdiff_cache **out, git_repository *repo);
+
+/* Get the lines of blob `id`, whose contents are `data`, hashing them
+ * now if they are not cached.  The result must be given back with
+ * git_xdiff_cache_release().
+ */
+int git_xdiff_cache_lines(
+	const xdlines_t **out,
+	git_xdiff_cache *cache,
+	const git_oid *id,
+	mmfile_t *data,
+	unsigned long flags);
+
+void git_xdiff_cache_release(const xdlines_t *lines);
+
 #endif
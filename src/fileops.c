@@ -501,6 +501,59 @@ int git_futils_mkdir_r(const char *path, const mode_t mode)
 	return git_futils_mkdir(path, mode, GIT_MKDIR_PATH);
 }
 
+/* Directories known to exist, and whether this caller made them: a
+ * directory that was just made is empty, so its children can be made
+ * without looking for them first.
+ */
+typedef struct {
+	unsigned int created:1;
+	char path[GIT_FLEX_ARRAY];
+} mkdir_cache_entry;
+
+GIT_INLINE(mkdir_cache_entry *) mkdir_cache_lookup(
+	struct git_futils_mkdir_options *opts, const char *path)
+{
+	khiter_t pos;
+
+	if (!opts->dir_map)
+		return NULL;
+
+	pos = git_strmap_lookup_index(opts->dir_map, path);
+
+	return git_strmap_valid_index(opts->dir_map, pos) ?
+		git_strmap_value_at(opts->dir_map, pos) : NULL;
+}
+
+static int mkdir_cache_insert(
+	struct git_futils_mkdir_options *opts,
+	const git_buf *path,
+	bool created)
+{
+	mkdir_cache_entry *entry;
+	size_t alloc_size;
+	int error;
+
+	if (!opts->dir_map || !opts->pool)
+		return 0;
+
+	GITERR_CHECK_ALLOC_ADD3(&alloc_size,
+		sizeof(mkdir_cache_entry), path->size, 1);
+	if (!git__is_uint32(alloc_size)) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	entry = git_pool_malloc(opts->pool, (uint32_t)alloc_size);
+	GITERR_CHECK_ALLOC(entry);
+
+	entry->created = created;
+	memcpy(entry->path, path->ptr, path->size + 1);
+
+	git_strmap_insert(opts->dir_map, entry->path, entry, error);
+
+	return (error < 0) ? -1 : 0;
+}
+
 int git_futils_mkdir_relative(
 	const char *relative_path,
 	const char *base,
@@ -513,6 +566,8 @@ int git_futils_mkdir_relative(
 	char lastch = '/', *tail;
 	struct stat st;
 	struct git_futils_mkdir_options empty_opts = {0};
+	mkdir_cache_entry *cached;
+	bool parent_created = false;
 	int error;
 
 	if (!opts)
@@ -526,6 +581,11 @@ int git_futils_mkdir_relative(
 		make_path.size == 0)
 		goto done;
 
+	/* the whole path is already known to exist */
+	if ((flags & GIT_MKDIR_EXCL) == 0 &&
+		mkdir_cache_lookup(opts, make_path.ptr) != NULL)
+		goto done;
+
 	/* if we are not supposed to make the whole path, reset root */
 	if ((flags & GIT_MKDIR_PATH) == 0)
 		root = git_buf_rfind(&make_path, '/');
@@ -545,7 +605,7 @@ int git_futils_mkdir_relative(
 
 	/* walk down tail of path making each directory */
 	for (tail = &make_path.ptr[root]; *tail; *tail = lastch) {
-		bool mkdir_attempted = false;
+		bool mkdir_attempted = false, created = false;
 
 		/* advance tail to include next path component */
 		while (*tail == '/')
@@ -558,8 +618,29 @@ int git_futils_mkdir_relative(
 		*tail = '\0';
 		st.st_mode = 0;
 
-		if (opts->dir_map && git_strmap_exists(opts->dir_map, make_path.ptr))
+		if ((cached = mkdir_cache_lookup(opts, make_path.ptr)) != NULL) {
+			parent_created = cached->created;
 			continue;
+		}
+
+		/* nothing can be in a directory that was just made */
+		if (parent_created) {
+			opts->perfdata.mkdir_calls++;
+			mkdir_attempted = true;
+
+			if (p_mkdir(make_path.ptr, mode) == 0) {
+				created = true;
+				goto made;
+			}
+
+			if (errno != EEXIST) {
+				giterr_set(GITERR_OS, "Failed to make directory '%s'", make_path.ptr);
+				error = -1;
+				goto done;
+			}
+
+			mkdir_attempted = false;
+		}
 
 		/* See what's going on with this path component */
 		opts->perfdata.stat_calls++;
@@ -582,33 +663,24 @@ retry_lstat:
 				error = -1;
 				goto done;
 			}
+
+			created = true;
 		} else {
 			if ((error = mkdir_validate_dir(
 				make_path.ptr, &st, mode, flags, opts)) < 0)
 				goto done;
 		}
 
+made:
 		/* chmod if requested and necessary */
 		if ((error = mkdir_validate_mode(
 			make_path.ptr, &st, (lastch == '\0'), mode, flags, opts)) < 0)
 			goto done;
 
-		if (opts->dir_map && opts->pool) {
-			char *cache_path;
-			size_t alloc_size;
-
-			GITERR_CHECK_ALLOC_ADD(&alloc_size, make_path.size, 1);
-			if (!git__is_uint32(alloc_size))
-				return -1;
-			cache_path = git_pool_malloc(opts->pool, (uint32_t)alloc_size);
-			GITERR_CHECK_ALLOC(cache_path);
-
-			memcpy(cache_path, make_path.ptr, make_path.size + 1);
+		if ((error = mkdir_cache_insert(opts, &make_path, created)) < 0)
+			goto done;
 
-			git_strmap_insert(opts->dir_map, cache_path, cache_path, error);
-			if (error < 0)
-				goto done;
-		}
+		parent_created = created;
 	}
 
 	error = 0;
@@ -111,6 +111,7 @@ static int filter_registry_initialize(void)
 	{
 		git_filter *crlf = git_crlf_filter_new();
 		git_filter *ident = git_ident_filter_new();
+		git_filter *process = git_process_filter_new();
 
 		if (crlf && git_filter_register(
 				GIT_FILTER_CRLF, crlf, GIT_FILTER_CRLF_PRIORITY) < 0)
@@ -118,8 +119,11 @@ static int filter_registry_initialize(void)
 		if (ident && git_filter_register(
 				GIT_FILTER_IDENT, ident, GIT_FILTER_IDENT_PRIORITY) < 0)
 			ident = NULL;
+		if (process && git_filter_register(
+				GIT_FILTER_PROCESS, process, GIT_FILTER_PROCESS_PRIORITY) < 0)
+			process = NULL;
 
-		if (!crlf || !ident)
+		if (!crlf || !ident || !process)
 			return -1;
 	}
 
@@ -284,7 +288,8 @@ int git_filter_unregister(const char *name)
 	assert(name);
 
 	/* cannot unregister default filters */
-	if (!strcmp(GIT_FILTER_CRLF, name) || !strcmp(GIT_FILTER_IDENT, name)) {
+	if (!strcmp(GIT_FILTER_CRLF, name) || !strcmp(GIT_FILTER_IDENT, name) ||
+		!strcmp(GIT_FILTER_PROCESS, name)) {
 		giterr_set(GITERR_FILTER, "Cannot unregister filter '%s'", name);
 		return -1;
 	}
@@ -634,6 +639,22 @@ size_t git_filter_list_length(const git_filter_list *fl)
 	return fl ? git_array_size(fl->filters) : 0;
 }
 
+bool git_filter_list__builtin_only(const git_filter_list *fl)
+{
+	size_t i;
+	const char *name;
+
+	for (i = 0; fl && i < git_array_size(fl->filters); i++) {
+		name = fl->filters.ptr[i].filter_name;
+
+		if (!name || (strcmp(name, GIT_FILTER_CRLF) != 0 &&
+			strcmp(name, GIT_FILTER_IDENT) != 0))
+			return false;
+	}
+
+	return true;
+}
+
 struct buf_stream {
 	git_writestream parent;
 	git_buf *target;
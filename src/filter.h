@@ -32,6 +32,14 @@ typedef struct {
 
 #define GIT_FILTER_OPTIONS_INIT {0}
 
+/* internal filter flags */
+enum {
+	/* the caller can wait for content that a filter process delays, which
+	 * the filter then signals by returning GIT_DELAYED
+	 */
+	GIT_FILTER__ALLOW_DELAY = (1u << 16),
+};
+
 extern void git_filter_free(git_filter *filter);
 
 extern int git_filter_list__load_ext(
@@ -42,11 +50,18 @@ extern int git_filter_list__load_ext(
 	git_filter_mode_t mode,
 	git_filter_options *filter_opts);
 
+/*
+ * Test whether only the built-in filters (which keep no state between
+ * calls and may be applied from several threads at once) are in the list.
+ */
+extern bool git_filter_list__builtin_only(const git_filter_list *fl);
+
 /*
  * Available filters
  */
 
 extern git_filter *git_crlf_filter_new(void);
 extern git_filter *git_ident_filter_new(void);
+extern git_filter *git_process_filter_new(void);
 
 #endif
@@ -0,0 +1,879 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "git2/attr.h"
+#include "git2/sys/filter.h"
+
+#include "filter.h"
+#include "filter_process.h"
+#include "repository.h"
+#include "config.h"
+#include "strmap.h"
+
+GIT__USE_STRMAP
+
+#ifndef GIT_WIN32
+# include <sys/socket.h>
+# include <sys/wait.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+/* Without SOCK_CLOEXEC the socket pair is made close-on-exec only after
+ * it was created; serialize process starts so that no other one forks
+ * in between and leaks our ends into its child.
+ */
+#if !defined(GIT_WIN32) && !defined(SOCK_CLOEXEC) && defined(GIT_THREADS)
+static pthread_mutex_t filter_process_spawn_lock = PTHREAD_MUTEX_INITIALIZER;
+# define filter_process_spawn_lock() \
+	pthread_mutex_lock(&filter_process_spawn_lock)
+# define filter_process_spawn_unlock() \
+	pthread_mutex_unlock(&filter_process_spawn_lock)
+#else
+# define filter_process_spawn_lock() (void)0
+# define filter_process_spawn_unlock() (void)0
+#endif
+
+/* the largest pkt-line, and the most data that fits in one */
+#define PKT_MAX_SIZE 65520
+#define PKT_MAX_DATA (PKT_MAX_SIZE - 4)
+
+enum {
+	FILTER_PROCESS_CLEAN = (1u << 0),
+	FILTER_PROCESS_SMUDGE = (1u << 1),
+	FILTER_PROCESS_DELAY = (1u << 2),
+};
+
+typedef struct {
+	git_mutex lock;
+	char *command;
+	int fd;
+#ifndef GIT_WIN32
+	pid_t pid;
+#endif
+	unsigned int capabilities;
+	unsigned int required:1,
+		started:1,
+		failed:1;
+	git_strmap *delayed; /* paths whose content is still to come */
+	char name[GIT_FLEX_ARRAY];
+} filter_process;
+
+struct git_filter_process_registry {
+	git_mutex lock;
+	git_strmap *processes;
+};
+
+static void filter_process_stop(filter_process *proc)
+{
+	if (!proc->started)
+		return;
+
+	/* the process is expected to exit once its input is closed */
+	p_close(proc->fd);
+	proc->fd = -1;
+
+#ifndef GIT_WIN32
+	while (waitpid(proc->pid, NULL, 0) < 0 && errno == EINTR)
+		/* wait again */;
+#endif
+
+	proc->started = 0;
+}
+
+static void filter_process_clear_delayed(filter_process *proc)
+{
+	char *path;
+
+	git_strmap_foreach_value(proc->delayed, path, git__free(path));
+	git_strmap_clear(proc->delayed);
+}
+
+static void filter_process_free(filter_process *proc)
+{
+	if (!proc)
+		return;
+
+	filter_process_stop(proc);
+	filter_process_clear_delayed(proc);
+	git_strmap_free(proc->delayed);
+	git_mutex_free(&proc->lock);
+	git__free(proc->command);
+	git__free(proc);
+}
+
+void git_filter_process_registry_free(git_filter_process_registry *reg)
+{
+	filter_process *proc;
+
+	if (!reg)
+		return;
+
+	git_strmap_foreach_value(reg->processes, proc, filter_process_free(proc));
+	git_strmap_free(reg->processes);
+	git_mutex_free(&reg->lock);
+	git__free(reg);
+}
+
+static git_filter_process_registry *filter_process_registry(
+	git_repository *repo)
+{
+	git_filter_process_registry *reg;
+
+	if (!repo->filter_processes) {
+		if ((reg = git__calloc(1, sizeof(*reg))) == NULL)
+			return NULL;
+
+		if (git_mutex_init(&reg->lock) < 0 ||
+			git_strmap_alloc(&reg->processes) < 0) {
+			git__free(reg);
+			return NULL;
+		}
+
+		reg = git__compare_and_swap(&repo->filter_processes, NULL, reg);
+
+		if (reg != NULL) /* if we race, free losing allocation */
+			git_filter_process_registry_free(reg);
+	}
+
+	return repo->filter_processes;
+}
+
+/* Follow changes to the configuration: a new command starts over. */
+static int filter_process_reconfigure(
+	filter_process *proc, const char *command, bool required)
+{
+	char *dup;
+
+	if (git_mutex_lock(&proc->lock) < 0) {
+		giterr_set(GITERR_OS, "unable to lock the '%s' filter process",
+			proc->name);
+		return -1;
+	}
+
+	proc->required = required;
+
+	if (strcmp(proc->command, command) != 0) {
+		if ((dup = git__strdup(command)) == NULL) {
+			git_mutex_unlock(&proc->lock);
+			return -1;
+		}
+
+		filter_process_stop(proc);
+		filter_process_clear_delayed(proc);
+		git__free(proc->command);
+
+		proc->command = dup;
+		proc->capabilities = 0;
+		proc->failed = 0;
+	}
+
+	git_mutex_unlock(&proc->lock);
+	return 0;
+}
+
+static int filter_process_lookup(
+	filter_process **out,
+	git_repository *repo,
+	const char *name,
+	const char *command,
+	bool required)
+{
+	git_filter_process_registry *reg;
+	filter_process *proc;
+	size_t namelen = strlen(name), alloclen;
+	khiter_t pos;
+	int error = 0;
+
+	GITERR_CHECK_ALLOC_ADD3(&alloclen, sizeof(filter_process), namelen, 1);
+
+	if ((reg = filter_process_registry(repo)) == NULL) {
+		giterr_set(GITERR_FILTER, "unable to create filter process registry");
+		return -1;
+	}
+
+	if (git_mutex_lock(&reg->lock) < 0) {
+		giterr_set(GITERR_OS, "unable to lock filter process registry");
+		return -1;
+	}
+
+	pos = git_strmap_lookup_index(reg->processes, name);
+
+	if (git_strmap_valid_index(reg->processes, pos)) {
+		proc = git_strmap_value_at(reg->processes, pos);
+		error = filter_process_reconfigure(proc, command, required);
+		*out = proc;
+		goto done;
+	}
+
+	if ((proc = git__calloc(1, alloclen)) == NULL ||
+		(proc->command = git__strdup(command)) == NULL ||
+		git_strmap_alloc(&proc->delayed) < 0 ||
+		git_mutex_init(&proc->lock) < 0) {
+		if (proc) {
+			git__free(proc->command);
+			git_strmap_free(proc->delayed);
+		}
+		git__free(proc);
+		error = -1;
+		goto done;
+	}
+
+	memcpy(proc->name, name, namelen);
+	proc->fd = -1;
+	proc->required = required;
+
+	git_strmap_insert(reg->processes, proc->name, proc, error);
+
+	if (error < 0) {
+		filter_process_free(proc);
+		goto done;
+	}
+
+	*out = proc;
+	error = 0;
+
+done:
+	git_mutex_unlock(&reg->lock);
+	return error;
+}
+
+/* Any failure to talk to the process stops it for good. */
+static int filter_process_failed(filter_process *proc)
+{
+	filter_process_stop(proc);
+	filter_process_clear_delayed(proc);
+	proc->failed = 1;
+	return -1;
+}
+
+static int filter_process_write(filter_process *proc, git_buf *out)
+{
+	const char *data = out->ptr;
+	size_t len = out->size;
+	ssize_t written;
+
+	if (git_buf_oom(out))
+		return filter_process_failed(proc);
+
+	while (len > 0) {
+#ifdef GIT_WIN32
+		written = p_write(proc->fd, data, len);
+#else
+		written = send(proc->fd, data, len, MSG_NOSIGNAL);
+#endif
+
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written <= 0) {
+			giterr_set(GITERR_OS,
+				"could not write to the '%s' filter process", proc->name);
+			return filter_process_failed(proc);
+		}
+
+		data += written;
+		len -= (size_t)written;
+	}
+
+	git_buf_clear(out);
+	return 0;
+}
+
+static int filter_process_read(filter_process *proc, char *data, size_t len)
+{
+	ssize_t nread;
+
+	while (len > 0) {
+		nread = p_read(proc->fd, data, len);
+
+		if (nread < 0 && errno == EINTR)
+			continue;
+
+		if (nread <= 0) {
+			if (nread == 0)
+				giterr_set(GITERR_FILTER,
+					"the '%s' filter process exited unexpectedly", proc->name);
+			else
+				giterr_set(GITERR_OS,
+					"could not read from the '%s' filter process", proc->name);
+			return filter_process_failed(proc);
+		}
+
+		data += nread;
+		len -= (size_t)nread;
+	}
+
+	return 0;
+}
+
+static int filter_process_protocol_error(filter_process *proc)
+{
+	giterr_set(GITERR_FILTER,
+		"the '%s' filter process does not follow the protocol", proc->name);
+	return filter_process_failed(proc);
+}
+
+static void pkt_put(git_buf *out, const char *data, size_t len)
+{
+	git_buf_printf(out, "%04x", (unsigned int)(len + 4));
+	git_buf_put(out, data, len);
+}
+
+static void pkt_puts(git_buf *out, const char *line)
+{
+	pkt_put(out, line, strlen(line));
+}
+
+static void pkt_put_value(git_buf *out, const char *key, const char *value)
+{
+	size_t keylen = strlen(key), valuelen = strlen(value);
+
+	git_buf_printf(out, "%04x%s=%s\n",
+		(unsigned int)(keylen + valuelen + 6), key, value);
+}
+
+static void pkt_put_data(git_buf *out, const char *data, size_t len)
+{
+	size_t chunk;
+
+	for (; len > 0; data += chunk, len -= chunk) {
+		chunk = min(len, PKT_MAX_DATA);
+		pkt_put(out, data, chunk);
+	}
+}
+
+static void pkt_flush(git_buf *out)
+{
+	git_buf_put(out, "0000", 4);
+}
+
+/* Append the data of the next pkt-line to `out`; a flush packet adds
+ * nothing and sets `flush` instead.
+ */
+static int pkt_read(git_buf *out, bool *flush, filter_process *proc)
+{
+	char hdr[4];
+	int32_t len;
+	size_t i;
+
+	if (filter_process_read(proc, hdr, sizeof(hdr)) < 0)
+		return -1;
+
+	for (i = 0, len = 0; i < sizeof(hdr); i++) {
+		int v = git__fromhex(hdr[i]);
+
+		if (v < 0)
+			return filter_process_protocol_error(proc);
+
+		len = (len << 4) | v;
+	}
+
+	if ((*flush = (len == 0)))
+		return 0;
+
+	if (len <= 4 || len > PKT_MAX_SIZE)
+		return filter_process_protocol_error(proc);
+
+	len -= 4;
+
+	if (git_buf_grow_by(out, (size_t)len + 1) < 0)
+		return filter_process_failed(proc);
+
+	if (filter_process_read(proc, out->ptr + out->size, (size_t)len) < 0)
+		return -1;
+
+	out->size += (size_t)len;
+	out->ptr[out->size] = '\0';
+	return 0;
+}
+
+/* Read one line of text, without its terminating newline. */
+static int pkt_read_line(git_buf *line, bool *flush, filter_process *proc)
+{
+	git_buf_clear(line);
+
+	if (pkt_read(line, flush, proc) < 0)
+		return -1;
+
+	if (line->size > 0 && line->ptr[line->size - 1] == '\n')
+		git_buf_truncate(line, line->size - 1);
+
+	return 0;
+}
+
+/* Read a list of lines up to a flush packet, keeping the last status. */
+static int pkt_read_status(git_buf *status, filter_process *proc)
+{
+	git_buf line = GIT_BUF_INIT;
+	bool flush;
+	int error;
+
+	while ((error = pkt_read_line(&line, &flush, proc)) == 0 && !flush) {
+		if (git__prefixcmp(line.ptr, "status=") == 0 &&
+			(error = git_buf_sets(status, line.ptr + 7)) < 0)
+			break;
+	}
+
+	git_buf_free(&line);
+	return error;
+}
+
+static int filter_process_handshake(filter_process *proc)
+{
+	git_buf buf = GIT_BUF_INIT;
+	bool flush, version = false;
+	int error;
+
+	pkt_puts(&buf, "git-filter-client\n");
+	pkt_puts(&buf, "version=2\n");
+	pkt_flush(&buf);
+
+	if ((error = filter_process_write(proc, &buf)) < 0 ||
+		(error = pkt_read_line(&buf, &flush, proc)) < 0)
+		goto done;
+
+	if (flush || strcmp(buf.ptr, "git-filter-server") != 0) {
+		error = filter_process_protocol_error(proc);
+		goto done;
+	}
+
+	while ((error = pkt_read_line(&buf, &flush, proc)) == 0 && !flush) {
+		if (strcmp(buf.ptr, "version=2") == 0)
+			version = true;
+	}
+
+	if (error < 0)
+		goto done;
+
+	if (!version) {
+		error = filter_process_protocol_error(proc);
+		goto done;
+	}
+
+	pkt_puts(&buf, "capability=clean\n");
+	pkt_puts(&buf, "capability=smudge\n");
+	pkt_puts(&buf, "capability=delay\n");
+	pkt_flush(&buf);
+
+	if ((error = filter_process_write(proc, &buf)) < 0)
+		goto done;
+
+	while ((error = pkt_read_line(&buf, &flush, proc)) == 0 && !flush) {
+		if (strcmp(buf.ptr, "capability=clean") == 0)
+			proc->capabilities |= FILTER_PROCESS_CLEAN;
+		else if (strcmp(buf.ptr, "capability=smudge") == 0)
+			proc->capabilities |= FILTER_PROCESS_SMUDGE;
+		else if (strcmp(buf.ptr, "capability=delay") == 0)
+			proc->capabilities |= FILTER_PROCESS_DELAY;
+	}
+
+done:
+	git_buf_free(&buf);
+	return error;
+}
+
+static int filter_process_start(filter_process *proc, git_repository *repo)
+{
+#ifdef GIT_WIN32
+	GIT_UNUSED(repo);
+
+	giterr_set(GITERR_FILTER,
+		"cannot run the '%s' filter process: not supported on Windows",
+		proc->name);
+	proc->failed = 1;
+	return -1;
+#else
+	const char *dir = git_repository_workdir(repo);
+	char *argv[] = { "sh", "-c", proc->command, NULL };
+	int fds[2], error;
+	pid_t pid;
+
+	if (!dir)
+		dir = git_repository_path(repo);
+
+	filter_process_spawn_lock();
+
+#ifdef SOCK_CLOEXEC
+	error = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+#else
+	if ((error = socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) == 0) {
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	}
+#endif
+
+	if (error < 0) {
+		filter_process_spawn_unlock();
+		giterr_set(GITERR_OS,
+			"could not create a socket for the '%s' filter process",
+			proc->name);
+		proc->failed = 1;
+		return -1;
+	}
+
+	if ((pid = fork()) < 0) {
+		filter_process_spawn_unlock();
+		giterr_set(GITERR_OS,
+			"could not start the '%s' filter process", proc->name);
+		p_close(fds[0]);
+		p_close(fds[1]);
+		proc->failed = 1;
+		return -1;
+	}
+
+	if (pid == 0) {
+		/* only async-signal-safe calls until exec */
+		close(fds[0]);
+
+		if (dup2(fds[1], 0) < 0 || dup2(fds[1], 1) < 0)
+			_exit(127);
+
+		/* dup2 onto itself keeps the close-on-exec flag */
+		if (fds[1] > 1)
+			close(fds[1]);
+		else if (fcntl(fds[1], F_SETFD, 0) < 0)
+			_exit(127);
+
+		if (chdir(dir) < 0)
+			_exit(127);
+
+		execv("/bin/sh", argv);
+		_exit(127);
+	}
+
+	filter_process_spawn_unlock();
+	p_close(fds[1]);
+
+#ifdef SO_NOSIGPIPE
+	{
+		int on = 1;
+		setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	}
+#endif
+
+	proc->fd = fds[0];
+	proc->pid = pid;
+	proc->started = 1;
+
+	return filter_process_handshake(proc);
+#endif
+}
+
+/* Processes are told about paths relative to the working directory. */
+static const char *filter_process_path(const git_filter_source *src)
+{
+	const char *path = git_filter_source_path(src);
+	const char *workdir = git_repository_workdir(git_filter_source_repo(src));
+	size_t len = workdir ? strlen(workdir) : 0;
+
+	if (len && strncmp(path, workdir, len) == 0)
+		path += len;
+
+	return path;
+}
+
+static int filter_process_run(
+	filter_process *proc,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *src)
+{
+	git_filter_mode_t mode = git_filter_source_mode(src);
+	const char *path = filter_process_path(src);
+	const char *command = (mode == GIT_FILTER_SMUDGE) ? "smudge" : "clean";
+	git_buf buf = GIT_BUF_INIT, status = GIT_BUF_INIT;
+	bool delayed = false, can_delay, flush;
+	khiter_t pos;
+	int error;
+
+	/* content that was delayed is asked for again without sending it */
+	if (mode == GIT_FILTER_SMUDGE) {
+		pos = git_strmap_lookup_index(proc->delayed, path);
+
+		if (git_strmap_valid_index(proc->delayed, pos)) {
+			git__free((char *)git_strmap_key(proc->delayed, pos));
+			git_strmap_delete_at(proc->delayed, pos);
+			delayed = true;
+		}
+	}
+
+	can_delay = mode == GIT_FILTER_SMUDGE && !delayed &&
+		(proc->capabilities & FILTER_PROCESS_DELAY) != 0 &&
+		(git_filter_source_flags(src) & GIT_FILTER__ALLOW_DELAY) != 0;
+
+	pkt_put_value(&buf, "command", command);
+	pkt_put_value(&buf, "pathname", path);
+	if (can_delay)
+		pkt_put_value(&buf, "can-delay", "1");
+	pkt_flush(&buf);
+
+	if (!delayed)
+		pkt_put_data(&buf, from->ptr, from->size);
+	pkt_flush(&buf);
+
+	if ((error = filter_process_write(proc, &buf)) < 0 ||
+		(error = pkt_read_status(&status, proc)) < 0)
+		goto done;
+
+	if (can_delay && strcmp(status.ptr, "delayed") == 0) {
+		char *key = git__strdup(path);
+		GITERR_CHECK_ALLOC(key);
+
+		git_strmap_insert(proc->delayed, key, key, error);
+
+		if (error < 0) {
+			git__free(key);
+			goto done;
+		}
+
+		error = GIT_DELAYED;
+		goto done;
+	}
+
+	if (strcmp(status.ptr, "success") == 0) {
+		git_buf_clear(to);
+
+		while ((error = pkt_read(to, &flush, proc)) == 0 && !flush)
+			/* read all the content */;
+
+		/* and the status may still change after it */
+		if (error < 0 || (error = pkt_read_status(&status, proc)) < 0)
+			goto done;
+	}
+
+	if (strcmp(status.ptr, "success") == 0)
+		error = 0;
+	else if (strcmp(status.ptr, "error") == 0 ||
+		strcmp(status.ptr, "abort") == 0) {
+		if (status.ptr[0] == 'a')
+			proc->capabilities &= (mode == GIT_FILTER_SMUDGE) ?
+				~FILTER_PROCESS_SMUDGE : ~FILTER_PROCESS_CLEAN;
+
+		giterr_set(GITERR_FILTER, "the '%s' filter process could not %s '%s'",
+			proc->name, command, path);
+		error = -1;
+	} else
+		error = filter_process_protocol_error(proc);
+
+done:
+	git_buf_free(&buf);
+	git_buf_free(&status);
+	return error;
+}
+
+static int process_filter_check(
+	git_filter *self,
+	void **payload, /* points to NULL ptr on entry, may be set */
+	const git_filter_source *src,
+	const char **attr_values)
+{
+	git_repository *repo = git_filter_source_repo(src);
+	const char *driver = attr_values ? attr_values[0] : NULL;
+	git_config_entry *command = NULL;
+	git_buf key = GIT_BUF_INIT;
+	git_config *cfg;
+	bool required;
+	int error;
+
+	GIT_UNUSED(self);
+
+	if (!GIT_ATTR_HAS_VALUE(driver) || !repo)
+		return GIT_PASSTHROUGH;
+
+	if ((error = git_repository_config__weakptr(&cfg, repo)) < 0 ||
+		(error = git_buf_printf(&key, "filter.%s.process", driver)) < 0 ||
+		(error = git_config__lookup_entry(&command, cfg, key.ptr, false)) < 0)
+		goto done;
+
+	if (!command || !command->value || !*command->value) {
+		error = GIT_PASSTHROUGH;
+		goto done;
+	}
+
+	git_buf_clear(&key);
+
+	if ((error = git_buf_printf(&key, "filter.%s.required", driver)) < 0)
+		goto done;
+
+	required = git_config__get_bool_force(cfg, key.ptr, 0) != 0;
+
+	error = filter_process_lookup((filter_process **)payload,
+		repo, driver, command->value, required);
+
+done:
+	git_config_entry_free(command);
+	git_buf_free(&key);
+	return error;
+}
+
+static int process_filter_apply(
+	git_filter *self,
+	void **payload,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *src)
+{
+	filter_process *proc = *payload;
+	unsigned int capability =
+		(git_filter_source_mode(src) == GIT_FILTER_SMUDGE) ?
+		FILTER_PROCESS_SMUDGE : FILTER_PROCESS_CLEAN;
+	int error;
+
+	GIT_UNUSED(self);
+
+	if (git_mutex_lock(&proc->lock) < 0) {
+		giterr_set(GITERR_OS, "unable to lock the '%s' filter process",
+			proc->name);
+		return -1;
+	}
+
+	if (proc->failed) {
+		giterr_set(GITERR_FILTER,
+			"the '%s' filter process is not running", proc->name);
+		error = -1;
+	} else if (!proc->started &&
+		(error = filter_process_start(proc, git_filter_source_repo(src))) < 0)
+		/* failed to start */;
+	else if ((proc->capabilities & capability) == 0)
+		error = GIT_PASSTHROUGH;
+	else
+		error = filter_process_run(proc, to, from, src);
+
+	git_mutex_unlock(&proc->lock);
+
+	/* like git, use the content as it is unless the filter is required */
+	if (error < 0 && error != GIT_DELAYED && error != GIT_PASSTHROUGH &&
+		!proc->required) {
+		giterr_clear();
+		error = GIT_PASSTHROUGH;
+	}
+
+	return error;
+}
+
+static int filter_process_available(git_vector *out, filter_process *proc)
+{
+	git_buf line = GIT_BUF_INIT, status = GIT_BUF_INIT;
+	size_t found = 0;
+	bool flush;
+	char *path;
+	int error;
+
+	pkt_put_value(&line, "command", "list_available_blobs");
+	pkt_flush(&line);
+
+	if ((error = filter_process_write(proc, &line)) < 0)
+		goto done;
+
+	while ((error = pkt_read_line(&line, &flush, proc)) == 0 && !flush) {
+		if (git__prefixcmp(line.ptr, "pathname=") != 0 ||
+			!git_strmap_exists(proc->delayed, line.ptr + 9))
+			continue;
+
+		if ((path = git__strdup(line.ptr + 9)) == NULL ||
+			(error = git_vector_insert(out, path)) < 0) {
+			git__free(path);
+			error = -1;
+			goto done;
+		}
+
+		found++;
+	}
+
+	if (error < 0 || (error = pkt_read_status(&status, proc)) < 0)
+		goto done;
+
+	if (strcmp(status.ptr, "success") != 0) {
+		error = filter_process_protocol_error(proc);
+		goto done;
+	}
+
+	/* an empty list means that nothing more is coming */
+	if (!found) {
+		giterr_set(GITERR_FILTER,
+			"the '%s' filter process did not deliver %d delayed files",
+			proc->name, (int)git_strmap_num_entries(proc->delayed));
+		filter_process_clear_delayed(proc);
+		error = -1;
+	}
+
+done:
+	git_buf_free(&line);
+	git_buf_free(&status);
+	return error;
+}
+
+int git_filter_process__available(git_vector *out, git_repository *repo)
+{
+	git_filter_process_registry *reg = repo->filter_processes;
+	filter_process *proc;
+	int error = 0;
+
+	if (!reg)
+		return 0;
+
+	if (git_mutex_lock(&reg->lock) < 0) {
+		giterr_set(GITERR_OS, "unable to lock filter process registry");
+		return -1;
+	}
+
+	git_strmap_foreach_value(reg->processes, proc, {
+		if (error < 0 || git_strmap_num_entries(proc->delayed) == 0)
+			continue;
+
+		if (git_mutex_lock(&proc->lock) < 0) {
+			giterr_set(GITERR_OS, "unable to lock the '%s' filter process",
+				proc->name);
+			error = -1;
+			continue;
+		}
+
+		error = filter_process_available(out, proc);
+		git_mutex_unlock(&proc->lock);
+	});
+
+	git_mutex_unlock(&reg->lock);
+	return error;
+}
+
+void git_filter_process__clear_delayed(git_repository *repo)
+{
+	git_filter_process_registry *reg = repo->filter_processes;
+	filter_process *proc;
+
+	if (!reg || git_mutex_lock(&reg->lock) < 0)
+		return;
+
+	git_strmap_foreach_value(reg->processes, proc, {
+		if (git_mutex_lock(&proc->lock) < 0)
+			continue;
+
+		filter_process_clear_delayed(proc);
+		git_mutex_unlock(&proc->lock);
+	});
+
+	git_mutex_unlock(&reg->lock);
+}
+
+git_filter *git_process_filter_new(void)
+{
+	git_filter *f = git__calloc(1, sizeof(git_filter));
+	if (f == NULL)
+		return NULL;
+
+	f->version = GIT_FILTER_VERSION;
+	f->attributes = "filter";
+	f->shutdown = git_filter_free;
+	f->check = process_filter_check;
+	f->apply = process_filter_apply;
+
+	return f;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_filter_process_h__
+#define INCLUDE_filter_process_h__
+
+#include "common.h"
+#include "vector.h"
+
+/*
+ * Filter drivers configured with `filter.<driver>.process` run as one
+ * long-lived child process per driver and repository, which is sent
+ * every file to clean or smudge using git's pkt-line based protocol.
+ * The processes are kept in a registry on the repository, and stopped
+ * when it is freed.
+ */
+typedef struct git_filter_process_registry git_filter_process_registry;
+
+extern void git_filter_process_registry_free(git_filter_process_registry *reg);
+
+/*
+ * Ask every filter process that delayed some content (because it was
+ * loaded with `GIT_FILTER__ALLOW_DELAY`) which of those paths it can
+ * deliver now, and append them to `out` as allocated strings.  Nothing
+ * is appended once there is nothing left to wait for.
+ */
+extern int git_filter_process__available(
+	git_vector *out, git_repository *repo);
+
+/* Forget about all the content the filter processes still have delayed. */
+extern void git_filter_process__clear_delayed(git_repository *repo);
+
+#endif
@@ -4,7 +4,7 @@
  * This file is part of libgit2, distributed under the GNU GPL v2 with
  * a Linking Exception. For full terms see the included COPYING file.
  */
-#include "git2/sys/hashsig.h"
+#include "hashsig.h"
 #include "fileops.h"
 #include "util.h"
 
@@ -311,6 +311,121 @@ void git_hashsig_free(git_hashsig *sig)
 	git__free(sig);
 }
 
+size_t git_hashsig__min_hashes(
+	uint32_t *out, size_t max, const git_hashsig *sig)
+{
+	size_t i, count = min((size_t)sig->mins.size, max);
+
+	/* the heap of minimums is sorted largest first */
+	for (i = 0; i < count; ++i)
+		out[i] = sig->mins.values[sig->mins.size - 1 - i];
+
+	return count;
+}
+
+git_hashsig_option_t git_hashsig__options(const git_hashsig *sig)
+{
+	return sig->opt;
+}
+
+size_t git_hashsig__memsize(const git_hashsig *sig)
+{
+	GIT_UNUSED(sig);
+	return sizeof(git_hashsig);
+}
+
+int git_hashsig__dup(git_hashsig **out, const git_hashsig *sig)
+{
+	*out = git__malloc(sizeof(git_hashsig));
+	GITERR_CHECK_ALLOC(*out);
+
+	memcpy(*out, sig, sizeof(git_hashsig));
+	return 0;
+}
+
+static void hashsig_put_u32(git_buf *out, uint32_t value)
+{
+	value = htonl(value);
+	git_buf_put(out, (const char *)&value, sizeof(value));
+}
+
+static uint32_t hashsig_get_u32(const char **buf)
+{
+	uint32_t value;
+
+	memcpy(&value, *buf, sizeof(value));
+	*buf += sizeof(value);
+
+	return ntohl(value);
+}
+
+static void hashsig_heap_write(git_buf *out, const hashsig_heap *h)
+{
+	int i;
+
+	hashsig_put_u32(out, (uint32_t)h->size);
+
+	for (i = 0; i < h->size; ++i)
+		hashsig_put_u32(out, h->values[i]);
+}
+
+static int hashsig_heap_read(
+	hashsig_heap *h, const char **buf, const char *end)
+{
+	int i;
+
+	if (end - *buf < 4)
+		return GIT_EBUFS;
+
+	h->size = (int)hashsig_get_u32(buf);
+
+	if (h->size < 0 || h->size > h->asize)
+		return -1;
+	if (end - *buf < 4 * h->size)
+		return GIT_EBUFS;
+
+	for (i = 0; i < h->size; ++i)
+		h->values[i] = hashsig_get_u32(buf);
+
+	return 0;
+}
+
+int git_hashsig__write(git_buf *out, const git_hashsig *sig)
+{
+	hashsig_put_u32(out, (uint32_t)sig->opt);
+	hashsig_put_u32(out, (uint32_t)sig->lines);
+	hashsig_heap_write(out, &sig->mins);
+	hashsig_heap_write(out, &sig->maxs);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+int git_hashsig__read(git_hashsig **out, const char **buf, const char *end)
+{
+	const char *scan = *buf;
+	git_hashsig *sig;
+	int error;
+
+	if (end - scan < 8)
+		return GIT_EBUFS;
+
+	sig = hashsig_alloc((git_hashsig_option_t)hashsig_get_u32(&scan));
+	GITERR_CHECK_ALLOC(sig);
+
+	sig->lines = hashsig_get_u32(&scan);
+
+	if ((error = hashsig_heap_read(&sig->mins, &scan, end)) < 0 ||
+		(error = hashsig_heap_read(&sig->maxs, &scan, end)) < 0) {
+		git_hashsig_free(sig);
+		return error;
+	}
+
+	*out = sig;
+	*buf = scan;
+
+	return 0;
+}
+
 static int hashsig_heap_compare(const hashsig_heap *a, const hashsig_heap *b)
 {
 	int matches = 0, i, j, cmp;
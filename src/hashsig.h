@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_hashsig_h__
+#define INCLUDE_hashsig_h__
+
+#include "git2/sys/hashsig.h"
+#include "buffer.h"
+
+/**
+ * Copy up to `max` of the smallest hashes in a signature into `out`,
+ * smallest first, and return how many were copied.  Similar files
+ * tend to share their smallest hashes, so these can be used to find
+ * likely pairs without comparing every signature with every other.
+ */
+extern size_t git_hashsig__min_hashes(
+	uint32_t *out, size_t max, const git_hashsig *sig);
+
+/**
+ * The options a signature was created with.
+ */
+extern git_hashsig_option_t git_hashsig__options(const git_hashsig *sig);
+
+/**
+ * The memory held by a signature.
+ */
+extern size_t git_hashsig__memsize(const git_hashsig *sig);
+
+/**
+ * Make a copy of a signature.
+ */
+extern int git_hashsig__dup(git_hashsig **out, const git_hashsig *sig);
+
+/**
+ * Append a portable copy of a signature to `out`.
+ */
+extern int git_hashsig__write(git_buf *out, const git_hashsig *sig);
+
+/**
+ * Read a signature written by `git_hashsig__write` from `*buf` and
+ * advance `*buf` past it.  Returns GIT_EBUFS if the data is truncated
+ * and -1 if it is not a signature.
+ */
+extern int git_hashsig__read(
+	git_hashsig **out, const char **buf, const char *end);
+
+#endif
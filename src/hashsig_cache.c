@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "hashsig_cache.h"
+#include "hashsig.h"
+#include "diff.h"
+#include "repository.h"
+#include "config.h"
+#include "fileops.h"
+#include "oidmap.h"
+
+GIT__USE_OIDMAP
+
+#define HASHSIG_CACHE_HEADER "HSIG\0\0\0\1"
+#define HASHSIG_CACHE_HEADER_LEN 8
+#define HASHSIG_CACHE_EVICT_COUNT 8
+
+typedef struct hashsig_cache_entry {
+	git_oid id;
+	git_hashsig *sig;
+	struct hashsig_cache_entry *next; /* same blob, other options */
+} hashsig_cache_entry;
+
+struct git_hashsig_cache {
+	git_mutex lock;
+	git_oidmap *map;
+	size_t used_memory;
+	size_t max_memory;
+	char *path;
+	git_buf pending;
+};
+
+static size_t entry_memsize(hashsig_cache_entry *entry)
+{
+	return sizeof(hashsig_cache_entry) + git_hashsig__memsize(entry->sig);
+}
+
+static void entry_free(hashsig_cache_entry *entry)
+{
+	hashsig_cache_entry *next;
+
+	for (; entry; entry = next) {
+		next = entry->next;
+		git_hashsig_free(entry->sig);
+		git__free(entry);
+	}
+}
+
+/* Called with lock */
+static void cache_evict_entries(git_hashsig_cache *cache)
+{
+	uint32_t seed = rand();
+	size_t evict_count = HASHSIG_CACHE_EVICT_COUNT;
+	hashsig_cache_entry *evict, *scan;
+
+	if (evict_count > kh_size(cache->map))
+		evict_count = kh_size(cache->map);
+
+	while (evict_count > 0) {
+		khiter_t pos = seed++ % kh_end(cache->map);
+
+		if (!kh_exist(cache->map, pos))
+			continue;
+
+		evict = kh_val(cache->map, pos);
+
+		for (scan = evict; scan; scan = scan->next)
+			cache->used_memory -= entry_memsize(scan);
+
+		kh_del(oid, cache->map, pos);
+		entry_free(evict);
+
+		evict_count--;
+	}
+}
+
+/* Called with lock, takes ownership of `sig` */
+static int cache_add(git_hashsig_cache *cache, const git_oid *id, git_hashsig *sig)
+{
+	hashsig_cache_entry *entry, *head = NULL, *scan;
+	git_hashsig_option_t opt = git_hashsig__options(sig);
+	khiter_t pos;
+	int error;
+
+	if ((entry = git__calloc(1, sizeof(hashsig_cache_entry))) == NULL) {
+		git_hashsig_free(sig);
+		return -1;
+	}
+
+	git_oid_cpy(&entry->id, id);
+	entry->sig = sig;
+
+	while (cache->used_memory + entry_memsize(entry) > cache->max_memory &&
+		kh_size(cache->map) > 0)
+		cache_evict_entries(cache);
+
+	pos = kh_get(oid, cache->map, id);
+
+	if (git_oidmap_valid_index(cache->map, pos)) {
+		head = kh_val(cache->map, pos);
+
+		/* a second copy of the same signature adds nothing */
+		for (scan = head; scan; scan = scan->next) {
+			if (git_hashsig__options(scan->sig) == opt) {
+				entry_free(entry);
+				return 0;
+			}
+		}
+	}
+
+	/* the new entry goes first, and its id becomes the key */
+	entry->next = head;
+	git_oidmap_insert(cache->map, &entry->id, entry, error);
+
+	if (error < 0) {
+		entry->next = NULL;
+		entry_free(entry);
+		giterr_set_oom();
+		return -1;
+	}
+
+	cache->used_memory += entry_memsize(entry);
+	return 0;
+}
+
+static void cache_load(git_hashsig_cache *cache)
+{
+	git_buf contents = GIT_BUF_INIT;
+	const char *scan, *end;
+	git_hashsig *sig;
+	git_oid id;
+
+	if (git_futils_readbuffer(&contents, cache->path) < 0) {
+		giterr_clear();
+		return;
+	}
+
+	/* anything but our own format is thrown away, and so is a file
+	 * that has grown much larger than the cache (the file is never
+	 * trimmed as entries are evicted)
+	 */
+	if (contents.size < HASHSIG_CACHE_HEADER_LEN ||
+		memcmp(contents.ptr, HASHSIG_CACHE_HEADER, HASHSIG_CACHE_HEADER_LEN) != 0 ||
+		contents.size > 2 * cache->max_memory) {
+		p_unlink(cache->path);
+		goto done;
+	}
+
+	scan = contents.ptr + HASHSIG_CACHE_HEADER_LEN;
+	end = contents.ptr + contents.size;
+
+	/* stop at the first entry that doesn't parse; a writer may have
+	 * been interrupted while appending it
+	 */
+	while (end - scan >= GIT_OID_RAWSZ) {
+		git_oid_fromraw(&id, (const unsigned char *)scan);
+		scan += GIT_OID_RAWSZ;
+
+		if (git_hashsig__read(&sig, &scan, end) < 0 ||
+			cache_add(cache, &id, sig) < 0)
+			break;
+	}
+
+done:
+	giterr_clear();
+	git_buf_free(&contents);
+}
+
+static int cache_new(git_hashsig_cache **out, git_repository *repo)
+{
+	git_hashsig_cache *cache;
+	git_config *cfg;
+	git_buf path = GIT_BUF_INIT;
+	int max_memory;
+
+	*out = NULL;
+
+	if (git_repository_config__weakptr(&cfg, repo) < 0)
+		return -1;
+
+	cache = git__calloc(1, sizeof(git_hashsig_cache));
+	GITERR_CHECK_ALLOC(cache);
+
+	max_memory = git_config__get_int_force(cfg, "diff.signaturecachesize", 0);
+	cache->max_memory = (max_memory > 0) ? (size_t)max_memory : 0;
+
+	if (git_mutex_init(&cache->lock) < 0 ||
+		(cache->map = git_oidmap_alloc()) == NULL) {
+		git_hashsig_cache_free(cache);
+		giterr_set_oom();
+		return -1;
+	}
+
+	if (cache->max_memory > 0 &&
+		git_config__get_bool_force(cfg, "diff.signaturecachefile", 0)) {
+		if (git_buf_joinpath(&path,
+				git_repository_path(repo), GIT_HASHSIG_CACHE_FILE) < 0) {
+			git_hashsig_cache_free(cache);
+			return -1;
+		}
+
+		cache->path = git_buf_detach(&path);
+		cache_load(cache);
+	}
+
+	*out = cache;
+	return 0;
+}
+
+static int cache_get(git_hashsig_cache **out, git_repository *repo)
+{
+	git_hashsig_cache *cache;
+
+	if (!repo->hashsig_cache) {
+		if (cache_new(&cache, repo) < 0)
+			return -1;
+
+		cache = git__compare_and_swap(&repo->hashsig_cache, NULL, cache);
+
+		if (cache != NULL) /* if we race, free losing allocation */
+			git_hashsig_cache_free(cache);
+	}
+
+	*out = repo->hashsig_cache->max_memory ? repo->hashsig_cache : NULL;
+	return 0;
+}
+
+void git_hashsig_cache_free(git_hashsig_cache *cache)
+{
+	hashsig_cache_entry *entry;
+
+	if (!cache)
+		return;
+
+	if (cache->map) {
+		git_oidmap_foreach_value(cache->map, entry, {
+			entry_free(entry);
+		});
+		git_oidmap_free(cache->map);
+	}
+
+	git_mutex_free(&cache->lock);
+	git_buf_free(&cache->pending);
+	git__free(cache->path);
+	git__free(cache);
+}
+
+static bool cacheable(
+	const git_diff_similarity_metric *metric, const git_oid *id)
+{
+	return metric->buffer_signature == git_diff_find_similar__hashsig_for_buf &&
+		!git_oid_iszero(id);
+}
+
+int git_hashsig_cache__lookup(
+	void **out,
+	git_repository *repo,
+	const git_diff_similarity_metric *metric,
+	const git_oid *id)
+{
+	git_hashsig_cache *cache;
+	git_hashsig_option_t opt = (git_hashsig_option_t)(intptr_t)metric->payload;
+	hashsig_cache_entry *entry = NULL;
+	khiter_t pos;
+	int error = GIT_ENOTFOUND;
+
+	*out = NULL;
+
+	if (!cacheable(metric, id))
+		return GIT_ENOTFOUND;
+
+	if (cache_get(&cache, repo) < 0)
+		return -1;
+
+	if (!cache)
+		return GIT_ENOTFOUND;
+
+	if (git_mutex_lock(&cache->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock signature cache");
+		return -1;
+	}
+
+	pos = kh_get(oid, cache->map, id);
+
+	if (git_oidmap_valid_index(cache->map, pos))
+		entry = kh_val(cache->map, pos);
+
+	for (; entry; entry = entry->next) {
+		if (git_hashsig__options(entry->sig) == opt) {
+			error = git_hashsig__dup((git_hashsig **)out, entry->sig);
+			break;
+		}
+	}
+
+	git_mutex_unlock(&cache->lock);
+	return error;
+}
+
+int git_hashsig_cache__insert(
+	git_repository *repo,
+	const git_diff_similarity_metric *metric,
+	const git_oid *id,
+	const void *sig)
+{
+	git_hashsig_cache *cache;
+	git_hashsig *copy;
+	int error;
+
+	if (!cacheable(metric, id))
+		return 0;
+
+	if (cache_get(&cache, repo) < 0)
+		return -1;
+
+	if (!cache)
+		return 0;
+
+	if (git_hashsig__dup(&copy, sig) < 0)
+		return -1;
+
+	if (git_mutex_lock(&cache->lock) < 0) {
+		git_hashsig_free(copy);
+		giterr_set(GITERR_OS, "Unable to lock signature cache");
+		return -1;
+	}
+
+	if (cache->path) {
+		git_buf_put(&cache->pending, (const char *)id->id, GIT_OID_RAWSZ);
+		git_hashsig__write(&cache->pending, copy);
+	}
+
+	error = cache_add(cache, id, copy);
+
+	git_mutex_unlock(&cache->lock);
+	return error;
+}
+
+int git_hashsig_cache__flush(git_repository *repo)
+{
+	git_hashsig_cache *cache = repo->hashsig_cache;
+	struct stat st;
+	int fd, error = 0;
+
+	if (!cache || !cache->path)
+		return 0;
+
+	if (git_mutex_lock(&cache->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock signature cache");
+		return -1;
+	}
+
+	if (!cache->pending.size)
+		goto done;
+
+	if (git_buf_oom(&cache->pending)) {
+		error = -1;
+		goto done;
+	}
+
+	if ((fd = p_open(cache->path, O_WRONLY | O_CREAT | O_APPEND, 0666)) < 0) {
+		giterr_set(GITERR_OS,
+			"Failed to open signature cache '%s'", cache->path);
+		error = -1;
+		goto done;
+	}
+
+	if ((error = p_fstat(fd, &st)) == 0 && st.st_size == 0)
+		error = p_write(fd, HASHSIG_CACHE_HEADER, HASHSIG_CACHE_HEADER_LEN);
+
+	if (!error)
+		error = p_write(fd, cache->pending.ptr, cache->pending.size);
+
+	if (error < 0)
+		giterr_set(GITERR_OS,
+			"Failed to write signature cache '%s'", cache->path);
+
+	p_close(fd);
+
+done:
+	git_buf_clear(&cache->pending);
+	git_mutex_unlock(&cache->lock);
+
+	return error;
+}
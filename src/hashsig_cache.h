@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_hashsig_cache_h__
+#define INCLUDE_hashsig_cache_h__
+
+#include "common.h"
+#include "git2/diff.h"
+
+/*
+ * Similarity signatures of blobs, kept across rename detection runs.
+ *
+ * The cache is enabled by giving it a budget in `diff.signatureCacheSize`,
+ * and `diff.signatureCacheFile` keeps its contents in `$GIT_DIR/hashsigs`
+ * so later processes can use them too.  Only signatures made by the
+ * built-in metric are cached; for other metrics the lookups never find
+ * anything and the inserts do nothing.
+ */
+
+#define GIT_HASHSIG_CACHE_FILE "hashsigs"
+
+typedef struct git_hashsig_cache git_hashsig_cache;
+
+extern void git_hashsig_cache_free(git_hashsig_cache *cache);
+
+/**
+ * Look up the signature of blob `id` for `metric`, returning a copy
+ * which the metric's `free_signature` will release, or GIT_ENOTFOUND.
+ */
+extern int git_hashsig_cache__lookup(
+	void **out,
+	git_repository *repo,
+	const git_diff_similarity_metric *metric,
+	const git_oid *id);
+
+/**
+ * Remember a copy of the signature of blob `id` for `metric`.
+ */
+extern int git_hashsig_cache__insert(
+	git_repository *repo,
+	const git_diff_similarity_metric *metric,
+	const git_oid *id,
+	const void *sig);
+
+/**
+ * Append the signatures added since the last flush to the cache file,
+ * if there is one.
+ */
+extern int git_hashsig_cache__flush(git_repository *repo);
+
+#endif
@@ -38,78 +38,135 @@ static int ident_find_id(
 	return 0;
 }
 
-static int ident_insert_id(
-	git_buf *to, const git_buf *from, const git_filter_source *src)
+/*
+ * Ident streams hold the content back until the end (binary content is
+ * left alone, and that can only be known once it has all been seen, or
+ * as soon as a NUL turns up), but write it on in place around the id
+ * rather than building a second, filtered copy.
+ */
+struct ident_stream {
+	git_writestream parent;
+	git_writestream *next;
+	const git_filter_source *src;
+	bool passthrough;
+	git_buf buffered;
+};
+
+static int ident_write_around_id(
+	git_writestream *next, const git_buf *from, const char *id, size_t id_len)
 {
-	char oid[GIT_OID_HEXSZ+1];
 	const char *id_start, *id_end, *from_end = from->ptr + from->size;
-	size_t need_size;
+	int error;
+
+	if (ident_find_id(&id_start, &id_end, from->ptr, from->size) < 0)
+		return next->write(next, from->ptr, from->size);
+
+	if ((error = next->write(next, from->ptr, (size_t)(id_start - from->ptr))) < 0 ||
+		(error = next->write(next, id, id_len)) < 0)
+		return error;
+
+	return next->write(next, id_end, (size_t)(from_end - id_end));
+}
+
+static int ident_insert_id(
+	git_writestream *next, const git_buf *from, const git_filter_source *src)
+{
+	char id[5 /* "$Id: " */ + GIT_OID_HEXSZ + 2 /* " $" */ + 1];
 
 	/* replace $Id$ with blob id */
 
 	if (!git_filter_source_id(src))
-		return GIT_PASSTHROUGH;
+		return next->write(next, from->ptr, from->size);
 
-	git_oid_tostr(oid, sizeof(oid), git_filter_source_id(src));
+	memcpy(id, "$Id: ", 5);
+	git_oid_fmt(id + 5, git_filter_source_id(src));
+	memcpy(id + 5 + GIT_OID_HEXSZ, " $", 3);
 
-	if (ident_find_id(&id_start, &id_end, from->ptr, from->size) < 0)
-		return GIT_PASSTHROUGH;
+	return ident_write_around_id(next, from, id, sizeof(id) - 1);
+}
+
+static int ident_remove_id(git_writestream *next, const git_buf *from)
+{
+	return ident_write_around_id(next, from, "$Id$", 4);
+}
+
+static int ident_stream_write(
+	git_writestream *stream, const char *buffer, size_t len)
+{
+	struct ident_stream *s = (struct ident_stream *)stream;
+	int error;
 
-	need_size = (size_t)(id_start - from->ptr) +
-		5 /* "$Id: " */ + GIT_OID_HEXSZ + 2 /* " $" */ +
-		(size_t)(from_end - id_end);
+	if (!s->passthrough) {
+		if (!memchr(buffer, '\0', len))
+			return git_buf_put(&s->buffered, buffer, len);
 
-	if (git_buf_grow(to, need_size) < 0)
-		return -1;
+		/* Don't filter binary files */
+		s->passthrough = true;
 
-	git_buf_set(to, from->ptr, (size_t)(id_start - from->ptr));
-	git_buf_put(to, "$Id: ", 5);
-	git_buf_put(to, oid, GIT_OID_HEXSZ);
-	git_buf_put(to, " $", 2);
-	git_buf_put(to, id_end, (size_t)(from_end - id_end));
+		error = s->next->write(s->next, s->buffered.ptr, s->buffered.size);
+		git_buf_free(&s->buffered);
 
-	return git_buf_oom(to) ? -1 : 0;
+		if (error < 0)
+			return error;
+	}
+
+	return s->next->write(s->next, buffer, len);
 }
 
-static int ident_remove_id(
-	git_buf *to, const git_buf *from)
+static int ident_stream_close(git_writestream *stream)
 {
-	const char *id_start, *id_end, *from_end = from->ptr + from->size;
-	size_t need_size;
+	struct ident_stream *s = (struct ident_stream *)stream;
+	int error = 0;
+
+	if (!s->passthrough) {
+		/* Don't filter binary files */
+		if (git_buf_text_is_binary(&s->buffered))
+			error = s->next->write(
+				s->next, s->buffered.ptr, s->buffered.size);
+		else if (git_filter_source_mode(s->src) == GIT_FILTER_SMUDGE)
+			error = ident_insert_id(s->next, &s->buffered, s->src);
+		else
+			error = ident_remove_id(s->next, &s->buffered);
+	}
 
-	if (ident_find_id(&id_start, &id_end, from->ptr, from->size) < 0)
-		return GIT_PASSTHROUGH;
+	git_buf_free(&s->buffered);
 
-	need_size = (size_t)(id_start - from->ptr) +
-		4 /* "$Id$" */ + (size_t)(from_end - id_end);
+	if (!error)
+		error = s->next->close(s->next);
 
-	if (git_buf_grow(to, need_size) < 0)
-		return -1;
+	return error;
+}
 
-	git_buf_set(to, from->ptr, (size_t)(id_start - from->ptr));
-	git_buf_put(to, "$Id$", 4);
-	git_buf_put(to, id_end, (size_t)(from_end - id_end));
+static void ident_stream_free(git_writestream *stream)
+{
+	struct ident_stream *s = (struct ident_stream *)stream;
 
-	return git_buf_oom(to) ? -1 : 0;
+	git_buf_free(&s->buffered);
+	git__free(s);
 }
 
-static int ident_apply(
-	git_filter     *self,
-	void          **payload,
-	git_buf        *to,
-	const git_buf  *from,
-	const git_filter_source *src)
+static int ident_stream(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
 {
+	struct ident_stream *s;
+
 	GIT_UNUSED(self); GIT_UNUSED(payload);
 
-	/* Don't filter binary files */
-	if (git_buf_text_is_binary(from))
-		return GIT_PASSTHROUGH;
+	s = git__calloc(1, sizeof(struct ident_stream));
+	GITERR_CHECK_ALLOC(s);
+
+	s->parent.write = ident_stream_write;
+	s->parent.close = ident_stream_close;
+	s->parent.free = ident_stream_free;
+	s->next = next;
+	s->src = src;
 
-	if (git_filter_source_mode(src) == GIT_FILTER_SMUDGE)
-		return ident_insert_id(to, from, src);
-	else
-		return ident_remove_id(to, from);
+	*out = (git_writestream *)s;
+	return 0;
 }
 
 git_filter *git_ident_filter_new(void)
@@ -121,7 +178,7 @@ git_filter *git_ident_filter_new(void)
 	f->version = GIT_FILTER_VERSION;
 	f->attributes = "+ident"; /* apply to files with ident attribute set */
 	f->shutdown = git_filter_free;
-	f->apply    = ident_apply;
+	f->stream   = ident_stream;
 
 	return f;
 }
@@ -188,6 +188,9 @@ static int parse_ignore_file(
 		}
 	}
 
+	if (!error)
+		error = git_attr_file__build_index(attrs);
+
 	git_mutex_unlock(&attrs->lock);
 	git__free(match);
 
@@ -371,25 +374,51 @@ void git_ignore__free(git_ignores *ignores)
 	git_vector_free(&ignores->ign_global);
 
 	git_buf_free(&ignores->dir);
+	git_buf_free(&ignores->scratch);
 }
 
-static bool ignore_lookup_in_rules(
-	int *ignored, git_attr_file *file, git_attr_path *path)
+static bool ignore_file_has_negations(git_attr_file *file)
 {
-	size_t j;
-	git_attr_fnmatch *match;
+	/* files parsed some other way are assumed to have them */
+	return !file->rule_index || file->rule_index->has_negative;
+}
+
+bool git_ignore__has_negations(git_ignores *ign)
+{
+	size_t i;
+	git_attr_file *file;
 
-	git_vector_rforeach(&file->rules, j, match) {
-		if (git_attr_fnmatch__match(match, path)) {
-			*ignored = ((match->flags & GIT_ATTR_FNMATCH_NEGATIVE) == 0) ?
-				GIT_IGNORE_TRUE : GIT_IGNORE_FALSE;
+	if (ign->ign_internal && ignore_file_has_negations(ign->ign_internal))
+		return true;
+
+	git_vector_foreach(&ign->ign_path, i, file) {
+		if (ignore_file_has_negations(file))
+			return true;
+	}
+
+	git_vector_foreach(&ign->ign_global, i, file) {
+		if (ignore_file_has_negations(file))
 			return true;
-		}
 	}
 
 	return false;
 }
 
+static bool ignore_lookup_in_rules(
+	int *ignored, git_attr_file *file, git_attr_path *path, git_buf *scratch)
+{
+	size_t pos = file->rules.length;
+	git_attr_fnmatch *match;
+
+	if (!git_attr_file__find_rule(&pos, file, path, scratch))
+		return false;
+
+	match = git_vector_get(&file->rules, pos);
+	*ignored = ((match->flags & GIT_ATTR_FNMATCH_NEGATIVE) == 0) ?
+		GIT_IGNORE_TRUE : GIT_IGNORE_FALSE;
+	return true;
+}
+
 int git_ignore__lookup(
 	int *out, git_ignores *ignores, const char *pathname, git_dir_flag dir_flag)
 {
@@ -404,18 +433,19 @@ int git_ignore__lookup(
 		return -1;
 
 	/* first process builtins - success means path was found */
-	if (ignore_lookup_in_rules(out, ignores->ign_internal, &path))
+	if (ignore_lookup_in_rules(
+			out, ignores->ign_internal, &path, &ignores->scratch))
 		goto cleanup;
 
 	/* next process files in the path */
 	git_vector_foreach(&ignores->ign_path, i, file) {
-		if (ignore_lookup_in_rules(out, file, &path))
+		if (ignore_lookup_in_rules(out, file, &path, &ignores->scratch))
 			goto cleanup;
 	}
 
 	/* last process global ignores */
 	git_vector_foreach(&ignores->ign_global, i, file) {
-		if (ignore_lookup_in_rules(out, file, &path))
+		if (ignore_lookup_in_rules(out, file, &path, &ignores->scratch))
 			goto cleanup;
 	}
 
@@ -479,18 +509,21 @@ int git_ignore_path_is_ignored(
 
 	while (1) {
 		/* first process builtins - success means path was found */
-		if (ignore_lookup_in_rules(ignored, ignores.ign_internal, &path))
+		if (ignore_lookup_in_rules(
+				ignored, ignores.ign_internal, &path, &ignores.scratch))
 			goto cleanup;
 
 		/* next process files in the path */
 		git_vector_foreach(&ignores.ign_path, i, file) {
-			if (ignore_lookup_in_rules(ignored, file, &path))
+			if (ignore_lookup_in_rules(
+					ignored, file, &path, &ignores.scratch))
 				goto cleanup;
 		}
 
 		/* last process global ignores */
 		git_vector_foreach(&ignores.ign_global, i, file) {
-			if (ignore_lookup_in_rules(ignored, file, &path))
+			if (ignore_lookup_in_rules(
+					ignored, file, &path, &ignores.scratch))
 				goto cleanup;
 		}
 
@@ -25,6 +25,7 @@
 typedef struct {
 	git_repository *repo;
 	git_buf dir; /* current directory reflected in ign_path */
+	git_buf scratch; /* lookup keys built while matching */
 	git_attr_file *ign_internal;
 	git_vector ign_path;
 	git_vector ign_global;
@@ -51,6 +52,12 @@ enum {
 
 extern int git_ignore__lookup(int *out, git_ignores *ign, const char *path, git_dir_flag dir_flag);
 
+/* True unless none of the ignore rules currently in effect is negative.
+ * Without negative rules, nothing inside an ignored directory can be
+ * anything but ignored, so there is no need to look its contents up.
+ */
+extern bool git_ignore__has_negations(git_ignores *ign);
+
 /* command line Git sometimes generates an error message if given a
  * pathspec that contains an exact match to an ignored file (provided
  * --force isn't also given).  This makes it easy to check it that has
@@ -20,6 +20,9 @@
 #include "idxmap.h"
 #include "idxbtree.h"
 #include "diff.h"
+#include "filter.h"
+#include "odb.h"
+#include "sparse.h"
 
 #include "git2/odb.h"
 #include "git2/oid.h"
@@ -29,6 +32,7 @@
 
 GIT__USE_IDXBTREE
 GIT__USE_IDXBTREE_ICASE
+GIT__USE_STRMAP
 
 #define INSERT_IN_TREE_EX(idx, tree, e) do {				\
 		printf("%s: inserting '%s' (%p) into %p, size %d\n", __func__, (e)->path, e, tree, kb_size((tree))); \
@@ -68,6 +72,10 @@ static int index_apply_to_wd_diff(git_index *index, int action, const git_strarr
 
 #define minimal_entry_size (offsetof(struct entry_short, path))
 
+/* entries handed out back to back from the entry pool must stay aligned
+ * for their 64-bit members */
+#define pool_entry_size(len) (((len) + 7) & ~((size_t)7))
+
 static const size_t INDEX_FOOTER_SIZE = GIT_OID_RAWSZ;
 static const size_t INDEX_HEADER_SIZE = 12;
 
@@ -75,9 +83,14 @@ static const unsigned int INDEX_VERSION_NUMBER = 2;
 static const unsigned int INDEX_VERSION_NUMBER_EXT = 3;
 
 static const unsigned int INDEX_HEADER_SIG = 0x44495243;
+
+/* adding at least this many files at once writes their blobs in bulk */
+#define INDEX_ADD_BATCH_MIN 128
+
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
 static const char INDEX_EXT_CONFLICT_NAME_SIG[] = {'N', 'A', 'M', 'E'};
+static const char INDEX_EXT_SPARSE_DIRS_SIG[] = {'s', 'd', 'i', 'r'};
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
@@ -135,6 +148,7 @@ struct entry_srch_key {
 struct entry_internal {
 	git_index_entry entry;
 	size_t pathlen;
+	unsigned int pooled:1; /* allocated from the index's entry_pool */
 	char path[GIT_FLEX_ARRAY];
 };
 
@@ -149,12 +163,16 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 static int read_header(struct index_header *dest, const void *buffer);
 
 static int parse_index(git_index *index, const char *buffer, size_t buffer_size);
-static bool is_index_extended(git_index *index);
+static bool is_index_extended(git_vector *entries);
 static int write_index(git_oid *checksum, git_index *index, git_filebuf *file);
 
 static void index_entry_free(git_index_entry *entry);
 static void index_entry_reuc_free(git_index_reuc_entry *reuc);
 
+static int index_sparse_expand(git_index *index, const git_index_entry *only);
+static int index_sparse_expand_for_path(git_index *index, const char *path);
+static void index_sparse_forget(git_index *index, const char *path);
+
 int git_index_entry_srch(const void *key, const void *array_member)
 {
 	const struct entry_srch_key *srch_key = key;
@@ -334,7 +352,11 @@ static void index_entry_free(git_index_entry *entry)
 		return;
 
 	memset(&entry->id, 0, sizeof(entry->id));
-	git__free(entry);
+
+	/* entries read from disk live in the index's entry pool and are
+	 * only released when the whole pool is cleared */
+	if (!((struct entry_internal *)entry)->pooled)
+		git__free(entry);
 }
 
 unsigned int git_index__create_mode(unsigned int mode)
@@ -447,6 +469,8 @@ int git_index_open(git_index **index_out, const char *index_path)
 	}
 
 	git_pool_init(&index->tree_pool, 1);
+	git_pool_init(&index->entry_pool, 1);
+	git_pool_init(&index->sparse_pool, 1);
 
 	if (index_path != NULL) {
 		index->index_file_path = git__strdup(index_path);
@@ -462,7 +486,8 @@ int git_index_open(git_index **index_out, const char *index_path)
 		git_idxbtree_alloc(&index->entries_tree, GIT_BTREE_DEFAULT_SIZE) < 0 ||
 		git_vector_init(&index->names, 8, conflict_name_cmp) < 0 ||
 		git_vector_init(&index->reuc, 8, reuc_cmp) < 0 ||
-		git_vector_init(&index->deleted, 8, git_index_entry_cmp) < 0)
+		git_vector_init(&index->deleted, 8, git_index_entry_cmp) < 0 ||
+		git_vector_init(&index->retired_pools, 0, NULL) < 0)
 		goto fail;
 
 	index->entries_cmp_path = git__strcmp_cb;
@@ -480,6 +505,7 @@ int git_index_open(git_index **index_out, const char *index_path)
 
 fail:
 	git_pool_clear(&index->tree_pool);
+	git_pool_clear(&index->entry_pool);
 	git_index_free(index);
 	return error;
 }
@@ -489,6 +515,20 @@ int git_index_new(git_index **out)
 	return git_index_open(out, NULL);
 }
 
+/* call with locked index */
+static void index_free_retired_pools(git_index *index)
+{
+	git_pool *pool;
+	size_t i;
+
+	git_vector_foreach(&index->retired_pools, i, pool) {
+		git_pool_clear(pool);
+		git__free(pool);
+	}
+
+	git_vector_clear(&index->retired_pools);
+}
+
 static void index_free(git_index *index)
 {
 	/* index iterators increment the refcount of the index, so if we
@@ -502,6 +542,11 @@ static void index_free(git_index *index)
 	git_vector_free(&index->names);
 	git_vector_free(&index->reuc);
 	git_vector_free(&index->deleted);
+	git_pool_clear(&index->entry_pool);
+	index_free_retired_pools(index);
+	git_vector_free(&index->retired_pools);
+	git_strmap_free(index->sparse_trees);
+	git_pool_clear(&index->sparse_pool);
 
 	git__free(index->index_file_path);
 	git_mutex_free(&index->lock);
@@ -518,13 +563,45 @@ void git_index_free(git_index *index)
 	GIT_REFCOUNT_DEC(index, index_free);
 }
 
+/* Release the entry pool once the index has no entries anymore; call
+ * with locked index.  While readers may still reach its entries through
+ * their snapshots, it is retired instead, to be freed along with the
+ * deleted entries, and the next read gets a pool of its own.
+ */
+static void index_free_entry_pool(git_index *index)
+{
+	git_pool *retired;
+
+	if (index->entries.length > 0)
+		return;
+
+	if (git_atomic_get(&index->readers) == 0 && !index->deleted.length) {
+		git_pool_clear(&index->entry_pool);
+		return;
+	}
+
+	if (git_pool__open_pages(&index->entry_pool) == 0 ||
+		(retired = git__malloc(sizeof(git_pool))) == NULL)
+		return;
+
+	git_pool_init(retired, 1);
+	git_pool_swap(retired, &index->entry_pool);
+
+	/* failing that, it simply stays in use until the index is freed */
+	if (git_vector_insert(&index->retired_pools, retired) < 0) {
+		git_pool_swap(retired, &index->entry_pool);
+		git__free(retired);
+	}
+}
+
 /* call with locked index */
 static void index_free_deleted(git_index *index)
 {
 	int readers = (int)git_atomic_get(&index->readers);
 	size_t i;
 
-	if (readers > 0 || !index->deleted.length)
+	if (readers > 0 ||
+		(!index->deleted.length && !index->retired_pools.length))
 		return;
 
 	for (i = 0; i < index->deleted.length; ++i) {
@@ -533,6 +610,8 @@ static void index_free_deleted(git_index *index)
 	}
 
 	git_vector_clear(&index->deleted);
+	index_free_retired_pools(index);
+	index_free_entry_pool(index);
 }
 
 /* call with locked index */
@@ -542,8 +621,13 @@ static int index_remove_entry(git_index *index, size_t pos)
 	git_index_entry *entry = git_vector_get(&index->entries, pos);
 	const git_index_entry *found = NULL;
 
-	if (entry != NULL)
+	if (entry != NULL) {
 		git_tree_cache_invalidate_path(index->tree, entry->path);
+		index_sparse_forget(index, entry->path);
+
+		if (git_index_entry__is_sparse_dir(entry))
+			index->sparse_dirs--;
+	}
 
 	LOOKUP_IN_TREE(found, index, entry);
 
@@ -585,10 +669,16 @@ int git_index_clear(git_index *index)
 		error = index_remove_entry(index, index->entries.length - 1);
 	btree = git__swap(index->entries_tree, btree);
 	index_free_deleted(index);
+	index_free_entry_pool(index);
 
 	git_index_reuc_clear(index);
 	git_index_name_clear(index);
 
+	index->sparse_dirs = 0;
+	if (index->sparse_trees)
+		git_strmap_clear(index->sparse_trees);
+	git_pool_clear(&index->sparse_pool);
+
 	git_futils_filestamp_set(&index->stamp, NULL);
 
 	git_mutex_unlock(&index->lock);
@@ -739,65 +829,215 @@ int git_index__changed_relative_to(
 
 static bool is_racy_entry(git_index *index, const git_index_entry *entry)
 {
-	/* Git special-cases submodules in the check */
-	if (S_ISGITLINK(entry->mode))
-		return false;
-
 	return git_index_entry_newer_than_index(entry, index);
 }
 
+#define RACY_CHECK_MAX_THREADS 8
+#define RACY_CHECK_ENTRIES_PER_THREAD 32
+#define RACY_CHECK_BATCH_SIZE 8
+
+typedef struct {
+	git_index_entry *entry;
+	git_filter_list *fl;
+	unsigned int hash:1;   /* stat data matches, compare the contents */
+	unsigned int serial:1; /* filters must run on the calling thread */
+	unsigned int smudge:1;
+} racy_entry;
+
+typedef struct {
+	const char *workdir;
+	racy_entry *entries;
+	bool trust_mode;
+} racy_check_data;
+
+static int racy_check_stat(size_t start, size_t end, void *payload)
+{
+	racy_check_data *data = payload;
+	git_buf path = GIT_BUF_INIT;
+	git_index_entry st_entry;
+	struct stat st;
+	racy_entry *re;
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		re = &data->entries[i];
+
+		if (git_buf_joinpath(&path, data->workdir, re->entry->path) < 0) {
+			git_buf_free(&path);
+			return -1;
+		}
+
+		memset(&st_entry, 0, sizeof(st_entry));
+
+		/* if the stat data changed, the next diff will look at the
+		 * contents anyway; smudging it costs nothing and keeps the
+		 * on-disk index honest for other readers */
+		if (p_lstat(path.ptr, &st) < 0) {
+			re->smudge = 1;
+			continue;
+		}
+
+		git_index_entry__init_from_stat(&st_entry, &st, data->trust_mode);
+
+		if (git_index_entry__stat_matches(re->entry, &st_entry))
+			re->hash = 1;
+		else
+			re->smudge = 1;
+	}
+
+	git_buf_free(&path);
+	return 0;
+}
+
+static void racy_check_hash_entry(racy_entry *re, const char *workdir)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_oid id;
+	int fd, error;
+
+	if ((error = git_buf_joinpath(&path, workdir, re->entry->path)) < 0)
+		goto done;
+
+	if (S_ISLNK(re->entry->mode)) {
+		error = git_odb__hashlink(&id, path.ptr);
+	} else if (!git__is_sizet(re->entry->file_size)) {
+		error = -1;
+	} else if ((fd = git_futils_open_ro(path.ptr)) < 0) {
+		error = fd;
+	} else {
+		error = git_odb__hashfd_filtered(&id, fd,
+			(size_t)re->entry->file_size, GIT_OBJ_BLOB, re->fl);
+		p_close(fd);
+	}
+
+done:
+	/* if we can't tell, let the next diff find out */
+	if (error < 0 || !git_oid_equal(&id, &re->entry->id))
+		re->smudge = 1;
+
+	giterr_clear();
+	git_buf_free(&path);
+}
+
+static int racy_check_hash(size_t start, size_t end, void *payload)
+{
+	racy_check_data *data = payload;
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		if (data->entries[i].hash && !data->entries[i].serial)
+			racy_check_hash_entry(&data->entries[i], data->workdir);
+	}
+
+	return 0;
+}
+
 /*
  * Force the next diff to take a look at those entries which have the
- * same timestamp as the current index.
+ * same timestamp as the current index and whose contents have changed.
+ *
+ * Entries whose stat data no longer matches the file are smudged
+ * straight away; only the ones which still look clean are re-hashed.
+ * Both passes are spread over several threads for large indexes.
  */
 static int truncate_racily_clean(git_index *index)
 {
-	size_t i;
-	int error;
+	git_repository *repo = INDEX_OWNER(index);
+	git_attr_session attr_session;
+	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
+	git_array_t(racy_entry) racy = GIT_ARRAY_INIT;
+	racy_check_data data;
 	git_index_entry *entry;
-	git_diff_options diff_opts = GIT_DIFF_OPTIONS_INIT;
-	git_diff *diff = NULL;
-	git_vector paths = GIT_VECTOR_INIT;
-	git_diff_delta *delta;
+	racy_entry *re;
+	size_t i, count;
+	int nthreads, error = 0;
 
 	/* Nothing to do if there's no repo to talk about */
-	if (!INDEX_OWNER(index))
+	if (!repo)
 		return 0;
 
 	/* If there's no workdir, we can't know where to even check */
-	if (!git_repository_workdir(INDEX_OWNER(index)))
+	if (!git_repository_workdir(repo))
 		return 0;
 
-	diff_opts.flags |= GIT_DIFF_INCLUDE_TYPECHANGE | GIT_DIFF_IGNORE_SUBMODULES | GIT_DIFF_DISABLE_PATHSPEC_MATCH;
 	git_vector_foreach(&index->entries, i, entry) {
-		if ((entry->flags_extended & GIT_IDXENTRY_UPTODATE) == 0 &&
-			is_racy_entry(index, entry))
-			git_vector_insert(&paths, (char *)entry->path);
+		/* Ensure that we have a stage 0 for this file (ie, it's not a
+		 * conflict), otherwise smudging it is quite pointless.  Git
+		 * special-cases submodules: their stat data is the directory's,
+		 * and there are no contents to hash.
+		 */
+		if ((entry->flags_extended &
+				(GIT_IDXENTRY_UPTODATE | GIT_IDXENTRY_SKIP_WORKTREE)) != 0 ||
+			GIT_IDXENTRY_STAGE(entry) != 0 ||
+			S_ISGITLINK(entry->mode) ||
+			!is_racy_entry(index, entry))
+			continue;
+
+		re = git_array_alloc(racy);
+		GITERR_CHECK_ALLOC(re);
+
+		memset(re, 0, sizeof(*re));
+		re->entry = entry;
 	}
 
-	if (paths.length == 0)
+	if ((count = git_array_size(racy)) == 0)
+		return 0;
+
+	memset(&data, 0, sizeof(data));
+	data.workdir = git_repository_workdir(repo);
+	data.entries = racy.ptr;
+	data.trust_mode = !index->distrust_filemode;
+
+	nthreads = (int)min(count / RACY_CHECK_ENTRIES_PER_THREAD,
+		RACY_CHECK_MAX_THREADS);
+
+	if ((error = git_parallel_foreach(count, RACY_CHECK_BATCH_SIZE,
+			nthreads, racy_check_stat, &data)) < 0)
 		goto done;
 
-	diff_opts.pathspec.count = paths.length;
-	diff_opts.pathspec.strings = (char **)paths.contents;
+	/* attribute lookups share a cache, so load the filters up front */
+	memset(&attr_session, 0, sizeof(attr_session));
+	git_attr_session__init(&attr_session, repo);
+	filter_opts.attr_session = &attr_session;
+	filter_opts.flags = GIT_FILTER_ALLOW_UNSAFE;
 
-	if ((error = git_diff_index_to_workdir(&diff, INDEX_OWNER(index), index, &diff_opts)) < 0)
-		return error;
+	for (i = 0; i < count; i++) {
+		re = git_array_get(racy, i);
 
-	git_vector_foreach(&diff->deltas, i, delta) {
-		entry = (git_index_entry *)git_index_get_bypath(index, delta->old_file.path, 0);
+		if (!re->hash || S_ISLNK(re->entry->mode))
+			continue;
 
-		/* Ensure that we have a stage 0 for this file (ie, it's not a
-		 * conflict), otherwise smudging it is quite pointless.
-		 */
-		if (entry)
-			entry->file_size = 0;
+		if (git_filter_list__load_ext(&re->fl, repo, NULL,
+				re->entry->path, GIT_FILTER_TO_ODB, &filter_opts) < 0) {
+			giterr_clear();
+			re->hash = 0;
+			re->smudge = 1;
+		} else if (!git_filter_list__builtin_only(re->fl)) {
+			re->serial = 1;
+		}
+	}
+
+	git_attr_session__free(&attr_session);
+
+	error = git_parallel_foreach(count, RACY_CHECK_BATCH_SIZE,
+		nthreads, racy_check_hash, &data);
+
+	for (i = 0; i < count; i++) {
+		re = git_array_get(racy, i);
+
+		if (re->serial)
+			racy_check_hash_entry(re, data.workdir);
+
+		if (re->smudge)
+			re->entry->file_size = 0;
 	}
 
 done:
-	git_diff_free(diff);
-	git_vector_free(&paths);
-	return 0;
+	for (i = 0; i < count; i++)
+		git_filter_list_free(git_array_get(racy, i)->fl);
+
+	git_array_clear(racy);
+	return error;
 }
 
 int git_index_write(git_index *index)
@@ -866,6 +1106,9 @@ const git_index_entry *git_index_get_bypath(
 
 	assert(index);
 
+	if (index_sparse_expand_for_path(index, path) < 0)
+		return NULL;
+
 	key.path = path;
 	GIT_IDXENTRY_STAGE_SET(&key, stage);
 	LOOKUP_IN_TREE(found, index, &key);
@@ -894,24 +1137,34 @@ void git_index_entry__init_from_stat(
 	entry->file_size = st->st_size;
 }
 
-static int index_entry_create(
+static int index_entry_alloc(
 	git_index_entry **out,
-	git_repository *repo,
-	const char *path)
+	const char *path,
+	size_t pathlen,
+	git_pool *pool)
 {
-	size_t pathlen = strlen(path), alloclen;
+	size_t alloclen;
 	struct entry_internal *entry;
 
-	if (!git_path_isvalid(repo, path,
-		GIT_PATH_REJECT_DEFAULTS | GIT_PATH_REJECT_DOT_GIT)) {
-		giterr_set(GITERR_INDEX, "Invalid path: '%s'", path);
-		return -1;
-	}
-
 	GITERR_CHECK_ALLOC_ADD(&alloclen, sizeof(struct entry_internal), pathlen);
 	GITERR_CHECK_ALLOC_ADD(&alloclen, alloclen, 1);
-	entry = git__calloc(1, alloclen);
-	GITERR_CHECK_ALLOC(entry);
+
+	if (pool) {
+		alloclen = pool_entry_size(alloclen);
+
+		if ((uint32_t)alloclen != alloclen) {
+			giterr_set_oom();
+			return -1;
+		}
+
+		entry = git_pool_mallocz(pool, (uint32_t)alloclen);
+		GITERR_CHECK_ALLOC(entry);
+
+		entry->pooled = 1;
+	} else {
+		entry = git__calloc(1, alloclen);
+		GITERR_CHECK_ALLOC(entry);
+	}
 
 	entry->pathlen = pathlen;
 	memcpy(entry->path, path, pathlen);
@@ -921,6 +1174,47 @@ static int index_entry_create(
 	return 0;
 }
 
+static int index_entry_create(
+	git_index_entry **out,
+	git_repository *repo,
+	const char *path,
+	git_pool *pool)
+{
+	if (!git_path_isvalid(repo, path,
+		GIT_PATH_REJECT_DEFAULTS | GIT_PATH_REJECT_DOT_GIT)) {
+		giterr_set(GITERR_INDEX, "Invalid path: '%s'", path);
+		return -1;
+	}
+
+	return index_entry_alloc(out, path, strlen(path), pool);
+}
+
+/* the path of a sparse directory entry has a trailing slash */
+static int index_sparse_dir_create(
+	git_index_entry **out,
+	git_repository *repo,
+	const char *path,
+	git_pool *pool)
+{
+	git_buf dir = GIT_BUF_INIT;
+	size_t pathlen = strlen(path);
+	bool valid;
+
+	valid = pathlen > 1 && path[pathlen - 1] == '/' &&
+		!git_buf_put(&dir, path, pathlen - 1) &&
+		git_path_isvalid(repo, dir.ptr,
+			GIT_PATH_REJECT_DEFAULTS | GIT_PATH_REJECT_DOT_GIT);
+
+	git_buf_free(&dir);
+
+	if (!valid) {
+		giterr_set(GITERR_INDEX, "Invalid sparse directory: '%s'", path);
+		return -1;
+	}
+
+	return index_entry_alloc(out, path, pathlen, pool);
+}
+
 static int index_entry_init(
 	git_index_entry **entry_out,
 	git_index *index,
@@ -936,7 +1230,7 @@ static int index_entry_init(
 			"Could not initialize index entry. "
 			"Index is not backed up by an existing repository.");
 
-	if (index_entry_create(&entry, INDEX_OWNER(index), rel_path) < 0)
+	if (index_entry_create(&entry, INDEX_OWNER(index), rel_path, NULL) < 0)
 		return -1;
 
 	/* write the blob to disk and get the oid and stat info */
@@ -1016,7 +1310,7 @@ static int index_entry_dup(
 	git_index *index,
 	const git_index_entry *src)
 {
-	if (index_entry_create(out, INDEX_OWNER(index), src->path) < 0)
+	if (index_entry_create(out, INDEX_OWNER(index), src->path, NULL) < 0)
 		return -1;
 
 	index_entry_cpy(*out, src);
@@ -1038,7 +1332,9 @@ static int index_entry_dup_nocache(
 	git_index *index,
 	const git_index_entry *src)
 {
-	if (index_entry_create(out, INDEX_OWNER(index), src->path) < 0)
+	if ((git_index_entry__is_sparse_dir(src) ?
+		index_sparse_dir_create(out, INDEX_OWNER(index), src->path, NULL) :
+		index_entry_create(out, INDEX_OWNER(index), src->path, NULL)) < 0)
 		return -1;
 
 	index_entry_cpy_nocache(*out, src);
@@ -1305,11 +1601,19 @@ static int index_insert(
 	/* this entry is now up-to-date and should not be checked for raciness */
 	entry->flags_extended |= GIT_IDXENTRY_UPTODATE;
 
+	if (index_sparse_expand_for_path(index, entry->path) < 0) {
+		index_entry_free(entry);
+		*entry_ptr = NULL;
+		return -1;
+	}
+
 	if (git_mutex_lock(&index->lock) < 0) {
 		giterr_set(GITERR_OS, "Unable to acquire index lock");
 		return -1;
 	}
 
+	index_sparse_forget(index, entry->path);
+
 	git_vector_sort(&index->entries);
 
 	/* look if an entry with this path already exists, either staged, or (if
@@ -1456,7 +1760,7 @@ static int add_repo_as_submodule(git_index_entry **out, git_index *index, const
 	struct stat st;
 	int error;
 
-	if (index_entry_create(&entry, INDEX_OWNER(index), path) < 0)
+	if (index_entry_create(&entry, INDEX_OWNER(index), path, NULL) < 0)
 		return -1;
 
 	if ((error = git_buf_joinpath(&abspath, git_repository_workdir(repo), path)) < 0)
@@ -1585,6 +1889,9 @@ int git_index_remove(git_index *index, const char *path, int stage)
 	const git_index_entry *found = NULL;
 	git_index_entry remove_key = {{ 0 }};
 
+	if (index_sparse_expand_for_path(index, path) < 0)
+		return -1;
+
 	if (git_mutex_lock(&index->lock) < 0) {
 		giterr_set(GITERR_OS, "Failed to lock index");
 		return -1;
@@ -1617,14 +1924,21 @@ int git_index_remove_directory(git_index *index, const char *dir, int stage)
 	size_t pos;
 	git_index_entry *entry;
 
+	/* sparse directories below `dir` are removed as they are */
+	if ((error = git_buf_sets(&pfx, dir)) < 0 ||
+		(error = git_path_to_dir(&pfx)) < 0 ||
+		(error = index_sparse_expand_for_path(index, pfx.ptr)) < 0) {
+		git_buf_free(&pfx);
+		return error;
+	}
+
 	if (git_mutex_lock(&index->lock) < 0) {
 		giterr_set(GITERR_OS, "Failed to lock index");
+		git_buf_free(&pfx);
 		return -1;
 	}
 
-	if (!(error = git_buf_sets(&pfx, dir)) &&
-		!(error = git_path_to_dir(&pfx)))
-		index_find(&pos, index, pfx.ptr, pfx.size, GIT_INDEX_STAGE_ANY, false);
+	index_find(&pos, index, pfx.ptr, pfx.size, GIT_INDEX_STAGE_ANY, false);
 
 	while (!error) {
 		entry = git_vector_get(&index->entries, pos);
@@ -1653,6 +1967,9 @@ int git_index_find_prefix(size_t *at_pos, git_index *index, const char *prefix)
 	size_t pos;
 	const git_index_entry *entry;
 
+	if (index_sparse_expand_for_path(index, prefix) < 0)
+		return -1;
+
 	if (git_mutex_lock(&index->lock) < 0) {
 		giterr_set(GITERR_OS, "Failed to lock index");
 		return -1;
@@ -1675,6 +1992,10 @@ int git_index__find_pos(
 	size_t *out, git_index *index, const char *path, size_t path_len, int stage)
 {
 	assert(index && path);
+
+	if (index_sparse_expand_for_path(index, path) < 0)
+		return -1;
+
 	return index_find(out, index, path, path_len, stage, true);
 }
 
@@ -1684,6 +2005,9 @@ int git_index_find(size_t *at_pos, git_index *index, const char *path)
 
 	assert(index && path);
 
+	if (index_sparse_expand_for_path(index, path) < 0)
+		return -1;
+
 	if (git_mutex_lock(&index->lock) < 0) {
 		giterr_set(GITERR_OS, "Failed to lock index");
 		return -1;
@@ -1766,6 +2090,9 @@ int git_index_conflict_add(git_index *index,
 		if ((ret = index_insert(index, &entries[i], 1, true, true)) < 0)
 			goto on_error;
 
+		/* the tree is no longer what the cache recorded for it */
+		git_tree_cache_invalidate_path(index->tree, entries[i]->path);
+
 		entries[i] = NULL; /* don't free if later entry fails */
 	}
 
@@ -2334,9 +2661,13 @@ static size_t read_entry(
 
 	entry.path = (char *)path_ptr;
 
-	if (index_entry_dup(out, index, &entry) < 0)
+	if ((git_index_entry__is_sparse_dir(&entry) ?
+		index_sparse_dir_create(out, INDEX_OWNER(index), entry.path, &index->entry_pool) :
+		index_entry_create(out, INDEX_OWNER(index), entry.path, &index->entry_pool)) < 0)
 		return 0;
 
+	index_entry_cpy(*out, &entry);
+
 	return entry_size;
 }
 
@@ -2388,6 +2719,8 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 		}
 		/* else, unsupported extension. We cannot parse this, but we can skip
 		 * it by returning `total_size */
+	} else if (memcmp(dest.signature, INDEX_EXT_SPARSE_DIRS_SIG, 4) == 0) {
+		/* only marks the index as containing sparse directory entries */
 	} else {
 		/* we cannot handle non-ignorable extensions;
 		 * in fact they aren't even defined in the standard */
@@ -2403,6 +2736,7 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 	unsigned int i;
 	struct index_header header = { 0 };
 	git_oid checksum_calculated, checksum_expected;
+	size_t fixed_size, reserve_size;
 
 #define seek_forward(_increase) { \
 	if (_increase >= buffer_size) { \
@@ -2432,6 +2766,21 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 
 	assert(!index->entries.length);
 
+	/* Entries read from disk are allocated out of the entry pool.  Every
+	 * on-disk entry takes at least `minimal_entry_size` bytes plus its
+	 * path, so this reserves enough for all of them in a single page.
+	 */
+	if (!git__multiply_sizet_overflow(&fixed_size,
+			header.entry_count, minimal_entry_size) &&
+		fixed_size < buffer_size &&
+		!git__multiply_sizet_overflow(&reserve_size,
+			header.entry_count, sizeof(struct entry_internal) + 8) &&
+		!git__add_sizet_overflow(&reserve_size,
+			reserve_size, buffer_size - fixed_size) &&
+		(uint32_t)reserve_size == reserve_size &&
+		(error = git_pool_reserve(&index->entry_pool, (uint32_t)reserve_size)) < 0)
+		goto done;
+
 	/* TODO: convert to the btree part
 	if (index->ignore_case)
 		kh_resize(idxicase, (khash_t(idxicase) *) index->entries_map, header.entry_count);
@@ -2462,6 +2811,9 @@ static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
 			goto done;
 		}
 
+		if (git_index_entry__is_sparse_dir(entry))
+			index->sparse_dirs++;
+
 		seek_forward(entry_size);
 	}
 
@@ -2515,72 +2867,611 @@ done:
 	return error;
 }
 
-static bool is_index_extended(git_index *index)
+/*
+ * Sparse index
+ *
+ * With `index.sparse` and a cone-mode sparse checkout, every directory
+ * that is entirely outside of the cone (and whose entries all have the
+ * skip-worktree bit) is written as a single sparse directory entry, so
+ * the size of the index follows the size of the cone.
+ *
+ * The sparse directory entries are part of the list of entries; they
+ * are only expanded in memory when a path inside of them is looked up
+ * or changed.  The tree ids of expanded directories are remembered until
+ * one of their entries changes, so that writing the index collapses them
+ * again without having to rebuild their trees.
+ */
+
+typedef struct {
+	git_repository *repo;
+	const char *prefix;
+	git_vector *entries;
+	git_pool *pool;
+	git_buf path;
+} expand_sparse_data;
+
+static int expand_sparse_cb(
+	const char *root, const git_tree_entry *tentry, void *payload)
 {
-	size_t i, extended;
+	expand_sparse_data *data = payload;
 	git_index_entry *entry;
 
-	extended = 0;
+	if (git_tree_entry__is_tree(tentry))
+		return 0;
 
-	git_vector_foreach(&index->entries, i, entry) {
-		entry->flags &= ~GIT_IDXENTRY_EXTENDED;
-		if (entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS) {
-			extended++;
-			entry->flags |= GIT_IDXENTRY_EXTENDED;
-		}
+	git_buf_clear(&data->path);
+
+	if (git_buf_puts(&data->path, data->prefix) < 0 ||
+		git_buf_puts(&data->path, root) < 0 ||
+		git_buf_puts(&data->path, tentry->filename) < 0 ||
+		index_entry_create(&entry, data->repo, data->path.ptr, data->pool) < 0)
+		return -1;
+
+	entry->mode = tentry->attr;
+	entry->id = tentry->oid;
+	entry->flags_extended = GIT_IDXENTRY_SKIP_WORKTREE;
+
+	if (data->path.size < GIT_IDXENTRY_NAMEMASK)
+		entry->flags = data->path.size & GIT_IDXENTRY_NAMEMASK;
+	else
+		entry->flags = GIT_IDXENTRY_NAMEMASK;
+
+	if (git_vector_insert(data->entries, entry) < 0) {
+		index_entry_free(entry);
+		return -1;
 	}
 
-	return (extended > 0);
+	return 0;
 }
 
-static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
+/* call with locked index */
+static int index_sparse_remember_dir(
+	git_index *index, const char *dir, size_t len, const git_oid *tree_id)
 {
-	void *mem = NULL;
-	struct entry_short *ondisk;
-	size_t path_len, disk_size;
 	char *path;
+	git_oid *id;
+	int error;
 
-	path_len = ((struct entry_internal *)entry)->pathlen;
-
-	if (entry->flags & GIT_IDXENTRY_EXTENDED)
-		disk_size = long_entry_size(path_len);
-	else
-		disk_size = short_entry_size(path_len);
-
-	if (git_filebuf_reserve(file, &mem, disk_size) < 0)
+	if (!index->sparse_trees &&
+		git_strmap_alloc(&index->sparse_trees) < 0)
 		return -1;
 
-	ondisk = (struct entry_short *)mem;
+	path = git_pool_strndup(&index->sparse_pool, dir, len);
+	GITERR_CHECK_ALLOC(path);
 
-	memset(ondisk, 0x0, disk_size);
+	id = git_pool_malloc(&index->sparse_pool, sizeof(git_oid));
+	GITERR_CHECK_ALLOC(id);
 
-	/**
-	 * Yes, we have to truncate.
-	 *
-	 * The on-disk format for Index entries clearly defines
-	 * the time and size fields to be 4 bytes each -- so even if
-	 * we store these values with 8 bytes on-memory, they must
-	 * be truncated to 4 bytes before writing to disk.
-	 *
-	 * In 2038 I will be either too dead or too rich to care about this
-	 */
-	ondisk->ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
-	ondisk->mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
-	ondisk->ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
-	ondisk->mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
-	ondisk->dev = htonl(entry->dev);
-	ondisk->ino = htonl(entry->ino);
-	ondisk->mode = htonl(entry->mode);
-	ondisk->uid = htonl(entry->uid);
-	ondisk->gid = htonl(entry->gid);
-	ondisk->file_size = htonl((uint32_t)entry->file_size);
+	git_oid_cpy(id, tree_id);
 
-	git_oid_cpy(&ondisk->oid, &entry->id);
+	git_strmap_insert(index->sparse_trees, path, id, error);
+	return (error < 0) ? -1 : 0;
+}
 
-	ondisk->flags = htons(entry->flags);
+/* call with locked index */
+static int index_sparse_remember(git_index *index, const git_index_entry *dir)
+{
+	return index_sparse_remember_dir(
+		index, dir->path, strlen(dir->path) - 1, &dir->id);
+}
 
-	if (entry->flags & GIT_IDXENTRY_EXTENDED) {
-		struct entry_long *ondisk_ext;
+int git_index__sparse_remember_tree(
+	git_index *index, const char *dir, const git_oid *tree_id)
+{
+	int error;
+
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to acquire index lock");
+		return -1;
+	}
+
+	error = index_sparse_remember_dir(index, dir, strlen(dir), tree_id);
+
+	git_mutex_unlock(&index->lock);
+	return error;
+}
+
+/* call with locked index */
+static void index_sparse_forget(git_index *index, const char *path)
+{
+	git_buf dir = GIT_BUF_INIT;
+	const char *slash;
+
+	if (!index->sparse_trees || !git_strmap_num_entries(index->sparse_trees))
+		return;
+
+	for (slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+		git_buf_clear(&dir);
+		if (git_buf_put(&dir, path, slash - path) < 0)
+			break;
+
+		git_strmap_delete(index->sparse_trees, dir.ptr);
+	}
+
+	git_buf_free(&dir);
+}
+
+/* Read the entries of the sparse directory `only` (or of every sparse
+ * directory, if it is NULL) in `entries` into `added`; when `remember` is
+ * given, the tree ids of the directories are remembered in that index.
+ */
+static int sparse_read_dirs(
+	git_vector *added,
+	git_vector *entries,
+	const git_index_entry *only,
+	git_repository *repo,
+	git_index *remember,
+	git_pool *pool)
+{
+	expand_sparse_data data;
+	git_index_entry *entry;
+	git_tree *tree;
+	size_t i;
+	int error = 0;
+
+	if (!repo)
+		return create_index_error(-1,
+			"Failed to expand sparse index. "
+			"The index is not backed up by an existing repository.");
+
+	memset(&data, 0, sizeof(data));
+	data.repo = repo;
+	data.entries = added;
+	data.pool = pool;
+
+	git_vector_foreach(entries, i, entry) {
+		if (!git_index_entry__is_sparse_dir(entry) ||
+			(only && entry != only))
+			continue;
+
+		if ((error = git_tree_lookup(&tree, repo, &entry->id)) < 0)
+			break;
+
+		data.prefix = entry->path;
+		error = git_tree_walk(tree, GIT_TREEWALK_PRE, expand_sparse_cb, &data);
+		git_tree_free(tree);
+
+		if (error < 0 ||
+			(remember && (error = index_sparse_remember(remember, entry)) < 0))
+			break;
+	}
+
+	git_buf_free(&data.path);
+	return error;
+}
+
+/* Put `added` in place of the expanded sparse directories in `entries` */
+static int sparse_replace_dirs(
+	git_vector *entries, const git_index_entry *only, git_vector *added)
+{
+	git_vector replaced = GIT_VECTOR_INIT;
+	git_index_entry *entry;
+	size_t i;
+	int error;
+
+	if ((error = git_vector_init(&replaced,
+			entries->length + added->length, entries->_cmp)) < 0)
+		return error;
+
+	git_vector_foreach(entries, i, entry) {
+		if ((!git_index_entry__is_sparse_dir(entry) ||
+			 (only && entry != only)) &&
+			(error = git_vector_insert(&replaced, entry)) < 0)
+			goto done;
+	}
+
+	git_vector_foreach(added, i, entry) {
+		if ((error = git_vector_insert(&replaced, entry)) < 0)
+			goto done;
+	}
+
+	git_vector_sort(&replaced);
+	git_vector_swap(&replaced, entries);
+
+done:
+	git_vector_free(&replaced);
+	return error;
+}
+
+/* Replace the sparse directory entry `only` (or every sparse directory
+ * entry, if it is NULL) with the entries of its tree.
+ */
+static int index_sparse_expand(git_index *index, const git_index_entry *only)
+{
+	git_vector added = GIT_VECTOR_INIT, old_entries = GIT_VECTOR_INIT;
+	git_index_entry *entry;
+	size_t i, expanded = 0;
+	int error = 0;
+
+	if (!index->sparse_dirs)
+		return 0;
+
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to acquire index lock");
+		return -1;
+	}
+
+	if ((error = sparse_read_dirs(&added, &index->entries, only,
+			INDEX_OWNER(index), index, NULL)) < 0 ||
+		(error = git_vector_dup(&old_entries, &index->entries, NULL)) < 0 ||
+		(error = sparse_replace_dirs(&index->entries, only, &added)) < 0)
+		goto done;
+
+	/* nothing can fail from here on */
+	git_vector_foreach(&old_entries, i, entry) {
+		if (!git_index_entry__is_sparse_dir(entry) ||
+			(only && entry != only))
+			continue;
+
+		DELETE_IN_TREE(index, entry);
+
+		if (git_atomic_get(&index->readers) > 0)
+			git_vector_insert(&index->deleted, entry);
+		else
+			index_entry_free(entry);
+
+		expanded++;
+	}
+
+	git_vector_foreach(&added, i, entry)
+		INSERT_IN_TREE(index, entry);
+
+	git_vector_clear(&added);
+
+	index->sparse_dirs -= expanded;
+
+done:
+	git_vector_foreach(&added, i, entry)
+		index_entry_free(entry);
+
+	git_vector_free(&added);
+	git_vector_free(&old_entries);
+
+	git_mutex_unlock(&index->lock);
+	return error;
+}
+
+int git_index_snapshot_expand(
+	git_vector *snap,
+	git_index *index,
+	const git_index_entry *only,
+	git_pool *pool)
+{
+	git_vector added = GIT_VECTOR_INIT;
+	int error;
+
+	if ((error = sparse_read_dirs(
+			&added, snap, only, INDEX_OWNER(index), NULL, pool)) == 0)
+		error = sparse_replace_dirs(snap, only, &added);
+
+	git_vector_free(&added);
+	return error;
+}
+
+/* expand the sparse directory that `path` is inside of, if there is one */
+static int index_sparse_expand_for_path(git_index *index, const char *path)
+{
+	git_buf dir = GIT_BUF_INIT;
+	git_index_entry key = {{ 0 }};
+	const git_index_entry *found = NULL;
+	const char *slash;
+	int error = 0;
+
+	if (!index->sparse_dirs)
+		return 0;
+
+	for (slash = strchr(path, '/'); slash && slash[1] != '\0';
+		 slash = strchr(slash + 1, '/')) {
+		git_buf_clear(&dir);
+		if ((error = git_buf_put(&dir, path, slash - path + 1)) < 0)
+			break;
+
+		key.path = dir.ptr;
+		LOOKUP_IN_TREE(found, index, &key);
+
+		if (found && git_index_entry__is_sparse_dir(found))
+			break;
+
+		found = NULL;
+	}
+
+	git_buf_free(&dir);
+
+	if (!error && found)
+		error = index_sparse_expand(index, found);
+
+	return error;
+}
+
+/* Find the top-most directory of `path` below the first `skip` characters
+ * that lies entirely outside of the cone, returning the length of its name
+ * or 0 if there is none.
+ */
+static size_t index_sparse_outside_dir(
+	git_sparse *sparse, const char *path, size_t skip)
+{
+	git_buf dir = GIT_BUF_INIT;
+	const char *slash;
+	size_t len = 0;
+
+	for (slash = strchr(path + skip + (skip > 0), '/'); slash;
+		 slash = strchr(slash + 1, '/')) {
+		git_buf_clear(&dir);
+		if (git_buf_put(&dir, path, slash - path) < 0)
+			break;
+
+		if (git_sparse__dir_outside(sparse, dir.ptr)) {
+			len = dir.size;
+			break;
+		}
+	}
+
+	git_buf_free(&dir);
+	return len;
+}
+
+static const git_oid *index_sparse_tree_id(
+	git_index *index, const char *path, size_t len)
+{
+	git_buf dir = GIT_BUF_INIT;
+	const git_tree_cache *cache;
+	const git_oid *id = NULL;
+	khiter_t pos;
+
+	if (git_buf_put(&dir, path, len) < 0)
+		return NULL;
+
+	if (index->sparse_trees &&
+		git_strmap_valid_index(index->sparse_trees,
+			(pos = git_strmap_lookup_index(index->sparse_trees, dir.ptr))))
+		id = git_strmap_value_at(index->sparse_trees, pos);
+	else if ((cache = git_tree_cache_get(index->tree, dir.ptr)) != NULL &&
+		cache->entry_count >= 0)
+		id = &cache->oid;
+
+	git_buf_free(&dir);
+	return id;
+}
+
+static bool index_sparse_can_collapse(const git_index_entry *entry)
+{
+	return GIT_IDXENTRY_STAGE(entry) == 0 &&
+		(entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0 &&
+		!git_index_entry__is_sparse_dir(entry);
+}
+
+/* Load the sparse checkout definition if the index is to be written as a
+ * sparse index and get the index ready for it: expand sparse directories
+ * that the cone has grown into.  Directories whose tree id is not known
+ * are simply written expanded.
+ */
+static int index_sparse_prepare(git_sparse **out, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_index_entry *entry;
+	size_t i;
+	int enabled = 0, error;
+
+	*out = NULL;
+
+	if (repo != NULL &&
+		((error = git_repository__cvar(&enabled, repo, GIT_CVAR_SPARSEINDEX)) < 0 ||
+		 (enabled && (error = git_sparse__load(out, repo)) < 0)))
+		return error;
+
+	if (*out == NULL)
+		return index_sparse_expand(index, NULL);
+
+	/* the expanded entries take the place of the directory */
+	git_vector_foreach(&index->entries, i, entry) {
+		if (git_index_entry__is_sparse_dir(entry) &&
+			!git_sparse__dir_outside(*out, entry->path) &&
+			(error = index_sparse_expand(index, entry)) < 0)
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	git_sparse__free(*out);
+	*out = NULL;
+	return error;
+}
+
+static int index_sparse_dir_for_write(
+	git_index_entry **out,
+	const char *path,
+	size_t len,
+	const git_oid *id,
+	git_pool *pool)
+{
+	struct entry_internal *dir;
+	size_t alloclen;
+
+	GITERR_CHECK_ALLOC_ADD(&alloclen, sizeof(struct entry_internal), len);
+	GITERR_CHECK_ALLOC_ADD(&alloclen, alloclen, 2);
+	alloclen = pool_entry_size(alloclen);
+
+	if ((uint32_t)alloclen != alloclen) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	dir = git_pool_mallocz(pool, (uint32_t)alloclen);
+	GITERR_CHECK_ALLOC(dir);
+
+	memcpy(dir->path, path, len);
+	dir->path[len] = '/';
+	dir->pathlen = len + 1;
+	dir->entry.path = dir->path;
+	dir->entry.mode = GIT_FILEMODE_TREE;
+	dir->entry.flags = (uint16_t)min(dir->pathlen, GIT_IDXENTRY_NAMEMASK);
+	dir->entry.flags_extended = GIT_IDXENTRY_SKIP_WORKTREE;
+	git_oid_cpy(&dir->entry.id, id);
+
+	*out = &dir->entry;
+	return 0;
+}
+
+typedef struct {
+	const char *path;
+	size_t len;
+} sparse_blocked_dir;
+
+/* Replace the runs of entries that are entirely outside of the cone with
+ * sparse directory entries; call with locked index.  When a directory
+ * can't be collapsed as a whole (because it has entries that are in the
+ * working directory), its subdirectories are tried instead.
+ */
+static int index_sparse_collapse(
+	git_vector *entries, size_t *sparse_dirs, git_index *index,
+	git_sparse *sparse, git_pool *pool)
+{
+	git_vector collapsed = GIT_VECTOR_INIT;
+	git_array_t(sparse_blocked_dir) blocked = GIT_ARRAY_INIT;
+	sparse_blocked_dir *b;
+	git_index_entry *entry, *dir;
+	const git_index_entry *prev, *next;
+	const git_oid *id;
+	size_t i, j, len, skip;
+	bool collapsible;
+	int error = 0;
+
+	*sparse_dirs = 0;
+
+	if ((error = git_vector_init(&collapsed, entries->length, NULL)) < 0)
+		return error;
+
+	for (i = 0; i < entries->length; i = j) {
+		entry = git_vector_get(entries, i);
+		j = i + 1;
+
+		/* leave the blocked directories that this entry is not in */
+		while ((b = git_array_last(blocked)) != NULL &&
+			strncmp(entry->path, b->path, b->len + 1) != 0)
+			(void)git_array_pop(blocked);
+
+		skip = b ? b->len : 0;
+		len = index_sparse_can_collapse(entry) ?
+			index_sparse_outside_dir(sparse, entry->path, skip) : 0;
+
+		if (len > 0) {
+			prev = (i > 0) ? git_vector_get(entries, i - 1) : NULL;
+			collapsible = !prev || strncmp(prev->path, entry->path, len + 1);
+
+			for (; j < entries->length; ++j) {
+				next = git_vector_get(entries, j);
+
+				if (strncmp(next->path, entry->path, len + 1) != 0)
+					break;
+
+				collapsible = collapsible && index_sparse_can_collapse(next);
+			}
+
+			if (collapsible &&
+				(id = index_sparse_tree_id(index, entry->path, len)) != NULL) {
+				if ((error = index_sparse_dir_for_write(
+						&dir, entry->path, len, id, pool)) < 0 ||
+					(error = git_vector_insert(&collapsed, dir)) < 0)
+					goto done;
+
+				(*sparse_dirs)++;
+				continue;
+			}
+
+			/* look at this entry again, below the blocked directory */
+			if ((b = git_array_alloc(blocked)) == NULL) {
+				error = -1;
+				goto done;
+			}
+
+			b->path = entry->path;
+			b->len = len;
+			j = i;
+			continue;
+		}
+
+		if (git_index_entry__is_sparse_dir(entry))
+			(*sparse_dirs)++;
+
+		if ((error = git_vector_insert(&collapsed, entry)) < 0)
+			goto done;
+	}
+
+	git_vector_swap(&collapsed, entries);
+
+done:
+	git_array_clear(blocked);
+	git_vector_free(&collapsed);
+	return error;
+}
+
+static bool is_index_extended(git_vector *entries)
+{
+	size_t i, extended;
+	git_index_entry *entry;
+
+	extended = 0;
+
+	git_vector_foreach(entries, i, entry) {
+		entry->flags &= ~GIT_IDXENTRY_EXTENDED;
+		if (entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS) {
+			extended++;
+			entry->flags |= GIT_IDXENTRY_EXTENDED;
+		}
+	}
+
+	return (extended > 0);
+}
+
+static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
+{
+	void *mem = NULL;
+	struct entry_short *ondisk;
+	size_t path_len, disk_size;
+	char *path;
+
+	path_len = ((struct entry_internal *)entry)->pathlen;
+
+	if (entry->flags & GIT_IDXENTRY_EXTENDED)
+		disk_size = long_entry_size(path_len);
+	else
+		disk_size = short_entry_size(path_len);
+
+	if (git_filebuf_reserve(file, &mem, disk_size) < 0)
+		return -1;
+
+	ondisk = (struct entry_short *)mem;
+
+	memset(ondisk, 0x0, disk_size);
+
+	/**
+	 * Yes, we have to truncate.
+	 *
+	 * The on-disk format for Index entries clearly defines
+	 * the time and size fields to be 4 bytes each -- so even if
+	 * we store these values with 8 bytes on-memory, they must
+	 * be truncated to 4 bytes before writing to disk.
+	 *
+	 * In 2038 I will be either too dead or too rich to care about this
+	 */
+	ondisk->ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
+	ondisk->mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
+	ondisk->ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
+	ondisk->mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
+	ondisk->dev = htonl(entry->dev);
+	ondisk->ino = htonl(entry->ino);
+	ondisk->mode = htonl(entry->mode);
+	ondisk->uid = htonl(entry->uid);
+	ondisk->gid = htonl(entry->gid);
+	ondisk->file_size = htonl((uint32_t)entry->file_size);
+
+	git_oid_cpy(&ondisk->oid, &entry->id);
+
+	ondisk->flags = htons(entry->flags);
+
+	if (entry->flags & GIT_IDXENTRY_EXTENDED) {
+		struct entry_long *ondisk_ext;
 		ondisk_ext = (struct entry_long *)ondisk;
 		ondisk_ext->flags_extended = htons(entry->flags_extended &
 			GIT_IDXENTRY_EXTENDED_FLAGS);
@@ -2594,37 +3485,42 @@ static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
 	return 0;
 }
 
-static int write_entries(git_index *index, git_filebuf *file)
+/* Collect the entries as they go on disk; call with locked index */
+static int entries_for_write(
+	git_vector *out,
+	size_t *sparse_dirs,
+	git_index *index,
+	git_sparse *sparse,
+	git_pool *pool)
 {
-	int error = 0;
-	size_t i;
-	git_vector case_sorted, *entries;
-	git_index_entry *entry;
+	int error;
 
-	if (git_mutex_lock(&index->lock) < 0) {
-		giterr_set(GITERR_OS, "Failed to lock index");
-		return -1;
-	}
+	*sparse_dirs = 0;
 
 	/* If index->entries is sorted case-insensitively, then we need
 	 * to re-sort it case-sensitively before writing */
-	if (index->ignore_case) {
-		git_vector_dup(&case_sorted, &index->entries, git_index_entry_cmp);
-		git_vector_sort(&case_sorted);
-		entries = &case_sorted;
-	} else {
-		entries = &index->entries;
-	}
+	if ((error = git_vector_dup(out, &index->entries, git_index_entry_cmp)) < 0)
+		return error;
+
+	if (index->ignore_case)
+		git_vector_sort(out);
+
+	if (sparse != NULL)
+		error = index_sparse_collapse(out, sparse_dirs, index, sparse, pool);
+
+	return error;
+}
+
+static int write_entries(git_vector *entries, git_filebuf *file)
+{
+	int error = 0;
+	size_t i;
+	git_index_entry *entry;
 
 	git_vector_foreach(entries, i, entry)
 		if ((error = write_disk_entry(file, entry)) < 0)
 			break;
 
-	git_mutex_unlock(&index->lock);
-
-	if (index->ignore_case)
-		git_vector_free(&case_sorted);
-
 	return error;
 }
 
@@ -2766,6 +3662,17 @@ static int write_tree_extension(git_index *index, git_filebuf *file)
 	return error;
 }
 
+static int write_sparse_extension(git_filebuf *file)
+{
+	struct index_extension extension;
+	git_buf buf = GIT_BUF_INIT;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_SPARSE_DIRS_SIG, 4);
+
+	return write_extension(file, &extension, &buf);
+}
+
 static void clear_uptodate(git_index *index)
 {
 	git_index_entry *entry;
@@ -2779,26 +3686,59 @@ static int write_index(git_oid *checksum, git_index *index, git_filebuf *file)
 {
 	git_oid hash_final;
 	struct index_header header;
+	git_vector entries = GIT_VECTOR_INIT;
+	git_sparse *sparse = NULL;
+	git_pool sparse_pool;
+	size_t sparse_dirs = 0;
 	bool is_extended;
 	uint32_t index_version_number;
+	int error;
 
 	assert(index && file);
 
-	is_extended = is_index_extended(index);
-	index_version_number = is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER;
+	if ((error = index_sparse_prepare(&sparse, index)) < 0)
+		return error;
 
-	header.signature = htonl(INDEX_HEADER_SIG);
-	header.version = htonl(index_version_number);
-	header.entry_count = htonl((uint32_t)index->entries.length);
+	git_pool_init(&sparse_pool, 1);
 
-	if (git_filebuf_write(file, &header, sizeof(struct index_header)) < 0)
-		return -1;
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Failed to lock index");
+		error = -1;
+		goto done;
+	}
+
+	if ((error = entries_for_write(
+			&entries, &sparse_dirs, index, sparse, &sparse_pool)) == 0) {
+		is_extended = is_index_extended(&entries);
+		index_version_number = is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER;
+
+		header.signature = htonl(INDEX_HEADER_SIG);
+		header.version = htonl(index_version_number);
+		header.entry_count = htonl((uint32_t)entries.length);
+
+		if ((error = git_filebuf_write(file, &header, sizeof(struct index_header))) == 0)
+			error = write_entries(&entries, file);
+	}
+
+	git_mutex_unlock(&index->lock);
+
+done:
+	git_vector_free(&entries);
+	git_pool_clear(&sparse_pool);
+	git_sparse__free(sparse);
+
+	if (error < 0)
+		return error;
 
-	if (write_entries(index, file) < 0)
+	/* write the tree cache extension; its entry counts only describe
+	 * the full index, so a sparse index goes without
+	 */
+	if (index->tree != NULL && !sparse_dirs &&
+		write_tree_extension(index, file) < 0)
 		return -1;
 
-	/* write the tree cache extension */
-	if (index->tree != NULL && write_tree_extension(index, file) < 0)
+	/* mark the index as sparse for other readers */
+	if (sparse_dirs > 0 && write_sparse_extension(file) < 0)
 		return -1;
 
 	/* write the rename conflict extension */
@@ -2841,6 +3781,70 @@ typedef struct read_tree_data {
 	git_tree_cache *tree;
 } read_tree_data;
 
+/* Keep a sparse directory of the old index whose tree is unchanged */
+static int read_tree_sparse_dir(
+	read_tree_data *data, const char *root, const git_tree_entry *tentry)
+{
+	git_index_entry *entry = NULL, *old_entry;
+	git_buf path = GIT_BUF_INIT;
+	size_t pos;
+	int error;
+
+	if (!data->index->sparse_dirs)
+		return 0;
+
+	if (git_buf_joinpath(&path, root, tentry->filename) < 0 ||
+		git_buf_putc(&path, '/') < 0)
+		return -1;
+
+	if (index_find_in_entries(
+			&pos, data->old_entries, data->entry_cmp, path.ptr, 0, 0) < 0 ||
+		(old_entry = git_vector_get(data->old_entries, pos)) == NULL ||
+		!git_index_entry__is_sparse_dir(old_entry) ||
+		!git_oid_equal(&old_entry->id, &tentry->oid)) {
+		git_buf_free(&path);
+		return 0;
+	}
+
+	error = index_sparse_dir_create(
+		&entry, INDEX_OWNER(data->index), path.ptr, NULL);
+	git_buf_free(&path);
+
+	if (error < 0)
+		return error;
+
+	index_entry_cpy(entry, old_entry);
+
+	if (git_vector_insert(data->new_entries, entry) < 0) {
+		index_entry_free(entry);
+		return -1;
+	}
+
+	/* don't walk into the directory */
+	return 1;
+}
+
+/* Is `path` inside of a sparse directory of the old index? */
+static bool read_tree_in_sparse_dir(read_tree_data *data, const char *path)
+{
+	const git_index_entry *old_entry;
+	const char *slash;
+	size_t pos;
+
+	if (!data->index->sparse_dirs)
+		return false;
+
+	for (slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+		if (!index_find_in_entries(&pos, data->old_entries,
+				data->entry_cmp, path, slash - path + 1, 0) &&
+			(old_entry = git_vector_get(data->old_entries, pos)) != NULL &&
+			git_index_entry__is_sparse_dir(old_entry))
+			return true;
+	}
+
+	return false;
+}
+
 static int read_tree_cb(
 	const char *root, const git_tree_entry *tentry, void *payload)
 {
@@ -2850,12 +3854,12 @@ static int read_tree_cb(
 	size_t pos;
 
 	if (git_tree_entry__is_tree(tentry))
-		return 0;
+		return read_tree_sparse_dir(data, root, tentry);
 
 	if (git_buf_joinpath(&path, root, tentry->filename) < 0)
 		return -1;
 
-	if (index_entry_create(&entry, INDEX_OWNER(data->index), path.ptr) < 0)
+	if (index_entry_create(&entry, INDEX_OWNER(data->index), path.ptr, NULL) < 0)
 		return -1;
 
 	entry->mode = tentry->attr;
@@ -2870,9 +3874,13 @@ static int read_tree_cb(
 		git_oid_equal(&entry->id, &old_entry->id))
 	{
 		index_entry_cpy(entry, old_entry);
-		entry->flags_extended = 0;
+		entry->flags_extended &= GIT_IDXENTRY_SKIP_WORKTREE;
 	}
 
+	/* entries of a changed sparse directory are still not checked out */
+	else if (read_tree_in_sparse_dir(data, path.ptr))
+		entry->flags_extended |= GIT_IDXENTRY_SKIP_WORKTREE;
+
 	if (path.size < GIT_IDXENTRY_NAMEMASK)
 		entry->flags = path.size & GIT_IDXENTRY_NAMEMASK;
 	else
@@ -2897,6 +3905,8 @@ int git_index_read_tree(git_index *index, const git_tree *tree)
 	size_t i;
 	git_index_entry *e;
 
+	/* the skip-worktree bits of the old entries are carried over, and
+	 * unchanged sparse directories are kept as they are */
 	if (git_idxbtree_alloc(&entries_tree, GIT_BTREE_DEFAULT_SIZE) < 0)
 		return -1;
 
@@ -2913,7 +3923,7 @@ int git_index_read_tree(git_index *index, const git_tree *tree)
 	if (index_sort_if_needed(index, true) < 0)
 		return -1;
 
-	if ((error = git_tree_walk(tree, GIT_TREEWALK_POST, read_tree_cb, &data)) < 0)
+	if ((error = git_tree_walk(tree, GIT_TREEWALK_PRE, read_tree_cb, &data)) < 0)
 		goto cleanup;
 
 	/* TODO: convert to the btree
@@ -2946,6 +3956,12 @@ int git_index_read_tree(git_index *index, const git_tree *tree)
 	} else {
 		git_vector_swap(&entries, &index->entries);
 		entries_tree = git__swap(index->entries_tree, entries_tree);
+
+		git_vector_foreach(&index->entries, i, e) {
+			if (git_index_entry__is_sparse_dir(e))
+				index->sparse_dirs++;
+		}
+
 		git_mutex_unlock(&index->lock);
 	}
 
@@ -2965,7 +3981,8 @@ int git_index_read_index(
 	const git_index *new_index)
 {
 	git_vector new_entries = GIT_VECTOR_INIT,
-		remove_entries = GIT_VECTOR_INIT;
+		remove_entries = GIT_VECTOR_INIT,
+		changed_entries = GIT_VECTOR_INIT;
 	git_idxbtree *new_entries_tree = NULL;
 	git_iterator *index_iterator = NULL;
 	git_iterator *new_iterator = NULL;
@@ -2977,7 +3994,8 @@ int git_index_read_index(
 
 	if ((error = git_vector_init(&new_entries, new_index->entries.length, index->entries._cmp)) < 0 ||
 		(error = git_vector_init(&remove_entries, index->entries.length, NULL)) < 0 ||
-		(error = git_idxbtree_alloc(&new_entries_tree, index->entries.length)) < 0)
+		(error = git_vector_init(&changed_entries, 0, NULL)) < 0 ||
+		(error = git_idxbtree_alloc(&new_entries_tree, GIT_BTREE_DEFAULT_SIZE)) < 0)
 		goto done;
 
 	/* TODO: implement for btree
@@ -2987,7 +4005,9 @@ int git_index_read_index(
 		kh_resize(idx, new_entries_map, new_index->entries.length);
 	*/
 
-	opts.flags = GIT_ITERATOR_DONT_IGNORE_CASE;
+	/* sparse directories are compared like any other entry */
+	opts.flags = GIT_ITERATOR_DONT_IGNORE_CASE |
+		GIT_ITERATOR_INCLUDE_SPARSE_DIRS;
 
 	if ((error = git_iterator_for_index(&index_iterator, index, &opts)) < 0 ||
 		(error = git_iterator_for_index(&new_iterator, (git_index *)new_index, &opts)) < 0)
@@ -3032,8 +4052,11 @@ int git_index_read_index(
 		}
 
 		if (dup_entry) {
-			if ((error = index_entry_dup_nocache(&add_entry, index, dup_entry)) < 0)
+			if ((error = index_entry_dup_nocache(&add_entry, index, dup_entry)) < 0 ||
+				(error = git_vector_insert(&changed_entries, add_entry)) < 0) {
+				index_entry_free(add_entry);
 				goto done;
+			}
 		}
 
 		if (add_entry) {
@@ -3068,10 +4091,26 @@ int git_index_read_index(
 	git_vector_swap(&new_entries, &index->entries);
 	new_entries_tree = git__swap(index->entries_tree, new_entries_tree);
 
+	index->sparse_dirs = 0;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (git_index_entry__is_sparse_dir(entry))
+			index->sparse_dirs++;
+	}
+
+	/* trees holding added or modified entries are out of date, too */
+	git_vector_foreach(&changed_entries, i, entry) {
+		if (index->tree)
+			git_tree_cache_invalidate_path(index->tree, entry->path);
+
+		index_sparse_forget(index, entry->path);
+	}
+
 	git_vector_foreach(&remove_entries, i, entry) {
 		if (index->tree)
 			git_tree_cache_invalidate_path(index->tree, entry->path);
 
+		index_sparse_forget(index, entry->path);
 		index_entry_free(entry);
 	}
 
@@ -3081,6 +4120,7 @@ done:
 	git_idxbtree_free(new_entries_tree);
 	git_vector_free(&new_entries);
 	git_vector_free(&remove_entries);
+	git_vector_free(&changed_entries);
 	git_iterator_free(index_iterator);
 	git_iterator_free(new_iterator);
 	return error;
@@ -3145,6 +4185,7 @@ struct foreach_diff_data {
 	unsigned int flags;
 	git_index_matched_path_cb cb;
 	void *payload;
+	git_vector adds;
 };
 
 static int apply_each_file(const git_diff_delta *delta, float progress, void *payload)
@@ -3159,8 +4200,8 @@ static int apply_each_file(const git_diff_delta *delta, float progress, void *pa
 
 	/* We only want those which match the pathspecs */
 	if (!git_pathspec__match(
-		    &data->pathspec->pathspec, path, false, (bool)data->index->ignore_case,
-		    &match, NULL))
+		    &data->pathspec->pathspec, data->pathspec->trie, path, false,
+		    (bool)data->index->ignore_case, &match, NULL))
 		return 0;
 
 	if (data->cb)
@@ -3171,20 +4212,77 @@ static int apply_each_file(const git_diff_delta *delta, float progress, void *pa
 	if (error < 0) /* actual error */
 		return error;
 
-	/* If the workdir item does not exist, remove it from the index. */
+	/* If the workdir item does not exist, remove it from the index;
+	 * additions are collected so that the blobs can be created in bulk. */
 	if ((delta->new_file.flags & GIT_DIFF_FLAG_EXISTS) == 0)
 		error = git_index_remove_bypath(data->index, path);
 	else
-		error = git_index_add_bypath(data->index, delta->new_file.path);
+		error = git_vector_insert(&data->adds, (char *)delta->new_file.path);
 
 	return error;
 }
 
+static int index_add_bypaths(git_index *index, git_vector *paths)
+{
+	git_blob_batch_entry *entries = NULL, *be;
+	git_index_entry *entry;
+	const char *path;
+	size_t i;
+	int error = 0;
+
+	if (paths->length >= INDEX_ADD_BATCH_MIN) {
+		entries = git__calloc(paths->length, sizeof(git_blob_batch_entry));
+		GITERR_CHECK_ALLOC(entries);
+
+		git_vector_foreach(paths, i, path)
+			entries[i].path = path;
+
+		if ((error = git_blob__create_from_workdir_batch(
+				INDEX_OWNER(index), entries, paths->length)) < 0)
+			goto done;
+	}
+
+	/* the index itself is only ever touched from this thread */
+	git_vector_foreach(paths, i, path) {
+		be = entries ? &entries[i] : NULL;
+
+		if (!be || be->serial) {
+			if ((error = git_index_add_bypath(index, path)) < 0)
+				break;
+
+			continue;
+		}
+
+		if ((error = index_entry_create(
+				&entry, INDEX_OWNER(index), path, NULL)) < 0)
+			break;
+
+		entry->id = be->id;
+		git_index_entry__init_from_stat(
+			entry, &be->st, !index->distrust_filemode);
+
+		if ((error = index_insert(index, &entry, 1, false, false)) < 0)
+			break;
+
+		/* as in git_index_add_bypath */
+		if ((error = index_conflict_to_reuc(index, path)) < 0 &&
+			error != GIT_ENOTFOUND)
+			break;
+
+		error = 0;
+		git_tree_cache_invalidate_path(index->tree, entry->path);
+	}
+
+done:
+	git__free(entries);
+	return error;
+}
+
 static int index_apply_to_wd_diff(git_index *index, int action, const git_strarray *paths,
 				  unsigned int flags,
 				  git_index_matched_path_cb cb, void *payload)
 {
-	int error;
+	int error, add_error;
 	git_diff *diff;
 	git_pathspec ps;
 	git_repository *repo;
@@ -3195,6 +4293,7 @@ static int index_apply_to_wd_diff(git_index *index, int action, const git_strarr
 		flags,
 		cb,
 		payload,
+		GIT_VECTOR_INIT,
 	};
 
 	assert(index);
@@ -3229,6 +4328,12 @@ static int index_apply_to_wd_diff(git_index *index, int action, const git_strarr
 
 	data.pathspec = &ps;
 	error = git_diff_foreach(diff, apply_each_file, NULL, NULL, NULL, &data);
+
+	/* files matched before the iteration stopped are still added */
+	if ((add_error = index_add_bypaths(index, &data.adds)) < 0 && !error)
+		error = add_error;
+
+	git_vector_free(&data.adds);
 	git_diff_free(diff);
 
 	if (error) /* make sure error is set if callback stopped iteration */
@@ -3262,10 +4367,25 @@ static int index_apply_to_all(
 	for (i = 0; !error && i < index->entries.length; ++i) {
 		git_index_entry *entry = git_vector_get(&index->entries, i);
 
+		/* look at the entries of a sparse directory the pathspec may
+		 * match inside of, and leave any other one alone */
+		if (git_index_entry__is_sparse_dir(entry)) {
+			if (action == INDEX_ACTION_UPDATE ||
+				!git_pathspec__trie_may_match(
+					ps.trie, entry->path, strlen(entry->path), true))
+				continue;
+
+			if ((error = index_sparse_expand(index, entry)) < 0)
+				break;
+
+			i--; /* the first of its entries took its place */
+			continue;
+		}
+
 		/* check if path actually matches */
 		if (!git_pathspec__match(
-				&ps.pathspec, entry->path, false, (bool)index->ignore_case,
-				&match, NULL))
+				&ps.pathspec, ps.trie, entry->path, false,
+				(bool)index->ignore_case, &match, NULL))
 			continue;
 
 		/* issue notification callback if requested */
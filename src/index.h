@@ -13,6 +13,7 @@
 #include "idxmap.h"
 #include "idxbtree.h"
 #include "tree-cache.h"
+#include "strmap.h"
 #include "git2/odb.h"
 #include "git2/index.h"
 
@@ -41,6 +42,14 @@ struct git_index {
 	git_tree_cache *tree;
 	git_pool tree_pool;
 
+	git_pool entry_pool; /* entries read from disk; freed as a whole */
+	git_vector retired_pools; /* entry pools of replaced reads, still
+	                           * reachable through readers' snapshots */
+
+	size_t sparse_dirs;       /* number of sparse directory entries */
+	git_strmap *sparse_trees; /* tree ids of expanded sparse directories */
+	git_pool sparse_pool;
+
 	git_vector names;
 	git_vector reuc;
 
@@ -80,6 +89,34 @@ GIT_INLINE(bool) git_index_time_eq(const git_index_time *one, const git_index_ti
 	return true;
 }
 
+/*
+ * A sparse directory entry stands for a whole directory outside of the
+ * sparse checkout cone: its path ends in a slash and its id is the id
+ * of the directory's tree.
+ */
+GIT_INLINE(bool) git_index_entry__is_sparse_dir(const git_index_entry *entry)
+{
+	return entry->mode == GIT_FILEMODE_TREE &&
+		(entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0;
+}
+
+/*
+ * Test whether the stat data of `st_entry` (as filled in by
+ * `git_index_entry__init_from_stat`) is identical to that of `entry`.
+ */
+GIT_INLINE(bool) git_index_entry__stat_matches(
+	const git_index_entry *entry, const git_index_entry *st_entry)
+{
+	return entry->mode == st_entry->mode &&
+		entry->file_size == st_entry->file_size &&
+		entry->ino == st_entry->ino &&
+		entry->dev == st_entry->dev &&
+		entry->uid == st_entry->uid &&
+		entry->gid == st_entry->gid &&
+		git_index_time_eq(&entry->mtime, &st_entry->mtime) &&
+		git_index_time_eq(&entry->ctime, &st_entry->ctime);
+}
+
 /*
  * Test if the given index time is newer than the given existing index entry.
  * If the timestamps are exactly equivalent, then the given index time is
@@ -94,10 +131,14 @@ GIT_INLINE(bool) git_index_entry_newer_than_index(
 
 	/* If the timestamp is the same or newer than the index, it's racy */
 #if defined(GIT_USE_NSEC)
-	if ((int32_t)index->stamp.tv_sec < entry->mtime.seconds)
+	if ((int32_t)index->stamp.mtime.tv_sec < entry->mtime.seconds)
 		return true;
 	else if ((int32_t)index->stamp.mtime.tv_sec > entry->mtime.seconds)
 		return false;
+	/* an entry without nanoseconds may have come from a writer that
+	 * truncated them, so treat the whole second as racy */
+	else if (!entry->mtime.nanoseconds)
+		return true;
 	else
 		return (uint32_t)index->stamp.mtime.tv_nsec <= entry->mtime.nanoseconds;
 #else
@@ -116,6 +157,13 @@ extern int git_index__find_pos(
 
 extern void git_index__set_ignore_case(git_index *index, bool ignore_case);
 
+/* Record that the entries below `dir` (without trailing slash) make up the
+ * tree `tree_id`, so that a sparse index can collapse them when written;
+ * this is forgotten again as soon as one of them changes.
+ */
+extern int git_index__sparse_remember_tree(
+	git_index *index, const char *dir, const git_oid *tree_id);
+
 extern unsigned int git_index__create_mode(unsigned int mode);
 
 GIT_INLINE(const git_futils_filestamp *) git_index__filestamp(git_index *index)
@@ -136,6 +184,14 @@ extern int git_index_snapshot_find(
 	size_t *at_pos, git_vector *snap, git_vector_cmp entry_srch,
 	const char *path, size_t path_len, int stage);
 
+/* Replace the sparse directory entry `only` of a snapshot (or all of them,
+ * if it is NULL) with the entries of its tree, allocated from `pool`; the
+ * index itself is left as it is.
+ */
+extern int git_index_snapshot_expand(
+	git_vector *snap, git_index *index,
+	const git_index_entry *only, git_pool *pool);
+
 /* Replace an index with a new index */
 int git_index_read_index(git_index *index, const git_index *new_index);
 
@@ -17,6 +17,7 @@
 #include "oid.h"
 #include "oidmap.h"
 #include "zstream.h"
+#include "indexer.h"
 
 GIT__USE_OIDMAP
 
@@ -55,6 +56,13 @@ struct git_indexer {
 	/* Needed to look up objects which we want to inject to fix a thin pack */
 	git_odb *odb;
 
+	/* Told about every object as soon as its content is known */
+	git_odb__indexed_cb indexed_cb;
+	void *indexed_payload;
+	git_otype entry_type;
+	git_buf entry_data;
+	unsigned int keep_data :1;
+
 	/* Fields for calculating the packfile trailer (hash of everything before it) */
 	char inbuf[GIT_OID_RAWSZ];
 	size_t inbuf_len;
@@ -172,6 +180,15 @@ static int store_delta(git_indexer *idx)
 	return 0;
 }
 
+#define INDEXER_MAX_DATA_SIZE (32 * 1024 * 1024)
+
+/* whether the indexed callback is interested in an object */
+static bool indexer_wants_data(git_otype type, size_t size)
+{
+	return (type == GIT_OBJ_COMMIT || type == GIT_OBJ_TREE ||
+		type == GIT_OBJ_BLOB) && size <= INDEXER_MAX_DATA_SIZE;
+}
+
 static void hash_header(git_hash_ctx *ctx, git_off_t len, git_otype type)
 {
 	char buffer[64];
@@ -192,6 +209,12 @@ static int hash_object_stream(git_indexer*idx, git_packfile_stream *stream)
 			break;
 
 		git_hash_update(&idx->hash_ctx, idx->objbuf, read);
+
+		if (idx->keep_data &&
+			git_buf_put(&idx->entry_data, idx->objbuf, read) < 0) {
+			giterr_clear();
+			idx->keep_data = 0;
+		}
 	} while (read > 0);
 
 	if (read < 0)
@@ -317,6 +340,10 @@ static int store_object(git_indexer *idx)
 		idx->fanout[i]++;
 	}
 
+	if (idx->keep_data)
+		idx->indexed_cb(&oid, idx->entry_type,
+			idx->entry_data.ptr, idx->entry_data.size, idx->indexed_payload);
+
 	return 0;
 
 on_error:
@@ -391,7 +418,14 @@ static int hash_and_save(git_indexer *idx, git_rawobj *obj, git_off_t entry_star
 	if (crc_object(&entry->crc, &idx->pack->mwf, entry_start, entry_size) < 0)
 		goto on_error;
 
-	return save_entry(idx, entry, pentry, entry_start);
+	if (save_entry(idx, entry, pentry, entry_start) < 0)
+		return -1;
+
+	if (idx->indexed_cb && indexer_wants_data(obj->type, obj->len))
+		idx->indexed_cb(&oid, obj->type, obj->data, obj->len,
+			idx->indexed_payload);
+
+	return 0;
 
 on_error:
 	git__free(pentry);
@@ -593,6 +627,11 @@ int git_indexer_append(git_indexer *idx, const void *data, size_t size, git_tran
 			} else {
 				idx->have_delta = 0;
 				hash_header(&idx->hash_ctx, entry_size, type);
+
+				idx->entry_type = type;
+				idx->keep_data = idx->indexed_cb &&
+					indexer_wants_data(type, entry_size);
+				git_buf_clear(&idx->entry_data);
 			}
 
 			idx->have_stream = 1;
@@ -1063,6 +1102,13 @@ on_error:
 	return -1;
 }
 
+void git_indexer__set_indexed_cb(
+	git_indexer *idx, git_odb__indexed_cb cb, void *payload)
+{
+	idx->indexed_cb = cb;
+	idx->indexed_payload = payload;
+}
+
 void git_indexer_free(git_indexer *idx)
 {
 	if (idx == NULL)
@@ -1087,5 +1133,6 @@ void git_indexer_free(git_indexer *idx)
 
 	git_hash_ctx_cleanup(&idx->trailer);
 	git_hash_ctx_cleanup(&idx->hash_ctx);
+	git_buf_free(&idx->entry_data);
 	git__free(idx);
 }
@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_indexer_h__
+#define INCLUDE_indexer_h__
+
+#include "git2/indexer.h"
+#include "odb.h"
+
+/*
+ * Have the indexer call `cb` with the contents of every commit, tree and
+ * blob (of a sane size) in the pack once it knows them: as they are read
+ * for whole objects, and when they are resolved for deltas.
+ */
+extern void git_indexer__set_indexed_cb(
+	git_indexer *idx, git_odb__indexed_cb cb, void *payload);
+
+#endif
@@ -11,6 +11,8 @@
 #include "ignore.h"
 #include "buffer.h"
 #include "submodule.h"
+#include "pathspec.h"
+#include "sparse.h"
 #include <ctype.h>
 
 #define ITERATOR_SET_CB(P,NAME_LC) do { \
@@ -41,6 +43,7 @@
 	(P)->base.strcomp = git__strcmp; \
 	(P)->base.strncomp = git__strncmp; \
 	(P)->base.prefixcomp = git__prefixcmp; \
+	(P)->base.pathspec_trie = options ? options->pathspec_trie : NULL; \
 	(P)->base.flags = options ? options->flags & ~ITERATOR_CASE_FLAGS : 0; \
 	if ((P)->base.flags & GIT_ITERATOR_DONT_AUTOEXPAND) \
 		(P)->base.flags |= GIT_ITERATOR_INCLUDE_TREES; \
@@ -348,6 +351,7 @@ typedef struct {
 	git_pool pool;
 	git_index_entry entry;
 	git_buf path;
+	git_buf pathspec_path; /* scratch space for checking the pathspec */
 	int path_ambiguities;
 	bool path_has_filename;
 	bool entry_is_current;
@@ -444,7 +448,6 @@ static bool tree_iterator__move_to_next(
 
 static int tree_iterator__set_next(tree_iterator *ti, tree_iterator_frame *tf)
 {
-	int error = 0;
 	const git_tree_entry *te, *last = NULL;
 
 	tf->next = tf->current;
@@ -454,22 +457,11 @@ static int tree_iterator__set_next(tree_iterator *ti, tree_iterator_frame *tf)
 
 		if (last && tree_iterator__te_cmp(last, te, ti->base.strncomp))
 			break;
-
-		/* try to load trees for items in [current,next) range */
-		if (!error && git_tree_entry__is_tree(te))
-			error = git_tree_lookup(
-				&tf->entries[tf->next]->tree, ti->base.repo, &te->oid);
 	}
 
 	if (tf->next > tf->current + 1)
 		ti->path_ambiguities++;
 
-	/* if a tree lookup failed, advance over this span and return failure */
-	if (error < 0) {
-		tree_iterator__move_to_next(ti, tf);
-		return error;
-	}
-
 	if (last && !tree_iterator__current_filename(ti, last))
 		return -1; /* must have been allocation failure */
 
@@ -478,21 +470,98 @@ static int tree_iterator__set_next(tree_iterator *ti, tree_iterator_frame *tf)
 
 GIT_INLINE(bool) tree_iterator__at_tree(tree_iterator *ti)
 {
-	return (ti->head->current < ti->head->n_entries &&
-			ti->head->entries[ti->head->current]->tree != NULL);
+	tree_iterator_entry *entry;
+
+	if (ti->head->current >= ti->head->n_entries)
+		return false;
+
+	entry = ti->head->entries[ti->head->current];
+
+	return entry->te ? git_tree_entry__is_tree(entry->te) : (entry->tree != NULL);
 }
 
-static int tree_iterator__push_frame(tree_iterator *ti)
+/* Subtrees are only looked up once we descend into them, so that callers
+ * which step over a tree (e.g. a diff that found the same tree id on both
+ * sides) never need to read it.
+ */
+static int tree_iterator__load_trees(tree_iterator *ti, tree_iterator_frame *tf)
+{
+	tree_iterator_entry *entry;
+	size_t i;
+	int error = 0;
+
+	for (i = tf->current; !error && i < tf->next; ++i) {
+		entry = tf->entries[i];
+
+		if (!entry->tree && entry->te && git_tree_entry__is_tree(entry->te))
+			error = git_tree_lookup(&entry->tree, ti->base.repo, &entry->te->oid);
+	}
+
+	/* if a tree lookup failed, advance over this span and return failure */
+	if (error < 0)
+		tree_iterator__move_to_next(ti, tf);
+
+	return error;
+}
+
+/* skip entries that cannot match the pathspec, nor contain anything that
+ * can; ti->pathspec_path holds the path of the tree being expanded
+ */
+static int tree_iterator__pathspec_skip(
+	tree_iterator *ti, const git_tree_entry *te)
+{
+	size_t dir_len = ti->path.size;
+	bool is_tree = git_tree_entry__is_tree(te);
+
+	git_buf_truncate(&ti->pathspec_path, dir_len);
+
+	if (git_buf_put(&ti->pathspec_path, te->filename, te->filename_len) < 0 ||
+		(is_tree && git_buf_putc(&ti->pathspec_path, '/') < 0))
+		return -1;
+
+	return !git_pathspec__trie_may_match(ti->base.pathspec_trie,
+		ti->pathspec_path.ptr, ti->pathspec_path.size, is_tree);
+}
+
+static bool tree_iterator__pop_frame(tree_iterator *ti, bool final);
+
+/* move past the current span of entries, popping finished frames */
+static int tree_iterator__step_over(tree_iterator *ti)
+{
+	tree_iterator_frame *tf = ti->head;
+
+	if (ti->path_has_filename) {
+		git_buf_rtruncate_at_char(&ti->path, '/');
+		ti->path_has_filename = ti->entry_is_current = false;
+	}
+
+	/* scan forward and up, advancing in frame or popping frame when done */
+	while (!tree_iterator__move_to_next(ti, tf) &&
+		tree_iterator__pop_frame(ti, false))
+		tf = ti->head;
+
+	/* find next and load trees */
+	return tree_iterator__set_next(ti, tf);
+}
+
+/* expand the trees at the current position into a new frame; `*empty`
+ * is set, and no frame is pushed, when none of their entries are wanted
+ */
+static int tree_iterator__expand_frame(tree_iterator *ti, bool *empty)
 {
 	int error = 0;
 	tree_iterator_frame *head = ti->head, *tf = NULL;
 	size_t i, n_entries = 0, alloclen;
 
-	if (head->current >= head->n_entries || !head->entries[head->current]->tree)
-		return GIT_ITEROVER;
+	*empty = false;
 
-	for (i = head->current; i < head->next; ++i)
-		n_entries += git_tree_entrycount(head->entries[i]->tree);
+	if ((error = tree_iterator__load_trees(ti, head)) < 0)
+		return error;
+
+	for (i = head->current; i < head->next; ++i) {
+		if (head->entries[i]->tree)
+			n_entries += git_tree_entrycount(head->entries[i]->tree);
+	}
 
 	GITERR_CHECK_ALLOC_MULTIPLY(&alloclen, sizeof(tree_iterator_entry *), n_entries);
 	GITERR_CHECK_ALLOC_ADD(&alloclen, alloclen, sizeof(tree_iterator_frame));
@@ -500,28 +569,53 @@ static int tree_iterator__push_frame(tree_iterator *ti)
 	tf = git__calloc(1, alloclen);
 	GITERR_CHECK_ALLOC(tf);
 
-	tf->n_entries = n_entries;
-
 	tf->up     = head;
 	head->down = tf;
 	ti->head   = tf;
 
+	/* ti->path is the path of the trees being expanded */
+	if (ti->base.pathspec_trie &&
+		git_buf_set(&ti->pathspec_path, ti->path.ptr, ti->path.size) < 0)
+		return -1;
+
 	for (i = head->current, n_entries = 0; i < head->next; ++i) {
 		git_tree *tree = head->entries[i]->tree;
-		size_t j, max_j = git_tree_entrycount(tree);
+		size_t j, max_j = tree ? git_tree_entrycount(tree) : 0;
 
 		for (j = 0; j < max_j; ++j) {
-			tree_iterator_entry *entry = git_pool_malloc(&ti->pool, 1);
+			const git_tree_entry *te = git_tree_entry_byindex(tree, j);
+			tree_iterator_entry *entry;
+
+			if (ti->base.pathspec_trie) {
+				int skip = tree_iterator__pathspec_skip(ti, te);
+				if (skip < 0)
+					return skip;
+				if (skip)
+					continue;
+			}
+
+			entry = git_pool_malloc(&ti->pool, 1);
 			GITERR_CHECK_ALLOC(entry);
 
 			entry->parent = head->entries[i];
-			entry->te     = git_tree_entry_byindex(tree, j);
+			entry->te     = te;
 			entry->tree   = NULL;
 
 			tf->entries[n_entries++] = entry;
 		}
 	}
 
+	tf->n_entries = n_entries;
+
+	if (!n_entries && ti->base.pathspec_trie) {
+		ti->head   = head;
+		head->down = NULL;
+		git__free(tf);
+
+		*empty = true;
+		return 0;
+	}
+
 	/* if ignore_case, sort entries case insensitively */
 	if (iterator__ignore_case(ti))
 		git__tsort_r(
@@ -544,7 +638,27 @@ static int tree_iterator__push_frame(tree_iterator *ti)
 
 	ti->path_has_filename = ti->entry_is_current = false;
 
-	if ((error = tree_iterator__set_next(ti, tf)) < 0)
+	return tree_iterator__set_next(ti, tf);
+}
+
+static int tree_iterator__push_frame(tree_iterator *ti)
+{
+	int error;
+	bool empty;
+
+	if (!tree_iterator__at_tree(ti))
+		return GIT_ITEROVER;
+
+	/* trees with nothing in them that the pathspec can match are stepped
+	 * over, as if they were empty
+	 */
+	while (!(error = tree_iterator__expand_frame(ti, &empty)) && empty) {
+		if ((error = tree_iterator__step_over(ti)) < 0 ||
+			iterator__include_trees(ti) || !tree_iterator__at_tree(ti))
+			return error;
+	}
+
+	if (error < 0)
 		return error;
 
 	/* autoexpand as needed */
@@ -667,18 +781,7 @@ static int tree_iterator__advance_internal(git_iterator *self)
 		tree_iterator__at_tree(ti))
 		return tree_iterator__advance_into_internal(self);
 
-	if (ti->path_has_filename) {
-		git_buf_rtruncate_at_char(&ti->path, '/');
-		ti->path_has_filename = ti->entry_is_current = false;
-	}
-
-	/* scan forward and up, advancing in frame or popping frame when done */
-	while (!tree_iterator__move_to_next(ti, tf) &&
-		tree_iterator__pop_frame(ti, false))
-		tf = ti->head;
-
-	/* find next and load trees */
-	if ((error = tree_iterator__set_next(ti, tf)) < 0)
+	if ((error = tree_iterator__step_over(ti)) < 0)
 		return error;
 
 	/* deal with include_trees / auto_expand as needed */
@@ -779,6 +882,7 @@ static void tree_iterator__free(git_iterator *self)
 	git__free(ti->head);
 	git_pool_clear(&ti->pool);
 	git_buf_free(&ti->path);
+	git_buf_free(&ti->pathspec_path);
 }
 
 static int tree_iterator__create_root_frame(tree_iterator *ti, git_tree *tree)
@@ -851,6 +955,8 @@ typedef struct {
 	size_t partial_pos;
 	char restore_terminator;
 	git_index_entry tree_entry;
+	/* the entries of the sparse directories that have been expanded */
+	git_pool sparse_pool;
 } index_iterator;
 
 static const git_index_entry *index_iterator__index_entry(index_iterator *ii)
@@ -865,11 +971,30 @@ static const git_index_entry *index_iterator__index_entry(index_iterator *ii)
 	return ie;
 }
 
+/* is there a pathlist entry below the directory `dir`? */
+static bool iterator_pathlist_walk__contains_below(
+	git_iterator *iter, const char *dir)
+{
+	size_t dir_len = strlen(dir), i;
+	int cmp;
+
+	for (i = iter->pathlist_walk_idx; i < iter->pathlist.length; i++) {
+		cmp = iter->strncomp(iter->pathlist.contents[i], dir, dir_len);
+
+		if (cmp > 0)
+			break;
+		else if (cmp == 0)
+			return true;
+	}
+
+	return false;
+}
+
 static const git_index_entry *index_iterator__advance_over_unwanted(
 	index_iterator *ii)
 {
 	const git_index_entry *ie = index_iterator__index_entry(ii);
-	bool match;
+	bool match, sparse_dir;
 
 	while (ie) {
 		if (!iterator__include_conflicts(ii) &&
@@ -879,12 +1004,24 @@ static const git_index_entry *index_iterator__advance_over_unwanted(
 			continue;
 		}
 
+		sparse_dir = git_index_entry__is_sparse_dir(ie);
+
+		if (ii->base.pathspec_trie &&
+			!git_pathspec__trie_may_match(ii->base.pathspec_trie,
+				ie->path, strlen(ie->path), sparse_dir)) {
+			ii->current++;
+			ie = index_iterator__index_entry(ii);
+			continue;
+		}
+
 		/* if we have a pathlist, this entry's path must be in it to be
 		 * returned.  walk the pathlist in unison with the index to
 		 * compare paths.
 		 */
 		if (ii->base.pathlist.length) {
-			match = iterator_pathlist_walk__contains(&ii->base, ie->path);
+			match = iterator_pathlist_walk__contains(&ii->base, ie->path) ||
+				(sparse_dir &&
+				 iterator_pathlist_walk__contains_below(&ii->base, ie->path));
 
 			if (!match) {
 				ii->current++;
@@ -946,6 +1083,18 @@ static int index_iterator__first_prefix_tree(index_iterator *ii)
 #define index_iterator__at_tree(I) \
 	(iterator__include_trees(I) && (I)->partial_pos < (I)->partial.size)
 
+/* give the directory the id recorded in the tree cache, if it is valid */
+static void index_iterator__tree_id(index_iterator *ii)
+{
+	const git_tree_cache *cache =
+		git_tree_cache_get(ii->index->tree, ii->partial.ptr);
+
+	if (cache && cache->entry_count >= 0)
+		git_oid_cpy(&ii->tree_entry.id, &cache->oid);
+	else
+		memset(&ii->tree_entry.id, 0, sizeof(git_oid));
+}
+
 static int index_iterator__current(
 	const git_index_entry **entry, git_iterator *self)
 {
@@ -954,6 +1103,7 @@ static int index_iterator__current(
 
 	if (ie != NULL && index_iterator__at_tree(ii)) {
 		ii->tree_entry.path = ii->partial.ptr;
+		index_iterator__tree_id(ii);
 		ie = &ii->tree_entry;
 	}
 
@@ -1019,6 +1169,12 @@ static int index_iterator__advance_into(
 		if (ii->restore_terminator)
 			ii->partial.ptr[ii->partial_pos] = ii->restore_terminator;
 		index_iterator__next_prefix_tree(ii);
+	} else if (ie != NULL && git_index_entry__is_sparse_dir(ie)) {
+		/* its entries sort right where the sparse directory was */
+		if (git_index_snapshot_expand(
+				&ii->entries, ii->index, ie, &ii->sparse_pool) < 0 ||
+			index_iterator__first_prefix_tree(ii) < 0)
+			return -1;
 	}
 
 	return index_iterator__current(entry, self);
@@ -1076,6 +1232,7 @@ static void index_iterator__free(git_iterator *self)
 	git_index_snapshot_release(&ii->entries, ii->index);
 	ii->index = NULL;
 	git_buf_free(&ii->partial);
+	git_pool_clear(&ii->sparse_pool);
 }
 
 int git_iterator_for_index(
@@ -1092,9 +1249,20 @@ int git_iterator_for_index(
 		return error;
 	}
 	ii->index = index;
+	git_pool_init(&ii->sparse_pool, 1);
 
 	ITERATOR_BASE_INIT(ii, index, INDEX, git_index_owner(index));
 
+	/* unless the caller can handle sparse directories, hand out their
+	 * entries instead, without expanding the index itself */
+	if (index->sparse_dirs > 0 &&
+		!iterator__flag(ii, INCLUDE_SPARSE_DIRS) &&
+		(error = git_index_snapshot_expand(
+			&ii->entries, index, NULL, &ii->sparse_pool)) < 0) {
+		git_iterator_free((git_iterator *)ii);
+		return error;
+	}
+
 	if ((error = iterator__update_ignore_case((git_iterator *)ii, options ? options->flags : 0)) < 0) {
 		git_iterator_free((git_iterator *)ii);
 		return error;
@@ -1117,12 +1285,19 @@ int git_iterator_for_index(
 }
 
 
+typedef struct fs_iterator_prefetch fs_iterator_prefetch;
+typedef struct fs_iterator_prefetch_job fs_iterator_prefetch_job;
+
 typedef struct fs_iterator_frame fs_iterator_frame;
 struct fs_iterator_frame {
 	fs_iterator_frame *next;
 	git_vector entries;
 	size_t index;
 	int is_ignored;
+
+	/* directories being read ahead, by entry index */
+	fs_iterator_prefetch_job **prefetched;
+	size_t prefetch_next;
 };
 
 typedef struct fs_iterator fs_iterator;
@@ -1136,10 +1311,16 @@ struct fs_iterator {
 	uint32_t dirload_flags;
 	int depth;
 	iterator_pathlist__match_t pathlist_match;
+	fs_iterator_prefetch *prefetch;
 
 	int (*enter_dir_cb)(fs_iterator *self);
 	int (*leave_dir_cb)(fs_iterator *self);
 	int (*update_entry_cb)(fs_iterator *self);
+	int (*preloaded_stat_cb)(
+		struct stat *st, fs_iterator *self, const char *path, size_t path_len);
+	bool (*defer_stat_cb)(
+		fs_iterator *self, const char *path, size_t path_len, unsigned int type);
+	bool (*skip_stat_cb)(fs_iterator *self);
 };
 
 #define FS_MAX_DEPTH 100
@@ -1147,6 +1328,7 @@ struct fs_iterator {
 typedef struct {
 	struct stat st;
 	iterator_pathlist__match_t pathlist_match;
+	bool        stat_pending; /* only the type in `st` is known */
 	size_t      path_len;
 	char        path[GIT_FLEX_ARRAY];
 } fs_iterator_path_with_stat;
@@ -1163,6 +1345,374 @@ static int fs_iterator_path_with_stat_cmp_icase(const void *a, const void *b)
 	return strcasecmp(psa->path, psb->path);
 }
 
+/* Reading ahead
+ *
+ * With prefetching on, a few threads read and lstat the subdirectories
+ * of the directories the iterator has entered, up to FS_PREFETCH_AHEAD
+ * entries past its position in each, while it works through the entries
+ * before them.  When the iterator gets to a subdirectory it takes the
+ * sorted entries the threads read for it, or reads the directory itself
+ * if no thread has started on it yet.  Newly queued directories go to
+ * the front of the queue, so the threads follow the iterator depth first.
+ */
+
+#define FS_PREFETCH_AHEAD 32
+#define FS_PREFETCH_MAX_THREADS 32
+
+typedef enum {
+	FS_PREFETCH_QUEUED = 0,
+	FS_PREFETCH_RUNNING,
+	FS_PREFETCH_DONE,
+} fs_iterator_prefetch_state;
+
+struct fs_iterator_prefetch_job {
+	fs_iterator_prefetch_job *prev, *next;
+	fs_iterator_prefetch_state state;
+	bool abandoned; /* freed by the thread that reads it */
+	iterator_pathlist__match_t pathlist_match;
+	git_vector entries;
+	int error;
+	char path[GIT_FLEX_ARRAY];
+};
+
+struct fs_iterator_prefetch {
+	fs_iterator *fi;
+	git_mutex lock;
+	git_cond work;
+	git_cond done;
+	fs_iterator_prefetch_job *head;
+	git_thread *threads;
+	int nthreads;
+	int running;
+	bool shutdown;
+	size_t stat_calls;
+};
+
+static int dirload_with_stat(
+	git_vector *contents,
+	size_t *stat_calls,
+	fs_iterator *fi,
+	const char *dirpath,
+	iterator_pathlist__match_t dir_match);
+
+static void fs_iterator__prefetch_job_free(fs_iterator_prefetch_job *job)
+{
+	git_vector_free_deep(&job->entries);
+	git__free(job);
+}
+
+/* Called with lock */
+static void fs_iterator__prefetch_unlink(
+	fs_iterator_prefetch *pf, fs_iterator_prefetch_job *job)
+{
+	if (job->prev)
+		job->prev->next = job->next;
+	else
+		pf->head = job->next;
+
+	if (job->next)
+		job->next->prev = job->prev;
+
+	job->prev = job->next = NULL;
+}
+
+static void *fs_iterator__prefetch_worker(void *arg)
+{
+	fs_iterator_prefetch *pf = arg;
+	fs_iterator_prefetch_job *job;
+	size_t stat_calls;
+	int error;
+
+	if (git_mutex_lock(&pf->lock) < 0)
+		return NULL;
+
+	while (1) {
+		while (!pf->shutdown && !pf->head)
+			git_cond_wait(&pf->work, &pf->lock);
+
+		if (pf->shutdown)
+			break;
+
+		job = pf->head;
+		fs_iterator__prefetch_unlink(pf, job);
+		job->state = FS_PREFETCH_RUNNING;
+		pf->running++;
+
+		git_mutex_unlock(&pf->lock);
+
+		stat_calls = 0;
+		error = dirload_with_stat(&job->entries, &stat_calls,
+			pf->fi, job->path, job->pathlist_match);
+
+		/* the iterator reads the directory again to report the error */
+		if (error < 0)
+			giterr_clear();
+
+		git_mutex_lock(&pf->lock);
+
+		job->error = error;
+		job->state = FS_PREFETCH_DONE;
+		pf->stat_calls += stat_calls;
+		pf->running--;
+
+		if (job->abandoned)
+			fs_iterator__prefetch_job_free(job);
+
+		git_cond_broadcast(&pf->done);
+	}
+
+	git_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+static void fs_iterator__prefetch_stop(fs_iterator *fi)
+{
+	fs_iterator_prefetch *pf = fi->prefetch;
+	int i;
+
+	if (!pf)
+		return;
+
+	git_mutex_lock(&pf->lock);
+	pf->shutdown = true;
+	git_cond_broadcast(&pf->work);
+	git_mutex_unlock(&pf->lock);
+
+	for (i = 0; i < pf->nthreads; i++)
+		git_thread_join(&pf->threads[i], NULL);
+
+	/* jobs still queued belong to their frames and go with them */
+	fi->base.stat_calls += pf->stat_calls;
+	fi->prefetch = NULL;
+
+	git_cond_free(&pf->work);
+	git_cond_free(&pf->done);
+	git_mutex_free(&pf->lock);
+	git__free(pf->threads);
+	git__free(pf);
+}
+
+static int fs_iterator__prefetch_start(fs_iterator *fi, int nthreads)
+{
+#ifdef GIT_THREADS
+	fs_iterator_prefetch *pf;
+	int i;
+
+	if (nthreads < 1)
+		return 0;
+
+	pf = git__calloc(1, sizeof(fs_iterator_prefetch));
+	GITERR_CHECK_ALLOC(pf);
+
+	if ((pf->threads = git__calloc(nthreads, sizeof(git_thread))) == NULL) {
+		git__free(pf);
+		return -1;
+	}
+
+	if (git_mutex_init(&pf->lock) < 0 ||
+		git_cond_init(&pf->work) < 0 ||
+		git_cond_init(&pf->done) < 0) {
+		giterr_set(GITERR_OS, "Failed to initialize lock");
+		git__free(pf->threads);
+		git__free(pf);
+		return -1;
+	}
+
+	pf->fi = fi;
+	fi->prefetch = pf;
+
+	/* make do with however many threads we can get */
+	for (i = 0; i < nthreads; i++) {
+		if (git_thread_create(&pf->threads[i], NULL,
+				fs_iterator__prefetch_worker, pf) != 0)
+			break;
+
+		pf->nthreads++;
+	}
+
+	if (!pf->nthreads)
+		fs_iterator__prefetch_stop(fi);
+#else
+	GIT_UNUSED(fi);
+	GIT_UNUSED(nthreads);
+#endif
+
+	return 0;
+}
+
+/* Queue the directories among the next few entries of `ff` */
+static void fs_iterator__prefetch_ahead(fs_iterator *fi, fs_iterator_frame *ff)
+{
+	fs_iterator_prefetch *pf = fi->prefetch;
+	fs_iterator_prefetch_job *first = NULL, *last = NULL, *job;
+	fs_iterator_path_with_stat *ps;
+	size_t limit, queued = 0;
+
+	if (!pf)
+		return;
+
+	if (ff->prefetch_next < ff->index)
+		ff->prefetch_next = ff->index;
+
+	/* top up in batches rather than one directory at a time */
+	if (ff->prefetch_next >= ff->entries.length ||
+		ff->prefetch_next - ff->index > FS_PREFETCH_AHEAD / 2)
+		return;
+
+	limit = min(ff->entries.length, ff->index + FS_PREFETCH_AHEAD);
+
+	/* reading ahead is only an optimization, so give up quietly */
+	if (!ff->prefetched &&
+		(ff->prefetched = git__calloc(ff->entries.length,
+			sizeof(fs_iterator_prefetch_job *))) == NULL) {
+		giterr_clear();
+		return;
+	}
+
+	for (; ff->prefetch_next < limit; ff->prefetch_next++) {
+		ps = git_vector_get(&ff->entries, ff->prefetch_next);
+
+		if (!S_ISDIR(ps->st.st_mode))
+			continue;
+
+		job = git__calloc(1,
+			sizeof(fs_iterator_prefetch_job) + fi->root_len + ps->path_len + 1);
+
+		if (!job || git_vector_init(&job->entries, 0, ff->entries._cmp) < 0) {
+			git__free(job);
+			giterr_clear();
+			break;
+		}
+
+		memcpy(job->path, fi->path.ptr, fi->root_len);
+		memcpy(job->path + fi->root_len, ps->path, ps->path_len);
+		job->pathlist_match = ps->pathlist_match;
+
+		if (last) {
+			last->next = job;
+			job->prev = last;
+		} else {
+			first = job;
+		}
+		last = job;
+		queued++;
+
+		ff->prefetched[ff->prefetch_next] = job;
+	}
+
+	if (!first)
+		return;
+
+	git_mutex_lock(&pf->lock);
+
+	last->next = pf->head;
+	if (pf->head)
+		pf->head->prev = last;
+	pf->head = first;
+
+	if (queued < (size_t)pf->nthreads) {
+		while (queued--)
+			git_cond_signal(&pf->work);
+	} else {
+		git_cond_broadcast(&pf->work);
+	}
+
+	git_mutex_unlock(&pf->lock);
+}
+
+/* Take the entries read ahead for the directory at the current entry of
+ * the top frame into `ff`, or GIT_ENOTFOUND if it has to be read here */
+static int fs_iterator__prefetched(fs_iterator_frame *ff, fs_iterator *fi)
+{
+	fs_iterator_prefetch *pf = fi->prefetch;
+	fs_iterator_frame *parent = fi->stack;
+	fs_iterator_prefetch_job *job;
+
+	if (!pf || !parent || !parent->prefetched ||
+		(job = parent->prefetched[parent->index]) == NULL)
+		return GIT_ENOTFOUND;
+
+	parent->prefetched[parent->index] = NULL;
+
+	git_mutex_lock(&pf->lock);
+
+	/* no thread has started on it, so it's as quick to read it here */
+	if (job->state == FS_PREFETCH_QUEUED)
+		fs_iterator__prefetch_unlink(pf, job);
+
+	while (job->state == FS_PREFETCH_RUNNING)
+		git_cond_wait(&pf->done, &pf->lock);
+
+	fi->base.stat_calls += pf->stat_calls;
+	pf->stat_calls = 0;
+
+	git_mutex_unlock(&pf->lock);
+
+	if (job->state != FS_PREFETCH_DONE || job->error < 0) {
+		fs_iterator__prefetch_job_free(job);
+		return GIT_ENOTFOUND;
+	}
+
+	git_vector_free(&ff->entries);
+	memcpy(&ff->entries, &job->entries, sizeof(git_vector));
+	git__free(job);
+
+	return 0;
+}
+
+/* Drop the directories being read ahead for `ff` */
+static void fs_iterator__prefetch_discard(fs_iterator *fi, fs_iterator_frame *ff)
+{
+	fs_iterator_prefetch *pf = fi ? fi->prefetch : NULL;
+	fs_iterator_prefetch_job *job;
+	size_t i;
+
+	if (!ff->prefetched)
+		return;
+
+	if (pf)
+		git_mutex_lock(&pf->lock);
+
+	for (i = 0; i < ff->prefetch_next; i++) {
+		if ((job = ff->prefetched[i]) == NULL)
+			continue;
+
+		if (pf && job->state == FS_PREFETCH_QUEUED)
+			fs_iterator__prefetch_unlink(pf, job);
+
+		if (pf && job->state == FS_PREFETCH_RUNNING)
+			job->abandoned = true;
+		else
+			fs_iterator__prefetch_job_free(job);
+	}
+
+	if (pf) {
+		fi->base.stat_calls += pf->stat_calls;
+		pf->stat_calls = 0;
+		git_mutex_unlock(&pf->lock);
+	}
+
+	git__free(ff->prefetched);
+	ff->prefetched = NULL;
+	ff->prefetch_next = 0;
+}
+
+/* Wait for the directories being read to be done with */
+static void fs_iterator__prefetch_wait(fs_iterator *fi)
+{
+	fs_iterator_prefetch *pf = fi->prefetch;
+
+	if (!pf)
+		return;
+
+	git_mutex_lock(&pf->lock);
+
+	while (pf->running > 0)
+		git_cond_wait(&pf->done, &pf->lock);
+
+	git_mutex_unlock(&pf->lock);
+}
+
 static fs_iterator_frame *fs_iterator__alloc_frame(fs_iterator *fi)
 {
 	fs_iterator_frame *ff = git__calloc(1, sizeof(fs_iterator_frame));
@@ -1179,8 +1729,9 @@ static fs_iterator_frame *fs_iterator__alloc_frame(fs_iterator *fi)
 	return ff;
 }
 
-static void fs_iterator__free_frame(fs_iterator_frame *ff)
+static void fs_iterator__free_frame(fs_iterator *fi, fs_iterator_frame *ff)
 {
+	fs_iterator__prefetch_discard(fi, ff);
 	git_vector_free_deep(&ff->entries);
 	git__free(ff);
 }
@@ -1201,7 +1752,7 @@ static void fs_iterator__pop_frame(
 		fi->depth--;
 	}
 
-	fs_iterator__free_frame(ff);
+	fs_iterator__free_frame(fi, ff);
 }
 
 static int fs_iterator__update_entry(fs_iterator *fi);
@@ -1228,7 +1779,12 @@ static void fs_iterator__seek_frame_start(
 		ff->index = 0;
 }
 
-static int dirload_with_stat(git_vector *contents, fs_iterator *fi)
+static int dirload_with_stat(
+	git_vector *contents,
+	size_t *stat_calls,
+	fs_iterator *fi,
+	const char *dirpath,
+	iterator_pathlist__match_t dir_match)
 {
 	git_path_diriter diriter = GIT_PATH_DIRITER_INIT;
 	const char *path;
@@ -1237,11 +1793,13 @@ static int dirload_with_stat(git_vector *contents, fs_iterator *fi)
 	fs_iterator_path_with_stat *ps;
 	size_t path_len, cmp_len, ps_size;
 	iterator_pathlist__match_t pathlist_match = ITERATOR_PATHLIST_MATCH;
+	unsigned int type;
+	bool preloaded;
 	int error;
 
 	/* Any error here is equivalent to the dir not existing, skip over it */
 	if ((error = git_path_diriter_init(
-			&diriter, fi->path.ptr, fi->dirload_flags)) < 0) {
+			&diriter, dirpath, fi->dirload_flags)) < 0) {
 		error = GIT_ENOTFOUND;
 		goto done;
 	}
@@ -1272,11 +1830,20 @@ static int dirload_with_stat(git_vector *contents, fs_iterator *fi)
 		 * this path or children of this path.
 		 */
 		if (fi->base.pathlist.length &&
-			fi->pathlist_match != ITERATOR_PATHLIST_MATCH &&
-			fi->pathlist_match != ITERATOR_PATHLIST_MATCH_DIRECTORY &&
+			dir_match != ITERATOR_PATHLIST_MATCH &&
+			dir_match != ITERATOR_PATHLIST_MATCH_DIRECTORY &&
 			!(pathlist_match = iterator_pathlist__match(&fi->base, path, path_len)))
 			continue;
 
+		/* skip paths that cannot match the pathspec, nor contain anything
+		 * that can.  files are looked at as directories here, since one
+		 * may be in the way of a directory that checkout has to create.
+		 */
+		if (fi->base.pathspec_trie &&
+			!git_pathspec__trie_may_match(
+				fi->base.pathspec_trie, path, path_len, true))
+			continue;
+
 		/* Make sure to append two bytes, one for the path's null
 		 * termination, one for a possible trailing '/' for folders.
 		 */
@@ -1288,9 +1855,31 @@ static int dirload_with_stat(git_vector *contents, fs_iterator *fi)
 
 		memcpy(ps->path, path, path_len);
 
-		/* TODO: don't stat if assume unchanged for this path */
+		type = git_path_diriter_type(&diriter);
+		preloaded = false;
+
+		/* use the stat data gathered ahead of time when we have it */
+		if (fi->preloaded_stat_cb &&
+			fi->preloaded_stat_cb(&ps->st, fi, ps->path, ps->path_len) == 0)
+			preloaded = true;
+
+		/* or put the lstat off when the type may be all that's wanted */
+		else if ((type == S_IFREG || type == S_IFDIR || type == S_IFLNK) &&
+			fi->defer_stat_cb &&
+			fi->defer_stat_cb(fi, ps->path, ps->path_len, type)) {
+			ps->st.st_mode = type;
+			ps->stat_pending = true;
+			preloaded = true;
+		}
+
+		/* Ignore wacky things in the filesystem */
+		else if (type && type != S_IFREG && type != S_IFDIR && type != S_IFLNK) {
+			git__free(ps);
+			continue;
+		}
 
-		if ((error = git_path_diriter_stat(&ps->st, &diriter)) < 0) {
+		if (!preloaded &&
+			(error = git_path_diriter_stat(&ps->st, &diriter)) < 0) {
 			if (error == GIT_ENOTFOUND) {
 				/* file was removed between readdir and lstat */
 				git__free(ps);
@@ -1325,6 +1914,9 @@ static int dirload_with_stat(git_vector *contents, fs_iterator *fi)
 		 */
 		ps->pathlist_match = pathlist_match;
 		git_vector_insert(contents, ps);
+
+		if (!preloaded)
+			(*stat_calls)++;
 	}
 
 	if (error == GIT_ITEROVER)
@@ -1343,6 +1935,8 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 {
 	int error;
 	fs_iterator_frame *ff;
+	fs_iterator_path_with_stat *ps;
+	size_t pos;
 
 	if (fi->depth > FS_MAX_DEPTH) {
 		giterr_set(GITERR_REPOSITORY,
@@ -1353,14 +1947,16 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 	ff = fs_iterator__alloc_frame(fi);
 	GITERR_CHECK_ALLOC(ff);
 
-	error = dirload_with_stat(&ff->entries, fi);
+	if ((error = fs_iterator__prefetched(ff, fi)) == GIT_ENOTFOUND)
+		error = dirload_with_stat(&ff->entries, &fi->base.stat_calls,
+			fi, fi->path.ptr, fi->pathlist_match);
 
 	if (error < 0) {
 		git_error_state last_error = { 0 };
 		giterr_state_capture(&last_error, error);
 
 		/* these callbacks may clear the error message */
-		fs_iterator__free_frame(ff);
+		fs_iterator__free_frame(fi, ff);
 		fs_iterator__advance_over(NULL, (git_iterator *)fi);
 		/* next time return value we skipped to */
 		fi->base.flags &= ~GIT_ITERATOR_FIRST_ACCESS;
@@ -1369,10 +1965,15 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 	}
 
 	if (ff->entries.length == 0) {
-		fs_iterator__free_frame(ff);
+		fs_iterator__free_frame(fi, ff);
 		return GIT_ENOTFOUND;
 	}
-	fi->base.stat_calls += ff->entries.length;
+
+	/* until the entries are reached and turn out to need it after all */
+	git_vector_foreach(&ff->entries, pos, ps) {
+		if (ps->stat_pending)
+			fi->base.stat_calls_avoided++;
+	}
 
 	fs_iterator__seek_frame_start(fi, ff);
 
@@ -1383,6 +1984,9 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 	if (fi->enter_dir_cb && (error = fi->enter_dir_cb(fi)) < 0)
 		return error;
 
+	/* only now, as entering the directory can reorder its entries */
+	fs_iterator__prefetch_ahead(fi, ff);
+
 	return fs_iterator__update_entry(fi);
 }
 
@@ -1443,8 +2047,10 @@ static void fs_iterator__advance_over_internal(git_iterator *self)
 		ff = fi->stack;
 		next = git_vector_get(&ff->entries, ++ff->index);
 
-		if (next != NULL)
+		if (next != NULL) {
+			fs_iterator__prefetch_ahead(fi, ff);
 			break;
+		}
 
 		fs_iterator__pop_frame(fi, ff, false);
 	}
@@ -1511,10 +2117,17 @@ static int fs_iterator__reset(
 		fs_iterator__pop_frame(fi, fi->stack, false);
 	fi->depth = 0;
 
+	/* what was read ahead was filtered by the old range */
+	if (fi->stack)
+		fs_iterator__prefetch_discard(fi, fi->stack);
+	fs_iterator__prefetch_wait(fi);
+
 	if ((error = iterator__reset_range(self, start, end)) < 0)
 		return error;
 
 	fs_iterator__seek_frame_start(fi, fi->stack);
+	if (fi->stack)
+		fs_iterator__prefetch_ahead(fi, fi->stack);
 
 	error = fs_iterator__update_entry(fi);
 	if (error == GIT_ITEROVER)
@@ -1527,15 +2140,70 @@ static void fs_iterator__free(git_iterator *self)
 {
 	fs_iterator *fi = (fs_iterator *)self;
 
+	fs_iterator__prefetch_stop(fi);
+
 	while (fi->stack != NULL)
 		fs_iterator__pop_frame(fi, fi->stack, true);
 
 	git_buf_free(&fi->path);
 }
 
+/* Do the lstat that loading the directory put off.  Directories (and
+ * submodules) never need it, as their type is all anyone looks at, and
+ * neither do entries the wrapper knows will be passed over; those keep
+ * a zeroed stat. */
+static int fs_iterator__finish_stat(
+	fs_iterator *fi, fs_iterator_path_with_stat *ps)
+{
+	struct stat st;
+	int error;
+
+	if (!ps->stat_pending ||
+		(!S_ISREG(ps->st.st_mode) && !S_ISLNK(ps->st.st_mode)) ||
+		(fi->skip_stat_cb && fi->skip_stat_cb(fi)))
+		return 0;
+
+	ps->stat_pending = false;
+	fi->base.stat_calls_avoided--;
+	fi->base.stat_calls++;
+
+	if ((error = git_path_lstat(fi->path.ptr, &st)) < 0) {
+		/* file was removed between readdir and now */
+		if (error == GIT_ENOTFOUND)
+			return error;
+
+		/* Treat the file as unreadable if we get any other error */
+		memset(&st, 0, sizeof(st));
+		st.st_mode = GIT_FILEMODE_UNREADABLE;
+		giterr_clear();
+	} else if (!S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode)) {
+		/* replaced by something we would not have listed */
+		return GIT_ENOTFOUND;
+	}
+
+	memcpy(&ps->st, &st, sizeof(st));
+
+	git_index_entry__init_from_stat(&fi->entry, &ps->st, true);
+	fi->entry.mode = git_futils_canonical_mode(ps->st.st_mode);
+
+	return 0;
+}
+
+static int fs_iterator__finish_current_stat(fs_iterator *fi)
+{
+	fs_iterator_path_with_stat *ps;
+
+	if (!fi->stack ||
+		(ps = git_vector_get(&fi->stack->entries, fi->stack->index)) == NULL)
+		return 0;
+
+	return fs_iterator__finish_stat(fi, ps);
+}
+
 static int fs_iterator__update_entry(fs_iterator *fi)
 {
 	fs_iterator_path_with_stat *ps;
+	int error;
 
 	while (true) {
 		memset(&fi->entry, 0, sizeof(fi->entry));
@@ -1568,9 +2236,16 @@ static int fs_iterator__update_entry(fs_iterator *fi)
 			continue;
 		}
 
+		if ((error = fs_iterator__finish_stat(fi, ps)) == GIT_ENOTFOUND) {
+			giterr_clear();
+			fs_iterator__advance_over_internal(&fi->base);
+			continue;
+		} else if (error < 0)
+			return error;
+
 		/* if this is a tree and trees aren't included, then skip */
 		if (fi->entry.mode == GIT_FILEMODE_TREE && !iterator__include_trees(fi)) {
-			int error = fs_iterator__advance_into(NULL, &fi->base);
+			error = fs_iterator__advance_into(NULL, &fi->base);
 
 			if (error != GIT_ENOTFOUND)
 				return error;
@@ -1648,6 +2323,16 @@ typedef struct {
 	git_vector index_snapshot;
 	git_vector_cmp entry_srch;
 
+	/* for each snapshot entry, whether its stat data was preloaded and
+	 * found to be identical to what is on disk (WORKDIR_PRELOAD_*) */
+	unsigned char *preloaded;
+
+	/* looking through an untracked directory for files */
+	bool scanning;
+
+	/* the cone of a sparse checkout, when the index has sparse
+	 * directories that need not be looked at */
+	git_sparse *sparse;
 } workdir_iterator;
 
 GIT_INLINE(bool) workdir_path_is_dotgit(const git_buf *path)
@@ -1733,8 +2418,17 @@ static int workdir_iterator__enter_dir(fs_iterator *fi)
 
 	git_dir_flag dir_flag = git_entry__dir_flag(&fi->entry);
 
+	/* the directory's entry in its parent may have been looked up
+	 * already, and nothing below an ignored directory can be unignored
+	 * without a negative rule */
+	if (ff->next != NULL && wi->is_ignored != GIT_IGNORE_UNCHECKED)
+		ff->is_ignored = wi->is_ignored;
+	else if (ff->next != NULL && ff->next->is_ignored == GIT_IGNORE_TRUE &&
+		!git_ignore__has_negations(&wi->ignores))
+		ff->is_ignored = GIT_IGNORE_TRUE;
+
 	/* check if this directory is ignored */
-	if (git_ignore__lookup(&ff->is_ignored, &wi->ignores, fi->path.ptr + fi->root_len, dir_flag) < 0) {
+	else if (git_ignore__lookup(&ff->is_ignored, &wi->ignores, fi->path.ptr + fi->root_len, dir_flag) < 0) {
 		giterr_clear();
 		ff->is_ignored = GIT_IGNORE_NOTFOUND;
 	}
@@ -1781,6 +2475,52 @@ static int workdir_iterator__leave_dir(fs_iterator *fi)
 	return 0;
 }
 
+/* Directories never need an lstat, and untracked files only when they
+ * are looked at */
+static bool workdir_iterator__defer_stat(
+	fs_iterator *fi, const char *path, size_t path_len, unsigned int type)
+{
+	workdir_iterator *wi = (workdir_iterator *)fi;
+	size_t pos;
+
+	if (type == S_IFDIR)
+		return true;
+
+	return wi->index != NULL &&
+		git_index_snapshot_find(&pos, &wi->index_snapshot, wi->entry_srch,
+			path, path_len, GIT_INDEX_STAGE_ANY) < 0;
+}
+
+static bool workdir_iterator__skip_stat(fs_iterator *fi)
+{
+	workdir_iterator *wi = (workdir_iterator *)fi;
+
+	/* the scan of an untracked directory only goes by names */
+	if (wi->scanning)
+		return true;
+
+	return iterator__flag(fi, SKIP_IGNORED_STAT) &&
+		git_iterator_current_is_ignored(&fi->base);
+}
+
+/* A directory that is a sparse directory entry in the index and that is
+ * still outside of the cone has no files that are checked out.
+ */
+static bool workdir_iterator__is_sparse_dir(
+	workdir_iterator *wi, const char *path, size_t path_len)
+{
+	const git_index_entry *ie;
+	size_t pos;
+
+	if (git_index_snapshot_find(&pos, &wi->index_snapshot, wi->entry_srch,
+			path, path_len, 0) < 0 ||
+		(ie = git_vector_get(&wi->index_snapshot, pos)) == NULL ||
+		!git_index_entry__is_sparse_dir(ie))
+		return false;
+
+	return git_sparse__dir_outside(wi->sparse, path);
+}
+
 static int workdir_iterator__update_entry(fs_iterator *fi)
 {
 	workdir_iterator *wi = (workdir_iterator *)fi;
@@ -1789,17 +2529,190 @@ static int workdir_iterator__update_entry(fs_iterator *fi)
 	if (workdir_path_is_dotgit(&fi->path))
 		return GIT_ENOTFOUND;
 
+	/* and over directories that are sparse in the index */
+	if (wi->sparse && fi->entry.mode == GIT_FILEMODE_TREE &&
+		workdir_iterator__is_sparse_dir(wi, fi->entry.path,
+			fi->path.size - fi->root_len))
+		return GIT_ENOTFOUND;
+
 	/* reset is_ignored since we haven't checked yet */
 	wi->is_ignored = GIT_IGNORE_UNCHECKED;
 
 	return 0;
 }
 
+/* The stat preloading mirrors git's core.preloadIndex: only spread the
+ * work over several threads when there is enough of it to go around. */
+#define WORKDIR_PRELOAD_MAX_THREADS 20
+#define WORKDIR_PRELOAD_ENTRIES_PER_THREAD 500
+#define WORKDIR_PRELOAD_BATCH_SIZE 64
+
+enum {
+	WORKDIR_PRELOAD_MATCHED = 1,
+	WORKDIR_PRELOAD_UPTODATE = 2,
+};
+
+typedef struct {
+	workdir_iterator *wi;
+	const char *root;
+	size_t start_len;
+	size_t end_len;
+	git_atomic stat_calls;
+} workdir_preload_data;
+
+static int workdir_iterator__preload_batch(
+	size_t start, size_t end, void *payload)
+{
+	workdir_preload_data *data = payload;
+	workdir_iterator *wi = data->wi;
+	git_iterator *iter = &wi->fi.base;
+	git_buf path = GIT_BUF_INIT;
+	git_index_entry *ie, st_entry;
+	struct stat st;
+	size_t root_len, path_len, i;
+	int stat_calls = 0, error = 0;
+
+	if ((error = git_buf_sets(&path, data->root)) < 0 ||
+		(error = git_path_to_dir(&path)) < 0)
+		goto done;
+
+	root_len = path.size;
+
+	for (i = start; i < end; i++) {
+		ie = git_vector_get(&wi->index_snapshot, i);
+
+		if (GIT_IDXENTRY_STAGE(ie) != 0 ||
+			(ie->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0 ||
+			(!S_ISREG(ie->mode) && !S_ISLNK(ie->mode)))
+			continue;
+
+		path_len = strlen(ie->path);
+
+		if ((data->start_len && iter->strncomp(ie->path, iter->start,
+				min(data->start_len, path_len)) < 0) ||
+			(data->end_len && iter->strncomp(ie->path, iter->end,
+				min(data->end_len, path_len)) > 0))
+			continue;
+
+		git_buf_truncate(&path, root_len);
+		if ((error = git_buf_put(&path, ie->path, path_len)) < 0)
+			goto done;
+
+		stat_calls++;
+
+		if (p_lstat(path.ptr, &st) < 0)
+			continue;
+
+		memset(&st_entry, 0, sizeof(st_entry));
+		git_index_entry__init_from_stat(&st_entry, &st, true);
+		st_entry.mode = git_futils_canonical_mode(st.st_mode);
+
+		if (!git_index_entry__stat_matches(ie, &st_entry))
+			continue;
+
+		/* the stat data matches and the entry is not racy, so the
+		 * file cannot have changed since the index was written; the
+		 * entries are shared, so the flag is set by the caller */
+		wi->preloaded[i] = git_index_entry_newer_than_index(ie, wi->index) ?
+			WORKDIR_PRELOAD_MATCHED : WORKDIR_PRELOAD_UPTODATE;
+	}
+
+done:
+	git_atomic_add(&data->stat_calls, stat_calls);
+	git_buf_free(&path);
+	return error;
+}
+
+static int workdir_iterator__preloaded_stat(
+	struct stat *st, fs_iterator *fi, const char *path, size_t path_len)
+{
+	workdir_iterator *wi = (workdir_iterator *)fi;
+	const git_index_entry *ie;
+	size_t pos;
+
+	if (git_index_snapshot_find(&pos, &wi->index_snapshot,
+			wi->entry_srch, path, path_len, 0) < 0 ||
+		!wi->preloaded[pos])
+		return GIT_ENOTFOUND;
+
+	ie = git_vector_get(&wi->index_snapshot, pos);
+
+	/* the preloaded lstat was identical to the index entry, so rebuild
+	 * it from there; this round-trips through init_from_stat exactly */
+	memset(st, 0, sizeof(*st));
+	st->st_mode = ie->mode;
+	st->st_size = ie->file_size;
+	st->st_ino = ie->ino;
+	st->st_rdev = ie->dev;
+	st->st_uid = ie->uid;
+	st->st_gid = ie->gid;
+	st->st_mtime = (time_t)ie->mtime.seconds;
+	st->st_ctime = (time_t)ie->ctime.seconds;
+#if defined(GIT_USE_NSEC)
+	st->st_mtim.tv_nsec = ie->mtime.nanoseconds;
+	st->st_ctim.tv_nsec = ie->ctime.nanoseconds;
+#endif
+
+	return 0;
+}
+
+/* lstat the index entries in parallel ahead of the (serial) directory
+ * scan, so that the scan can skip the stat of every unchanged file */
+static int workdir_iterator__preload(workdir_iterator *wi, const char *root)
+{
+	workdir_preload_data data;
+	git_index_entry *ie;
+	size_t count = wi->index_snapshot.length, i;
+	int nthreads, error;
+
+	/* a pathlist is matched directory by directory while scanning and
+	 * is usually short anyway, so don't bother preloading for it */
+	if (wi->fi.base.pathlist.length)
+		return 0;
+
+	nthreads = (int)min(count / WORKDIR_PRELOAD_ENTRIES_PER_THREAD,
+		WORKDIR_PRELOAD_MAX_THREADS);
+
+	if (nthreads < 2)
+		return 0;
+
+	wi->preloaded = git__calloc(count, sizeof(unsigned char));
+	GITERR_CHECK_ALLOC(wi->preloaded);
+
+	memset(&data, 0, sizeof(data));
+	data.wi = wi;
+	data.root = root;
+	data.start_len = wi->fi.base.start ? strlen(wi->fi.base.start) : 0;
+	data.end_len = wi->fi.base.end ? strlen(wi->fi.base.end) : 0;
+
+	error = git_parallel_foreach(count, WORKDIR_PRELOAD_BATCH_SIZE,
+		nthreads, workdir_iterator__preload_batch, &data);
+
+	wi->fi.base.stat_calls += git_atomic_get(&data.stat_calls);
+
+	if (error < 0)
+		return error;
+
+	git_vector_foreach(&wi->index_snapshot, i, ie) {
+		if (wi->preloaded[i] == WORKDIR_PRELOAD_UPTODATE)
+			ie->flags_extended |= GIT_IDXENTRY_UPTODATE;
+	}
+
+	wi->fi.preloaded_stat_cb = workdir_iterator__preloaded_stat;
+	return 0;
+}
+
 static void workdir_iterator__free(git_iterator *self)
 {
 	workdir_iterator *wi = (workdir_iterator *)self;
+
+	/* the threads reading ahead look at the index snapshot */
+	fs_iterator__prefetch_stop(&wi->fi);
+
 	if (wi->index)
 		git_index_snapshot_release(&wi->index_snapshot, wi->index);
+	git_sparse__free(wi->sparse);
+	git__free(wi->preloaded);
 	git_tree_free(wi->tree);
 	fs_iterator__free(self);
 	git_ignore__free(&wi->ignores);
@@ -1813,8 +2726,9 @@ int git_iterator_for_workdir_ext(
 	git_tree *tree,
 	git_iterator_options *options)
 {
-	int error, precompose = 0;
+	int error, precompose = 0, scan_threads = 0;
 	workdir_iterator *wi;
+	fs_iterator_frame *ff;
 
 	if (!repo_workdir) {
 		if (git_repository__ensure_not_bare(repo, "scan working directory") < 0)
@@ -1832,6 +2746,8 @@ int git_iterator_for_workdir_ext(
 	wi->fi.enter_dir_cb = workdir_iterator__enter_dir;
 	wi->fi.leave_dir_cb = workdir_iterator__leave_dir;
 	wi->fi.update_entry_cb = workdir_iterator__update_entry;
+	wi->fi.defer_stat_cb = workdir_iterator__defer_stat;
+	wi->fi.skip_stat_cb = workdir_iterator__skip_stat;
 
 	if ((error = iterator__update_ignore_case((git_iterator *)wi, options ? options->flags : 0)) < 0 ||
 		(error = git_ignore__for_path(repo, ".gitignore", &wi->ignores)) < 0)
@@ -1851,6 +2767,17 @@ int git_iterator_for_workdir_ext(
 	wi->entry_srch = iterator__ignore_case(wi) ?
 		git_index_entry_isrch : git_index_entry_srch;
 
+	if (index && index->sparse_dirs > 0 &&
+		(error = git_sparse__load(&wi->sparse, repo)) < 0) {
+		git_iterator_free((git_iterator *)wi);
+		return error;
+	}
+
+	if (index && iterator__flag(wi, PRELOAD_INDEX) &&
+		(error = workdir_iterator__preload(wi, repo_workdir)) < 0) {
+		git_iterator_free((git_iterator *)wi);
+		return error;
+	}
 
 	/* try to look up precompose and set flag if appropriate */
 	if (git_repository__cvar(&precompose, repo, GIT_CVAR_PRECOMPOSE) < 0)
@@ -1858,7 +2785,26 @@ int git_iterator_for_workdir_ext(
 	else if (precompose)
 		wi->fi.base.flags |= GIT_ITERATOR_PRECOMPOSE_UNICODE;
 
-	return fs_iterator__initialize(out, &wi->fi, repo_workdir);
+	if ((error = fs_iterator__initialize(out, &wi->fi, repo_workdir)) < 0)
+		return error;
+
+	if (git_repository__cvar(&scan_threads, repo, GIT_CVAR_SCANTHREADS) < 0)
+		giterr_clear();
+
+	/* start reading ahead of the directories entered so far */
+	if (scan_threads > 0) {
+		if ((error = fs_iterator__prefetch_start(&wi->fi,
+				min(scan_threads, FS_PREFETCH_MAX_THREADS))) < 0) {
+			git_iterator_free(*out);
+			*out = NULL;
+			return error;
+		}
+
+		for (ff = wi->fi.stack; ff; ff = ff->next)
+			fs_iterator__prefetch_ahead(&wi->fi, ff);
+	}
+
+	return 0;
 }
 
 void git_iterator_free(git_iterator *iter)
@@ -1905,6 +2851,13 @@ git_index *git_iterator_get_index(git_iterator *iter)
 	return NULL;
 }
 
+git_tree *git_iterator_get_tree(git_iterator *iter)
+{
+	if (iter->type == GIT_ITERATOR_TYPE_TREE)
+		return ((tree_iterator *)iter)->root->entries[0]->tree;
+	return NULL;
+}
+
 int git_iterator_current_tree_entry(
 	const git_tree_entry **tree_entry, git_iterator *iter)
 {
@@ -1954,7 +2907,11 @@ static void workdir_iterator_update_is_ignored(workdir_iterator *wi)
 {
 	git_dir_flag dir_flag = git_entry__dir_flag(&wi->fi.entry);
 
-	if (git_ignore__lookup(&wi->is_ignored, &wi->ignores, wi->fi.entry.path, dir_flag) < 0) {
+	if (wi->fi.stack->is_ignored == GIT_IGNORE_TRUE &&
+		!git_ignore__has_negations(&wi->ignores))
+		wi->is_ignored = GIT_IGNORE_TRUE;
+
+	else if (git_ignore__lookup(&wi->is_ignored, &wi->ignores, wi->fi.entry.path, dir_flag) < 0) {
 		giterr_clear();
 		wi->is_ignored = GIT_IGNORE_NOTFOUND;
 	}
@@ -2057,6 +3014,8 @@ int git_iterator_advance_over_with_status(
 	base = git__strdup(entry->path);
 	GITERR_CHECK_ALLOC(base);
 
+	wi->scanning = true;
+
 	/* scan inside directory looking for a non-ignored item */
 	while (entry && !iter->prefixcomp(entry->path, base)) {
 		workdir_iterator_update_is_ignored(wi);
@@ -2100,6 +3059,15 @@ int git_iterator_advance_over_with_status(
 		if ((error = git_iterator_advance(&entry, iter)) < 0)
 			break;
 
+	wi->scanning = false;
+
+	/* the entry after the directory is wanted as usual */
+	if (entry && !error &&
+		(error = fs_iterator__finish_current_stat(&wi->fi)) == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = git_iterator_advance(&entry, iter);
+	}
+
 	*entryptr = entry;
 	git__free(base);
 
@@ -15,6 +15,8 @@
 
 typedef struct git_iterator git_iterator;
 
+struct git_pathspec_trie;
+
 typedef enum {
 	GIT_ITERATOR_TYPE_EMPTY = 0,
 	GIT_ITERATOR_TYPE_TREE = 1,
@@ -36,6 +38,13 @@ typedef enum {
 	GIT_ITERATOR_PRECOMPOSE_UNICODE = (1u << 4),
 	/** include conflicts */
 	GIT_ITERATOR_INCLUDE_CONFLICTS = (1u << 5),
+	/** lstat tracked files in parallel before scanning the workdir */
+	GIT_ITERATOR_PRELOAD_INDEX = (1u << 6),
+	/** don't lstat untracked, ignored files (their stat data stays zero) */
+	GIT_ITERATOR_SKIP_IGNORED_STAT = (1u << 7),
+	/** return sparse directories of the index as they are, requiring
+	 * advance_into to see their entries */
+	GIT_ITERATOR_INCLUDE_SPARSE_DIRS = (1u << 8),
 } git_iterator_flag_t;
 
 typedef struct {
@@ -47,6 +56,12 @@ typedef struct {
 	 */
 	git_strarray pathlist;
 
+	/* the pathspec the caller will match paths against.  if set, paths
+	 * (and directories) that cannot match it are skipped; the caller
+	 * keeps it alive for as long as the iterator.
+	 */
+	struct git_pathspec_trie *pathspec_trie;
+
 	/* flags, from above */
 	unsigned int flags;
 } git_iterator_options;
@@ -71,10 +86,12 @@ struct git_iterator {
 	char *end;
 	git_vector pathlist;
 	size_t pathlist_walk_idx;
+	struct git_pathspec_trie *pathspec_trie;
 	int (*strcomp)(const char *a, const char *b);
 	int (*strncomp)(const char *a, const char *b, size_t n);
 	int (*prefixcomp)(const char *str, const char *prefix);
 	size_t stat_calls;
+	size_t stat_calls_avoided;
 	unsigned int flags;
 };
 
@@ -275,6 +292,9 @@ extern int git_iterator_current_workdir_path(
 /* Return index pointer if index iterator, else NULL */
 extern git_index *git_iterator_get_index(git_iterator *iter);
 
+/* Return the tree being iterated over if tree iterator, else NULL */
+extern git_tree *git_iterator_get_tree(git_iterator *iter);
+
 typedef enum {
 	GIT_ITERATOR_STATUS_NORMAL = 0,
 	GIT_ITERATOR_STATUS_IGNORED = 1,
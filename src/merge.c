@@ -961,6 +961,10 @@ static int index_entry_similarity_calc(
 
 	*out = NULL;
 
+	if ((error = git_hashsig_cache__lookup(
+			out, repo, opts->metric, &entry->id)) != GIT_ENOTFOUND)
+		return error;
+
 	if ((error = git_blob_lookup(&blob, repo, &entry->id)) < 0)
 		return error;
 
@@ -980,6 +984,10 @@ static int index_entry_similarity_calc(
 		git_blob_rawcontent(blob), (size_t)blobsize,
 		opts->metric->payload);
 
+	if (!error && *out)
+		error = git_hashsig_cache__insert(
+			repo, opts->metric, &entry->id, *out);
+
 	git_blob_free(blob);
 
 	return error;
@@ -1348,6 +1356,10 @@ int git_merge_diff_list__find_renames(
 	git_vector_remove_matching(&diff_list->conflicts, merge_diff_empty, NULL);
 
 done:
+	/* the signature cache is only a shortcut, don't fail the merge */
+	if (!error && git_hashsig_cache__flush(repo) < 0)
+		giterr_clear();
+
 	if (cache != NULL) {
 		for (i = 0; i < cache_size; ++i) {
 			if (cache[i] != NULL)
@@ -758,6 +758,36 @@ int git_odb_read_header(size_t *len_p, git_otype *type_p, git_odb *db, const git
 	return error;
 }
 
+int git_odb__pack_position(
+	struct git_pack_file **pack, git_off_t *offset,
+	git_odb *db, const git_oid *id)
+{
+	size_t i;
+	int error;
+
+	assert(pack && offset && db && id);
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+
+		error = git_odb_pack__position(pack, offset, internal->backend, id);
+
+		if (error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	return git_odb__error_notfound("object is not in a pack", id);
+}
+
+void git_odb__set_indexed_cb(
+	git_odb *db, git_odb__indexed_cb cb, void *payload)
+{
+	assert(db);
+
+	db->indexed_cb = cb;
+	db->indexed_payload = payload;
+}
+
 int git_odb__read_header_or_object(
 	git_odb_object **out, size_t *len_p, git_otype *type_p,
 	git_odb *db, const git_oid *id)
@@ -1169,6 +1199,20 @@ int git_odb_open_rstream(git_odb_stream **stream, git_odb *db, const git_oid *oi
 	return error;
 }
 
+bool git_odb__can_write_pack(git_odb *db)
+{
+	size_t i;
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+
+		if (!internal->is_alternate && internal->backend->writepack != NULL)
+			return true;
+	}
+
+	return false;
+}
+
 int git_odb_write_pack(struct git_odb_writepack **out, git_odb *db, git_transfer_progress_cb progress_cb, void *progress_payload)
 {
 	size_t i, writes = 0;
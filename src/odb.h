@@ -16,6 +16,8 @@
 #include "posix.h"
 #include "filter.h"
 
+struct git_pack_file;
+
 #define GIT_OBJECTS_DIR "objects/"
 #define GIT_OBJECT_DIR_MODE 0777
 #define GIT_OBJECT_FILE_MODE 0444
@@ -33,11 +35,23 @@ struct git_odb_object {
 	void *buffer;
 };
 
+/*
+ * Told about each commit, tree and blob a pack being written into the
+ * odb holds, as soon as the indexer knows its contents; `data` is only
+ * valid during the call.
+ */
+typedef void (*git_odb__indexed_cb)(
+	const git_oid *id, git_otype type, const void *data, size_t len,
+	void *payload);
+
 /* EXPORT */
 struct git_odb {
 	git_refcount rc;
 	git_vector backends;
 	git_cache own_cache;
+
+	git_odb__indexed_cb indexed_cb;
+	void *indexed_payload;
 };
 
 /*
@@ -97,6 +111,37 @@ int git_odb__read_header_or_object(
 	git_odb_object **out, size_t *len_p, git_otype *type_p,
 	git_odb *db, const git_oid *id);
 
+/*
+ * Find where an object is stored in a pack: `pack` is the pack file that
+ * reads of the object are served from and `offset` its offset in there.
+ * Returns GIT_ENOTFOUND when the object isn't in any pack (it may still
+ * be loose, or in a custom backend).
+ */
+int git_odb__pack_position(
+	struct git_pack_file **pack, git_off_t *offset,
+	git_odb *db, const git_oid *id);
+
+/*
+ * The pack backend's half of `git_odb__pack_position`; GIT_ENOTFOUND
+ * for backends that are not pack backends.
+ */
+int git_odb_pack__position(
+	struct git_pack_file **pack, git_off_t *offset,
+	git_odb_backend *backend, const git_oid *id);
+
+/*
+ * Whether `git_odb_write_pack` has a backend to write to; this doesn't
+ * create a pack.
+ */
+bool git_odb__can_write_pack(git_odb *db);
+
+/*
+ * Set (or with a NULL `cb`, clear) the callback packs written with
+ * `git_odb_write_pack` tell about their objects as they are indexed.
+ */
+void git_odb__set_indexed_cb(
+	git_odb *db, git_odb__indexed_cb cb, void *payload);
+
 /* fully free the object; internal method, DO NOT EXPORT */
 void git_odb_object__free(void *object);
 
@@ -17,6 +17,7 @@
 #include "sha1_lookup.h"
 #include "mwindow.h"
 #include "pack.h"
+#include "indexer.h"
 
 #include "git2/odb_backend.h"
 
@@ -380,6 +381,24 @@ static int pack_backend__read(
 	return 0;
 }
 
+int git_odb_pack__position(
+	struct git_pack_file **pack, git_off_t *offset,
+	git_odb_backend *backend, const git_oid *oid)
+{
+	struct git_pack_entry e;
+	int error;
+
+	if (backend->read != pack_backend__read)
+		return GIT_ENOTFOUND;
+
+	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, oid)) < 0)
+		return error;
+
+	*pack = e.p;
+	*offset = e.offset;
+	return 0;
+}
+
 static int pack_backend__read_prefix(
 	git_oid *out_oid,
 	void **buffer_p,
@@ -509,6 +528,10 @@ static int pack_backend__writepack(struct git_odb_writepack **out,
 		return -1;
 	}
 
+	if (odb && odb->indexed_cb)
+		git_indexer__set_indexed_cb(
+			writepack->indexer, odb->indexed_cb, odb->indexed_payload);
+
 	writepack->parent.backend = _backend;
 	writepack->parent.append = pack_backend__writepack_append;
 	writepack->parent.commit = pack_backend__writepack_commit;
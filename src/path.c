@@ -16,6 +16,9 @@
 #else
 #include <dirent.h>
 #endif
+#ifdef HAVE_STATX
+#include <sys/sysmacros.h>
+#endif
 #include <stdio.h>
 #include <ctype.h>
 
@@ -1245,6 +1248,14 @@ int git_path_diriter_stat(struct stat *out, git_path_diriter *diriter)
 		diriter->path);
 }
 
+unsigned int git_path_diriter_type(git_path_diriter *diriter)
+{
+	/* the listing already carries the stat data here, so there is
+	 * nothing to save by not asking for it */
+	GIT_UNUSED(diriter);
+	return 0;
+}
+
 void git_path_diriter_free(git_path_diriter *diriter)
 {
 	if (diriter == NULL)
@@ -1260,6 +1271,22 @@ void git_path_diriter_free(git_path_diriter *diriter)
 
 #else
 
+#ifdef DT_DIR
+static unsigned int diriter_dtype(unsigned char d_type)
+{
+	switch (d_type) {
+	case DT_REG:  return S_IFREG;
+	case DT_DIR:  return S_IFDIR;
+	case DT_LNK:  return S_IFLNK;
+	case DT_FIFO: return S_IFIFO;
+	case DT_CHR:  return S_IFCHR;
+	case DT_BLK:  return S_IFBLK;
+	case DT_SOCK: return S_IFSOCK;
+	default:      return 0;
+	}
+}
+#endif
+
 int git_path_diriter_init(
 	git_path_diriter *diriter,
 	const char *path,
@@ -1323,6 +1350,10 @@ int git_path_diriter_next(git_path_diriter *diriter)
 	filename = de->d_name;
 	filename_len = strlen(filename);
 
+#ifdef DT_DIR
+	diriter->type = diriter_dtype(de->d_type);
+#endif
+
 #ifdef GIT_USE_ICONV
 	if ((diriter->flags & GIT_PATH_DIR_PRECOMPOSE_UNICODE) != 0 &&
 		(error = git_path_iconv(&diriter->ic, &filename, &filename_len)) < 0)
@@ -1369,13 +1400,69 @@ int git_path_diriter_fullpath(
 	return 0;
 }
 
+#ifdef HAVE_STATX
+
+/* Only what the index keeps; on network filesystems the other fields
+ * may take another round trip to the server to fill in. */
+#define DIRITER_STATX_MASK \
+	(STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_INO | \
+	 STATX_SIZE | STATX_MTIME | STATX_CTIME)
+
+static int diriter_statx(struct stat *out, git_path_diriter *diriter)
+{
+	struct statx stx;
+	const char *filename = &diriter->path.ptr[diriter->parent_len];
+
+	if (*filename == '/')
+		filename++;
+
+	if (statx(dirfd(diriter->dir), filename,
+			AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+			DIRITER_STATX_MASK, &stx) < 0)
+		return (errno == ENOSYS) ? 1 :
+			git_path_set_error(errno, diriter->path.ptr, "stat");
+
+	memset(out, 0, sizeof(*out));
+	out->st_mode = stx.stx_mode;
+	out->st_uid = stx.stx_uid;
+	out->st_gid = stx.stx_gid;
+	out->st_ino = stx.stx_ino;
+	out->st_size = stx.stx_size;
+	out->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+	out->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+	out->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+	out->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+	out->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+
+	return 0;
+}
+
+#endif
+
 int git_path_diriter_stat(struct stat *out, git_path_diriter *diriter)
 {
 	assert(out && diriter);
 
+#ifdef HAVE_STATX
+	/* the name in the directory is only the one we have when it has
+	 * not been precomposed */
+	if ((diriter->flags & GIT_PATH_DIR_PRECOMPOSE_UNICODE) == 0) {
+		int error = diriter_statx(out, diriter);
+
+		if (error <= 0)
+			return error;
+	}
+#endif
+
 	return git_path_lstat(diriter->path.ptr, out);
 }
 
+unsigned int git_path_diriter_type(git_path_diriter *diriter)
+{
+	assert(diriter);
+	return diriter->type;
+}
+
 void git_path_diriter_free(git_path_diriter *diriter)
 {
 	if (diriter == NULL)
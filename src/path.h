@@ -452,6 +452,7 @@ struct git_path_diriter
 	unsigned int flags;
 
 	DIR *dir;
+	unsigned int type;
 
 #ifdef GIT_USE_ICONV
 	git_path_iconv_t ic;
@@ -521,6 +522,16 @@ extern int git_path_diriter_fullpath(
  */
 extern int git_path_diriter_stat(struct stat *out, git_path_diriter *diriter);
 
+/**
+ * Returns the type of the current item in the iterator (the `S_IFMT`
+ * bits of its mode) when the directory listing gives it, so that it
+ * need not be `lstat`ed just to tell files from directories.
+ *
+ * @param diriter The directory iterator
+ * @return the type, or 0 if `git_path_diriter_stat` is needed to know
+ */
+extern unsigned int git_path_diriter_type(git_path_diriter *diriter);
+
 /**
  * Closes the directory iterator.
  *
@@ -108,6 +108,224 @@ void git_pathspec__vfree(git_vector *vspec)
 	git_vector_free_deep(vspec);
 }
 
+/* Nodes of the trie are kept in an array, with the root first; keys are
+ * folded to lower case, as items may be matched without regard to case.
+ */
+typedef struct {
+	uint32_t child;   /* first child, or 0 */
+	uint32_t sibling; /* next child of the same parent, or 0 */
+	uint32_t items;   /* first item whose literal prefix ends here, plus 1 */
+	uint32_t below;   /* number of items ending here or further down */
+	char ch;
+} pathspec_trie_node;
+
+struct git_pathspec_trie {
+	git_array_t(pathspec_trie_node) nodes;
+	uint32_t *next_item;      /* next item ending at the same node, plus 1 */
+	git_array_t(uint32_t) negative;
+};
+
+/* more than this many candidates for a path, and all items are tried */
+#define PATHSPEC_TRIE_MAX_CANDIDATES 64
+
+GIT_INLINE(char) pathspec_trie_fold(char c)
+{
+	return (char)git__tolower(c);
+}
+
+static uint32_t pathspec_trie_child(
+	const git_pathspec_trie *trie, uint32_t node, char c)
+{
+	uint32_t child = trie->nodes.ptr[node].child;
+
+	c = pathspec_trie_fold(c);
+
+	while (child && trie->nodes.ptr[child].ch != c)
+		child = trie->nodes.ptr[child].sibling;
+
+	return child;
+}
+
+static int pathspec_trie_insert(
+	git_pathspec_trie *trie, const git_attr_fnmatch *match, uint32_t item)
+{
+	const char *scan = match->pattern;
+	uint32_t node = 0, child;
+	pathspec_trie_node *added;
+
+	trie->nodes.ptr[0].below++;
+
+	/* the literal prefix ends at the first character that might be wild */
+	if ((match->flags & GIT_ATTR_FNMATCH_MATCH_ALL) != 0)
+		scan = "";
+
+	for (; *scan && !strchr("*?[\\", *scan); ++scan) {
+		if (!(child = pathspec_trie_child(trie, node, *scan))) {
+			added = git_array_alloc(trie->nodes);
+			GITERR_CHECK_ALLOC(added);
+
+			child = (uint32_t)(git_array_size(trie->nodes) - 1);
+
+			memset(added, 0, sizeof(*added));
+			added->ch = pathspec_trie_fold(*scan);
+			added->sibling = trie->nodes.ptr[node].child;
+			trie->nodes.ptr[node].child = child;
+		}
+
+		node = child;
+		trie->nodes.ptr[node].below++;
+	}
+
+	trie->next_item[item] = trie->nodes.ptr[node].items;
+	trie->nodes.ptr[node].items = item + 1;
+
+	/* negative items also match their own name with a leading '!' */
+	if ((match->flags & GIT_ATTR_FNMATCH_NEGATIVE) != 0) {
+		uint32_t *negative = git_array_alloc(trie->negative);
+		GITERR_CHECK_ALLOC(negative);
+		*negative = item;
+	}
+
+	return 0;
+}
+
+int git_pathspec__trie_new(git_pathspec_trie **out, const git_vector *vspec)
+{
+	git_pathspec_trie *trie;
+	pathspec_trie_node *root;
+	const git_attr_fnmatch *match;
+	size_t i;
+
+	*out = NULL;
+
+	if (!vspec || !vspec->length)
+		return 0;
+
+	if (vspec->length > UINT32_MAX - 1) {
+		giterr_set(GITERR_INVALID, "too many items in pathspec");
+		return -1;
+	}
+
+	trie = git__calloc(1, sizeof(git_pathspec_trie));
+	GITERR_CHECK_ALLOC(trie);
+
+	if ((trie->next_item = git__calloc(vspec->length, sizeof(uint32_t))) == NULL ||
+		(root = git_array_alloc(trie->nodes)) == NULL)
+		goto on_error;
+
+	memset(root, 0, sizeof(*root));
+
+	git_vector_foreach(vspec, i, match) {
+		if (pathspec_trie_insert(trie, match, (uint32_t)i) < 0)
+			goto on_error;
+	}
+
+	*out = trie;
+	return 0;
+
+on_error:
+	git_pathspec__trie_free(trie);
+	return -1;
+}
+
+void git_pathspec__trie_free(git_pathspec_trie *trie)
+{
+	if (!trie)
+		return;
+
+	git_array_clear(trie->nodes);
+	git_array_clear(trie->negative);
+	git__free(trie->next_item);
+	git__free(trie);
+}
+
+bool git_pathspec__trie_may_match(
+	const git_pathspec_trie *trie, const char *path, size_t len, bool is_dir)
+{
+	uint32_t node = 0;
+	size_t i;
+
+	if (!trie)
+		return true;
+
+	if (len && path[0] == '!' && git_array_size(trie->negative))
+		return true;
+
+	/* an item whose prefix this path starts with may match it */
+	for (i = 0; !trie->nodes.ptr[node].items; ++i) {
+		if (i == len)
+			break;
+
+		if (!(node = pathspec_trie_child(trie, node, path[i])))
+			return false;
+	}
+
+	if (trie->nodes.ptr[node].items)
+		return true;
+
+	if (!is_dir)
+		return false;
+
+	/* items whose prefix starts with the directory may match beneath it */
+	if (len && path[len - 1] != '/' &&
+		!(node = pathspec_trie_child(trie, node, '/')))
+		return false;
+
+	return (trie->nodes.ptr[node].below > 0);
+}
+
+static void pathspec_trie_add_candidate(
+	uint32_t *candidates, size_t *count, uint32_t item)
+{
+	size_t pos = *count;
+
+	/* keep candidates in pathspec order, without duplicates */
+	while (pos > 0 && candidates[pos - 1] > item)
+		pos--;
+
+	if (pos > 0 && candidates[pos - 1] == item)
+		return;
+
+	memmove(&candidates[pos + 1], &candidates[pos],
+		(*count - pos) * sizeof(uint32_t));
+	candidates[pos] = item;
+	(*count)++;
+}
+
+/* gather the items that may match `path`; false if there are too many */
+static bool pathspec_trie_candidates(
+	uint32_t *candidates,
+	size_t *count,
+	const git_pathspec_trie *trie,
+	const char *path)
+{
+	uint32_t node = 0, item;
+	size_t i;
+
+	if (!path)
+		return true;
+
+	if (*path == '!') {
+		for (i = 0; i < git_array_size(trie->negative); ++i) {
+			if (*count == PATHSPEC_TRIE_MAX_CANDIDATES)
+				return false;
+			pathspec_trie_add_candidate(
+				candidates, count, trie->negative.ptr[i]);
+		}
+	}
+
+	do {
+		for (item = trie->nodes.ptr[node].items; item;
+			 item = trie->next_item[item - 1]) {
+			if (*count == PATHSPEC_TRIE_MAX_CANDIDATES)
+				return false;
+			pathspec_trie_add_candidate(candidates, count, item - 1);
+		}
+	} while (*path && (node = pathspec_trie_child(trie, node, *path++)) != 0);
+
+	return true;
+}
+
 struct pathspec_match_context {
 	int fnmatch_flags;
 	int (*strcomp)(const char *, const char *);
@@ -146,7 +364,8 @@ static int pathspec_match_one(
 		result = ctxt->strcomp(match->pattern, path) ? FNM_NOMATCH : 0;
 
 	if (ctxt->fnmatch_flags >= 0 && result == FNM_NOMATCH)
-		result = p_fnmatch(match->pattern, path, ctxt->fnmatch_flags);
+		result = git_wildmatch_match(
+			match->wildmatch, path, ctxt->fnmatch_flags);
 
 	/* if we didn't match, look for exact dirname prefix match */
 	if (result == FNM_NOMATCH &&
@@ -173,13 +392,33 @@ static int pathspec_match_one(
 static int git_pathspec__match_at(
 	size_t *matched_at,
 	const git_vector *vspec,
+	const git_pathspec_trie *trie,
 	struct pathspec_match_context *ctxt,
 	const char *path0,
 	const char *path1)
 {
 	int result = GIT_ENOTFOUND;
-	size_t i = 0;
+	size_t i = 0, c, count = 0;
 	const git_attr_fnmatch *match;
+	uint32_t candidates[PATHSPEC_TRIE_MAX_CANDIDATES];
+
+	/* try only the items that may match, in the same order as below */
+	if (trie &&
+		pathspec_trie_candidates(candidates, &count, trie, path0) &&
+		pathspec_trie_candidates(candidates, &count, trie, path1)) {
+		for (c = 0; c < count; ++c) {
+			i = candidates[c];
+			match = git_vector_get(vspec, i);
+
+			if (path0 && (result = pathspec_match_one(match, ctxt, path0)) >= 0)
+				break;
+			if (path1 && (result = pathspec_match_one(match, ctxt, path1)) >= 0)
+				break;
+		}
+
+		*matched_at = (c < count) ? i : vspec->length;
+		return result;
+	}
 
 	git_vector_foreach(vspec, i, match) {
 		if (path0 && (result = pathspec_match_one(match, ctxt, path0)) >= 0)
@@ -195,6 +434,7 @@ static int git_pathspec__match_at(
 /* match a path against the vectorized pathspec */
 bool git_pathspec__match(
 	const git_vector *vspec,
+	const git_pathspec_trie *trie,
 	const char *path,
 	bool disable_fnmatch,
 	bool casefold,
@@ -215,7 +455,7 @@ bool git_pathspec__match(
 
 	pathspec_match_context_init(&ctxt, disable_fnmatch, casefold);
 
-	result = git_pathspec__match_at(&pos, vspec, &ctxt, path, NULL);
+	result = git_pathspec__match_at(&pos, vspec, trie, &ctxt, path, NULL);
 	if (result >= 0) {
 		if (matched_pathspec) {
 			const git_attr_fnmatch *match = git_vector_get(vspec, pos);
@@ -239,7 +479,8 @@ int git_pathspec__init(git_pathspec *ps, const git_strarray *paths)
 	ps->prefix = git_pathspec_prefix(paths);
 	git_pool_init(&ps->pool, 1);
 
-	if ((error = git_pathspec__vinit(&ps->pathspec, paths, &ps->pool)) < 0)
+	if ((error = git_pathspec__vinit(&ps->pathspec, paths, &ps->pool)) < 0 ||
+		(error = git_pathspec__trie_new(&ps->trie, &ps->pathspec)) < 0)
 		git_pathspec__clear(ps);
 
 	return error;
@@ -249,6 +490,7 @@ void git_pathspec__clear(git_pathspec *ps)
 {
 	git__free(ps->prefix);
 	git_pathspec__vfree(&ps->pathspec);
+	git_pathspec__trie_free(ps->trie);
 	git_pool_clear(&ps->pool);
 	memset(ps, 0, sizeof(*ps));
 }
@@ -291,7 +533,7 @@ int git_pathspec_matches_path(
 	assert(ps && path);
 
 	return (0 != git_pathspec__match(
-		&ps->pathspec, path, no_fnmatch, casefold, NULL, NULL));
+		&ps->pathspec, ps->trie, path, no_fnmatch, casefold, NULL, NULL));
 }
 
 static void pathspec_match_free(git_pathspec_match_list *m)
@@ -433,7 +675,7 @@ static int pathspec_match_from_iterator(
 	while (!(error = git_iterator_advance(&entry, iter))) {
 		/* search for match with entry->path */
 		int result = git_pathspec__match_at(
-			&pos, patterns, &ctxt, entry->path, NULL);
+			&pos, patterns, ps->trie, &ctxt, entry->path, NULL);
 
 		/* no matches for this path */
 		if (result < 0)
@@ -527,6 +769,7 @@ int git_pathspec_match_workdir(
 	assert(repo);
 
 	iter_opts.flags = pathspec_match_iter_flags(flags);
+	iter_opts.pathspec_trie = ps->trie;
 
 	if (!(error = git_iterator_for_workdir(&iter, repo, NULL, NULL, &iter_opts))) {
 		error = pathspec_match_from_iterator(out, iter, flags, ps);
@@ -549,6 +792,7 @@ int git_pathspec_match_index(
 	assert(index);
 
 	iter_opts.flags = pathspec_match_iter_flags(flags);
+	iter_opts.pathspec_trie = ps->trie;
 
 	if (!(error = git_iterator_for_index(&iter, index, &iter_opts))) {
 		error = pathspec_match_from_iterator(out, iter, flags, ps);
@@ -571,6 +815,7 @@ int git_pathspec_match_tree(
 	assert(tree);
 
 	iter_opts.flags = pathspec_match_iter_flags(flags);
+	iter_opts.pathspec_trie = ps->trie;
 
 	if (!(error = git_iterator_for_tree(&iter, tree, &iter_opts))) {
 		error = pathspec_match_from_iterator(out, iter, flags, ps);
@@ -613,7 +858,8 @@ int git_pathspec_match_diff(
 	git_vector_foreach(&diff->deltas, i, delta) {
 		/* search for match with delta */
 		int result = git_pathspec__match_at(
-			&pos, patterns, &ctxt, delta->old_file.path, delta->new_file.path);
+			&pos, patterns, ps->trie, &ctxt,
+			delta->old_file.path, delta->new_file.path);
 
 		/* no matches for this path */
 		if (result < 0)
@@ -14,11 +14,20 @@
 #include "pool.h"
 #include "array.h"
 
+/*
+ * The literal prefixes of the items of a pathspec, as a trie.  An item
+ * can only match paths that start with its literal prefix, so walking a
+ * path down the trie finds the items worth trying on it, and whether
+ * anything beneath a directory can match at all.
+ */
+typedef struct git_pathspec_trie git_pathspec_trie;
+
 /* public compiled pathspec */
 struct git_pathspec {
 	git_refcount rc;
 	char *prefix;
 	git_vector pathspec;
+	git_pathspec_trie *trie;
 	git_pool pool;
 };
 
@@ -51,15 +60,32 @@ extern int git_pathspec__vinit(
 /* free data from the pathspec vector */
 extern void git_pathspec__vfree(git_vector *vspec);
 
+/* build a trie of the vectorized pathspec; `*out` is NULL if it is empty */
+extern int git_pathspec__trie_new(
+	git_pathspec_trie **out, const git_vector *vspec);
+
+extern void git_pathspec__trie_free(git_pathspec_trie *trie);
+
+/*
+ * Can any item of the pathspec match `path`, or when `is_dir` is set,
+ * `path` or anything beneath it?  False positives are possible, false
+ * negatives are not, so iterators use this to skip whole directories.
+ * A NULL trie may match anything.
+ */
+extern bool git_pathspec__trie_may_match(
+	const git_pathspec_trie *trie, const char *path, size_t len, bool is_dir);
+
 #define GIT_PATHSPEC_NOMATCH ((size_t)-1)
 
 /*
  * Match a path against the vectorized pathspec.
  * The matched pathspec is passed back into the `matched_pathspec` parameter,
- * unless it is passed as NULL by the caller.
+ * unless it is passed as NULL by the caller.  Given the trie built from
+ * `vspec`, only the items that may match are tried.
  */
 extern bool git_pathspec__match(
 	const git_vector *vspec,
+	const git_pathspec_trie *trie,
 	const char *path,
 	bool disable_fnmatch,
 	bool casefold,
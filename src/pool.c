@@ -81,6 +81,30 @@ static void *pool_alloc_page(git_pool *pool, uint32_t size)
 	return page->data;
 }
 
+int git_pool_reserve(git_pool *pool, uint32_t size)
+{
+	git_pool_page *page = pool->pages;
+	size_t alloc_size;
+
+	if (page && page->avail >= size)
+		return 0;
+
+	if (size <= pool->page_size)
+		size = pool->page_size;
+
+	GITERR_CHECK_ALLOC_ADD(&alloc_size, size, sizeof(git_pool_page));
+	page = git__malloc(alloc_size);
+	GITERR_CHECK_ALLOC(page);
+
+	page->size = size;
+	page->avail = size;
+	page->next = pool->pages;
+
+	pool->pages = page;
+
+	return 0;
+}
+
 static void *pool_alloc(git_pool *pool, uint32_t size)
 {
 	git_pool_page *page = pool->pages;
@@ -67,6 +67,16 @@ extern void git_pool_swap(git_pool *a, git_pool *b);
 extern void *git_pool_malloc(git_pool *pool, uint32_t items);
 extern void *git_pool_mallocz(git_pool *pool, uint32_t items);
 
+/**
+ * Make sure that the next `size` bytes of allocations from the pool
+ * can be served from a single page.
+ *
+ * This is useful when the caller knows ahead of time how much data it
+ * is about to put into the pool (e.g. when parsing a file) and wants
+ * to avoid allocating a lot of small pages.
+ */
+extern int git_pool_reserve(git_pool *pool, uint32_t size);
+
 /**
  * Allocate space and duplicate string data into it.
  *
@@ -26,6 +26,8 @@
 #include "remote.h"
 #include "merge.h"
 #include "diff_driver.h"
+#include "diff_xdiff.h"
+#include "filter_process.h"
 #include "annotated_commit.h"
 
 #ifdef GIT_WIN32
@@ -132,6 +134,17 @@ void git_repository_free(git_repository *repo)
 	git_diff_driver_registry_free(repo->diff_drivers);
 	repo->diff_drivers = NULL;
 
+	if (git_hashsig_cache__flush(repo) < 0)
+		giterr_clear();
+	git_hashsig_cache_free(repo->hashsig_cache);
+	repo->hashsig_cache = NULL;
+
+	git_xdiff_cache_free(repo->xdiff_cache);
+	repo->xdiff_cache = NULL;
+
+	git_filter_process_registry_free(repo->filter_processes);
+	repo->filter_processes = NULL;
+
 	for (i = 0; i < repo->reserved_names.size; i++)
 		git_buf_free(git_array_get(repo->reserved_names, i));
 	git_array_clear(repo->reserved_names);
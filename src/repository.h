@@ -22,6 +22,7 @@
 #include "attrcache.h"
 #include "submodule.h"
 #include "diff_driver.h"
+#include "hashsig_cache.h"
 
 #define DOT_GIT ".git"
 #define GIT_DIR DOT_GIT "/"
@@ -46,6 +47,11 @@ typedef enum {
 	GIT_CVAR_LOGALLREFUPDATES, /* core.logallrefupdates */
 	GIT_CVAR_PROTECTHFS,    /* core.protectHFS */
 	GIT_CVAR_PROTECTNTFS,   /* core.protectNTFS */
+	GIT_CVAR_PRELOADINDEX,  /* core.preloadIndex */
+	GIT_CVAR_SPARSECHECKOUT, /* core.sparseCheckout */
+	GIT_CVAR_SPARSEINDEX,   /* index.sparse */
+	GIT_CVAR_DIFFWINDOW,    /* diff.windowSize */
+	GIT_CVAR_SCANTHREADS,   /* core.scanThreads */
 	GIT_CVAR_CACHE_MAX
 } git_cvar_cached;
 
@@ -106,6 +112,16 @@ typedef enum {
 	GIT_PROTECTHFS_DEFAULT = GIT_CVAR_FALSE,
 	/* core.protectNTFS */
 	GIT_PROTECTNTFS_DEFAULT = GIT_CVAR_FALSE,
+	/* core.preloadIndex */
+	GIT_PRELOADINDEX_DEFAULT = GIT_CVAR_TRUE,
+	/* core.sparseCheckout */
+	GIT_SPARSECHECKOUT_DEFAULT = GIT_CVAR_FALSE,
+	/* index.sparse */
+	GIT_SPARSEINDEX_DEFAULT = GIT_CVAR_FALSE,
+	/* diff.windowSize */
+	GIT_DIFFWINDOW_DEFAULT = 0,
+	/* core.scanThreads */
+	GIT_SCANTHREADS_DEFAULT = 0,
 } git_cvar_value;
 
 /* internal repository init flags */
@@ -125,6 +141,9 @@ struct git_repository {
 	git_cache objects;
 	git_attr_cache *attrcache;
 	git_diff_driver_registry *diff_drivers;
+	git_hashsig_cache *hashsig_cache;
+	struct git_xdiff_cache *xdiff_cache;
+	struct git_filter_process_registry *filter_processes;
 
 	char *path_repository;
 	char *path_gitlink;
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "sparse.h"
+#include "fileops.h"
+#include "vector.h"
+
+GIT__USE_STRMAP
+
+static int sparse_add(git_strmap *map, const char *dir)
+{
+	int error;
+
+	if (git_strmap_exists(map, dir))
+		return 0;
+
+	git_strmap_insert(map, dir, (void *)dir, error);
+	return (error < 0) ? -1 : 0;
+}
+
+static int sparse_add_parents(git_sparse *sparse, const char *dir)
+{
+	const char *slash;
+	char *parent;
+
+	while ((slash = strrchr(dir, '/')) != NULL) {
+		if ((parent = git_pool_strndup(&sparse->pool, dir, slash - dir)) == NULL)
+			return -1;
+
+		if (sparse_add(sparse->parents, parent) < 0)
+			return -1;
+
+		dir = parent;
+	}
+
+	return sparse_add(sparse->parents, "");
+}
+
+static bool is_cone_dirname(const char *name, size_t len)
+{
+	size_t i;
+
+	if (!len || name[0] == '/' || name[len - 1] == '/')
+		return false;
+
+	for (i = 0; i < len; ++i) {
+		if (strchr("*?[\\", name[i]) != NULL)
+			return false;
+		if (name[i] == '/' && name[i + 1] == '/')
+			return false;
+	}
+
+	return true;
+}
+
+static int sparse_parse_line(
+	git_sparse *sparse,
+	git_vector *included,
+	git_vector *excluded,
+	bool *has_root,
+	bool *root_recursive,
+	const char *line,
+	size_t len)
+{
+	git_vector *target;
+	const char *name;
+	size_t name_len;
+	char *dir;
+
+	if (len == 2 && !memcmp(line, "/*", 2)) {
+		*has_root = true;
+		return 0;
+	}
+
+	if (len == 4 && !memcmp(line, "!/*/", 4)) {
+		*root_recursive = false;
+		return 0;
+	}
+
+	if (len > 5 && !memcmp(line, "!/", 2) && !memcmp(line + len - 3, "/*/", 3)) {
+		target = excluded;
+		name = line + 2;
+		name_len = len - 5;
+	} else if (len > 2 && line[0] == '/' && line[len - 1] == '/') {
+		target = included;
+		name = line + 1;
+		name_len = len - 2;
+	} else {
+		name = NULL;
+		name_len = 0;
+	}
+
+	if (!name || !is_cone_dirname(name, name_len)) {
+		giterr_set(GITERR_INVALID,
+			"sparse-checkout pattern '%.*s' is not a cone-mode pattern",
+			(int)len, line);
+		return -1;
+	}
+
+	if ((dir = git_pool_strndup(&sparse->pool, name, name_len)) == NULL)
+		return -1;
+
+	return git_vector_insert(target, dir);
+}
+
+int git_sparse__parse(git_sparse **out, const char *patterns)
+{
+	git_sparse *sparse;
+	git_vector included = GIT_VECTOR_INIT, excluded = GIT_VECTOR_INIT;
+	bool has_root = false, root_recursive = true;
+	const char *scan = patterns, *eol;
+	const char *dir;
+	size_t len, i;
+	int error = 0;
+
+	*out = NULL;
+
+	sparse = git__calloc(1, sizeof(git_sparse));
+	GITERR_CHECK_ALLOC(sparse);
+
+	git_pool_init(&sparse->pool, 1);
+
+	if (git_strmap_alloc(&sparse->recursive) < 0 ||
+		git_strmap_alloc(&sparse->parents) < 0) {
+		error = -1;
+		goto done;
+	}
+
+	while (*scan) {
+		if ((eol = strchr(scan, '\n')) == NULL)
+			eol = scan + strlen(scan);
+
+		for (len = eol - scan; len && git__isspace(scan[len - 1]); --len)
+			/* trim trailing whitespace and CR */;
+
+		if (len && scan[0] != '#' &&
+			(error = sparse_parse_line(sparse, &included, &excluded,
+				&has_root, &root_recursive, scan, len)) < 0)
+			goto done;
+
+		scan = *eol ? eol + 1 : eol;
+	}
+
+	if (has_root && root_recursive)
+		error = sparse_add(sparse->recursive, "");
+	else if (has_root)
+		error = sparse_add(sparse->parents, "");
+
+	/* a directory that is included but whose subdirectories are excluded
+	 * again only contributes its immediate files
+	 */
+	git_vector_foreach(&excluded, i, dir) {
+		if (!error)
+			error = sparse_add(sparse->parents, dir);
+	}
+
+	git_vector_foreach(&included, i, dir) {
+		if (!error && !git_strmap_exists(sparse->parents, dir))
+			error = sparse_add(sparse->recursive, dir);
+	}
+
+	git_vector_foreach(&included, i, dir) {
+		if (!error)
+			error = sparse_add_parents(sparse, dir);
+	}
+
+	git_vector_foreach(&excluded, i, dir) {
+		if (!error)
+			error = sparse_add_parents(sparse, dir);
+	}
+
+done:
+	git_vector_free(&included);
+	git_vector_free(&excluded);
+
+	if (error < 0)
+		git_sparse__free(sparse);
+	else
+		*out = sparse;
+
+	return error;
+}
+
+int git_sparse__load(git_sparse **out, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT, contents = GIT_BUF_INIT;
+	int enabled, error;
+
+	*out = NULL;
+
+	if ((error = git_repository__cvar(
+			&enabled, repo, GIT_CVAR_SPARSECHECKOUT)) < 0 || !enabled)
+		return error;
+
+	if ((error = git_buf_joinpath(&path,
+			git_repository_path(repo), GIT_SPARSE_FILE_INREPO)) < 0)
+		return error;
+
+	if ((error = git_futils_readbuffer(&contents, path.ptr)) == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	} else if (!error) {
+		error = git_sparse__parse(out, contents.ptr);
+	}
+
+	git_buf_free(&contents);
+	git_buf_free(&path);
+	return error;
+}
+
+static bool sparse_has_recursive_ancestor(git_sparse *sparse, git_buf *dir)
+{
+	const char *slash;
+
+	while (true) {
+		if (git_strmap_exists(sparse->recursive, dir->ptr))
+			return true;
+
+		if (!dir->size)
+			return false;
+
+		slash = strrchr(dir->ptr, '/');
+		git_buf_truncate(dir, slash ? (size_t)(slash - dir->ptr) : 0);
+	}
+}
+
+bool git_sparse__contains(git_sparse *sparse, const char *path)
+{
+	git_buf dir = GIT_BUF_INIT;
+	const char *slash = strrchr(path, '/');
+	bool contains;
+
+	if (git_buf_put(&dir, path, slash ? (size_t)(slash - path) : 0) < 0)
+		return true;
+
+	contains = git_strmap_exists(sparse->parents, dir.ptr) ||
+		sparse_has_recursive_ancestor(sparse, &dir);
+
+	git_buf_free(&dir);
+	return contains;
+}
+
+bool git_sparse__dir_outside(git_sparse *sparse, const char *path)
+{
+	git_buf dir = GIT_BUF_INIT;
+	bool outside;
+
+	if (git_buf_puts(&dir, path) < 0)
+		return false;
+
+	while (dir.size && dir.ptr[dir.size - 1] == '/')
+		git_buf_truncate(&dir, dir.size - 1);
+
+	outside = !git_strmap_exists(sparse->parents, dir.ptr) &&
+		!sparse_has_recursive_ancestor(sparse, &dir);
+
+	git_buf_free(&dir);
+	return outside;
+}
+
+void git_sparse__free(git_sparse *sparse)
+{
+	if (!sparse)
+		return;
+
+	git_strmap_free(sparse->recursive);
+	git_strmap_free(sparse->parents);
+	git_pool_clear(&sparse->pool);
+	git__free(sparse);
+}
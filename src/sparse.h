@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_sparse_h__
+#define INCLUDE_sparse_h__
+
+#include "common.h"
+#include "repository.h"
+#include "strmap.h"
+#include "pool.h"
+
+#define GIT_SPARSE_FILE_INREPO "info/sparse-checkout"
+
+/* A cone-mode sparse checkout definition, as written by
+ * `git sparse-checkout set --cone`.  Cone mode only allows two kinds of
+ * directory patterns, so the whole definition reduces to two sets of
+ * directory names (without trailing slash, "" is the root):
+ *
+ * - `recursive` directories have all of their contents in the cone
+ * - `parents` directories have only their immediate files in the cone
+ *
+ * Every ancestor of a directory in either set is a parent, so a
+ * directory that appears in neither set and has no recursive ancestor
+ * has nothing at all in the cone.
+ */
+typedef struct {
+	git_strmap *recursive;
+	git_strmap *parents;
+	git_pool pool;
+} git_sparse;
+
+/**
+ * Load the sparse checkout definition for the repository.  `*out` is set
+ * to NULL when `core.sparseCheckout` is not enabled or when there is no
+ * sparse-checkout file.  Returns an error for patterns that are not in
+ * cone mode.
+ */
+extern int git_sparse__load(git_sparse **out, git_repository *repo);
+
+/* Parse cone-mode patterns from a buffer; mostly useful for testing */
+extern int git_sparse__parse(git_sparse **out, const char *patterns);
+
+/* Is the given file (not directory) path inside the cone? */
+extern bool git_sparse__contains(git_sparse *sparse, const char *path);
+
+/* Is the given directory (with or without trailing slash) entirely
+ * outside of the cone, that is, no file below it can be in the cone?
+ */
+extern bool git_sparse__dir_outside(git_sparse *sparse, const char *dir);
+
+extern void git_sparse__free(git_sparse *sparse);
+
+#endif
@@ -544,6 +544,8 @@ int git_status_init_options(git_status_options *opts, unsigned int version)
 int git_status_list_get_perfdata(
 	git_diff_perfdata *out, const git_status_list *status)
 {
+	size_t stat_calls_avoided = 0;
+
 	assert(out);
 	GITERR_CHECK_VERSION(out, GIT_DIFF_PERFDATA_VERSION, "git_diff_perfdata");
 
@@ -553,12 +555,18 @@ int git_status_list_get_perfdata(
 	if (status->head2idx) {
 		out->stat_calls += status->head2idx->perf.stat_calls;
 		out->oid_calculations += status->head2idx->perf.oid_calculations;
+		stat_calls_avoided += status->head2idx->perf.stat_calls_avoided;
 	}
 	if (status->idx2wd) {
 		out->stat_calls += status->idx2wd->perf.stat_calls;
 		out->oid_calculations += status->idx2wd->perf.oid_calculations;
+		stat_calls_avoided += status->idx2wd->perf.stat_calls_avoided;
 	}
 
+	/* version 1 callers have no room for this */
+	if (out->version >= 2)
+		out->stat_calls_avoided = stat_calls_avoided;
+
 	return 0;
 }
 
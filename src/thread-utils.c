@@ -55,3 +55,124 @@ int git_online_cpus(void)
 
 	return 1;
 }
+
+typedef struct {
+	size_t count;
+	size_t batch_size;
+	git_parallel_cb cb;
+	void *payload;
+
+	git_mutex lock;
+	size_t next;
+	int error;
+	git_error_state error_state;
+} parallel_foreach_data;
+
+static void *parallel_foreach_worker(void *arg)
+{
+	parallel_foreach_data *data = arg;
+	size_t start, end;
+	int error;
+
+	while (1) {
+		if (git_mutex_lock(&data->lock) < 0)
+			break;
+
+		if (data->error || data->next >= data->count) {
+			git_mutex_unlock(&data->lock);
+			break;
+		}
+
+		start = data->next;
+		end = start + min(data->batch_size, data->count - start);
+		data->next = end;
+
+		git_mutex_unlock(&data->lock);
+
+		if ((error = data->cb(start, end, data->payload)) != 0) {
+			if (git_mutex_lock(&data->lock) < 0)
+				break;
+
+			/* the error message is thread-local; keep the first one
+			 * so that the calling thread can report it */
+			if (!data->error) {
+				data->error = error;
+				giterr_state_capture(&data->error_state, error);
+			}
+
+			git_mutex_unlock(&data->lock);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int git_parallel_foreach(
+	size_t count,
+	size_t batch_size,
+	int nthreads,
+	git_parallel_cb cb,
+	void *payload)
+{
+	parallel_foreach_data data;
+#ifdef GIT_THREADS
+	git_thread *threads = NULL;
+	size_t batches;
+	int i, started = 0;
+#endif
+
+	assert(cb);
+
+	if (!count)
+		return 0;
+
+	memset(&data, 0, sizeof(data));
+	data.count = count;
+	data.batch_size = batch_size ? batch_size : 1;
+	data.cb = cb;
+	data.payload = payload;
+
+	if (git_mutex_init(&data.lock) < 0) {
+		giterr_set(GITERR_OS, "Failed to initialize lock");
+		return -1;
+	}
+
+#ifdef GIT_THREADS
+	batches = (count / data.batch_size) + (count % data.batch_size ? 1 : 0);
+
+	if (batches < (size_t)nthreads)
+		nthreads = (int)batches;
+
+	/* if we cannot get as many threads as we wanted, the ones we do
+	 * get (and the calling thread) will simply pick up the slack */
+	if (nthreads > 1 &&
+		(threads = git__calloc(nthreads - 1, sizeof(git_thread))) != NULL) {
+		for (i = 0; i < nthreads - 1; i++) {
+			if (git_thread_create(&threads[i], NULL,
+					parallel_foreach_worker, &data) != 0)
+				break;
+
+			started++;
+		}
+	}
+#else
+	GIT_UNUSED(nthreads);
+#endif
+
+	parallel_foreach_worker(&data);
+
+#ifdef GIT_THREADS
+	for (i = 0; i < started; i++)
+		git_thread_join(&threads[i], NULL);
+
+	git__free(threads);
+#endif
+
+	git_mutex_free(&data.lock);
+
+	if (data.error)
+		giterr_state_restore(&data.error_state);
+
+	return data.error;
+}
@@ -275,6 +275,33 @@ GIT_INLINE(int) git_atomic_get(git_atomic *a)
 
 extern int git_online_cpus(void);
 
+/**
+ * Callback for `git_parallel_foreach`, invoked for the half-open range
+ * of items `[start, end)`.  A non-zero return stops the iteration.
+ */
+typedef int (*git_parallel_cb)(size_t start, size_t end, void *payload);
+
+/**
+ * Hand out `count` items in batches of `batch_size` to up to `nthreads`
+ * threads, the calling thread being one of them.
+ *
+ * Batches are handed out in order, but may complete in any order; the
+ * callback must only touch state that belongs to its own range or that
+ * it protects itself.  When libgit2 is built without thread support,
+ * or when `nthreads` is less than two, every batch is processed on the
+ * calling thread.
+ *
+ * Returns 0 on success or the first non-zero value returned by a
+ * callback, in which case that callback's error message is restored
+ * on the calling thread.
+ */
+extern int git_parallel_foreach(
+	size_t count,
+	size_t batch_size,
+	int nthreads,
+	git_parallel_cb cb,
+	void *payload);
+
 #if defined(GIT_THREADS) && defined(GIT_WIN32)
 # define GIT_MEMORY_BARRIER MemoryBarrier()
 #elif defined(GIT_THREADS)
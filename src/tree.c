@@ -576,7 +576,19 @@ static int write_tree(
 		if (*filename == '/')
 			filename++;
 		next_slash = strchr(filename, '/');
-		if (next_slash) {
+		if (next_slash && next_slash[1] == '\0' &&
+			git_index_entry__is_sparse_dir(entry)) {
+			char *subdir;
+
+			/* a sparse directory is a whole subtree already */
+			subdir = git__strndup(filename, next_slash - filename);
+			GITERR_CHECK_ALLOC(subdir);
+
+			error = append_entry(bld, subdir, &entry->id, S_IFDIR);
+			git__free(subdir);
+			if (error < 0)
+				goto on_error;
+		} else if (next_slash) {
 			git_oid sub_oid;
 			int written;
 			char *subdir, *last_comp;
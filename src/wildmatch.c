@@ -0,0 +1,566 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include <ctype.h>
+
+#include "wildmatch.h"
+
+#define EOS '\0'
+
+#define RANGE_MATCH		1
+#define RANGE_ERROR		(-1)
+
+/* states (bits of uint64_t) kept on the stack before we go to the heap */
+#define WILDMATCH_STACK_WORDS	8
+
+typedef enum {
+	WILDMATCH_LITERAL = 0,
+	WILDMATCH_ANY,      /* '?' */
+	WILDMATCH_ANYALL,   /* any character, even '/' with FNM_PATHNAME */
+	WILDMATCH_CLASS,    /* '[...]' */
+	WILDMATCH_STAR,     /* '*', stops at '/' with FNM_PATHNAME */
+	WILDMATCH_STARSTAR, /* '**', never stops */
+} wildmatch_token_t;
+
+typedef struct {
+	uint8_t type;
+	/* never matches with FNM_PATHNAME: a bracket expression with a '/' */
+	uint8_t no_pathname;
+	unsigned char ch;
+	uint32_t class_idx;
+} wildmatch_token;
+
+/* bracket expression members, by byte, as is and with FNM_CASEFOLD */
+typedef struct {
+	uint32_t exact[8];
+	uint32_t folded[8];
+} wildmatch_class;
+
+struct git_wildmatch {
+	size_t ntokens;
+	size_t nwords;
+	size_t prefix; /* leading literal tokens */
+	size_t suffix; /* trailing literal tokens, after the prefix */
+	size_t leading_state; /* also accepts at a '/' with FNM_LEADING_DIR */
+	wildmatch_token *tokens;
+	wildmatch_class *classes;
+	uint64_t *stars; /* star tokens, as a state set */
+
+	/* for patterns of fewer than 64 tokens, which run in one word */
+	uint64_t any_char;  /* tokens that take any character */
+	uint64_t any_slash; /* ... but '/' only without FNM_PATHNAME */
+	uint64_t checked;   /* literals and classes */
+};
+
+#define CLASS_SET(set, c) ((set)[(c) >> 5] |= (1u << ((c) & 31)))
+#define CLASS_HAS(set, c) (((set)[(c) >> 5] & (1u << ((c) & 31))) != 0)
+
+static void class_add(wildmatch_class *cls, char lo, char hi)
+{
+	char flo = (char)git__tolower((unsigned char)lo);
+	char fhi = (char)git__tolower((unsigned char)hi);
+	int t;
+
+	/* compared as `char`, the way p_fnmatch compares them */
+	for (t = 1; t < 256; t++) {
+		char c = (char)t;
+		char fc = (char)git__tolower(t);
+
+		if (lo <= c && c <= hi)
+			CLASS_SET(cls->exact, t);
+		if (flo <= fc && fc <= fhi)
+			CLASS_SET(cls->folded, t);
+	}
+}
+
+/*
+ * Parse a bracket expression the way p_fnmatch's rangematch does, for
+ * every byte at once.  `pattern` points just past the '['.
+ */
+static int parse_class(
+	wildmatch_class *cls,
+	bool *has_slash,
+	const char **end,
+	const char *pattern,
+	int flags)
+{
+	int negate, i;
+	char c, c2;
+
+	memset(cls, 0, sizeof(*cls));
+	*has_slash = false;
+
+	if ((negate = (*pattern == '!' || *pattern == '^')) != 0)
+		++pattern;
+
+	c = *pattern++;
+	do {
+		if (c == '\\' && !(flags & FNM_NOESCAPE))
+			c = *pattern++;
+		if (c == EOS)
+			return RANGE_ERROR;
+		if (c == '/')
+			*has_slash = true;
+		if (*pattern == '-' && (c2 = *(pattern + 1)) != EOS && c2 != ']') {
+			pattern += 2;
+			if (c2 == '\\' && !(flags & FNM_NOESCAPE))
+				c2 = *pattern++;
+			if (c2 == EOS)
+				return RANGE_ERROR;
+			class_add(cls, c, c2);
+		} else
+			class_add(cls, c, c);
+	} while ((c = *pattern++) != ']');
+
+	if (negate) {
+		for (i = 0; i < 8; i++) {
+			cls->exact[i] = ~cls->exact[i];
+			cls->folded[i] = ~cls->folded[i];
+		}
+	}
+
+	*end = pattern;
+	return RANGE_MATCH;
+}
+
+GIT_INLINE(bool) is_star(const wildmatch_token *tok)
+{
+	return (tok->type == WILDMATCH_STAR || tok->type == WILDMATCH_STARSTAR);
+}
+
+GIT_INLINE(bool) is_literal(const wildmatch_token *tok)
+{
+	return (tok->type == WILDMATCH_LITERAL && !tok->no_pathname);
+}
+
+GIT_INLINE(bool) char_matches(unsigned char p, unsigned char c, bool fold)
+{
+	return (p == c ||
+		(fold && git__tolower(p) == git__tolower(c)));
+}
+
+GIT_INLINE(bool) state_isset(const uint64_t *states, size_t i)
+{
+	return (states[i / 64] & ((uint64_t)1 << (i % 64))) != 0;
+}
+
+GIT_INLINE(void) state_set(uint64_t *states, size_t i)
+{
+	states[i / 64] |= ((uint64_t)1 << (i % 64));
+}
+
+int git_wildmatch_compile(
+	git_wildmatch **out, git_pool *pool, const char *pattern, int flags)
+{
+	git_wildmatch *wm;
+	wildmatch_token *tok;
+	wildmatch_class cls;
+	size_t len = strlen(pattern), nclasses = 0;
+	const char *scan, *end;
+	bool has_slash;
+	char c;
+
+	*out = NULL;
+
+	for (scan = pattern; *scan; scan++)
+		if (*scan == '[')
+			nclasses++;
+
+	wm = git_pool_mallocz(pool, (uint32_t)sizeof(git_wildmatch));
+	GITERR_CHECK_ALLOC(wm);
+
+	/* every token takes at least one byte of the pattern */
+	wm->nwords = (len + 1 + 63) / 64;
+	wm->tokens = git_pool_mallocz(pool,
+		(uint32_t)((len + 1) * sizeof(wildmatch_token)));
+	wm->classes = git_pool_malloc(pool,
+		(uint32_t)((nclasses + 1) * sizeof(wildmatch_class)));
+	wm->stars = git_pool_mallocz(pool,
+		(uint32_t)(wm->nwords * sizeof(uint64_t)));
+	if (!wm->tokens || !wm->classes || !wm->stars)
+		return -1;
+
+	nclasses = 0;
+
+	while ((c = *pattern++) != EOS) {
+		tok = &wm->tokens[wm->ntokens++];
+
+		switch (c) {
+		case '?':
+			tok->type = WILDMATCH_ANY;
+			break;
+		case '*':
+			if (*pattern != '*') {
+				tok->type = WILDMATCH_STAR;
+				break;
+			}
+
+			/* '**' also eats a following '/', as p_fnmatch does */
+			while (*pattern == '*')
+				pattern++;
+			if (*pattern == '/')
+				pattern++;
+			tok->type = WILDMATCH_STARSTAR;
+			break;
+		case '[':
+			if (parse_class(&cls, &has_slash, &end, pattern, flags) < 0) {
+				/* not a good range, treat as normal text */
+				tok->type = WILDMATCH_LITERAL;
+				tok->ch = '[';
+			} else {
+				tok->type = WILDMATCH_CLASS;
+				tok->class_idx = (uint32_t)nclasses;
+				memcpy(&wm->classes[nclasses++], &cls, sizeof(cls));
+				pattern = end;
+			}
+			tok->no_pathname = has_slash;
+			break;
+		case '\\':
+			if (!(flags & FNM_NOESCAPE)) {
+				if ((c = *pattern++) == EOS) {
+					c = '\\';
+					--pattern;
+				}
+			}
+			/* fall through */
+		default:
+			tok->type = WILDMATCH_LITERAL;
+			tok->ch = (unsigned char)c;
+			break;
+		}
+
+		if (is_star(tok))
+			state_set(wm->stars, wm->ntokens - 1);
+	}
+
+	/*
+	 * p_fnmatch only hands the rest of the pattern to a star while
+	 * there is some string left, so when a pattern ends in a "**" and
+	 * then another star, the last star has to match at least one
+	 * character.  Spell that as a one character match before it; the
+	 * "**" took at least two bytes, so there is room for the token.
+	 * With FNM_LEADING_DIR, a star there also matches a '/' (and what
+	 * follows it), so that character may be the leading dir's '/'.
+	 */
+	wm->leading_state = SIZE_MAX;
+
+	if (wm->ntokens >= 2 && is_star(&wm->tokens[wm->ntokens - 1]) &&
+		is_star(&wm->tokens[wm->ntokens - 2])) {
+		tok = &wm->tokens[wm->ntokens - 1];
+		memcpy(tok + 1, tok, sizeof(*tok));
+		if (tok->type == WILDMATCH_STARSTAR) {
+			tok->type = WILDMATCH_ANYALL;
+		} else {
+			tok->type = WILDMATCH_ANY;
+			wm->leading_state = wm->ntokens - 1;
+		}
+
+		wm->stars[(wm->ntokens - 1) / 64] &=
+			~((uint64_t)1 << ((wm->ntokens - 1) % 64));
+		state_set(wm->stars, wm->ntokens++);
+	}
+
+	if (wm->ntokens < 64) {
+		size_t i;
+
+		for (i = 0; i < wm->ntokens; i++) {
+			uint64_t bit = (uint64_t)1 << i;
+
+			switch (wm->tokens[i].type) {
+			case WILDMATCH_ANYALL:
+			case WILDMATCH_STARSTAR:
+				wm->any_char |= bit;
+				break;
+			case WILDMATCH_ANY:
+			case WILDMATCH_STAR:
+				wm->any_slash |= bit;
+				break;
+			default:
+				wm->checked |= bit;
+				break;
+			}
+		}
+	}
+
+	while (wm->prefix < wm->ntokens && is_literal(&wm->tokens[wm->prefix]))
+		wm->prefix++;
+	while (wm->prefix + wm->suffix < wm->ntokens &&
+		is_literal(&wm->tokens[wm->ntokens - wm->suffix - 1]))
+		wm->suffix++;
+
+	*out = wm;
+	return 0;
+}
+
+GIT_INLINE(size_t) lowest_bit(uint64_t bits)
+{
+#if defined(__GNUC__)
+	return (size_t)__builtin_ctzll(bits);
+#else
+	size_t n = 0;
+	while (!(bits & 1)) {
+		bits >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+/* follow the empty transitions: any star may match nothing */
+static bool states_close(const git_wildmatch *wm, uint64_t *states)
+{
+	uint64_t any = 0, stars, add, carry = 0;
+	size_t w;
+
+	for (w = 0; w < wm->nwords; w++) {
+		states[w] |= carry;
+
+		do {
+			stars = states[w] & wm->stars[w];
+			add = (stars << 1) & ~states[w];
+			states[w] |= add;
+		} while (add);
+
+		carry = (states[w] & wm->stars[w]) >> 63;
+		any |= states[w];
+	}
+
+	return (any != 0);
+}
+
+static bool token_matches(
+	const git_wildmatch *wm, const wildmatch_token *tok,
+	unsigned char c, bool pathname, bool fold)
+{
+	const wildmatch_class *cls;
+
+	switch (tok->type) {
+	case WILDMATCH_ANY:
+		return !(pathname && c == '/');
+	case WILDMATCH_ANYALL:
+		return true;
+	case WILDMATCH_CLASS:
+		if (pathname && (c == '/' || tok->no_pathname))
+			return false;
+		cls = &wm->classes[tok->class_idx];
+		return fold ? CLASS_HAS(cls->folded, c) : CLASS_HAS(cls->exact, c);
+	case WILDMATCH_STAR:
+		return !(pathname && c == '/');
+	case WILDMATCH_STARSTAR:
+		return true;
+	default:
+		if (pathname && tok->no_pathname)
+			return false;
+		return char_matches(tok->ch, c, fold);
+	}
+}
+
+/* The same as `wildmatch_run`, for patterns that fit in one word */
+static int wildmatch_run1(
+	const git_wildmatch *wm, size_t first, size_t last,
+	const char *str, const char *end, int flags)
+{
+	bool pathname = (flags & FNM_PATHNAME) != 0;
+	bool fold = (flags & FNM_CASEFOLD) != 0;
+	bool leading = (flags & FNM_LEADING_DIR) != 0;
+	uint64_t stars = wm->stars[0], live = ((uint64_t)1 << last) - 1;
+	uint64_t accept = (uint64_t)1 << last, lead = accept;
+	uint64_t cur, next, bits, add;
+	unsigned char c;
+
+	if (wm->leading_state < last)
+		lead |= (uint64_t)1 << wm->leading_state;
+
+#define CLOSE(states) do { \
+		add = (((states) & stars) << 1) & ~(states); \
+		(states) |= add; \
+	} while (add)
+
+	cur = (uint64_t)1 << first;
+	CLOSE(cur);
+
+	for (; str < end; str++) {
+		size_t i = lowest_bit(cur);
+
+		/*
+		 * When all we have is a star waiting for a literal, skip to
+		 * the next place where the literal could match.
+		 */
+		if (cur == ((uint64_t)3 << i) && (stars & cur) &&
+			i + 1 < last && is_literal(&wm->tokens[i + 1])) {
+			unsigned char lit = wm->tokens[i + 1].ch;
+			bool stops = pathname && wm->tokens[i].type == WILDMATCH_STAR;
+
+			while (str < end &&
+				!char_matches(lit, (unsigned char)*str, fold) &&
+				!(stops && *str == '/'))
+				str++;
+
+			if (str == end)
+				break;
+		}
+
+		c = (unsigned char)*str;
+
+		if (c == '/' && leading && (cur & lead))
+			return 0;
+
+		next = cur & wm->any_char;
+		if (c != '/' || !pathname)
+			next |= cur & wm->any_slash;
+
+		for (bits = cur & wm->checked & live; bits; bits &= bits - 1) {
+			i = lowest_bit(bits);
+
+			if (token_matches(wm, &wm->tokens[i], c, pathname, fold))
+				next |= (uint64_t)1 << i;
+		}
+
+		/* stars stay where they are, everything else moves on */
+		next &= live;
+		next = (next & stars) | ((next & ~stars) << 1);
+		CLOSE(next);
+
+		if (!next)
+			return FNM_NOMATCH;
+
+		cur = next;
+	}
+
+#undef CLOSE
+
+	return (cur & accept) ? 0 : FNM_NOMATCH;
+}
+
+/* Run tokens [first, last) over [str, end) as an NFA, one state per
+ * token plus the accepting state `last`.
+ */
+static int wildmatch_run(
+	const git_wildmatch *wm, size_t first, size_t last,
+	const char *str, const char *end, int flags)
+{
+	uint64_t stack[WILDMATCH_STACK_WORDS * 2], *states, *cur, *next, *swap;
+	uint64_t bits;
+	bool pathname = (flags & FNM_PATHNAME) != 0;
+	bool fold = (flags & FNM_CASEFOLD) != 0;
+	bool leading = (flags & FNM_LEADING_DIR) != 0;
+	size_t w, i, nwords = wm->nwords;
+	const wildmatch_token *tok;
+	unsigned char c;
+	int result = FNM_NOMATCH;
+
+	if (nwords <= WILDMATCH_STACK_WORDS)
+		states = stack;
+	else if ((states = git__malloc(nwords * 2 * sizeof(uint64_t))) == NULL)
+		return FNM_NORES;
+
+	cur = states;
+	next = states + nwords;
+
+	memset(cur, 0, nwords * sizeof(uint64_t));
+	state_set(cur, first);
+	states_close(wm, cur);
+
+	for (; str < end; str++) {
+		c = (unsigned char)*str;
+
+		if (leading && c == '/' && (state_isset(cur, last) ||
+			(wm->leading_state < last &&
+			 state_isset(cur, wm->leading_state)))) {
+			result = 0;
+			goto done;
+		}
+
+		memset(next, 0, nwords * sizeof(uint64_t));
+
+		for (w = 0; w < nwords; w++) {
+			for (bits = cur[w]; bits; bits &= bits - 1) {
+				i = w * 64 + lowest_bit(bits);
+				if (i >= last)
+					break;
+
+				tok = &wm->tokens[i];
+				if (!token_matches(wm, tok, c, pathname, fold))
+					continue;
+
+				if (is_star(tok))
+					state_set(next, i);
+				else
+					state_set(next, i + 1);
+			}
+		}
+
+		if (!states_close(wm, next))
+			goto done;
+
+		swap = cur; cur = next; next = swap;
+	}
+
+	if (state_isset(cur, last))
+		result = 0;
+
+done:
+	if (states != stack)
+		git__free(states);
+	return result;
+}
+
+int git_wildmatch_match(const git_wildmatch *wm, const char *str, int flags)
+{
+	bool pathname = (flags & FNM_PATHNAME) != 0;
+	bool fold = (flags & FNM_CASEFOLD) != 0;
+	bool leading = (flags & FNM_LEADING_DIR) != 0;
+	size_t i, len, last = wm->ntokens;
+	const wildmatch_token *tok;
+	const char *end;
+
+	assert(wm && str && !(flags & FNM_PERIOD));
+
+	for (i = 0; i < wm->prefix; i++, str++) {
+		if (!char_matches(wm->tokens[i].ch, (unsigned char)*str, fold))
+			return FNM_NOMATCH;
+	}
+
+	if (wm->prefix == wm->ntokens)
+		return (!*str || (leading && *str == '/')) ? 0 : FNM_NOMATCH;
+
+	len = strlen(str);
+	end = str + len;
+
+	/* without FNM_LEADING_DIR, the string must end in the suffix */
+	if (wm->suffix && !leading) {
+		if (len < wm->suffix)
+			return FNM_NOMATCH;
+
+		last -= wm->suffix;
+		end -= wm->suffix;
+
+		for (i = 0; i < wm->suffix; i++) {
+			if (!char_matches(wm->tokens[last + i].ch,
+					(unsigned char)end[i], fold))
+				return FNM_NOMATCH;
+		}
+	}
+
+	/* a lone star between prefix and suffix, as in "*.c" or "foo*" */
+	if (last - wm->prefix == 1) {
+		tok = &wm->tokens[wm->prefix];
+
+		if (tok->type == WILDMATCH_STARSTAR ||
+			(tok->type == WILDMATCH_STAR && !pathname))
+			return 0;
+
+		if (tok->type == WILDMATCH_STAR)
+			return (leading || !memchr(str, '/', end - str)) ?
+				0 : FNM_NOMATCH;
+	}
+
+	if (wm->ntokens < 64)
+		return wildmatch_run1(wm, wm->prefix, last, str, end, flags);
+
+	return wildmatch_run(wm, wm->prefix, last, str, end, flags);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) the libgit2 contributors.  All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_wildmatch_h__
+#define INCLUDE_wildmatch_h__
+
+#include "common.h"
+#include "fnmatch.h"
+#include "pool.h"
+
+/*
+ * A glob pattern compiled for repeated matching.
+ *
+ * The pattern is split into a literal prefix and suffix, which are
+ * compared directly, and a sequence of tokens which is run as an NFA,
+ * one pass over the string, so no pattern can make matching take
+ * more than (pattern length * string length) steps.
+ *
+ * Matches give the same answer as `p_fnmatch` with the same flags,
+ * including its treatment of `**`, so callers can switch between the
+ * two freely.
+ */
+typedef struct git_wildmatch git_wildmatch;
+
+/**
+ * Compile a pattern
+ *
+ * @param out Pointer to store the compiled pattern
+ * @param pool Pool to allocate the compiled pattern from; it lives as
+ *        long as the pool does
+ * @param pattern The pattern
+ * @param flags Only FNM_NOESCAPE is used here; the rest of the flags
+ *        are given to `git_wildmatch_match`
+ * @return 0 on success, <0 on allocation failure
+ */
+extern int git_wildmatch_compile(
+	git_wildmatch **out, git_pool *pool, const char *pattern, int flags);
+
+/**
+ * Match a string against a compiled pattern
+ *
+ * @param wm The compiled pattern
+ * @param str The string to match
+ * @param flags FNM_PATHNAME, FNM_LEADING_DIR and FNM_CASEFOLD as for
+ *        `p_fnmatch` (FNM_PERIOD is not supported)
+ * @return 0 on match, FNM_NOMATCH otherwise
+ */
+extern int git_wildmatch_match(
+	const git_wildmatch *wm, const char *str, int flags);
+
+#endif
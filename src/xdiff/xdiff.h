@@ -79,8 +79,26 @@ typedef struct s_mmbuffer {
 	size_t size;
 } mmbuffer_t;
 
+/*
+ * The lines of a file, found and hashed ahead of time so that a file
+ * which is diffed repeatedly only has to be scanned once.  Line i runs
+ * from offs[i] to offs[i + 1].  The hashes depend on the whitespace
+ * flags they were computed with.
+ */
+typedef struct s_xdlines {
+	unsigned long flags;
+	long nrec;
+	long *offs;
+	unsigned long *ha;
+} xdlines_t;
+
 typedef struct s_xpparam {
 	unsigned long flags;
+
+	/* lines of mf1 and mf2 from xdl_prepare_lines(), or NULL; these
+	 * are also used when the file is a prefix of the one they describe
+	 */
+	xdlines_t const *lines1, *lines2;
 } xpparam_t;
 
 typedef struct s_xdemitcb {
@@ -118,6 +136,9 @@ long xdl_mmfile_size(mmfile_t *mmf);
 int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	     xdemitconf_t const *xecfg, xdemitcb_t *ecb);
 
+int xdl_prepare_lines(mmfile_t *mf, unsigned long flags, xdlines_t *lines);
+void xdl_free_lines(xdlines_t *lines);
+
 typedef struct s_xmparam {
 	xpparam_t xpp;
 	int marker_size;
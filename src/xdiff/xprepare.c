@@ -58,7 +58,7 @@ static void xdl_free_classifier(xdlclassifier_t *cf);
 static int xdl_classify_record(unsigned int pass, xdlclassifier_t *cf, xrecord_t **rhash,
 			       unsigned int hbits, xrecord_t *rec);
 static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_t const *xpp,
-			   xdlclassifier_t *cf, xdfile_t *xdf);
+			   xdlines_t const *lines, xdlclassifier_t *cf, xdfile_t *xdf);
 static void xdl_free_ctx(xdfile_t *xdf);
 static int xdl_clean_mmatch(char const *dis, long i, long s, long e);
 static int xdl_cleanup_records(xdlclassifier_t *cf, xdfile_t *xdf1, xdfile_t *xdf2);
@@ -158,7 +158,7 @@ static int xdl_classify_record(unsigned int pass, xdlclassifier_t *cf, xrecord_t
 
 
 static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_t const *xpp,
-			   xdlclassifier_t *cf, xdfile_t *xdf) {
+			   xdlines_t const *lines, xdlclassifier_t *cf, xdfile_t *xdf) {
 	unsigned int hbits;
 	long nrec, hsize, bsize;
 	unsigned long hav;
@@ -195,7 +195,12 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 	if ((cur = blk = xdl_mmfile_first(mf, &bsize)) != NULL) {
 		for (top = blk + bsize; cur < top; ) {
 			prev = cur;
-			hav = xdl_hash_record(&cur, top, xpp->flags);
+			if (lines && nrec < lines->nrec &&
+			    lines->offs[nrec + 1] <= bsize) {
+				hav = lines->ha[nrec];
+				cur = blk + lines->offs[nrec + 1];
+			} else
+				hav = xdl_hash_record(&cur, top, xpp->flags);
 			if (nrec >= narec) {
 				narec *= 2;
 				if (!(rrecs = (xrecord_t **) xdl_realloc(recs, narec * sizeof(xrecord_t *))))
@@ -259,10 +264,69 @@ static void xdl_free_ctx(xdfile_t *xdf) {
 }
 
 
+int xdl_prepare_lines(mmfile_t *mf, unsigned long flags, xdlines_t *lines) {
+	long bsize, alloc;
+	char const *blk, *cur, *top;
+	long *offs;
+	unsigned long *ha;
+
+	memset(lines, 0, sizeof(*lines));
+	lines->flags = flags & XDF_WHITESPACE_FLAGS;
+
+	alloc = xdl_guess_lines(mf, XDL_GUESS_NLINES1) + 1;
+	if (!(lines->offs = (long *) xdl_malloc((alloc + 1) * sizeof(long))) ||
+	    !(lines->ha = (unsigned long *) xdl_malloc(alloc * sizeof(unsigned long))))
+		goto abort;
+
+	lines->offs[0] = 0;
+
+	if ((cur = blk = xdl_mmfile_first(mf, &bsize)) != NULL) {
+		for (top = blk + bsize; cur < top; ) {
+			if (lines->nrec >= alloc) {
+				alloc *= 2;
+				if (!(offs = (long *) xdl_realloc(lines->offs, (alloc + 1) * sizeof(long))))
+					goto abort;
+				lines->offs = offs;
+				if (!(ha = (unsigned long *) xdl_realloc(lines->ha, alloc * sizeof(unsigned long))))
+					goto abort;
+				lines->ha = ha;
+			}
+			lines->ha[lines->nrec] = xdl_hash_record(&cur, top, lines->flags);
+			lines->offs[++lines->nrec] = (long) (cur - blk);
+		}
+	}
+
+	return 0;
+
+abort:
+	xdl_free_lines(lines);
+	return -1;
+}
+
+
+void xdl_free_lines(xdlines_t *lines) {
+
+	xdl_free(lines->offs);
+	xdl_free(lines->ha);
+	memset(lines, 0, sizeof(*lines));
+}
+
+
+static xdlines_t const *xdl_usable_lines(xdlines_t const *lines, xpparam_t const *xpp) {
+
+	if (!lines || lines->flags != (xpp->flags & XDF_WHITESPACE_FLAGS))
+		return NULL;
+
+	return lines;
+}
+
+
 int xdl_prepare_env(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 		    xdfenv_t *xe) {
 	long enl1, enl2, sample;
 	xdlclassifier_t cf;
+	xdlines_t const *lines1 = xdl_usable_lines(xpp->lines1, xpp);
+	xdlines_t const *lines2 = xdl_usable_lines(xpp->lines2, xpp);
 
 	memset(&cf, 0, sizeof(cf));
 
@@ -276,19 +340,19 @@ int xdl_prepare_env(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	sample = (XDF_DIFF_ALG(xpp->flags) == XDF_HISTOGRAM_DIFF
 		  ? XDL_GUESS_NLINES2 : XDL_GUESS_NLINES1);
 
-	enl1 = xdl_guess_lines(mf1, sample) + 1;
-	enl2 = xdl_guess_lines(mf2, sample) + 1;
+	enl1 = lines1 ? lines1->nrec + 1 : xdl_guess_lines(mf1, sample) + 1;
+	enl2 = lines2 ? lines2->nrec + 1 : xdl_guess_lines(mf2, sample) + 1;
 
 	if (XDF_DIFF_ALG(xpp->flags) != XDF_HISTOGRAM_DIFF &&
 	    xdl_init_classifier(&cf, enl1 + enl2 + 1, xpp->flags) < 0)
 		return -1;
 
-	if (xdl_prepare_ctx(1, mf1, enl1, xpp, &cf, &xe->xdf1) < 0) {
+	if (xdl_prepare_ctx(1, mf1, enl1, xpp, lines1, &cf, &xe->xdf1) < 0) {
 
 		xdl_free_classifier(&cf);
 		return -1;
 	}
-	if (xdl_prepare_ctx(2, mf2, enl2, xpp, &cf, &xe->xdf2) < 0) {
+	if (xdl_prepare_ctx(2, mf2, enl2, xpp, lines2, &cf, &xe->xdf2) < 0) {
 
 		xdl_free_ctx(&xe->xdf1);
 		xdl_free_classifier(&cf);
@@ -252,3 +252,66 @@ void test_attr_ignore__dont_ignore_files_for_folder(void)
 	if (cl_repo_get_bool(g_repo, "core.ignorecase"))
 		assert_is_ignored(false, "dir/TeSt");
 }
+
+void test_attr_ignore__rules_of_every_kind_keep_their_order(void)
+{
+	cl_git_rewritefile("attr/.gitignore",
+		"*.o\n"
+		"!keep.o\n"
+		"out/\n"
+		"docs/*.html\n"
+		"!docs/index.html\n"
+		"Thumbs.db\n"
+		"*~\n"
+		"!*.tmp~\n"
+		"[Ll]ogs\n");
+
+	assert_is_ignored(true,  "a.o");
+	assert_is_ignored(true,  "sub/b.o");
+	assert_is_ignored(false, "keep.o");
+	assert_is_ignored(false, "sub/keep.o");
+	assert_is_ignored(true,  "out/file");
+	assert_is_ignored(true,  "sub/out/file");
+	assert_is_ignored(true,  "docs/a.html");
+	assert_is_ignored(false, "docs/index.html");
+	assert_is_ignored(false, "docs/sub/a.html");
+	assert_is_ignored(false, "other/docs/a.html");
+	assert_is_ignored(true,  "Thumbs.db");
+	assert_is_ignored(true,  "sub/Thumbs.db");
+	assert_is_ignored(true,  "notes~");
+	assert_is_ignored(false, "a.tmp~");
+	assert_is_ignored(true,  "logs");
+	assert_is_ignored(true,  "sub/Logs/today");
+	assert_is_ignored(false, "plain.c");
+
+	cl_repo_set_bool(g_repo, "core.ignorecase", true);
+	cl_git_rewritefile("attr/.gitignore",
+		"*.o\n"
+		"!keep.o\n"
+		"Docs/*.html\n"
+		"thumbs.db\n");
+
+	assert_is_ignored(true,  "A.O");
+	assert_is_ignored(false, "KEEP.O");
+	assert_is_ignored(true,  "docs/A.HTML");
+	assert_is_ignored(true,  "sub/THUMBS.DB");
+	assert_is_ignored(false, "plain.c");
+}
+
+void test_attr_ignore__indexed_rules_stay_in_their_directory(void)
+{
+	cl_git_rmfile("attr/.gitignore");
+	cl_must_pass(p_mkdir("attr/nested", 0777));
+	cl_git_mkfile("attr/nested/.gitignore", "*.log\nlocal\n/top\nbuild/\n");
+
+	assert_is_ignored(true,  "nested/a.log");
+	assert_is_ignored(false, "a.log");
+	assert_is_ignored(true,  "nested/local");
+	assert_is_ignored(true,  "nested/x/local");
+	assert_is_ignored(false, "local");
+	assert_is_ignored(true,  "nested/top");
+	assert_is_ignored(false, "nested/x/top");
+	assert_is_ignored(false, "top");
+	assert_is_ignored(true,  "nested/build/file");
+	assert_is_ignored(false, "build/file");
+}
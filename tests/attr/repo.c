@@ -97,6 +97,35 @@ void test_attr_repo__get_one_start_deep(void)
 		g_repo, GIT_ATTR_FILE__FROM_FILE, "sub/.gitattributes"));
 }
 
+static void check_with_session(git_attr_session *session, int i)
+{
+	struct attr_expected *scan = &get_one_test_cases[i];
+	const char *value;
+
+	cl_git_pass(git_attr_get_many_with_session(
+		&value, g_repo, session, 0, scan->path, 1, &scan->attr));
+	attr_check_expected(
+		scan->expected, scan->expected_str, scan->attr, value);
+}
+
+void test_attr_repo__get_with_session(void)
+{
+	git_attr_session session;
+	int i;
+
+	/* directories are held by the session and left as paths move on,
+	 * so go through them in both directions */
+	memset(&session, 0, sizeof(session));
+	cl_git_pass(git_attr_session__init(&session, g_repo));
+
+	for (i = 0; i < (int)ARRAY_SIZE(get_one_test_cases); ++i)
+		check_with_session(&session, i);
+	for (i = (int)ARRAY_SIZE(get_one_test_cases) - 1; i >= 0; --i)
+		check_with_session(&session, i);
+
+	git_attr_session__free(&session);
+}
+
 void test_attr_repo__get_many(void)
 {
 	const char *names[4] = { "repoattr", "rootattr", "missingattr", "subattr" };
@@ -0,0 +1,285 @@
+#include "clar_libgit2.h"
+
+#include "git2/checkout.h"
+#include "git2/pack.h"
+#include "git2/sys/filter.h"
+#include "fileops.h"
+#include "index.h"
+#include "odb.h"
+#include "repository.h"
+
+static git_repository *g_repo;
+
+/* more than one window of blobs to write */
+#define FILE_COUNT 1500
+#define DIR_COUNT 12
+
+static const char *file_ext(size_t i)
+{
+	if (i % 7 == 0)
+		return "crlf";
+	if (i % 11 == 0)
+		return "id";
+	if (i % 13 == 0)
+		return "up";
+	return "txt";
+}
+
+static void file_path(git_buf *out, size_t i)
+{
+	git_buf_clear(out);
+	cl_git_pass(git_buf_printf(out, "empty_standard_repo/d%02d/f%04d.%s",
+		(int)(i % DIR_COUNT), (int)i, file_ext(i)));
+}
+
+/* a filter that isn't built in, to make checkout write some files on
+ * the calling thread
+ */
+static int upcase_filter_apply(
+	git_filter *self,
+	void **payload,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *source)
+{
+	bool smudge = (git_filter_source_mode(source) == GIT_FILTER_SMUDGE);
+	size_t i;
+
+	GIT_UNUSED(self);
+	GIT_UNUSED(payload);
+
+	if (git_buf_set(to, from->ptr, from->size) < 0)
+		return -1;
+
+	for (i = 0; i < to->size; i++)
+		to->ptr[i] = smudge ?
+			(char)toupper(to->ptr[i]) : (char)tolower(to->ptr[i]);
+
+	return 0;
+}
+
+static git_filter upcase_filter;
+
+void test_checkout_parallel__initialize(void)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_index *index;
+	size_t i;
+
+	memset(&upcase_filter, 0, sizeof(upcase_filter));
+	upcase_filter.version = GIT_FILTER_VERSION;
+	upcase_filter.attributes = "+checkoutupcase";
+	upcase_filter.apply = upcase_filter_apply;
+
+	cl_git_pass(git_filter_register(
+		"checkout-upcase", &upcase_filter, GIT_FILTER_DRIVER_PRIORITY));
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_mkfile("empty_standard_repo/.gitattributes",
+		"*.crlf text eol=crlf\n"
+		"*.id ident\n"
+		"*.up checkoutupcase\n");
+
+	for (i = 0; i < DIR_COUNT; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/d%02d", (int)i));
+		cl_git_pass(p_mkdir(path.ptr, 0777));
+	}
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		file_path(&path, i);
+
+		git_buf_clear(&content);
+		cl_git_pass(git_buf_printf(&content,
+			"file %d\nsecond line\n%s", (int)i, i % 11 ? "" : "$Id$\n"));
+
+		cl_git_mkfile(path.ptr, content.ptr);
+	}
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_repo_commit_from_index(NULL, g_repo, NULL, 0, "many files");
+
+	git_buf_free(&path);
+	git_buf_free(&content);
+}
+
+void test_checkout_parallel__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+	git_filter_unregister("checkout-upcase");
+}
+
+typedef struct {
+	size_t calls;
+	git_buf last;
+	int out_of_order;
+	git_tree *tree;
+	git_off_t last_offset;
+} progress_data;
+
+static void checkout_progress(
+	const char *path, size_t cur, size_t tot, void *payload)
+{
+	progress_data *progress = payload;
+
+	GIT_UNUSED(tot);
+
+	if (!path)
+		return;
+
+	if (progress->calls && strcmp(progress->last.ptr, path) >= 0)
+		progress->out_of_order = 1;
+
+	progress->calls = cur;
+	git_buf_sets(&progress->last, path);
+}
+
+static void checkout_progress_by_offset(
+	const char *path, size_t cur, size_t tot, void *payload)
+{
+	progress_data *progress = payload;
+	struct git_pack_file *pack;
+	git_tree_entry *entry;
+	git_odb *odb;
+	git_off_t offset;
+
+	GIT_UNUSED(tot);
+
+	if (!path)
+		return;
+
+	cl_git_pass(git_tree_entry_bypath(&entry, progress->tree, path));
+	cl_git_pass(git_repository_odb__weakptr(&odb, g_repo));
+	cl_git_pass(git_odb__pack_position(
+		&pack, &offset, odb, git_tree_entry_id(entry)));
+	git_tree_entry_free(entry);
+
+	if (progress->calls && offset <= progress->last_offset)
+		progress->out_of_order = 1;
+
+	progress->calls = cur;
+	progress->last_offset = offset;
+}
+
+static void remove_all_files(void)
+{
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < DIR_COUNT; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/d%02d", (int)i));
+		cl_git_pass(git_futils_rmdir_r(path.ptr, NULL, GIT_RMDIR_REMOVE_FILES));
+	}
+
+	git_buf_free(&path);
+}
+
+static void assert_all_files_checked_out(void)
+{
+	git_buf path = GIT_BUF_INIT, expected = GIT_BUF_INIT;
+	git_status_list *status;
+	git_index *index;
+	const git_index_entry *entry;
+	struct stat st;
+	size_t i;
+
+	/* every file is filtered and its stat data recorded in the index */
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		file_path(&path, i);
+
+		cl_git_pass(p_stat(path.ptr, &st));
+
+		entry = git_index_get_bypath(
+			index, path.ptr + strlen("empty_standard_repo/"), 0);
+		cl_assert(entry);
+		cl_assert_equal_i((int)st.st_size, (int)entry->file_size);
+		cl_assert_equal_i((int)st.st_mtime, (int)entry->mtime.seconds);
+	}
+
+	cl_assert_equal_file("file 0\r\nsecond line\r\n$Id$\r\n", 0,
+		"empty_standard_repo/d00/f0000.crlf");
+	cl_assert_equal_file("FILE 13\nSECOND LINE\n", 0,
+		"empty_standard_repo/d01/f0013.up");
+
+	/* ident is expanded with the id of the blob being written */
+	entry = git_index_get_bypath(index, "d11/f0011.id", 0);
+	cl_assert(entry);
+	cl_git_pass(git_buf_printf(&expected,
+		"file 11\nsecond line\n$Id: %s $\n", git_oid_tostr_s(&entry->id)));
+	cl_assert_equal_file(expected.ptr, 0, "empty_standard_repo/d11/f0011.id");
+
+	git_index_free(index);
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_i(0, git_status_list_entrycount(status));
+	git_status_list_free(status);
+
+	git_buf_free(&path);
+	git_buf_free(&expected);
+}
+
+void test_checkout_parallel__writes_every_file_in_order(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	progress_data progress = { 0, GIT_BUF_INIT, 0 };
+
+	remove_all_files();
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	opts.progress_cb = checkout_progress;
+	opts.progress_payload = &progress;
+
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+
+	cl_assert_equal_sz(FILE_COUNT, progress.calls);
+	cl_assert(!progress.out_of_order);
+
+	assert_all_files_checked_out();
+
+	git_buf_free(&progress.last);
+}
+
+void test_checkout_parallel__writes_in_pack_order(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	progress_data progress = { 0, GIT_BUF_INIT, 0 };
+	git_packbuilder *pb;
+	git_object *head;
+	git_odb *odb;
+
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD"));
+	cl_git_pass(git_packbuilder_new(&pb, g_repo));
+	cl_git_pass(git_packbuilder_insert_commit(pb, git_object_id(head)));
+	cl_git_pass(git_packbuilder_write(
+		pb, "empty_standard_repo/.git/objects/pack", 0, NULL, NULL));
+	git_packbuilder_free(pb);
+
+	cl_git_pass(git_repository_odb__weakptr(&odb, g_repo));
+	cl_git_pass(git_odb_refresh(odb));
+
+	remove_all_files();
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_PACK_ORDER;
+	opts.progress_cb = checkout_progress_by_offset;
+	opts.progress_payload = &progress;
+	cl_git_pass(git_commit_tree((git_tree **)&progress.tree, (git_commit *)head));
+
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+
+	/* .gitattributes was not removed, so is not written again */
+	cl_assert_equal_sz(FILE_COUNT, progress.calls);
+	cl_assert(!progress.out_of_order);
+
+	assert_all_files_checked_out();
+
+	git_tree_free(progress.tree);
+	git_object_free(head);
+}
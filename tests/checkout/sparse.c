@@ -0,0 +1,378 @@
+#include "clar_libgit2.h"
+
+#include "git2/checkout.h"
+#include "fileops.h"
+#include "index.h"
+#include "sparse.h"
+
+static git_repository *g_repo;
+
+#define ROOT_AND_AB_DE \
+	"/*\n!/*/\n/ab/\n!/ab/*/\n/ab/de/\n"
+
+void test_checkout_sparse__initialize(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_object *head;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	/* the fixture's index doesn't match HEAD; start from a clean tree */
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_REMOVE_UNTRACKED;
+
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD"));
+	cl_git_pass(git_reset(g_repo, head, GIT_RESET_HARD, &opts));
+	git_object_free(head);
+}
+
+void test_checkout_sparse__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void set_cone(const char *patterns)
+{
+	cl_repo_set_bool(g_repo, "core.sparseCheckout", true);
+	cl_git_pass(git_futils_mkdir_r("testrepo/.git/info", 0777));
+	cl_git_rewritefile("testrepo/.git/info/sparse-checkout", patterns);
+}
+
+static void checkout_subtrees(unsigned int strategy)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_object *obj;
+
+	opts.checkout_strategy = strategy;
+
+	cl_git_pass(git_revparse_single(&obj, g_repo, "subtrees"));
+	cl_git_pass(git_checkout_tree(g_repo, obj, &opts));
+	cl_git_pass(git_repository_set_head(g_repo, "refs/heads/subtrees"));
+
+	git_object_free(obj);
+}
+
+static void checkout_head(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+
+	opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+}
+
+static bool skips_worktree(git_index *index, const char *path)
+{
+	const git_index_entry *entry = git_index_get_bypath(index, path, 0);
+
+	cl_assert(entry);
+	return (entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0;
+}
+
+static void assert_status_clean(void)
+{
+	git_status_list *status;
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_i(0, git_status_list_entrycount(status));
+	git_status_list_free(status);
+}
+
+void test_checkout_sparse__cone_patterns(void)
+{
+	git_sparse *sparse;
+
+	cl_git_pass(git_sparse__parse(&sparse, ROOT_AND_AB_DE));
+
+	cl_assert(git_sparse__contains(sparse, "README"));
+	cl_assert(git_sparse__contains(sparse, "ab/4.txt"));
+	cl_assert(git_sparse__contains(sparse, "ab/de/2.txt"));
+	cl_assert(git_sparse__contains(sparse, "ab/de/fgh/1.txt"));
+	cl_assert(!git_sparse__contains(sparse, "ab/c/3.txt"));
+	cl_assert(!git_sparse__contains(sparse, "other/file.txt"));
+
+	cl_assert(git_sparse__dir_outside(sparse, "ab/c"));
+	cl_assert(git_sparse__dir_outside(sparse, "other/"));
+	cl_assert(!git_sparse__dir_outside(sparse, "ab"));
+	cl_assert(!git_sparse__dir_outside(sparse, "ab/de/fgh"));
+
+	git_sparse__free(sparse);
+
+	cl_git_fail(git_sparse__parse(&sparse, "*.txt\n"));
+	cl_git_fail(git_sparse__parse(&sparse, "/*\n!/*/\n/ab/*/\n"));
+}
+
+void test_checkout_sparse__skips_files_outside_of_the_cone(void)
+{
+	git_index *index;
+
+	set_cone(ROOT_AND_AB_DE);
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+
+	cl_assert(git_path_exists("testrepo/ab/4.txt"));
+	cl_assert(git_path_exists("testrepo/ab/de/2.txt"));
+	cl_assert(git_path_exists("testrepo/ab/de/fgh/1.txt"));
+	cl_assert(!git_path_exists("testrepo/ab/c/3.txt"));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert(skips_worktree(index, "ab/c/3.txt"));
+	cl_assert(!skips_worktree(index, "ab/4.txt"));
+	cl_assert(!skips_worktree(index, "ab/de/fgh/1.txt"));
+	git_index_free(index);
+
+	assert_status_clean();
+}
+
+void test_checkout_sparse__widening_the_cone_restores_files(void)
+{
+	git_index *index;
+
+	set_cone(ROOT_AND_AB_DE);
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+	cl_assert(!git_path_exists("testrepo/ab/c/3.txt"));
+
+	set_cone("/*\n!/*/\n/ab/\n");
+	checkout_head();
+
+	cl_assert(git_path_exists("testrepo/ab/c/3.txt"));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert(!skips_worktree(index, "ab/c/3.txt"));
+	git_index_free(index);
+
+	assert_status_clean();
+}
+
+void test_checkout_sparse__narrowing_keeps_modified_files(void)
+{
+	git_index *index;
+
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+	cl_git_rewritefile("testrepo/ab/de/2.txt", "modified\n");
+
+	set_cone("/*\n!/*/\n");
+	checkout_head();
+
+	cl_assert(!git_path_exists("testrepo/ab/4.txt"));
+	cl_assert(!git_path_exists("testrepo/ab/de/fgh/1.txt"));
+	cl_assert(git_path_exists("testrepo/ab/de/2.txt"));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert(skips_worktree(index, "ab/4.txt"));
+	cl_assert(!skips_worktree(index, "ab/de/2.txt"));
+	git_index_free(index);
+}
+
+void test_checkout_sparse__rejects_non_cone_patterns(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+
+	set_cone("*.txt\n");
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_fail(git_checkout_head(g_repo, &opts));
+}
+
+void test_checkout_sparse__sparse_index_collapses_directories(void)
+{
+	git_index *index;
+	const git_index_entry *entry;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	set_cone("/*\n!/*/\n");
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+
+	cl_assert(!git_path_exists("testrepo/ab"));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+
+	/* README, ab/, branch_file.txt, new.txt */
+	cl_assert_equal_i(4, git_index_entrycount(index));
+	cl_assert((entry = git_index_get_byindex(index, 1)) != NULL);
+	cl_assert_equal_s("ab/", entry->path);
+	cl_assert_equal_i(GIT_FILEMODE_TREE, entry->mode);
+	cl_assert(git_index_entry__is_sparse_dir(entry));
+
+	/* in-cone lookups and status don't need the full index */
+	cl_assert(git_index_get_bypath(index, "README", 0) != NULL);
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	assert_status_clean();
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	/* looking up a path inside of it expands it */
+	cl_assert(skips_worktree(index, "ab/de/fgh/1.txt"));
+	cl_assert_equal_i(7, git_index_entrycount(index));
+
+	/* and writing collapses it again */
+	cl_git_pass(git_index_write(index));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	git_index_free(index);
+}
+
+void test_checkout_sparse__status_passes_over_sparse_directories(void)
+{
+	git_index *index;
+	git_status_list *status;
+	const git_status_entry *entry;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	set_cone("/*\n!/*/\n");
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+
+	/* nothing in the directory is looked at while it's outside the cone */
+	cl_git_pass(git_futils_mkdir_r("testrepo/ab", 0777));
+	cl_git_mkfile("testrepo/ab/untracked.txt", "untracked\n");
+
+	assert_status_clean();
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	/* once the cone has grown into it, it is compared entry by entry */
+	set_cone("/*\n!/*/\n/ab/\n");
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_i(1, git_status_list_entrycount(status));
+	cl_assert((entry = git_status_byindex(status, 0)) != NULL);
+	cl_assert_equal_i(GIT_STATUS_WT_NEW, entry->status);
+	cl_assert_equal_s("ab/untracked.txt", entry->index_to_workdir->new_file.path);
+	git_status_list_free(status);
+
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	git_index_free(index);
+}
+
+void test_checkout_sparse__reading_a_tree_keeps_sparse_directories(void)
+{
+	git_index *index;
+	git_object *obj, *ab;
+	git_treebuilder *bld;
+	git_tree *tree;
+	git_oid id;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	set_cone("/*\n!/*/\n");
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+
+	cl_git_pass(git_revparse_single(&obj, g_repo, "subtrees^{tree}"));
+	cl_git_pass(git_index_read_tree(index, (git_tree *)obj));
+	git_object_free(obj);
+
+	cl_assert_equal_i(4, git_index_entrycount(index));
+	assert_status_clean();
+
+	/* the entries of a changed directory are still not checked out */
+	cl_git_pass(git_revparse_single(&obj, g_repo, "subtrees^{tree}"));
+	cl_git_pass(git_revparse_single(&ab, g_repo, "subtrees:ab"));
+	cl_git_pass(git_treebuilder_new(&bld, g_repo, (git_tree *)ab));
+	cl_git_pass(git_treebuilder_insert(NULL, bld, "5.txt",
+		git_tree_entry_id(git_tree_entry_byname((git_tree *)obj, "README")),
+		GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&id, bld));
+	git_treebuilder_free(bld);
+
+	cl_git_pass(git_treebuilder_new(&bld, g_repo, (git_tree *)obj));
+	cl_git_pass(git_treebuilder_insert(NULL, bld, "ab", &id, GIT_FILEMODE_TREE));
+	cl_git_pass(git_treebuilder_write(&id, bld));
+	git_treebuilder_free(bld);
+	git_object_free(ab);
+	git_object_free(obj);
+
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+	cl_git_pass(git_index_read_tree(index, tree));
+	git_tree_free(tree);
+
+	cl_assert_equal_i(8, git_index_entrycount(index));
+	cl_assert(skips_worktree(index, "ab/4.txt"));
+	cl_assert(skips_worktree(index, "ab/5.txt"));
+
+	git_index_free(index);
+}
+
+void test_checkout_sparse__sparse_index_keeps_changed_directories_expanded(void)
+{
+	git_index *index;
+	git_index_entry entry;
+	const git_index_entry *old;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	set_cone("/*\n!/*/\n");
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+
+	cl_assert((old = git_index_get_bypath(index, "ab/4.txt", 0)) != NULL);
+	memcpy(&entry, old, sizeof(entry));
+	cl_git_pass(git_oid_fromstr(&entry.id,
+		"a8233120f6ad708f843d861ce2b7228ec4e3dec6"));
+	cl_git_pass(git_index_add(index, &entry));
+
+	/* there's no tree for the directory, and none is written for it */
+	cl_git_pass(git_index_write(index));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert_equal_i(7, git_index_entrycount(index));
+	cl_assert(skips_worktree(index, "ab/4.txt"));
+
+	git_index_free(index);
+}
+
+void test_checkout_sparse__sparse_index_reports_expansion_errors(void)
+{
+	git_index *index;
+	git_index_entry *dir;
+	size_t pos;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	set_cone("/*\n!/*/\n");
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+
+	cl_assert((dir = (git_index_entry *)git_index_get_byindex(index, 1)) != NULL);
+	cl_assert(git_index_entry__is_sparse_dir(dir));
+	cl_git_pass(git_oid_fromstr(&dir->id,
+		"1111111111111111111111111111111111111111"));
+
+	cl_git_pass(git_index_find(&pos, index, "README"));
+	cl_assert(git_index_find(&pos, index, "ab/4.txt") < 0);
+	cl_assert(giterr_last() != NULL);
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	/* don't write the broken entry back */
+	cl_git_pass(git_index_read(index, true));
+	git_index_free(index);
+}
+
+void test_checkout_sparse__sparse_index_writes_the_same_trees(void)
+{
+	git_index *index;
+	git_oid tree_id;
+	git_object *obj;
+
+	cl_repo_set_bool(g_repo, "index.sparse", true);
+	set_cone("/*\n!/*/\n");
+	checkout_subtrees(GIT_CHECKOUT_FORCE);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	cl_git_pass(git_revparse_single(&obj, g_repo, "subtrees^{tree}"));
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_assert_equal_oid(git_object_id(obj), &tree_id);
+
+	/* writing the tree doesn't need the full index either */
+	cl_assert_equal_i(4, git_index_entrycount(index));
+
+	git_object_free(obj);
+	git_index_free(index);
+}
@@ -1247,6 +1247,55 @@ void test_checkout_tree__can_collect_perfdata(void)
 	git_object_free(obj);
 }
 
+void test_checkout_tree__makes_each_directory_once(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_checkout_perfdata perfdata = {0};
+	git_buf path = GIT_BUF_INIT;
+	git_index *index;
+	git_oid tree_id;
+	git_object *tree;
+	const char *dirs[] = { "deep/a", "deep/a/x", "deep/b" };
+	size_t i, j;
+
+	for (i = 0; i < ARRAY_SIZE(dirs); i++) {
+		for (j = 0; j < 10; j++) {
+			git_buf_clear(&path);
+			cl_git_pass(git_buf_printf(&path,
+				"testrepo/%s/f%d.txt", dirs[i], (int)j));
+			cl_git_pass(git_futils_mkpath2file(path.ptr, 0777));
+			cl_git_mkfile(path.ptr, path.ptr);
+		}
+	}
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_git_pass(git_object_lookup(&tree, g_repo, &tree_id, GIT_OBJ_TREE));
+	git_index_free(index);
+
+	cl_git_pass(git_futils_rmdir_r(
+		"testrepo/deep", NULL, GIT_RMDIR_REMOVE_FILES));
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	opts.perfdata_cb = perfdata_cb;
+	opts.perfdata_payload = &perfdata;
+
+	cl_git_pass(git_checkout_tree(g_repo, tree, &opts));
+
+	/* "deep" has to be looked for, but nothing below it once it is made */
+	cl_assert_equal_sz(4, perfdata.mkdir_calls);
+	cl_assert_equal_sz(30, perfdata.open_calls);
+	cl_assert_equal_sz(31, perfdata.stat_calls);
+
+	cl_assert(git_path_isfile("testrepo/deep/a/x/f9.txt"));
+	cl_assert(git_path_isfile("testrepo/deep/b/f0.txt"));
+
+	git_object_free(tree);
+	git_buf_free(&path);
+}
+
 void update_attr_callback(
 	const char *path,
 	size_t completed_steps,
@@ -0,0 +1,205 @@
+#include "clar_libgit2.h"
+
+#include "git2/clone.h"
+#include "fileops.h"
+
+static git_repository *g_source;
+static git_repository *g_repo;
+
+#define FILE_COUNT 400
+#define DIR_COUNT 8
+
+static const char *file_content(git_buf *out, size_t i, const char *branch)
+{
+	size_t line;
+
+	/* similar enough for the pack to hold most of them as deltas */
+	git_buf_clear(out);
+	cl_git_pass(git_buf_printf(out, "file %d on %s\n", (int)i, branch));
+	for (line = 0; line < 20; line++)
+		cl_git_pass(git_buf_printf(out, "line %d of the shared text\n",
+			(int)line));
+
+	return out->ptr;
+}
+
+static void write_files(const char *branch)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "source/d%d/f%03d.txt",
+			(int)(i % DIR_COUNT), (int)i));
+		cl_git_pass(git_futils_mkpath2file(path.ptr, 0777));
+		cl_git_mkfile(path.ptr, file_content(&content, i, branch));
+	}
+
+	git_buf_free(&path);
+	git_buf_free(&content);
+}
+
+void test_clone_pipeline__initialize(void)
+{
+	git_index *index;
+	git_oid commit_id;
+	git_commit *commit;
+	git_reference *ref;
+
+	cl_git_pass(git_repository_init(&g_source, "source", false));
+
+	write_files("master");
+
+	/* attributes apply below "attr", so checkout writes those files */
+	cl_git_pass(p_mkdir("source/attr", 0777));
+	cl_git_mkfile("source/attr/.gitattributes", "*.txt text eol=crlf\n");
+	cl_git_mkfile("source/attr/crlf.txt", "one\ntwo\n");
+	cl_git_mkfile("source/script.sh", "#!/bin/sh\n");
+	cl_must_pass(p_chmod("source/script.sh", 0755));
+
+	cl_git_pass(git_repository_index(&index, g_source));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_repo_commit_from_index(&commit_id, g_source, NULL, 0, "master");
+
+	/* and a branch where every file is different */
+	cl_git_pass(git_commit_lookup(&commit, g_source, &commit_id));
+	cl_git_pass(git_branch_create(&ref, g_source, "feature", commit, false));
+	cl_git_pass(git_repository_set_head(g_source, "refs/heads/feature"));
+	git_reference_free(ref);
+	git_commit_free(commit);
+
+	write_files("feature");
+
+	cl_git_pass(git_repository_index(&index, g_source));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_repo_commit_from_index(NULL, g_source, NULL, 0, "feature");
+	cl_git_pass(git_repository_set_head(g_source, "refs/heads/master"));
+
+	g_repo = NULL;
+}
+
+void test_clone_pipeline__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+	git_repository_free(g_source);
+	g_source = NULL;
+
+	cl_fixture_cleanup("source");
+	cl_fixture_cleanup("cloned");
+}
+
+typedef struct {
+	size_t total;
+	size_t calls;
+} progress_data;
+
+static void checkout_progress(
+	const char *path, size_t cur, size_t tot, void *payload)
+{
+	progress_data *progress = payload;
+
+	GIT_UNUSED(cur);
+
+	if (path)
+		progress->calls++;
+	progress->total = tot;
+}
+
+static void clone_pipelined(progress_data *progress, const char *branch)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+
+	opts.local = GIT_CLONE_NO_LOCAL;
+	opts.pipeline_checkout = 1;
+	opts.checkout_branch = branch;
+	opts.checkout_opts.progress_cb = checkout_progress;
+	opts.checkout_opts.progress_payload = progress;
+
+	cl_git_pass(git_clone(&g_repo,
+		cl_git_path_url(git_repository_path(g_source)), "cloned", &opts));
+}
+
+static void assert_clean_checkout(const char *branch)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_status_list *status;
+	git_index *index;
+	size_t i;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert_equal_sz(FILE_COUNT + 3, git_index_entrycount(index));
+	git_index_free(index);
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_i(0, git_status_list_entrycount(status));
+	git_status_list_free(status);
+
+	for (i = 0; i < FILE_COUNT; i += 37) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "cloned/d%d/f%03d.txt",
+			(int)(i % DIR_COUNT), (int)i));
+		cl_assert_equal_file(
+			file_content(&content, i, branch), 0, path.ptr);
+	}
+
+	cl_assert(git_path_isfile("cloned/attr/crlf.txt"));
+
+	if (cl_is_chmod_supported()) {
+		struct stat st;
+		cl_must_pass(p_stat("cloned/script.sh", &st));
+		cl_assert((st.st_mode & 0100) != 0);
+	}
+
+	git_buf_free(&path);
+	git_buf_free(&content);
+}
+
+void test_clone_pipeline__writes_files_while_fetching(void)
+{
+	progress_data progress = { 0 };
+
+	clone_pipelined(&progress, NULL);
+
+	/* checkout was only left with the files below the attributes */
+	cl_assert_equal_sz(2, progress.total);
+	cl_assert_equal_sz(2, progress.calls);
+
+	assert_clean_checkout("master");
+}
+
+void test_clone_pipeline__follows_the_branch_being_cloned(void)
+{
+	progress_data progress = { 0 };
+
+	clone_pipelined(&progress, "feature");
+
+	cl_assert_equal_sz(2, progress.total);
+
+	assert_clean_checkout("feature");
+}
+
+void test_clone_pipeline__leaves_files_to_checkout_when_it_must(void)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+	progress_data progress = { 0 };
+
+	/* checkout has to tell about every file it writes */
+	opts.local = GIT_CLONE_NO_LOCAL;
+	opts.pipeline_checkout = 1;
+	opts.checkout_opts.checkout_strategy |= GIT_CHECKOUT_DONT_WRITE_INDEX;
+	opts.checkout_opts.progress_cb = checkout_progress;
+	opts.checkout_opts.progress_payload = &progress;
+
+	cl_git_pass(git_clone(&g_repo,
+		cl_git_path_url(git_repository_path(g_source)), "cloned", &opts));
+
+	cl_assert_equal_sz(FILE_COUNT + 3, progress.total);
+}
@@ -842,6 +842,117 @@ void test_core_buffer__classify_with_utf8(void)
 	cl_assert(!git_buf_text_contains_nul(&b));
 }
 
+/* byte at a time versions of the classifiers, to check the fast ones */
+static bool expected_stats(git_buf_text_stats *stats, const char *scan, const char *end)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (scan < end && end[-1] == '\032')
+		end--;
+
+	for (; scan < end; scan++) {
+		unsigned char c = *scan;
+
+		if (c > 0x1F && c != 0x7F)
+			stats->printable++;
+		else if (c == '\0') {
+			stats->nul++;
+			stats->nonprintable++;
+		} else if (c == '\n')
+			stats->lf++;
+		else if (c == '\r') {
+			stats->cr++;
+			if (scan + 1 < end && scan[1] == '\n')
+				stats->crlf++;
+		} else if (strchr("\t\f\v\b\033", c))
+			stats->printable++;
+		else
+			stats->nonprintable++;
+	}
+
+	return (stats->nul > 0 ||
+		((stats->printable >> 7) < stats->nonprintable));
+}
+
+static bool expected_is_binary(const char *scan, const char *end)
+{
+	int printable = 0, nonprintable = 0;
+
+	for (; scan < end; scan++) {
+		unsigned char c = *scan;
+
+		if ((c > 0x1F && c != 127) || c == '\b' || c == '\033' || c == '\014')
+			printable++;
+		else if (c == '\0')
+			return true;
+		else if (!git__isspace(c))
+			nonprintable++;
+	}
+
+	return ((printable >> 7) < nonprintable);
+}
+
+static void fill_mostly_text(char *buf, size_t len, unsigned int seed, int nul)
+{
+	static const char special[] = "\r\n\t\v\f\b\033\001\037\177\032\200\377";
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+
+		if ((seed >> 16) % 8 == 0)
+			buf[i] = special[(seed >> 8) % (sizeof(special) - 1)];
+		else if ((seed >> 16) % 8 == 1)
+			buf[i] = '\n';
+		else
+			buf[i] = 'a' + (seed >> 8) % 26;
+	}
+
+	if (nul && len)
+		buf[seed % len] = '\0';
+}
+
+void test_core_buffer__classify_long_buffers(void)
+{
+	static const size_t lengths[] = {
+		0, 1, 2, 15, 16, 17, 31, 32, 33, 63, 64, 65, 200, 4095, 8161, 70001
+	};
+	char *data = git__malloc(70001 + 3);
+	git_buf_text_stats actual, expected;
+	git_buf b;
+	size_t i, offset;
+	int nul;
+
+	cl_assert(data);
+
+	for (i = 0; i < ARRAY_SIZE(lengths); i++) {
+		for (offset = 0; offset < 3; offset++) {
+			for (nul = 0; nul < 2; nul++) {
+				fill_mostly_text(data, lengths[i] + offset, (unsigned int)i, nul);
+
+				b.ptr = data + offset;
+				b.size = b.asize = lengths[i];
+
+				cl_assert_equal_b(
+					expected_stats(&expected, b.ptr, b.ptr + b.size),
+					git_buf_text_gather_stats(&actual, &b, false));
+				cl_assert_equal_i(expected.nul, actual.nul);
+				cl_assert_equal_i(expected.cr, actual.cr);
+				cl_assert_equal_i(expected.lf, actual.lf);
+				cl_assert_equal_i(expected.crlf, actual.crlf);
+				cl_assert_equal_i(expected.printable, actual.printable);
+				cl_assert_equal_i(expected.nonprintable, actual.nonprintable);
+
+				cl_assert_equal_b(
+					expected_is_binary(b.ptr, b.ptr + b.size),
+					git_buf_text_is_binary(&b));
+			}
+		}
+	}
+
+	git__free(data);
+}
+
 #define SIMILARITY_TEST_DATA_1 \
 	"000\n001\n002\n003\n004\n005\n006\n007\n008\n009\n" \
 	"010\n011\n012\n013\n014\n015\n016\n017\n018\n019\n" \
@@ -84,3 +84,25 @@ void test_core_pool__strndup_limit(void)
 	git_pool_clear(&p);
 }
 
+
+void test_core_pool__reserve(void)
+{
+	int i;
+	git_pool p;
+
+	git_pool_init(&p, 1);
+	cl_git_pass(git_pool_reserve(&p, 100 * 1024));
+	cl_assert_equal_i(1, git_pool__open_pages(&p));
+
+	for (i = 0; i < 1024; i++)
+		cl_assert(git_pool_malloc(&p, 96) != NULL);
+
+	/* everything fit into the reserved page */
+	cl_assert_equal_i(1, git_pool__open_pages(&p));
+
+	/* there is still room, so reserving again does not add a page */
+	cl_git_pass(git_pool_reserve(&p, 1024));
+	cl_assert_equal_i(1, git_pool__open_pages(&p));
+
+	git_pool_clear(&p);
+}
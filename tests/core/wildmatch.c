@@ -0,0 +1,165 @@
+#include "clar_libgit2.h"
+#include "wildmatch.h"
+
+static git_pool g_pool;
+
+void test_core_wildmatch__initialize(void)
+{
+	git_pool_init(&g_pool, 1);
+}
+
+void test_core_wildmatch__cleanup(void)
+{
+	git_pool_clear(&g_pool);
+}
+
+static bool wildmatch(const char *pattern, const char *str, int flags)
+{
+	git_wildmatch *wm;
+
+	cl_git_pass(git_wildmatch_compile(&wm, &g_pool, pattern, flags));
+	return (git_wildmatch_match(wm, str, flags) == 0);
+}
+
+static void assert_same_as_fnmatch(
+	const char *pattern, const char *str, int flags)
+{
+	bool expected = (p_fnmatch(pattern, str, flags) == 0);
+
+	if (wildmatch(pattern, str, flags) != expected) {
+		char msg[256];
+		p_snprintf(msg, sizeof(msg),
+			"'%s' against '%s' with flags %d: expected %s",
+			pattern, str, flags, expected ? "match" : "no match");
+		clar__fail(__FILE__, __LINE__, "wildmatch disagrees with p_fnmatch",
+			msg, 1);
+	}
+}
+
+void test_core_wildmatch__matches_like_fnmatch(void)
+{
+	cl_assert(wildmatch("foo", "foo", 0));
+	cl_assert(!wildmatch("foo", "foo/bar", 0));
+	cl_assert(wildmatch("foo", "foo/bar", FNM_LEADING_DIR));
+	cl_assert(wildmatch("*.c", "src/foo.c", 0));
+	cl_assert(!wildmatch("*.c", "src/foo.c", FNM_PATHNAME));
+	cl_assert(wildmatch("src/*.c", "src/foo.c", FNM_PATHNAME));
+	cl_assert(!wildmatch("src/*.c", "src/a/foo.c", FNM_PATHNAME));
+	cl_assert(wildmatch("src/**/*.c", "src/a/b/foo.c", FNM_PATHNAME));
+	cl_assert(wildmatch("src/**/*.c", "src/foo.c", FNM_PATHNAME));
+	cl_assert(wildmatch("**/foo", "a/b/foo", FNM_PATHNAME));
+	cl_assert(wildmatch("a/**", "a/b/c", FNM_PATHNAME));
+	cl_assert(wildmatch("FOO.[ch]", "foo.H", FNM_CASEFOLD));
+	cl_assert(!wildmatch("FOO.[ch]", "foo.H", 0));
+	cl_assert(wildmatch("[!a-c]x", "dx", 0));
+	cl_assert(!wildmatch("[!a-c]x", "bx", 0));
+	cl_assert(wildmatch("a[/]b", "a/b", 0));
+	cl_assert(!wildmatch("a[/]b", "a/b", FNM_PATHNAME));
+	cl_assert(wildmatch("a[b", "a[b", 0));
+	cl_assert(wildmatch("\\*", "*", 0));
+	cl_assert(!wildmatch("\\*", "x", 0));
+	cl_assert(wildmatch("\\*", "\\x", FNM_NOESCAPE));
+	cl_assert(wildmatch("?", "/", 0));
+	cl_assert(!wildmatch("?", "/", FNM_PATHNAME));
+}
+
+/* small, deterministic generator so failures can be reproduced */
+static unsigned int g_seed;
+
+static unsigned int next_random(void)
+{
+	g_seed = g_seed * 1103515245 + 12345;
+	return (g_seed >> 16) & 0x7fff;
+}
+
+static void random_string(char *out, size_t max, const char *alphabet)
+{
+	size_t i, len = next_random() % max, n = strlen(alphabet);
+
+	for (i = 0; i < len; i++)
+		out[i] = alphabet[next_random() % n];
+	out[len] = '\0';
+}
+
+/* a pattern that is `str` with some of its characters made wild */
+static void pattern_from(char *out, const char *str)
+{
+	static const char *wild[] = { "?", "*", "**", "[a-c]", "[!/]", "**/" };
+
+	for (; *str; str++) {
+		if (next_random() % 3) {
+			*out++ = *str;
+		} else {
+			const char *w = wild[next_random() % ARRAY_SIZE(wild)];
+			while (*w)
+				*out++ = *w++;
+		}
+	}
+	*out = '\0';
+}
+
+void test_core_wildmatch__random_patterns_match_like_fnmatch(void)
+{
+	static const int flags[] = {
+		0, FNM_PATHNAME, FNM_LEADING_DIR, FNM_CASEFOLD, FNM_NOESCAPE,
+		FNM_PATHNAME | FNM_LEADING_DIR,
+		FNM_PATHNAME | FNM_CASEFOLD,
+		FNM_PATHNAME | FNM_LEADING_DIR | FNM_CASEFOLD,
+	};
+	char pattern[96], str[16];
+	size_t i, f;
+
+	g_seed = 42;
+
+	for (i = 0; i < 20000; i++) {
+		random_string(pattern, 16, "ab/A*?*[]!-\\");
+		random_string(str, sizeof(str), "abB/-[]!\\*");
+
+		for (f = 0; f < ARRAY_SIZE(flags); f++)
+			assert_same_as_fnmatch(pattern, str, flags[f]);
+	}
+
+	/* paths made of a few names, against patterns built from them */
+	for (i = 0; i < 20000; i++) {
+		random_string(pattern, 16, "ab/*.c/**?[a-c]");
+		random_string(str, sizeof(str), "ab/.c/ab");
+
+		for (f = 0; f < ARRAY_SIZE(flags); f++)
+			assert_same_as_fnmatch(pattern, str, flags[f]);
+	}
+
+	/* and patterns which mostly match */
+	for (i = 0; i < 20000; i++) {
+		random_string(str, sizeof(str), "abC/.c/ab");
+		pattern_from(pattern, str);
+
+		for (f = 0; f < ARRAY_SIZE(flags); f++)
+			assert_same_as_fnmatch(pattern, str, flags[f]);
+	}
+}
+
+void test_core_wildmatch__long_patterns(void)
+{
+	git_buf pattern = GIT_BUF_INIT, str = GIT_BUF_INIT;
+	size_t i;
+
+	/* more states than fit in the stack */
+	for (i = 0; i < 300; i++)
+		cl_git_pass(git_buf_puts(&pattern, "a*"));
+	cl_git_pass(git_buf_puts(&pattern, "b"));
+
+	for (i = 0; i < 600; i++)
+		cl_git_pass(git_buf_puts(&str, "a"));
+
+	cl_assert(!wildmatch(pattern.ptr, str.ptr, FNM_PATHNAME));
+
+	cl_git_pass(git_buf_puts(&str, "b"));
+	cl_assert(wildmatch(pattern.ptr, str.ptr, FNM_PATHNAME));
+
+	/* and one that makes p_fnmatch backtrack a lot */
+	cl_assert(!wildmatch("**a**a**a**a**a**a**a**a**a**a**b",
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 0));
+
+	git_buf_free(&pattern);
+	git_buf_free(&str);
+}
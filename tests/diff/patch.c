@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "git2/sys/repository.h"
+#include "git2/sys/diff.h"
 
 #include "diff_helpers.h"
 #include "diff.h"
@@ -610,3 +611,310 @@ void test_diff_patch__line_counts_with_eofnl(void)
 
 	git_buf_free(&content);
 }
+
+static void build_many_changes(git_tree **old_tree, git_tree **new_tree)
+{
+	git_treebuilder *old_builder, *new_builder;
+	git_buf content = GIT_BUF_INIT;
+	git_oid id;
+	char name[32];
+	size_t i, j;
+
+	cl_git_pass(git_treebuilder_new(&old_builder, g_repo, NULL));
+	cl_git_pass(git_treebuilder_new(&new_builder, g_repo, NULL));
+
+	/* more files than fit in a single window of parallel patches */
+	for (i = 0; i < 300; i++) {
+		p_snprintf(name, sizeof(name), "file%03" PRIuZ ".txt", i);
+
+		if (i % 11 != 0) {
+			git_buf_clear(&content);
+			for (j = 0; j < 10 + i % 17; j++)
+				git_buf_printf(&content, "line %" PRIuZ "\n", j);
+
+			cl_git_pass(git_blob_create_frombuffer(
+				&id, g_repo, content.ptr, content.size));
+			cl_git_pass(git_treebuilder_insert(
+				NULL, old_builder, name, &id, GIT_FILEMODE_BLOB));
+		}
+
+		if (i % 7 != 0) {
+			git_buf_clear(&content);
+			for (j = 0; j < 10 + i % 13; j++)
+				git_buf_printf(&content, "%s %" PRIuZ "\n",
+					(j % (1 + i % 5)) ? "line" : "changed", j);
+
+			/* and a few binary files */
+			if (i % 23 == 0)
+				git_buf_putc(&content, '\0');
+
+			cl_git_pass(git_blob_create_frombuffer(
+				&id, g_repo, content.ptr, content.size));
+			cl_git_pass(git_treebuilder_insert(
+				NULL, new_builder, name, &id, GIT_FILEMODE_BLOB));
+		}
+	}
+
+	cl_git_pass(git_treebuilder_write(&id, old_builder));
+	cl_git_pass(git_tree_lookup(old_tree, g_repo, &id));
+	cl_git_pass(git_treebuilder_write(&id, new_builder));
+	cl_git_pass(git_tree_lookup(new_tree, g_repo, &id));
+
+	git_buf_free(&content);
+	git_treebuilder_free(old_builder);
+	git_treebuilder_free(new_builder);
+}
+
+typedef struct {
+	git_buf buf;
+	size_t lines_left;
+} print_until;
+
+static int print_until_cb(
+	const git_diff_delta *delta,
+	const git_diff_hunk *hunk,
+	const git_diff_line *line,
+	void *payload)
+{
+	print_until *until = payload;
+
+	if (!until->lines_left--)
+		return -4321;
+
+	return git_diff_print_callback__to_buf(delta, hunk, line, &until->buf);
+}
+
+void test_diff_patch__parallel_patches_print_in_order(void)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_tree *old_tree, *new_tree;
+	git_diff *diff;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	build_many_changes(&old_tree, &new_tree);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, &opts));
+	/* the four multiples of 77 are missing on both sides */
+	cl_assert_equal_sz(296, git_diff_num_deltas(diff));
+	cl_git_pass(git_diff_print(diff, GIT_DIFF_FORMAT_PATCH,
+		git_diff_print_callback__to_buf, &expected));
+	git_diff_free(diff);
+
+	opts.flags |= GIT_DIFF_PARALLEL_PATCHES;
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, &opts));
+	cl_git_pass(git_diff_print(diff, GIT_DIFF_FORMAT_PATCH,
+		git_diff_print_callback__to_buf, &actual));
+
+	cl_assert(expected.size > 0);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_patch__can_cancel_parallel_patches(void)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_tree *old_tree, *new_tree;
+	git_diff *diff;
+	print_until expected = { GIT_BUF_INIT, 2500 };
+	print_until actual = { GIT_BUF_INIT, 2500 };
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	build_many_changes(&old_tree, &new_tree);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, &opts));
+	cl_git_fail_with(git_diff_print(
+		diff, GIT_DIFF_FORMAT_PATCH, print_until_cb, &expected), -4321);
+	git_diff_free(diff);
+
+	opts.flags |= GIT_DIFF_PARALLEL_PATCHES;
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, &opts));
+	cl_git_fail_with(git_diff_print(
+		diff, GIT_DIFF_FORMAT_PATCH, print_until_cb, &actual), -4321);
+
+	cl_assert_equal_s(expected.buf.ptr, actual.buf.ptr);
+
+	git_buf_free(&expected.buf);
+	git_buf_free(&actual.buf);
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+typedef struct {
+	git_buf buf;
+	git_diff *diff;
+	size_t files;
+} callback_log;
+
+static int log_file_cb(
+	const git_diff_delta *delta, float progress, void *payload)
+{
+	callback_log *log = payload;
+	const git_diff_delta *next;
+
+	GIT_UNUSED(progress);
+
+	git_buf_printf(&log->buf, "file %s %d %x %x %x\n", delta->new_file.path,
+		delta->status, delta->flags, delta->old_file.flags,
+		delta->new_file.flags);
+
+	/* the deltas that haven't been handed out yet are untouched */
+	if ((next = git_diff_get_delta(log->diff, ++log->files)) != NULL)
+		git_buf_printf(&log->buf, "next %s %d %x %x %x\n",
+			next->new_file.path, next->status, next->flags,
+			next->old_file.flags, next->new_file.flags);
+
+	return 0;
+}
+
+static int log_binary_cb(
+	const git_diff_delta *delta, const git_diff_binary *binary, void *payload)
+{
+	callback_log *log = payload;
+
+	git_buf_printf(&log->buf, "binary %s %x %" PRIuZ " %" PRIuZ "\n",
+		delta->new_file.path, delta->flags,
+		binary->old_file.datalen, binary->new_file.datalen);
+	return 0;
+}
+
+static int log_hunk_cb(
+	const git_diff_delta *delta, const git_diff_hunk *hunk, void *payload)
+{
+	callback_log *log = payload;
+
+	git_buf_printf(&log->buf, "hunk %s %x %.*s", delta->new_file.path,
+		delta->flags, (int)hunk->header_len, hunk->header);
+	return 0;
+}
+
+static int log_line_cb(
+	const git_diff_delta *delta,
+	const git_diff_hunk *hunk,
+	const git_diff_line *line,
+	void *payload)
+{
+	callback_log *log = payload;
+
+	GIT_UNUSED(hunk);
+
+	git_buf_printf(&log->buf, "line %s %c %.*s", delta->new_file.path,
+		line->origin, (int)line->content_len, line->content);
+	return 0;
+}
+
+static void log_callbacks(
+	git_buf *out, git_tree *old_tree, git_tree *new_tree, uint32_t flags)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	callback_log log = { GIT_BUF_INIT, NULL, 0 };
+
+	opts.flags = flags;
+
+	cl_git_pass(git_diff_tree_to_tree(
+		&log.diff, g_repo, old_tree, new_tree, &opts));
+	cl_git_pass(git_diff_foreach(log.diff,
+		log_file_cb, log_binary_cb, log_hunk_cb, log_line_cb, &log));
+
+	git_buf_swap(out, &log.buf);
+	git_buf_free(&log.buf);
+	git_diff_free(log.diff);
+}
+
+void test_diff_patch__parallel_patches_call_back_like_serial_ones(void)
+{
+	git_tree *old_tree, *new_tree;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	build_many_changes(&old_tree, &new_tree);
+
+	log_callbacks(&expected, old_tree, new_tree, 0);
+	log_callbacks(&actual, old_tree, new_tree, GIT_DIFF_PARALLEL_PATCHES);
+
+	cl_assert(strstr(expected.ptr, "binary ") != NULL);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+static void print_trees(
+	git_buf *out, const git_oid *old_id, const git_oid *new_id, uint32_t flags)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_tree *old_tree, *new_tree;
+	git_diff *diff;
+
+	opts.flags = flags;
+
+	cl_git_pass(git_tree_lookup(&old_tree, g_repo, old_id));
+	cl_git_pass(git_tree_lookup(&new_tree, g_repo, new_id));
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, &opts));
+	cl_git_pass(git_diff_print(diff, GIT_DIFF_FORMAT_PATCH,
+		git_diff_print_callback__to_buf, out));
+
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_patch__line_cache_gives_the_same_patches(void)
+{
+	static const uint32_t flags[] = {
+		0,
+		GIT_DIFF_IGNORE_WHITESPACE_CHANGE,
+		GIT_DIFF_PATIENCE,
+		GIT_DIFF_PARALLEL_PATCHES,
+	};
+	static const int32_t cache_sizes[] = { 2048, 1024 * 1024 };
+	git_tree *old_tree, *new_tree;
+	git_oid old_id, new_id;
+	git_buf expected[ARRAY_SIZE(flags)], actual = GIT_BUF_INIT;
+	git_config *cfg;
+	size_t i, j;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	build_many_changes(&old_tree, &new_tree);
+	git_oid_cpy(&old_id, git_tree_id(old_tree));
+	git_oid_cpy(&new_id, git_tree_id(new_tree));
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+
+	for (i = 0; i < ARRAY_SIZE(flags); i++) {
+		git_buf_init(&expected[i], 0);
+		print_trees(&expected[i], &old_id, &new_id, flags[i]);
+		cl_assert(expected[i].size > 0);
+	}
+
+	/* a small cache evicts as it goes, a big one keeps everything */
+	for (j = 0; j < ARRAY_SIZE(cache_sizes); j++) {
+		cl_git_pass(git_repository_config(&cfg, g_repo));
+		cl_git_pass(git_config_set_int32(
+			cfg, "diff.lineCacheSize", cache_sizes[j]));
+		git_config_free(cfg);
+
+		g_repo = cl_git_sandbox_reopen();
+
+		/* twice, so that the second pass is served from the cache */
+		for (i = 0; i < 2 * ARRAY_SIZE(flags); i++) {
+			git_buf_clear(&actual);
+			print_trees(&actual, &old_id, &new_id, flags[i % ARRAY_SIZE(flags)]);
+			cl_assert_equal_s(expected[i % ARRAY_SIZE(flags)].ptr, actual.ptr);
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(flags); i++)
+		git_buf_free(&expected[i]);
+	git_buf_free(&actual);
+}
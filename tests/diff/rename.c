@@ -1702,3 +1702,181 @@ void test_diff_rename__blank_files_not_renamed_when_not_ignoring_whitespace(void
 	expect_files_not_renamed("", "\n\n\n\n",  GIT_DIFF_FIND_DONT_IGNORE_WHITESPACE);
 	expect_files_not_renamed("\n\n\n\n", "\r\n\r\n\r\n",  GIT_DIFF_FIND_DONT_IGNORE_WHITESPACE);
 }
+
+static void write_numbered_blob(
+	git_oid *out, size_t file, size_t lines, size_t changed_line)
+{
+	git_buf content = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < lines; i++) {
+		if (i == changed_line)
+			git_buf_printf(&content, "changed line %" PRIuZ "\n", i);
+		else
+			git_buf_printf(&content,
+				"file %" PRIuZ " line %" PRIuZ "\n", file, i);
+	}
+
+	cl_assert(!git_buf_oom(&content));
+	cl_git_pass(git_blob_create_frombuffer(
+		out, g_repo, content.ptr, content.size));
+	git_buf_free(&content);
+}
+
+static void build_many_renames(git_tree **old_tree, git_tree **new_tree)
+{
+	git_treebuilder *old_builder, *new_builder;
+	git_oid id;
+	char name[32];
+	size_t i;
+
+	cl_git_pass(git_treebuilder_new(&old_builder, g_repo, NULL));
+	cl_git_pass(git_treebuilder_new(&new_builder, g_repo, NULL));
+
+	/* enough deleted and added files that they won't all be compared
+	 * with each other; every other one is modified a little, and the
+	 * last few are blank
+	 */
+	for (i = 0; i < 200; i++) {
+		p_snprintf(name, sizeof(name), "a%03" PRIuZ ".txt", i);
+		if (i < 195)
+			write_numbered_blob(&id, i, 20, (size_t)-1);
+		else
+			cl_git_pass(git_blob_create_frombuffer(&id, g_repo, "\n", 1));
+		cl_git_pass(git_treebuilder_insert(
+			NULL, old_builder, name, &id, GIT_FILEMODE_BLOB));
+
+		p_snprintf(name, sizeof(name), "b%03" PRIuZ ".txt", i);
+		if (i < 195)
+			write_numbered_blob(&id, i, 20, (i % 2) ? i % 20 : (size_t)-1);
+		else
+			cl_git_pass(git_blob_create_frombuffer(&id, g_repo, "\n\n", 2));
+		cl_git_pass(git_treebuilder_insert(
+			NULL, new_builder, name, &id, GIT_FILEMODE_BLOB));
+	}
+
+	cl_git_pass(git_treebuilder_write(&id, old_builder));
+	cl_git_pass(git_tree_lookup(old_tree, g_repo, &id));
+	cl_git_pass(git_treebuilder_write(&id, new_builder));
+	cl_git_pass(git_tree_lookup(new_tree, g_repo, &id));
+
+	git_treebuilder_free(old_builder);
+	git_treebuilder_free(new_builder);
+}
+
+static void expect_many_renames(uint32_t flags, size_t expected)
+{
+	git_tree *old_tree, *new_tree;
+	git_diff *diff;
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	const git_diff_delta *delta;
+	size_t i, renamed = 0;
+
+	build_many_renames(&old_tree, &new_tree);
+
+	cl_git_pass(git_diff_tree_to_tree(
+		&diff, g_repo, old_tree, new_tree, NULL));
+	cl_assert_equal_sz(400, git_diff_num_deltas(diff));
+
+	opts.flags = flags;
+	opts.rename_limit = 50;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	for (i = 0; i < git_diff_num_deltas(diff); i++) {
+		delta = git_diff_get_delta(diff, i);
+
+		if (delta->status != GIT_DELTA_RENAMED)
+			continue;
+
+		/* each file was renamed from its own a*.txt */
+		cl_assert_equal_i('a', delta->old_file.path[0]);
+		cl_assert_equal_i('b', delta->new_file.path[0]);
+		cl_assert_equal_s(delta->old_file.path + 1, delta->new_file.path + 1);
+		renamed++;
+	}
+
+	cl_assert_equal_sz(expected, renamed);
+
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_rename__many_files_beyond_rename_limit(void)
+{
+	expect_many_renames(GIT_DIFF_FIND_RENAMES, 195);
+	expect_many_renames(
+		GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_IGNORE_WHITESPACE, 200);
+	expect_many_renames(
+		GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_EXACT_MATCH_ONLY, 98);
+}
+
+static void find_renames_to_buf(git_buf *out, git_repository *repo)
+{
+	const char *sha0 = "2bc7f351d20b53f1c72c16c4b036e491c478c49a";
+	const char *sha1 = "1c068dee5790ef1580cfc4cd670915b48d790084";
+	git_tree *old_tree, *new_tree;
+	git_diff *diff;
+	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	const git_diff_delta *delta;
+	size_t i;
+
+	old_tree = resolve_commit_oid_to_tree(repo, sha0);
+	new_tree = resolve_commit_oid_to_tree(repo, sha1);
+
+	diffopts.flags |= GIT_DIFF_INCLUDE_UNMODIFIED;
+	opts.flags = GIT_DIFF_FIND_ALL;
+
+	cl_git_pass(git_diff_tree_to_tree(
+		&diff, repo, old_tree, new_tree, &diffopts));
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	git_buf_clear(out);
+
+	for (i = 0; i < git_diff_num_deltas(diff); i++) {
+		delta = git_diff_get_delta(diff, i);
+		git_buf_printf(out, "%c %s %s %d\n",
+			git_diff_status_char(delta->status), delta->old_file.path,
+			delta->new_file.path, (int)delta->similarity);
+	}
+
+	cl_assert(!git_buf_oom(out));
+
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_rename__signature_cache(void)
+{
+	git_repository *repo;
+	git_config *cfg;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+
+	find_renames_to_buf(&expected, g_repo);
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_int32(cfg, "diff.signatureCacheSize", 1024 * 1024));
+	cl_git_pass(git_config_set_bool(cfg, "diff.signatureCacheFile", true));
+	git_config_free(cfg);
+
+	/* fill the cache, then use it */
+	cl_git_pass(git_repository_open(&repo, "renames"));
+	find_renames_to_buf(&actual, repo);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+	find_renames_to_buf(&actual, repo);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+	git_repository_free(repo);
+
+	cl_assert(git_path_isfile("renames/.git/hashsigs"));
+
+	/* and read it back from the file */
+	cl_git_pass(git_repository_open(&repo, "renames"));
+	find_renames_to_buf(&actual, repo);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+	git_repository_free(repo);
+
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+}
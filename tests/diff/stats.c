@@ -287,3 +287,82 @@ void test_diff_stats__mode_change(void)
 	cl_assert_equal_s(stat, git_buf_cstr(&buf));
 	git_buf_free(&buf);
 }
+
+static void write_numbered_lines(
+	git_oid *out, size_t count, size_t changed_every, const char *changed)
+{
+	git_buf content = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (changed_every && i % changed_every == 0)
+			git_buf_printf(&content, "%s %" PRIuZ "\n", changed, i);
+		else
+			git_buf_printf(&content, "line %" PRIuZ "\n", i);
+	}
+
+	cl_assert(!git_buf_oom(&content));
+	cl_git_pass(git_blob_create_frombuffer(
+		out, _repo, content.ptr, content.size));
+	git_buf_free(&content);
+}
+
+void test_diff_stats__many_files_match_patch_line_stats(void)
+{
+	git_treebuilder *old_builder, *new_builder;
+	git_tree *old_tree, *new_tree;
+	git_diff *diff;
+	git_patch *patch;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	git_oid old_id, new_id;
+	char name[32];
+	size_t i, adds, dels;
+
+	cl_git_pass(git_treebuilder_new(&old_builder, _repo, NULL));
+	cl_git_pass(git_treebuilder_new(&new_builder, _repo, NULL));
+
+	/* enough files with different changes to be split across threads */
+	for (i = 0; i < 300; i++) {
+		p_snprintf(name, sizeof(name), "file%03" PRIuZ ".txt", i);
+
+		write_numbered_lines(&old_id, 10 + i % 17, 0, NULL);
+		write_numbered_lines(&new_id, 10 + i % 13, 1 + i % 5, "changed");
+
+		cl_git_pass(git_treebuilder_insert(
+			NULL, old_builder, name, &old_id, GIT_FILEMODE_BLOB));
+		cl_git_pass(git_treebuilder_insert(
+			NULL, new_builder, name, &new_id, GIT_FILEMODE_BLOB));
+	}
+
+	cl_git_pass(git_treebuilder_write(&old_id, old_builder));
+	cl_git_pass(git_treebuilder_write(&new_id, new_builder));
+	cl_git_pass(git_tree_lookup(&old_tree, _repo, &old_id));
+	cl_git_pass(git_tree_lookup(&new_tree, _repo, &new_id));
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, _repo, old_tree, new_tree, NULL));
+	cl_assert_equal_sz(300, git_diff_num_deltas(diff));
+
+	for (i = 0; i < git_diff_num_deltas(diff); i++) {
+		cl_git_pass(git_patch_from_diff(&patch, diff, i));
+		cl_git_pass(git_patch_line_stats(NULL, &adds, &dels, patch));
+
+		git_buf_printf(&expected, "%-8" PRIuZ "%-8" PRIuZ "%s\n",
+			adds, dels, git_patch_get_delta(patch)->new_file.path);
+
+		git_patch_free(patch);
+	}
+
+	cl_git_pass(git_diff_get_stats(&_stats, diff));
+	cl_git_pass(git_diff_stats_to_buf(
+		&actual, _stats, GIT_DIFF_STATS_NUMBER, 0));
+
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+	git_treebuilder_free(old_builder);
+	git_treebuilder_free(new_builder);
+}
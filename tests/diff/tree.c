@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "diff_helpers.h"
+#include "index.h"
 
 static git_repository *g_repo = NULL;
 static git_diff_options opts;
@@ -524,3 +525,206 @@ void test_diff_tree__diff_configs(void)
 	cl_assert_equal_i(7, expect.line_adds);
 	cl_assert_equal_i(15, expect.line_dels);
 }
+
+static int count_paths_below_ab(
+	const git_diff *diff_so_far,
+	const char *old_path,
+	const char *new_path,
+	void *payload)
+{
+	int *count = payload;
+	const char *path = old_path ? old_path : new_path;
+
+	GIT_UNUSED(diff_so_far);
+
+	if (path && !git__prefixcmp(path, "ab/") && strcmp(path, "ab/") != 0)
+		(*count)++;
+
+	return 0;
+}
+
+static void make_tree_with_new_readme(git_tree **out, git_tree *base)
+{
+	git_treebuilder *builder;
+	const git_tree_entry *entry;
+	git_oid id;
+
+	cl_assert((entry = git_tree_entry_byname(base, "new.txt")) != NULL);
+
+	cl_git_pass(git_treebuilder_new(&builder, g_repo, base));
+	cl_git_pass(git_treebuilder_insert(
+		NULL, builder, "README", git_tree_entry_id(entry), GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&id, builder));
+	cl_git_pass(git_tree_lookup(out, g_repo, &id));
+
+	git_treebuilder_free(builder);
+}
+
+void test_diff_tree__skips_identical_subtrees(void)
+{
+	int visited = 0;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, "763d71aadf09")) != NULL);
+	make_tree_with_new_readme(&b, a);
+
+	opts.progress_cb = count_paths_below_ab;
+	opts.payload = &visited;
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, a, b, &opts));
+	cl_assert_equal_i(1, git_diff_num_deltas(diff));
+	cl_assert_equal_i(0, visited);
+
+	git_diff_free(diff);
+
+	/* unmodified records need every file to be looked at */
+	opts.flags |= GIT_DIFF_INCLUDE_UNMODIFIED;
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, a, b, &opts));
+	cl_assert_equal_i(7, git_diff_num_deltas(diff));
+	cl_assert_equal_i(4, visited);
+}
+
+void test_diff_tree__skips_subtrees_matching_the_tree_cache(void)
+{
+	git_index *index;
+	git_index_entry entry;
+	int visited = 0;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, "763d71aadf09")) != NULL);
+	make_tree_with_new_readme(&b, a);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read_tree(index, b));
+
+	opts.progress_cb = count_paths_below_ab;
+	opts.payload = &visited;
+
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, a, index, &opts));
+	cl_assert_equal_i(1, git_diff_num_deltas(diff));
+	cl_assert_equal_i(0, visited);
+
+	git_diff_free(diff);
+	diff = NULL;
+
+	/* touching a file below "ab/" invalidates the cached tree */
+	memcpy(&entry, git_index_get_bypath(index, "ab/de/2.txt", 0), sizeof(entry));
+	git_oid_cpy(&entry.id, git_tree_entry_id(git_tree_entry_byname(a, "README")));
+	cl_git_pass(git_index_add(index, &entry));
+
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, a, index, &opts));
+	cl_assert_equal_i(2, git_diff_num_deltas(diff));
+	cl_assert(visited > 0);
+
+	git_index_free(index);
+}
+
+void test_diff_tree__read_index_invalidates_the_tree_cache(void)
+{
+	git_index *index, *new_index;
+	git_index_entry entry;
+	int visited = 0;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, "763d71aadf09")) != NULL);
+	make_tree_with_new_readme(&b, a);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read_tree(index, b));
+
+	/* an entry added below "ab/" */
+	cl_git_pass(git_index_new(&new_index));
+	cl_git_pass(git_index_read_tree(new_index, b));
+
+	memcpy(&entry, git_index_get_bypath(new_index, "ab/de/2.txt", 0), sizeof(entry));
+	entry.path = "ab/de/added.txt";
+	cl_git_pass(git_index_add(new_index, &entry));
+
+	cl_git_pass(git_index_read_index(index, new_index));
+
+	opts.progress_cb = count_paths_below_ab;
+	opts.payload = &visited;
+
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, a, index, &opts));
+	cl_assert_equal_i(2, git_diff_num_deltas(diff));
+	cl_assert(visited > 0);
+
+	git_diff_free(diff);
+	diff = NULL;
+	git_index_free(new_index);
+
+	/* an entry below "ab/" that has a different id */
+	cl_git_pass(git_index_read_tree(index, b));
+
+	cl_git_pass(git_index_new(&new_index));
+	cl_git_pass(git_index_read_tree(new_index, b));
+
+	memcpy(&entry, git_index_get_bypath(new_index, "ab/de/2.txt", 0), sizeof(entry));
+	git_oid_cpy(&entry.id, git_tree_entry_id(git_tree_entry_byname(a, "README")));
+	cl_git_pass(git_index_add(new_index, &entry));
+
+	cl_git_pass(git_index_read_index(index, new_index));
+
+	visited = 0;
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, a, index, &opts));
+	cl_assert_equal_i(2, git_diff_num_deltas(diff));
+	cl_assert(visited > 0);
+
+	git_index_free(new_index);
+	git_index_free(index);
+}
+
+void test_diff_tree__conflicts_below_a_cached_tree_are_reported(void)
+{
+	git_index *index;
+	git_index_entry ancestor, ours, theirs;
+	git_oid tree_id;
+	git_status_list *status;
+	git_checkout_options checkout_opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_object *head;
+	const git_index_entry *entry;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	/* start from a clean working directory for the status */
+	checkout_opts.checkout_strategy =
+		GIT_CHECKOUT_FORCE | GIT_CHECKOUT_REMOVE_UNTRACKED;
+
+	cl_git_pass(git_repository_set_head(g_repo, "refs/heads/subtrees"));
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD"));
+	cl_git_pass(git_reset(g_repo, head, GIT_RESET_HARD, &checkout_opts));
+	git_object_free(head);
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, "763d71aadf09")) != NULL);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read_tree(index, a));
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_assert_equal_oid(git_tree_id(a), &tree_id);
+
+	/* a conflict where "ab/" has no stage 0 entry of that name */
+	cl_assert((entry = git_index_get_bypath(index, "ab/de/2.txt", 0)) != NULL);
+	memcpy(&ancestor, entry, sizeof(ancestor));
+	ancestor.path = "ab/de/conflicted.txt";
+	memcpy(&ours, &ancestor, sizeof(ours));
+	memcpy(&theirs, &ancestor, sizeof(theirs));
+	git_oid_cpy(&theirs.id, git_tree_entry_id(git_tree_entry_byname(a, "README")));
+
+	cl_git_pass(git_index_conflict_add(index, &ancestor, &ours, &theirs));
+
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, a, index, NULL));
+	cl_assert_equal_i(1, git_diff_num_deltas(diff));
+	cl_assert_equal_i(GIT_DELTA_CONFLICTED, git_diff_get_delta(diff, 0)->status);
+
+	cl_git_pass(git_index_write(index));
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_i(1, git_status_list_entrycount(status));
+	cl_assert_equal_i(GIT_STATUS_CONFLICTED, git_status_byindex(status, 0)->status);
+
+	git_status_list_free(status);
+	git_index_free(index);
+}
@@ -0,0 +1,266 @@
+#include "clar_libgit2.h"
+#include "diff_helpers.h"
+
+static git_repository *g_repo = NULL;
+
+void test_diff_window__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+}
+
+void test_diff_window__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void set_window_size(int32_t size)
+{
+	git_config *cfg;
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_int32(cfg, "diff.windowSize", size));
+	git_config_free(cfg);
+}
+
+static git_blob *make_blob(const git_buf *content)
+{
+	git_oid id;
+	git_blob *blob;
+
+	cl_git_pass(git_blob_create_frombuffer(
+		&id, g_repo, content->ptr, content->size));
+	cl_git_pass(git_blob_lookup(&blob, g_repo, &id));
+
+	return blob;
+}
+
+/* Check that the patch turns `old` into `new`, and that its line numbers
+ * agree with where its lines are.
+ */
+static void assert_patch_applies(
+	git_patch *patch, const git_buf *old, const git_buf *new)
+{
+	git_buf result = GIT_BUF_INIT;
+	const git_diff_hunk *hunk;
+	const git_diff_line *line;
+	const char *scan = old->ptr, *end = old->ptr + old->size, *nl;
+	size_t h, l, hunk_lines;
+	int old_lineno = 1, new_lineno = 1;
+
+	for (h = 0; h < git_patch_num_hunks(patch); h++) {
+		cl_git_pass(git_patch_get_hunk(&hunk, &hunk_lines, patch, h));
+
+		/* copy the unchanged lines up to the hunk */
+		while (old_lineno < hunk->old_start ||
+			(hunk->old_lines == 0 && old_lineno == hunk->old_start)) {
+			cl_assert(scan < end);
+			nl = memchr(scan, '\n', end - scan);
+			nl = nl ? nl + 1 : end;
+			cl_git_pass(git_buf_put(&result, scan, nl - scan));
+			scan = nl;
+			old_lineno++;
+			new_lineno++;
+		}
+
+		cl_assert_equal_i(new_lineno,
+			hunk->new_lines ? hunk->new_start : hunk->new_start + 1);
+
+		for (l = 0; l < hunk_lines; l++) {
+			cl_git_pass(git_patch_get_line_in_hunk(&line, patch, h, l));
+
+			switch (line->origin) {
+			case GIT_DIFF_LINE_CONTEXT:
+			case GIT_DIFF_LINE_DELETION:
+				cl_assert_equal_i(old_lineno, line->old_lineno);
+				cl_assert((size_t)(end - scan) >= line->content_len);
+				cl_assert(!memcmp(scan, line->content, line->content_len));
+				scan += line->content_len;
+				old_lineno++;
+
+				if (line->origin == GIT_DIFF_LINE_DELETION)
+					break;
+
+				cl_git_pass(git_buf_put(
+					&result, line->content, line->content_len));
+				new_lineno++;
+				break;
+
+			case GIT_DIFF_LINE_ADDITION:
+				cl_assert_equal_i(new_lineno, line->new_lineno);
+				cl_git_pass(git_buf_put(
+					&result, line->content, line->content_len));
+				new_lineno++;
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	cl_git_pass(git_buf_put(&result, scan, end - scan));
+	cl_assert_equal_s(new->ptr, result.ptr);
+
+	git_buf_free(&result);
+}
+
+static void diff_blobs_to_buf(
+	git_buf *out, git_patch **patch_out, git_blob *old, git_blob *new)
+{
+	git_patch *patch;
+
+	cl_git_pass(git_patch_from_blobs(&patch, old, NULL, new, NULL, NULL));
+	cl_git_pass(git_patch_to_buf(out, patch));
+
+	if (patch_out)
+		*patch_out = patch;
+	else
+		git_patch_free(patch);
+}
+
+static git_tree *make_tree(git_blob *blob)
+{
+	git_treebuilder *builder;
+	git_tree *tree;
+	git_oid id;
+
+	cl_git_pass(git_treebuilder_new(&builder, g_repo, NULL));
+	cl_git_pass(git_treebuilder_insert(
+		NULL, builder, "file", git_blob_id(blob), GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&id, builder));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+
+	git_treebuilder_free(builder);
+	return tree;
+}
+
+static void build_lines(git_buf *out, size_t count, size_t change_every)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (change_every && i % change_every == change_every / 2)
+			cl_git_pass(git_buf_printf(out, "changed line %d\n", (int)i));
+		else
+			cl_git_pass(git_buf_printf(out, "this is line %d\n", (int)i));
+	}
+}
+
+void test_diff_window__scattered_changes_match_a_whole_diff(void)
+{
+	git_buf old = GIT_BUF_INIT, new = GIT_BUF_INIT;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	git_blob *old_blob, *new_blob;
+	git_tree *old_tree, *new_tree;
+	git_patch *patch;
+	git_diff *diff;
+	git_diff_stats *stats;
+	size_t expected_adds, expected_dels, adds, dels;
+
+	build_lines(&old, 3000, 0);
+	build_lines(&new, 3000, 97);
+	old_blob = make_blob(&old);
+	new_blob = make_blob(&new);
+
+	diff_blobs_to_buf(&expected, &patch, old_blob, new_blob);
+	cl_git_pass(git_patch_line_stats(NULL, &expected_adds, &expected_dels, patch));
+	git_patch_free(patch);
+
+	/* about 50 lines per window */
+	set_window_size(1000);
+
+	diff_blobs_to_buf(&actual, &patch, old_blob, new_blob);
+	cl_assert_equal_s(expected.ptr, actual.ptr);
+	cl_git_pass(git_patch_line_stats(NULL, &adds, &dels, patch));
+	cl_assert_equal_sz(expected_adds, adds);
+	cl_assert_equal_sz(expected_dels, dels);
+	assert_patch_applies(patch, &old, &new);
+
+	/* stats count lines without building patches */
+	old_tree = make_tree(old_blob);
+	new_tree = make_tree(new_blob);
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+	cl_git_pass(git_diff_get_stats(&stats, diff));
+	cl_assert_equal_sz(expected_adds, git_diff_stats_insertions(stats));
+	cl_assert_equal_sz(expected_dels, git_diff_stats_deletions(stats));
+
+	git_diff_stats_free(stats);
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+	git_patch_free(patch);
+	git_blob_free(old_blob);
+	git_blob_free(new_blob);
+	git_buf_free(&old);
+	git_buf_free(&new);
+	git_buf_free(&expected);
+	git_buf_free(&actual);
+}
+
+void test_diff_window__finds_its_way_past_large_insertions(void)
+{
+	git_buf old = GIT_BUF_INIT, new = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	git_blob *old_blob, *new_blob;
+	git_patch *patch;
+	size_t adds, dels, i;
+
+	build_lines(&old, 1000, 0);
+
+	/* lines 0-399, then 500 new ones, then 400-999 less 700-899 */
+	build_lines(&new, 400, 0);
+	for (i = 0; i < 500; i++)
+		cl_git_pass(git_buf_printf(&new, "inserted line %d\n", (int)i));
+	for (i = 400; i < 1000; i++) {
+		if (i < 700 || i >= 900)
+			cl_git_pass(git_buf_printf(&new, "this is line %d\n", (int)i));
+	}
+
+	old_blob = make_blob(&old);
+	new_blob = make_blob(&new);
+
+	set_window_size(1000);
+
+	diff_blobs_to_buf(&actual, &patch, old_blob, new_blob);
+	assert_patch_applies(patch, &old, &new);
+
+	cl_git_pass(git_patch_line_stats(NULL, &adds, &dels, patch));
+	cl_assert_equal_sz(500, adds);
+	cl_assert_equal_sz(200, dels);
+
+	git_patch_free(patch);
+	git_blob_free(old_blob);
+	git_blob_free(new_blob);
+	git_buf_free(&old);
+	git_buf_free(&new);
+	git_buf_free(&actual);
+}
+
+void test_diff_window__unrelated_files_still_give_a_patch(void)
+{
+	git_buf old = GIT_BUF_INIT, new = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	git_blob *old_blob, *new_blob;
+	git_patch *patch;
+	size_t i;
+
+	for (i = 0; i < 700; i++) {
+		cl_git_pass(git_buf_printf(&old, "old %d\n", (int)(i * 7 % 700)));
+		cl_git_pass(git_buf_printf(&new, "new %d\n", (int)(i * 3 % 700)));
+	}
+	/* without a final newline on one side */
+	git_buf_truncate(&new, new.size - 1);
+
+	old_blob = make_blob(&old);
+	new_blob = make_blob(&new);
+
+	set_window_size(500);
+
+	diff_blobs_to_buf(&actual, &patch, old_blob, new_blob);
+	assert_patch_applies(patch, &old, &new);
+
+	git_patch_free(patch);
+	git_blob_free(old_blob);
+	git_blob_free(new_blob);
+	git_buf_free(&old);
+	git_buf_free(&new);
+	git_buf_free(&actual);
+}
@@ -62,7 +62,8 @@ void test_diff_workdir__to_index(void)
 		git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
 		cl_git_pass(git_diff_get_perfdata(&perf, diff));
 		cl_assert_equal_sz(
-			13 /* in root */ + 3 /* in subdir */, perf.stat_calls);
+			13 /* in root */ + 3 /* in subdir */ - 2, perf.stat_calls);
+		cl_assert_equal_sz(2 /* .git and subdir */, perf.stat_calls_avoided);
 		cl_assert_equal_sz(5, perf.oid_calculations);
 	}
 
@@ -1813,7 +1814,8 @@ void test_diff_workdir__can_update_index(void)
 	basic_diff_status(&diff, &opts);
 
 	cl_git_pass(git_diff_get_perfdata(&perf, diff));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(13 + 3 - 2, perf.stat_calls);
+	cl_assert_equal_sz(2 /* .git and subdir */, perf.stat_calls_avoided);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_diff_free(diff);
@@ -1828,7 +1830,8 @@ void test_diff_workdir__can_update_index(void)
 	basic_diff_status(&diff, &opts);
 
 	cl_git_pass(git_diff_get_perfdata(&perf, diff));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(13 + 3 - 2, perf.stat_calls);
+	cl_assert_equal_sz(2 /* .git and subdir */, perf.stat_calls_avoided);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_diff_free(diff);
@@ -1840,7 +1843,8 @@ void test_diff_workdir__can_update_index(void)
 	basic_diff_status(&diff, &opts);
 
 	cl_git_pass(git_diff_get_perfdata(&perf, diff));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(13 + 3 - 2, perf.stat_calls);
+	cl_assert_equal_sz(2 /* .git and subdir */, perf.stat_calls_avoided);
 	cl_assert_equal_sz(0, perf.oid_calculations);
 
 	git_diff_free(diff);
@@ -2158,3 +2162,79 @@ void test_diff_workdir__symlink_changed_on_non_symlink_platform(void)
 	git_tree_free(tree);
 	git_vector_free(&pathlist);
 }
+
+static void preload_index_diff(
+	diff_expects *exp, git_diff_perfdata *perf, bool preload)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_diff *diff;
+
+	cl_repo_set_bool(g_repo, "core.preloadIndex", preload);
+
+	memset(exp, 0, sizeof(*exp));
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, NULL, &opts));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, NULL, exp));
+	cl_git_pass(git_diff_get_perfdata(perf, diff));
+	git_diff_free(diff);
+}
+
+void test_diff_workdir__preload_index(void)
+{
+	git_index *index;
+	git_buf path = GIT_BUF_INIT;
+	const git_index_entry *entry;
+	diff_expects exp;
+	git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
+	int i, j;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	/* enough files to make preloading worth a couple of threads */
+	for (i = 0; i < 12; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/dir%02d", i));
+		cl_git_pass(p_mkdir(path.ptr, 0777));
+
+		for (j = 0; j < 100; j++) {
+			git_buf_clear(&path);
+			cl_git_pass(git_buf_printf(&path,
+				"empty_standard_repo/dir%02d/file%03d.txt", i, j));
+			cl_git_mkfile(path.ptr, path.ptr);
+		}
+	}
+	git_buf_free(&path);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	tick_index(index);
+
+	cl_git_rewritefile("empty_standard_repo/dir00/file000.txt", "changed\n");
+	cl_git_rewritefile("empty_standard_repo/dir05/file050.txt", "changed\n");
+	cl_git_rewritefile("empty_standard_repo/dir11/file099.txt", "changed\n");
+	cl_must_pass(p_unlink("empty_standard_repo/dir07/file007.txt"));
+
+	preload_index_diff(&exp, &perf, false);
+	cl_assert_equal_i(4, exp.files);
+	cl_assert_equal_i(3, exp.file_status[GIT_DELTA_MODIFIED]);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_DELETED]);
+	cl_assert_equal_sz(1199, perf.stat_calls);
+	cl_assert_equal_sz(1 /* .git */ + 12, perf.stat_calls_avoided);
+
+	preload_index_diff(&exp, &perf, true);
+	cl_assert_equal_i(4, exp.files);
+	cl_assert_equal_i(3, exp.file_status[GIT_DELTA_MODIFIED]);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_DELETED]);
+
+	/* every tracked file was stat'd once up front; the directory scan
+	 * only had to stat the files that changed, not the directories */
+	cl_assert_equal_sz(1200 + 3, perf.stat_calls);
+	cl_assert_equal_sz(1 + 12, perf.stat_calls_avoided);
+
+	cl_assert((entry = git_index_get_bypath(index, "dir03/file030.txt", 0)) != NULL);
+	cl_assert(entry->flags_extended & GIT_IDXENTRY_UPTODATE);
+	cl_assert((entry = git_index_get_bypath(index, "dir00/file000.txt", 0)) != NULL);
+	cl_assert(!(entry->flags_extended & GIT_IDXENTRY_UPTODATE));
+
+	git_index_free(index);
+}
@@ -16,6 +16,7 @@ void test_filter_crlf__initialize(void)
 
 void test_filter_crlf__cleanup(void)
 {
+	git_filter_unregister("trickle");
 	cl_git_sandbox_cleanup();
 }
 
@@ -233,3 +234,179 @@ void test_filter_crlf__safecrlf_warn(void)
 	git_filter_list_free(fl);
 	git_buf_free(&out);
 }
+
+/* With no `expected` output, filtering has to fail */
+static void assert_split_between_writes(
+	git_filter_mode_t mode,
+	const char *filename,
+	const char *before,
+	const char *after,
+	const char *expected)
+{
+	git_filter_list *fl;
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT, out = GIT_BUF_INIT;
+	size_t pad = FILTERIO_BUFSIZE - strlen(before);
+
+	/* files are filtered in pieces of FILTERIO_BUFSIZE, so make `before`
+	 * end the first piece and `after` start the next one */
+	cl_git_pass(git_buf_joinpath(&path, "crlf", filename));
+	cl_git_pass(git_buf_grow(&content, pad + 1));
+	memset(content.ptr, 'a', pad);
+	content.size = pad;
+	cl_git_pass(git_buf_puts(&content, before));
+	cl_git_pass(git_buf_puts(&content, after));
+	cl_git_mkfile(path.ptr, content.ptr);
+
+	cl_git_pass(git_filter_list_load(&fl, g_repo, NULL, filename, mode, 0));
+
+	if (expected) {
+		cl_git_pass(git_filter_list_apply_to_file(
+			&out, fl, g_repo, filename));
+		cl_assert_equal_sz(pad + strlen(expected), out.size);
+		cl_assert_equal_s(expected, out.ptr + pad);
+	} else {
+		cl_git_fail(git_filter_list_apply_to_file(
+			&out, fl, g_repo, filename));
+		cl_assert_equal_i(GITERR_FILTER, giterr_last()->klass);
+	}
+
+	git_filter_list_free(fl);
+	git_buf_free(&path);
+	git_buf_free(&content);
+	git_buf_free(&out);
+}
+
+struct trickle_stream {
+	git_writestream parent;
+	git_writestream *next;
+};
+
+static int trickle_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	struct trickle_stream *stream = (struct trickle_stream *)s;
+	size_t i;
+	int error;
+
+	for (i = 0; i < len; i++)
+		if ((error = stream->next->write(stream->next, &buffer[i], 1)) < 0)
+			return error;
+
+	return 0;
+}
+
+static int trickle_stream_close(git_writestream *s)
+{
+	struct trickle_stream *stream = (struct trickle_stream *)s;
+	return stream->next->close(stream->next);
+}
+
+static void trickle_stream_free(git_writestream *s)
+{
+	git__free(s);
+}
+
+static int trickle_stream_init(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
+{
+	struct trickle_stream *stream = git__calloc(1, sizeof(*stream));
+	cl_assert(stream);
+
+	GIT_UNUSED(self);
+	GIT_UNUSED(payload);
+	GIT_UNUSED(src);
+
+	stream->parent.write = trickle_stream_write;
+	stream->parent.close = trickle_stream_close;
+	stream->parent.free = trickle_stream_free;
+	stream->next = next;
+
+	*out = &stream->parent;
+	return 0;
+}
+
+static git_filter trickle_filter = {
+	GIT_FILTER_VERSION, NULL, NULL, NULL, NULL, NULL,
+	trickle_stream_init, NULL
+};
+
+/* feed `input` to the filters one byte at a time, so that it is split
+ * between writes everywhere */
+static void assert_trickled(
+	git_filter_mode_t mode,
+	const char *filename,
+	const char *input,
+	const char *expected)
+{
+	git_filter_list *fl;
+	git_buf path = GIT_BUF_INIT, out = GIT_BUF_INIT;
+
+	/* in front of the CRLF filter in either direction */
+	cl_git_pass(git_filter_register("trickle", &trickle_filter,
+		mode == GIT_FILTER_TO_WORKTREE ? -1 : 1));
+
+	cl_git_pass(git_buf_joinpath(&path, "crlf", filename));
+	cl_git_mkfile(path.ptr, input);
+
+	cl_git_pass(git_filter_list_load(&fl, g_repo, NULL, filename, mode, 0));
+	cl_assert_equal_sz(2, git_filter_list_length(fl));
+
+	cl_git_pass(git_filter_list_apply_to_file(&out, fl, g_repo, filename));
+	cl_assert_equal_s(expected, out.ptr);
+
+	git_filter_list_free(fl);
+	git_buf_free(&path);
+	git_buf_free(&out);
+
+	cl_git_pass(git_filter_unregister("trickle"));
+}
+
+void test_filter_crlf__converts_line_endings_split_between_writes(void)
+{
+	assert_split_between_writes(GIT_FILTER_TO_ODB, "split.crlf",
+		"one\r", "\ntwo\r\n", "one\ntwo\n");
+	assert_split_between_writes(GIT_FILTER_TO_ODB, "split.crlf",
+		"one\r", "two\r\n", "one\rtwo\n");
+	assert_split_between_writes(GIT_FILTER_TO_ODB, "split.crlf",
+		"one\r\r", "\ntwo\r", "one\r\ntwo\r");
+
+	assert_split_between_writes(GIT_FILTER_TO_WORKTREE, "split.crlf",
+		"one\r", "\ntwo\n", "one\r\ntwo\r\n");
+	assert_split_between_writes(GIT_FILTER_TO_WORKTREE, "split.crlf",
+		"one\n", "\ntwo", "one\r\n\r\ntwo");
+
+	/* "\r" | "\n" | "\n..." */
+	assert_trickled(GIT_FILTER_TO_WORKTREE, "split.crlf",
+		"a\r\n\nb\n", "a\r\n\r\nb\r\n");
+	assert_trickled(GIT_FILTER_TO_ODB, "split.crlf",
+		"a\r\n\r\r\nb\r\n", "a\n\r\nb\n");
+}
+
+void test_filter_crlf__counts_line_endings_split_between_writes(void)
+{
+	/* left to core.autocrlf, which only converts when every CR is part
+	 * of a CRLF */
+	assert_split_between_writes(GIT_FILTER_TO_ODB, "split.auto",
+		"one\r", "\ntwo\r\n", "one\ntwo\n");
+	assert_split_between_writes(GIT_FILTER_TO_ODB, "split.auto",
+		"one\r", "two\r\n", "one\rtwo\r\n");
+
+	assert_split_between_writes(GIT_FILTER_TO_WORKTREE, "split.auto",
+		"one\n", "\ntwo\n", "one\r\n\r\ntwo\r\n");
+	assert_split_between_writes(GIT_FILTER_TO_WORKTREE, "split.auto",
+		"one\n", "two\rthree\n", "one\ntwo\rthree\n");
+}
+
+void test_filter_crlf__safecrlf_counts_line_endings_split_between_writes(void)
+{
+	cl_repo_set_bool(g_repo, "core.safecrlf", true);
+
+	assert_split_between_writes(GIT_FILTER_TO_ODB, "split.auto",
+		"one\r", "\ntwo\r\n", "one\ntwo\n");
+	assert_split_between_writes(GIT_FILTER_TO_ODB, "split.auto",
+		"one\r", "\ntwo\n", NULL);
+}
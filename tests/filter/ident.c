@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "git2/sys/filter.h"
+#include "buffer.h"
 
 static git_repository *g_repo = NULL;
 
@@ -131,3 +132,36 @@ void test_filter_ident__to_odb(void)
 
 	git_filter_list_free(fl);
 }
+
+void test_filter_ident__to_odb_split_between_writes(void)
+{
+	git_filter_list *fl;
+	git_filter *ident;
+	git_buf content = GIT_BUF_INIT, out = GIT_BUF_INIT;
+	size_t pad = FILTERIO_BUFSIZE - strlen("$Id: some");
+
+	cl_git_pass(git_filter_list_new(
+		&fl, g_repo, GIT_FILTER_TO_ODB, 0));
+
+	ident = git_filter_lookup(GIT_FILTER_IDENT);
+	cl_assert(ident != NULL);
+
+	cl_git_pass(git_filter_list_push(fl, ident, NULL));
+
+	/* files are filtered in pieces of FILTERIO_BUFSIZE */
+	cl_git_pass(git_buf_grow(&content, pad + 1));
+	memset(content.ptr, 'a', pad);
+	content.size = pad;
+	cl_git_pass(git_buf_puts(&content, "$Id: some junk$\n"));
+	cl_git_mkfile("crlf/identtest", content.ptr);
+
+	cl_git_pass(git_filter_list_apply_to_file(
+		&out, fl, g_repo, "identtest"));
+
+	cl_assert_equal_sz(pad + strlen("$Id$\n"), out.size);
+	cl_assert_equal_s("$Id$\n", out.ptr + pad);
+
+	git_filter_list_free(fl);
+	git_buf_free(&content);
+	git_buf_free(&out);
+}
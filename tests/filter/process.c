@@ -0,0 +1,263 @@
+#include "clar_libgit2.h"
+#include "posix.h"
+#include "fileops.h"
+#include "git2/sys/filter.h"
+
+static git_repository *g_repo = NULL;
+
+#define FILE_COUNT 10
+
+void test_filter_process__initialize(void)
+{
+#ifdef GIT_WIN32
+	cl_skip();
+#else
+	if (system("perl -e 1 >/dev/null 2>&1") != 0)
+		cl_skip();
+#endif
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_mkfile("empty_standard_repo/.gitattributes",
+		"*.r13 filter=rot13\n");
+}
+
+void test_filter_process__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+	g_repo = NULL;
+
+	if (git_path_exists("filter.log"))
+		cl_must_pass(p_unlink("filter.log"));
+}
+
+static void set_filter(const char *capabilities, bool required)
+{
+	git_buf script = GIT_BUF_INIT, log = GIT_BUF_INIT, cmd = GIT_BUF_INIT;
+	git_config *cfg;
+
+	cl_git_pass(git_path_prettify(&script,
+		cl_fixture("filter_process/rot13-filter.pl"), NULL));
+	cl_git_pass(git_buf_joinpath(&log, clar_sandbox_path(), "filter.log"));
+	cl_git_pass(git_buf_printf(&cmd, "perl '%s' '%s' %s",
+		script.ptr, log.ptr, capabilities));
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_string(cfg, "filter.rot13.process", cmd.ptr));
+	cl_git_pass(git_config_set_bool(cfg, "filter.rot13.required", required));
+	git_config_free(cfg);
+
+	git_buf_free(&script);
+	git_buf_free(&log);
+	git_buf_free(&cmd);
+}
+
+static size_t count_in_log(const char *text)
+{
+	git_buf log = GIT_BUF_INIT;
+	const char *scan;
+	size_t count = 0;
+
+	cl_git_pass(git_futils_readbuffer(&log, "filter.log"));
+
+	for (scan = log.ptr; (scan = strstr(scan, text)) != NULL; scan++)
+		count++;
+
+	git_buf_free(&log);
+	return count;
+}
+
+static void write_files(const char *extra)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_index *index;
+	size_t i;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		git_buf_clear(&path);
+		git_buf_clear(&content);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/f%d.r13", (int)i));
+		cl_git_pass(git_buf_printf(&content, "Uryyb %d\n", (int)i));
+		cl_git_mkfile(path.ptr, content.ptr);
+	}
+
+	if (extra)
+		cl_git_mkfile(extra, "Uryyb\n");
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_repo_commit_from_index(NULL, g_repo, NULL, 0, "filtered");
+
+	git_buf_free(&path);
+	git_buf_free(&content);
+}
+
+static void remove_files(void)
+{
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < FILE_COUNT; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/f%d.r13", (int)i));
+		cl_must_pass(p_unlink(path.ptr));
+	}
+
+	git_buf_free(&path);
+}
+
+static void assert_blob(const char *path, const char *expected)
+{
+	git_index *index;
+	const git_index_entry *entry;
+	git_blob *blob;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert((entry = git_index_get_bypath(index, path, 0)) != NULL);
+	cl_git_pass(git_blob_lookup(&blob, g_repo, &entry->id));
+	cl_assert_equal_s(expected, git_blob_rawcontent(blob));
+	git_blob_free(blob);
+	git_index_free(index);
+}
+
+static void assert_clean_status(void)
+{
+	git_status_list *status;
+
+	cl_git_pass(git_status_list_new(&status, g_repo, NULL));
+	cl_assert_equal_sz(0, git_status_list_entrycount(status));
+	git_status_list_free(status);
+}
+
+void test_filter_process__cleans_and_smudges_through_one_process(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+
+	set_filter("clean smudge", false);
+	write_files(NULL);
+
+	assert_blob("f0.r13", "Hello 0\n");
+	assert_blob("f9.r13", "Hello 9\n");
+
+	remove_files();
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+
+	cl_assert_equal_file("Uryyb 0\n", 0, "empty_standard_repo/f0.r13");
+	cl_assert_equal_file("Uryyb 9\n", 0, "empty_standard_repo/f9.r13");
+
+	cl_assert_equal_sz(1, count_in_log("start"));
+	cl_assert(count_in_log("clean f") >= FILE_COUNT);
+	cl_assert_equal_sz(FILE_COUNT, count_in_log("smudge f"));
+
+	assert_clean_status();
+}
+
+void test_filter_process__uses_only_the_capabilities_offered(void)
+{
+	set_filter("smudge", false);
+	write_files(NULL);
+
+	/* without the clean capability, content goes in as it is */
+	assert_blob("f0.r13", "Uryyb 0\n");
+	cl_assert_equal_sz(0, count_in_log("clean"));
+}
+
+void test_filter_process__checkout_waits_for_delayed_content(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	size_t i;
+
+	set_filter("clean smudge delay", false);
+	write_files(NULL);
+	remove_files();
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+
+	/* everything was delayed, and handed over four at a time */
+	cl_assert_equal_sz(FILE_COUNT, count_in_log("delayed"));
+	cl_assert_equal_sz(FILE_COUNT, count_in_log("delivered"));
+	cl_assert(count_in_log("list_available_blobs") >= 3);
+
+	for (i = 0; i < FILE_COUNT; i += 3) {
+		git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/f%d.r13", (int)i));
+		cl_git_pass(git_buf_printf(&content, "Uryyb %d\n", (int)i));
+		cl_assert_equal_file(content.ptr, 0, path.ptr);
+
+		git_buf_free(&path);
+		git_buf_free(&content);
+	}
+
+	assert_clean_status();
+}
+
+void test_filter_process__delayed_content_is_written_once(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+
+	set_filter("clean smudge delay", false);
+	write_files(NULL);
+	remove_files();
+
+	/* a file created while its content was delayed would fail to open
+	 * when the content is delivered */
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	opts.file_open_flags = O_CREAT | O_EXCL | O_WRONLY;
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+
+	cl_assert_equal_sz(FILE_COUNT, count_in_log("delayed"));
+	cl_assert_equal_file("Uryyb 0\n", 0, "empty_standard_repo/f0.r13");
+	cl_assert_equal_file("Uryyb 9\n", 0, "empty_standard_repo/f9.r13");
+
+	assert_clean_status();
+}
+
+void test_filter_process__passes_content_through_unless_required(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+
+	set_filter("clean smudge", false);
+	write_files("empty_standard_repo/fail.r13");
+
+	/* the filter refuses this one, so it goes in unfiltered */
+	assert_blob("fail.r13", "Uryyb\n");
+
+	cl_must_pass(p_unlink("empty_standard_repo/fail.r13"));
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+	cl_assert_equal_file("Uryyb\n", 0, "empty_standard_repo/fail.r13");
+
+	/* but a required filter has to succeed */
+	set_filter("clean smudge", true);
+	cl_must_pass(p_unlink("empty_standard_repo/fail.r13"));
+
+	cl_git_fail(git_checkout_head(g_repo, &opts));
+}
+
+void test_filter_process__passes_content_through_when_it_cannot_start(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_config *cfg;
+
+	write_files(NULL);
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_string(cfg,
+		"filter.rot13.process", "no-such-filter-command"));
+	git_config_free(cfg);
+
+	remove_files();
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+
+	cl_assert_equal_file("Uryyb 0\n", 0, "empty_standard_repo/f0.r13");
+}
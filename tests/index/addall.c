@@ -479,3 +479,159 @@ void test_index_addall__removes_deleted_conflicted_files(void)
 	git_reference_free(ref);
 	git_index_free(index);
 }
+
+void test_index_addall__many_files_in_one_pack(void)
+{
+	git_index *index;
+	const git_index_entry *entry;
+	git_odb *odb;
+	git_oid id;
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_vector packs = GIT_VECTOR_INIT;
+	char oidstr[GIT_OID_HEXSZ + 1] = {0};
+	size_t i;
+
+	addall_create_test_repo(false);
+
+	cl_git_mkfile(TEST_DIR "/.gitattributes", "*.crlf text eol=crlf\n");
+	cl_git_mkfile(TEST_DIR "/file.crlf", "one\r\ntwo\r\n");
+	cl_git_mkfile(TEST_DIR "/empty", "");
+	cl_must_pass(p_mkdir(TEST_DIR "/subdir", 0777));
+
+	for (i = 0; i < 300; i++) {
+		git_buf_clear(&path);
+		git_buf_clear(&content);
+		cl_git_pass(git_buf_printf(&path, TEST_DIR "/subdir/file%d", (int)i));
+		/* plenty of duplicate contents */
+		cl_git_pass(git_buf_printf(&content, "content %d\n", (int)(i % 100)));
+		cl_git_mkfile(path.ptr, content.ptr);
+	}
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+
+	check_stat_data(index, TEST_DIR "/subdir/file42", true);
+	check_status(g_repo, 305, 0, 0, 0, 0, 0, 1, 0);
+
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+
+	cl_assert(entry = git_index_get_bypath(index, "subdir/file142", 0));
+	cl_git_pass(git_odb_hash(&id, "content 42\n", 11, GIT_OBJ_BLOB));
+	cl_assert_equal_oid(&id, &entry->id);
+	cl_assert(git_odb_exists(odb, &id));
+
+	cl_assert(entry = git_index_get_bypath(index, "file.crlf", 0));
+	cl_git_pass(git_odb_hash(&id, "one\ntwo\n", 8, GIT_OBJ_BLOB));
+	cl_assert_equal_oid(&id, &entry->id);
+	cl_assert(git_odb_exists(odb, &id));
+
+	cl_assert(entry = git_index_get_bypath(index, "empty", 0));
+	cl_git_pass(git_odb_hash(&id, "", 0, GIT_OBJ_BLOB));
+	cl_assert_equal_oid(&id, &entry->id);
+	cl_assert(git_odb_exists(odb, &id));
+
+	git_buf_clear(&path);
+
+	/* the new blobs went into a pack rather than loose objects */
+	cl_git_pass(git_path_dirload(&packs, TEST_DIR "/.git/objects/pack", 0, 0));
+	cl_assert_equal_i(2, packs.length);
+
+	git_oid_fmt(oidstr, &entry->id);
+	cl_git_pass(git_buf_printf(&path, TEST_DIR "/.git/objects/%.2s/%s",
+		oidstr, oidstr + 2));
+	cl_assert(!git_path_exists(path.ptr));
+
+	git_vector_free_deep(&packs);
+	git_odb_free(odb);
+	git_buf_free(&content);
+	git_buf_free(&path);
+	git_index_free(index);
+}
+
+void test_index_addall__many_files_update_the_tree_cache(void)
+{
+	git_index *index;
+	git_tree *tree;
+	git_tree_entry *entry;
+	git_oid tree_id, id;
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	addall_create_test_repo(false);
+	cl_must_pass(p_mkdir(TEST_DIR "/subdir", 0777));
+
+	for (i = 0; i < 300; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, TEST_DIR "/subdir/file%d", (int)i));
+		cl_git_mkfile(path.ptr, "before\n");
+	}
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+
+	/* the trees written before are not reused for the new contents */
+	for (i = 0; i < 300; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, TEST_DIR "/subdir/file%d", (int)i));
+		cl_git_rewritefile(path.ptr, "after the change\n");
+	}
+
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &tree_id));
+	cl_git_pass(git_tree_entry_bypath(&entry, tree, "subdir/file42"));
+	cl_git_pass(git_odb_hash(&id, "after the change\n", 17, GIT_OBJ_BLOB));
+	cl_assert_equal_oid(&id, git_tree_entry_id(entry));
+
+	git_tree_entry_free(entry);
+	git_tree_free(tree);
+	git_buf_free(&path);
+	git_index_free(index);
+}
+
+void test_index_addall__many_files_already_in_the_odb(void)
+{
+	git_index *index;
+	const git_index_entry *entry;
+	git_oid id;
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_vector packs = GIT_VECTOR_INIT;
+	size_t i;
+
+	addall_create_test_repo(false);
+	cl_must_pass(p_mkdir(TEST_DIR "/subdir", 0777));
+
+	/* the objects of every file are in the odb already */
+	cl_git_pass(git_blob_create_frombuffer(&id, g_repo, "*.foo\n", 6));
+	cl_git_pass(git_blob_create_frombuffer(&id, g_repo, "another file", 12));
+
+	for (i = 0; i < 300; i++) {
+		git_buf_clear(&path);
+		git_buf_clear(&content);
+		cl_git_pass(git_buf_printf(&path, TEST_DIR "/subdir/file%d", (int)i));
+		cl_git_pass(git_buf_printf(&content, "content %d\n", (int)i));
+		cl_git_mkfile(path.ptr, content.ptr);
+		cl_git_pass(git_blob_create_frombuffer(
+			&id, g_repo, content.ptr, content.size));
+	}
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+
+	check_status(g_repo, 302, 0, 0, 0, 0, 0, 1, 0);
+
+	cl_assert(entry = git_index_get_bypath(index, "subdir/file42", 0));
+	cl_git_pass(git_odb_hash(&id, "content 42\n", 11, GIT_OBJ_BLOB));
+	cl_assert_equal_oid(&id, &entry->id);
+
+	/* there was nothing new to put in a pack */
+	cl_git_pass(git_path_dirload(&packs, TEST_DIR "/.git/objects/pack", 0, 0));
+	cl_assert_equal_i(0, packs.length);
+
+	git_vector_free_deep(&packs);
+	git_buf_free(&content);
+	git_buf_free(&path);
+	git_index_free(index);
+}
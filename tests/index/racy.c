@@ -325,3 +325,142 @@ void test_index_racy__read_index_clears_uptodate_bit(void)
 	git_index_free(index);
 	git_index_free(newindex);
 }
+
+void test_index_racy__only_smudges_changed_entries(void)
+{
+	git_index *index;
+	const git_index_entry *entry;
+	git_buf path = GIT_BUF_INIT;
+	char name[16];
+	size_t i;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	/* enough entries to check them on several threads */
+	for (i = 0; i < 100; i++) {
+		p_snprintf(name, sizeof(name), "file%d", (int)i);
+		cl_git_pass(git_buf_joinpath(&path, git_repository_workdir(g_repo), name));
+		cl_git_mkfile(path.ptr, "content\n");
+		cl_git_pass(git_index_add_bypath(index, name));
+	}
+
+	cl_git_pass(git_index_write(index));
+
+	/* change every other file behind the index' back */
+	for (i = 0; i < 100; i += 2) {
+		p_snprintf(name, sizeof(name), "file%d", (int)i);
+		cl_git_pass(git_buf_joinpath(&path, git_repository_workdir(g_repo), name));
+		cl_git_mkfile(path.ptr, "changed content\n");
+	}
+
+	/* pretend the index was written in the same second as the files */
+	cl_assert(entry = git_index_get_bypath(index, "file0", 0));
+	index->stamp.mtime.tv_sec = entry->mtime.seconds;
+
+	cl_git_pass(git_index_write(index));
+
+	for (i = 0; i < 100; i++) {
+		p_snprintf(name, sizeof(name), "file%d", (int)i);
+		cl_assert(entry = git_index_get_bypath(index, name, 0));
+		cl_assert_equal_i((i % 2) ? 8 : 0, entry->file_size);
+	}
+
+	git_buf_free(&path);
+	git_index_free(index);
+}
+
+void test_index_racy__rehashes_entries_whose_stat_data_matches(void)
+{
+	git_index *index;
+	git_index_entry *entry;
+	git_buf path = GIT_BUF_INIT;
+	struct stat st;
+	char name[16];
+	size_t i;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	for (i = 0; i < 100; i++) {
+		p_snprintf(name, sizeof(name), "file%d", (int)i);
+		cl_git_pass(git_buf_joinpath(&path, git_repository_workdir(g_repo), name));
+		cl_git_mkfile(path.ptr, "content\n");
+		cl_git_pass(git_index_add_bypath(index, name));
+	}
+
+	cl_git_pass(git_index_write(index));
+
+	/* change every other file without changing its size, and make the
+	 * entry's stat data match it again, so only its contents differ */
+	for (i = 0; i < 100; i += 2) {
+		uint32_t mode;
+
+		p_snprintf(name, sizeof(name), "file%d", (int)i);
+		cl_git_pass(git_buf_joinpath(&path, git_repository_workdir(g_repo), name));
+		cl_git_rewritefile(path.ptr, "CONTENT\n");
+		cl_must_pass(p_lstat(path.ptr, &st));
+
+		cl_assert(entry = (git_index_entry *)git_index_get_bypath(index, name, 0));
+		mode = entry->mode;
+		git_index_entry__init_from_stat(entry, &st, true);
+		entry->mode = mode;
+	}
+
+	/* pretend the index was written in the same second as the files */
+	cl_assert(entry = (git_index_entry *)git_index_get_bypath(index, "file0", 0));
+	index->stamp.mtime.tv_sec = entry->mtime.seconds;
+
+	cl_git_pass(git_index_write(index));
+
+	for (i = 0; i < 100; i++) {
+		p_snprintf(name, sizeof(name), "file%d", (int)i);
+		cl_assert(entry = (git_index_entry *)git_index_get_bypath(index, name, 0));
+		cl_assert_equal_i((i % 2) ? 8 : 0, entry->file_size);
+	}
+
+	git_buf_free(&path);
+	git_index_free(index);
+}
+
+void test_index_racy__does_not_smudge_submodules(void)
+{
+	git_index *index;
+	git_index_entry entry, *added;
+	git_buf path = GIT_BUF_INIT;
+	struct stat st;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	cl_git_pass(git_buf_joinpath(&path, git_repository_workdir(g_repo), "file"));
+	cl_git_mkfile(path.ptr, "content\n");
+	cl_git_pass(git_index_add_bypath(index, "file"));
+
+	/* a submodule's stat data is that of its working directory, whose
+	 * contents can not be hashed and compared like a file's */
+	cl_git_pass(git_buf_joinpath(&path, git_repository_workdir(g_repo), "sub"));
+	cl_must_pass(p_mkdir(path.ptr, 0777));
+	cl_must_pass(p_lstat(path.ptr, &st));
+
+	memset(&entry, 0, sizeof(entry));
+	git_index_entry__init_from_stat(&entry, &st, true);
+	entry.mode = GIT_FILEMODE_COMMIT;
+	entry.path = "sub";
+	cl_git_pass(git_oid_fromstr(&entry.id, "099fabac3a9ea935598528c27f866e34089c2eff"));
+	cl_git_pass(git_index_add(index, &entry));
+
+	/* as if just read: nothing is known to be up to date */
+	cl_assert(added = (git_index_entry *)git_index_get_bypath(index, "sub", 0));
+	added->flags_extended &= ~GIT_IDXENTRY_UPTODATE;
+
+	/* pretend the index was written in the same second as the directory */
+	index->stamp.mtime.tv_sec = st.st_mtime;
+	index->stamp.mtime.tv_nsec = 0;
+
+	cl_git_pass(git_index_write(index));
+
+	cl_assert(added = (git_index_entry *)git_index_get_bypath(index, "sub", 0));
+	cl_assert_equal_i(GIT_FILEMODE_COMMIT, added->mode);
+	cl_assert_equal_i((uint32_t)st.st_size, added->file_size);
+
+	git_buf_free(&path);
+	git_index_free(index);
+}
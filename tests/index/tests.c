@@ -124,6 +124,66 @@ void test_index_tests__gitgit_index(void)
    git_index_free(index);
 }
 
+void test_index_tests__reread_while_reading_snapshot(void)
+{
+   git_index *index;
+   git_vector snap;
+   git_index_entry *entry;
+   size_t i;
+
+   cl_git_pass(git_index_open(&index, TEST_INDEX2_PATH));
+   cl_git_pass(git_index_snapshot_new(&snap, index));
+
+   /* the snapshot's entries must survive the index being re-read, even
+    * though they were allocated out of the index's entry pool */
+   cl_git_pass(git_index_read(index, true));
+   cl_git_pass(git_index_remove(index, "Makefile", 0));
+   cl_assert_equal_sz(index_entry_count_2 - 1, git_index_entrycount(index));
+
+   cl_assert_equal_sz(index_entry_count_2, snap.length);
+   git_vector_foreach(&snap, i, entry) {
+		if (i > 0)
+			cl_assert(strcmp(((git_index_entry *)snap.contents[i - 1])->path, entry->path) <= 0);
+   }
+
+   git_index_snapshot_release(&snap, index);
+
+   cl_assert(git_index_get_bypath(index, "Makefile", 0) == NULL);
+   cl_assert(git_index_get_bypath(index, "git.c", 0) != NULL);
+
+   git_index_free(index);
+}
+
+void test_index_tests__reread_while_reading_snapshot_retires_pool(void)
+{
+   git_index *index;
+   git_vector snap;
+   git_pool *retired;
+   uint32_t pages;
+
+   cl_git_pass(git_index_open(&index, TEST_INDEX2_PATH));
+   pages = git_pool__open_pages(&index->entry_pool);
+   cl_assert(pages > 0);
+
+   /* a read while a reader holds the old entries cannot reuse their
+    * pool; it gets its own, and the old one waits for the reader */
+   cl_git_pass(git_index_snapshot_new(&snap, index));
+   cl_git_pass(git_index_read(index, true));
+
+   cl_assert_equal_sz(1, index->retired_pools.length);
+   retired = git_vector_get(&index->retired_pools, 0);
+   cl_assert_equal_i(pages, git_pool__open_pages(retired));
+   cl_assert_equal_i(pages, git_pool__open_pages(&index->entry_pool));
+
+   git_index_snapshot_release(&snap, index);
+
+   cl_assert_equal_sz(0, index->retired_pools.length);
+   cl_assert_equal_i(pages, git_pool__open_pages(&index->entry_pool));
+   cl_assert_equal_sz(index_entry_count_2, git_index_entrycount(index));
+
+   git_index_free(index);
+}
+
 void test_index_tests__find_in_existing(void)
 {
    git_index *index;
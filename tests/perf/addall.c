@@ -0,0 +1,49 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+
+/* Time `git_index_add_all` on a freshly generated worktree, where every
+ * file needs a new blob.
+ *
+ * Set GITTEST_PERF to run, and GITTEST_PERF_FILES to change the number
+ * of files (100k by default).
+ */
+
+static git_repository *g_repo;
+
+void test_perf_addall__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+void test_perf_addall__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+}
+
+void test_perf_addall__fresh_tree(void)
+{
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_add = PERF_TIMER_INIT;
+	git_index *index;
+	size_t count = perf__worktree_size(100000);
+
+	perf__timer__start(&t_setup);
+	g_repo = perf__make_worktree("addall", count, 1000, false);
+	perf__timer__stop(&t_setup);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	perf__timer__start(&t_add);
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	perf__timer__stop(&t_add);
+
+	cl_assert_equal_sz(count, git_index_entrycount(index));
+	git_index_free(index);
+
+	perf__timer__report(&t_setup, "addall: setup (%d files)", (int)count);
+	perf__timer__report(&t_add, "addall: add all and write index");
+}
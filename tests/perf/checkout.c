@@ -0,0 +1,219 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+#include "fileops.h"
+#include "git2/pack.h"
+
+/* Time checking out a large index into an emptied workdir against a
+ * .gitattributes of generated rules, most of them for other
+ * directories and extensions.  Every file written looks its filters'
+ * attributes up.
+ *
+ * Set GITTEST_PERF to run, GITTEST_PERF_FILES to change the number of
+ * files (100k by default).
+ */
+
+#define ATTR_RULES 2000
+
+static git_repository *g_repo;
+
+void test_perf_checkout__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+void test_perf_checkout__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+}
+
+static void add_gitattributes(void)
+{
+	git_buf rules = GIT_BUF_INIT;
+	git_index *index;
+	int i;
+
+	for (i = 0; i < ATTR_RULES; i++) {
+		switch (i % 3) {
+		case 0:
+			git_buf_printf(&rules, "*.ext%05d text\n", i);
+			break;
+		case 1:
+			git_buf_printf(&rules, "d%05d/*.txt eol=crlf\n", i);
+			break;
+		case 2:
+			git_buf_printf(&rules, "generated%05d.txt -text\n", i);
+			break;
+		}
+	}
+	git_buf_puts(&rules, "*.txt text\n");
+	cl_assert(!git_buf_oom(&rules));
+
+	cl_git_mkfile("checkout/.gitattributes", rules.ptr);
+	git_buf_free(&rules);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_bypath(index, ".gitattributes"));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+}
+
+static void remove_worktree_files(size_t count)
+{
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < count; i += 100) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "checkout/d%05d", (int)(i / 100)));
+		cl_git_pass(git_futils_rmdir_r(path.ptr, NULL, GIT_RMDIR_REMOVE_FILES));
+	}
+
+	git_buf_free(&path);
+}
+
+void test_perf_checkout__index_with_many_attributes(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_checkout = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(100000);
+
+	perf__timer__start(&t_setup);
+	g_repo = perf__make_worktree("checkout", count, 100, true);
+	add_gitattributes();
+	remove_worktree_files(count);
+	perf__timer__stop(&t_setup);
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+
+	perf__timer__start(&t_checkout);
+	cl_git_pass(git_checkout_index(g_repo, NULL, &opts));
+	perf__timer__stop(&t_checkout);
+
+	cl_assert(git_path_exists("checkout/d00000/f0000000.txt"));
+
+	perf__timer__report(&t_setup, "checkout: setup (%d files)", (int)count);
+	perf__timer__report(&t_checkout,
+		"checkout: index with %d attribute rules", ATTR_RULES);
+}
+
+void test_perf_checkout__head_into_empty_workdir(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_checkout = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(100000);
+
+	perf__timer__start(&t_setup);
+	g_repo = perf__make_worktree("checkout", count, 100, true);
+	cl_repo_commit_from_index(NULL, g_repo, NULL, 0, "many files");
+	remove_worktree_files(count);
+	perf__timer__stop(&t_setup);
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+
+	perf__timer__start(&t_checkout);
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+	perf__timer__stop(&t_checkout);
+
+	cl_assert(git_path_exists("checkout/d00000/f0000000.txt"));
+
+	perf__timer__report(&t_setup, "checkout: setup (%d files)", (int)count);
+	perf__timer__report(&t_checkout, "checkout: HEAD into an empty workdir");
+}
+
+/* files large enough, and alike enough, to be stored as long delta
+ * chains, which are expensive to read in path order
+ */
+static void make_packed_worktree(size_t count)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_packbuilder *pb;
+	git_object *head;
+	git_index *index;
+	size_t i, line;
+
+	cl_git_pass(git_repository_init(&g_repo, "checkout", 0));
+
+	for (i = 0; i < count; i++) {
+		if (i % 100 == 0) {
+			git_buf_clear(&path);
+			cl_git_pass(git_buf_printf(&path,
+				"checkout/d%05d", (int)(i / 100)));
+			cl_git_pass(p_mkdir(path.ptr, 0777));
+		}
+
+		git_buf_clear(&content);
+		for (line = 0; line < 400; line++)
+			git_buf_printf(&content, "line %d of a file much like the others%s\n",
+				(int)line, line == i % 400 ? " (edited)" : "");
+		cl_assert(!git_buf_oom(&content));
+
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "checkout/d%05d/f%07d.txt",
+			(int)(i / 100), (int)i));
+		cl_git_mkfile(path.ptr, content.ptr);
+	}
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_repo_commit_from_index(NULL, g_repo, NULL, 0, "many similar files");
+
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD"));
+	cl_git_pass(git_packbuilder_new(&pb, g_repo));
+	cl_git_pass(git_packbuilder_insert_commit(pb, git_object_id(head)));
+	cl_git_pass(git_packbuilder_write(
+		pb, "checkout/.git/objects/pack", 0, NULL, NULL));
+	git_packbuilder_free(pb);
+	git_object_free(head);
+
+	git_buf_free(&path);
+	git_buf_free(&content);
+}
+
+static void checkout_head_afresh(perf_timer *timer, unsigned int strategy)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+
+	/* start with cold object and delta base caches */
+	git_repository_free(g_repo);
+	cl_git_pass(git_repository_open(&g_repo, "checkout"));
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE | strategy;
+
+	perf__timer__start(timer);
+	cl_git_pass(git_checkout_head(g_repo, &opts));
+	perf__timer__stop(timer);
+}
+
+void test_perf_checkout__head_in_pack_order(void)
+{
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_path = PERF_TIMER_INIT;
+	perf_timer t_pack = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(100000) / 10;
+
+	perf__timer__start(&t_setup);
+	make_packed_worktree(count);
+	remove_worktree_files(count);
+	perf__timer__stop(&t_setup);
+
+	checkout_head_afresh(&t_path, 0);
+
+	cl_assert(git_path_exists("checkout/d00000/f0000000.txt"));
+	remove_worktree_files(count);
+
+	checkout_head_afresh(&t_pack, GIT_CHECKOUT_PACK_ORDER);
+
+	cl_assert(git_path_exists("checkout/d00000/f0000000.txt"));
+
+	perf__timer__report(&t_setup, "checkout: setup (%d files)", (int)count);
+	perf__timer__report(&t_path, "checkout: HEAD from a pack, path order");
+	perf__timer__report(&t_pack, "checkout: HEAD from a pack, pack order");
+}
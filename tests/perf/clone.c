@@ -0,0 +1,62 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+#include "git2/clone.h"
+
+/* Time a clone over the local transport (which builds and indexes a
+ * pack, as a clone over the network does), once checking out after the
+ * pack is indexed and once writing the files out while it is.
+ *
+ * Set GITTEST_PERF to run, GITTEST_PERF_FILES to change the number of
+ * files (20k by default).
+ */
+
+static git_repository *g_source;
+
+void test_perf_clone__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+void test_perf_clone__cleanup(void)
+{
+	git_repository_free(g_source);
+	g_source = NULL;
+}
+
+static void clone_source(perf_timer *t, const char *path, int pipeline)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+	git_repository *repo;
+
+	opts.local = GIT_CLONE_NO_LOCAL;
+	opts.pipeline_checkout = pipeline;
+
+	perf__timer__start(t);
+	cl_git_pass(git_clone(&repo,
+		cl_git_path_url(git_repository_path(g_source)), path, &opts));
+	perf__timer__stop(t);
+
+	git_repository_free(repo);
+}
+
+void test_perf_clone__pipelined_checkout(void)
+{
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_serial = PERF_TIMER_INIT;
+	perf_timer t_pipelined = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(20000);
+
+	perf__timer__start(&t_setup);
+	g_source = perf__make_worktree("clonesource", count, 100, true);
+	cl_repo_commit_from_index(NULL, g_source, NULL, 0, "many files");
+	perf__timer__stop(&t_setup);
+
+	clone_source(&t_serial, "cloneserial", 0);
+	clone_source(&t_pipelined, "clonepipelined", 1);
+
+	perf__timer__report(&t_setup, "clone: setup (%d files)", (int)count);
+	perf__timer__report(&t_serial, "clone: checkout after indexing");
+	perf__timer__report(&t_pipelined, "clone: checkout pipelined with indexing");
+}
@@ -0,0 +1,59 @@
+#include "clar_libgit2.h"
+#include "helper__perf__worktree.h"
+#include "index.h"
+
+size_t perf__worktree_size(size_t dflt)
+{
+	char *env = cl_getenv("GITTEST_PERF_FILES");
+	size_t count = dflt;
+
+	if (env && atoi(env) > 0)
+		count = (size_t)atoi(env);
+
+	git__free(env);
+	return count;
+}
+
+git_repository *perf__make_worktree(
+	const char *path, size_t count, size_t per_dir, int stage)
+{
+	git_repository *repo;
+	git_index *index;
+	git_buf buf = GIT_BUF_INIT;
+	struct timeval times[2];
+	size_t i;
+
+	cl_git_pass(git_repository_init(&repo, path, 0));
+
+	for (i = 0; i < count; i++) {
+		if (i % per_dir == 0) {
+			git_buf_clear(&buf);
+			cl_git_pass(git_buf_printf(&buf, "%s/d%05d",
+				path, (int)(i / per_dir)));
+			cl_git_pass(p_mkdir(buf.ptr, 0777));
+		}
+
+		git_buf_clear(&buf);
+		cl_git_pass(git_buf_printf(&buf, "%s/d%05d/f%07d.txt",
+			path, (int)(i / per_dir), (int)i));
+		cl_git_mkfile(buf.ptr, buf.ptr);
+	}
+
+	git_buf_free(&buf);
+
+	if (!stage)
+		return repo;
+
+	cl_git_pass(git_repository_index(&index, repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+
+	/* push the index into the future so that no entry is racy */
+	times[0].tv_sec = times[1].tv_sec = index->stamp.mtime.tv_sec + 5;
+	times[0].tv_usec = times[1].tv_usec = 0;
+	cl_git_pass(p_utimes(git_index_path(index), times));
+	cl_git_pass(git_index_read(index, true));
+
+	git_index_free(index);
+	return repo;
+}
@@ -0,0 +1,11 @@
+/* Create a repository at `path` whose working directory holds `count`
+ * small files, spread over directories of at most `per_dir` files each.
+ * When `stage` is set, the files are also added to the index, and the
+ * index is written out and made to look older than the files so none
+ * of them is racily clean.
+ */
+git_repository *perf__make_worktree(
+	const char *path, size_t count, size_t per_dir, int stage);
+
+/* Number of files to generate, from GITTEST_PERF_FILES or `dflt` */
+size_t perf__worktree_size(size_t dflt);
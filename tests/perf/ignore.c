@@ -0,0 +1,96 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+
+/* Time the status of a worktree of untracked files against a generated
+ * .gitignore of the kind build systems write out: thousands of literal
+ * names, extensions and directories, of which only a few match.
+ *
+ * Set GITTEST_PERF to run, GITTEST_PERF_FILES to change the number of
+ * files (20k by default).
+ */
+
+#define IGNORE_RULES 5000
+
+static git_repository *g_repo;
+
+void test_perf_ignore__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+void test_perf_ignore__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+}
+
+static void write_gitignore(void)
+{
+	git_buf rules = GIT_BUF_INIT;
+	int i;
+
+	for (i = 0; i < IGNORE_RULES; i++) {
+		switch (i % 4) {
+		case 0:
+			git_buf_printf(&rules, "generated%05d.out\n", i);
+			break;
+		case 1:
+			git_buf_printf(&rules, "*.ext%05d\n", i);
+			break;
+		case 2:
+			git_buf_printf(&rules, "gen%05d/\n", i);
+			break;
+		case 3:
+			git_buf_printf(&rules, "d%05d/*.tmp\n", i);
+			break;
+		}
+	}
+
+	/* and a few that do match */
+	git_buf_puts(&rules, "f*7.txt\nd00001/\n");
+	cl_assert(!git_buf_oom(&rules));
+
+	cl_git_mkfile("ignore/.gitignore", rules.ptr);
+	git_buf_free(&rules);
+}
+
+static size_t count_status(void)
+{
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	git_status_list *status;
+	size_t count;
+
+	opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+		GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS |
+		GIT_STATUS_OPT_INCLUDE_IGNORED;
+
+	cl_git_pass(git_status_list_new(&status, g_repo, &opts));
+	count = git_status_list_entrycount(status);
+	git_status_list_free(status);
+
+	return count;
+}
+
+void test_perf_ignore__status_with_many_rules(void)
+{
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_status = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(20000), entries;
+
+	perf__timer__start(&t_setup);
+	g_repo = perf__make_worktree("ignore", count, 100, false);
+	write_gitignore();
+	perf__timer__stop(&t_setup);
+
+	perf__timer__start(&t_status);
+	entries = count_status();
+	perf__timer__stop(&t_status);
+
+	cl_assert(entries > 0);
+
+	perf__timer__report(&t_setup, "ignore: setup (%d files)", (int)count);
+	perf__timer__report(&t_status,
+		"ignore: status against %d rules", IGNORE_RULES);
+}
@@ -0,0 +1,115 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+#include "pathspec.h"
+#include "index.h"
+
+/* Time a diff of the index to the workdir limited by a long pathspec
+ * naming files in one directory in ten, and compare trying every item
+ * of the pathspec on each indexed path with trying only those its trie
+ * finds.
+ *
+ * Set GITTEST_PERF to run, GITTEST_PERF_FILES to change the number of
+ * files (100k by default).
+ */
+
+#define PATHSPEC_ITEMS 10000
+
+static git_repository *g_repo;
+
+void test_perf_pathspec__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+void test_perf_pathspec__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+}
+
+static void build_pathspec(git_vector *items, size_t count)
+{
+	git_buf path = GIT_BUF_INIT;
+	size_t i, file;
+
+	for (i = 0; i < PATHSPEC_ITEMS; i++) {
+		/* files in every tenth directory of 100, and some globs */
+		file = ((i / 10) * 1000 + (i % 10) * 7) % count;
+
+		git_buf_clear(&path);
+		if (i % 100 == 99)
+			cl_git_pass(git_buf_printf(&path, "d%05d/f*1.txt",
+				(int)(file / 100)));
+		else
+			cl_git_pass(git_buf_printf(&path, "d%05d/f%07d.txt",
+				(int)(file / 100), (int)file));
+		cl_git_pass(git_vector_insert(items, git_buf_detach(&path)));
+	}
+}
+
+void test_perf_pathspec__diff_with_many_items(void)
+{
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_scan = PERF_TIMER_INIT;
+	perf_timer t_trie = PERF_TIMER_INIT;
+	perf_timer t_diff = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(100000), i;
+	size_t scan_hits = 0, trie_hits = 0;
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_vector items = GIT_VECTOR_INIT;
+	const git_index_entry *entry;
+	git_pathspec *ps;
+	git_index *index;
+	git_diff *diff;
+
+	perf__timer__start(&t_setup);
+	g_repo = perf__make_worktree("pathspec", count, 100, true);
+	build_pathspec(&items, count);
+	perf__timer__stop(&t_setup);
+
+	opts.pathspec.strings = (char **)items.contents;
+	opts.pathspec.count = items.length;
+	cl_git_pass(git_pathspec_new(&ps, &opts.pathspec));
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	perf__timer__start(&t_scan);
+	for (i = 0; i < git_index_entrycount(index); i++) {
+		entry = git_index_get_byindex(index, i);
+		if (git_pathspec__match(&ps->pathspec, NULL, entry->path,
+				false, false, NULL, NULL))
+			scan_hits++;
+	}
+	perf__timer__stop(&t_scan);
+
+	perf__timer__start(&t_trie);
+	for (i = 0; i < git_index_entrycount(index); i++) {
+		entry = git_index_get_byindex(index, i);
+		if (git_pathspec__match(&ps->pathspec, ps->trie, entry->path,
+				false, false, NULL, NULL))
+			trie_hits++;
+	}
+	perf__timer__stop(&t_trie);
+
+	cl_assert_equal_sz(scan_hits, trie_hits);
+
+	opts.flags = GIT_DIFF_INCLUDE_UNMODIFIED;
+
+	perf__timer__start(&t_diff);
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, index, &opts));
+	perf__timer__stop(&t_diff);
+
+	cl_assert_equal_sz(trie_hits, git_diff_num_deltas(diff));
+
+	perf__timer__report(&t_setup, "pathspec: setup (%d files)", (int)count);
+	perf__timer__report(&t_scan, "pathspec: match index against %d items, every item",
+		PATHSPEC_ITEMS);
+	perf__timer__report(&t_trie, "pathspec: match index, items from the trie");
+	perf__timer__report(&t_diff, "pathspec: diff index to workdir");
+
+	git_diff_free(diff);
+	git_index_free(index);
+	git_pathspec_free(ps);
+	git_vector_free_deep(&items);
+}
@@ -0,0 +1,123 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+
+/* Time rename detection between two trees where every file has been
+ * moved, and half of them changed a little on the way.
+ *
+ * Set GITTEST_PERF to run, and GITTEST_PERF_FILES to change the number
+ * of deleted and added files (50k each by default).
+ */
+
+static git_repository *g_repo;
+
+void test_perf_rename__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+void test_perf_rename__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+}
+
+static void write_blob(git_oid *out, git_buf *buf, size_t file, int changed)
+{
+	size_t i;
+
+	git_buf_clear(buf);
+
+	for (i = 0; i < 30; i++) {
+		if (changed && i == file % 30)
+			git_buf_printf(buf, "changed line %d\n", (int)i);
+		else
+			git_buf_printf(buf, "file %d, line %d\n", (int)file, (int)i);
+	}
+
+	cl_git_pass(git_blob_create_frombuffer(out, g_repo, buf->ptr, buf->size));
+}
+
+static git_tree *build_tree(size_t count, const char *prefix, int changed)
+{
+	git_treebuilder *builder;
+	git_buf buf = GIT_BUF_INIT;
+	git_tree *tree;
+	git_oid id;
+	char name[32];
+	size_t i;
+
+	cl_git_pass(git_treebuilder_new(&builder, g_repo, NULL));
+
+	for (i = 0; i < count; i++) {
+		write_blob(&id, &buf, i, changed && (i % 2) != 0);
+
+		p_snprintf(name, sizeof(name), "%s%07d.txt", prefix, (int)i);
+		cl_git_pass(git_treebuilder_insert(
+			NULL, builder, name, &id, GIT_FILEMODE_BLOB));
+	}
+
+	cl_git_pass(git_treebuilder_write(&id, builder));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+
+	git_treebuilder_free(builder);
+	git_buf_free(&buf);
+
+	return tree;
+}
+
+static void timed_find_similar(
+	perf_timer *t, git_tree *old_tree, git_tree *new_tree,
+	uint32_t flags, size_t expected)
+{
+	git_diff *diff;
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	size_t i, renamed = 0;
+
+	cl_git_pass(git_diff_tree_to_tree(
+		&diff, g_repo, old_tree, new_tree, NULL));
+
+	opts.flags = flags;
+
+	perf__timer__start(t);
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+	perf__timer__stop(t);
+
+	for (i = 0; i < git_diff_num_deltas(diff); i++) {
+		if (git_diff_get_delta(diff, i)->status == GIT_DELTA_RENAMED)
+			renamed++;
+	}
+
+	cl_assert_equal_sz(expected, renamed);
+	git_diff_free(diff);
+}
+
+void test_perf_rename__many_moved_files(void)
+{
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_exact = PERF_TIMER_INIT;
+	perf_timer t_similar = PERF_TIMER_INIT;
+	git_tree *old_tree, *new_tree;
+	size_t count = perf__worktree_size(50000);
+
+	cl_git_pass(git_repository_init(&g_repo, "rename", true));
+
+	perf__timer__start(&t_setup);
+	old_tree = build_tree(count, "old", false);
+	new_tree = build_tree(count, "new", true);
+	perf__timer__stop(&t_setup);
+
+	timed_find_similar(&t_exact, old_tree, new_tree,
+		GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_EXACT_MATCH_ONLY,
+		(count + 1) / 2);
+	timed_find_similar(&t_similar, old_tree, new_tree,
+		GIT_DIFF_FIND_RENAMES, count);
+
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+
+	perf__timer__report(&t_setup, "rename: setup (%d files)", (int)count);
+	perf__timer__report(&t_exact, "rename: exact renames");
+	perf__timer__report(&t_similar, "rename: similar renames");
+}
@@ -0,0 +1,66 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+
+/* Compare index-to-workdir diffs with and without core.scanThreads on a
+ * generated worktree of many small directories.  Like core.preloadIndex,
+ * this pays off most on slow (NFS, overlay) filesystems, so point the
+ * sandbox at one with CLAR_TMP.
+ *
+ * Set GITTEST_PERF to run, and GITTEST_PERF_FILES to change the number
+ * of files (200k by default).
+ */
+
+static git_repository *g_repo;
+
+void test_perf_scan__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+void test_perf_scan__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+}
+
+static void timed_status(perf_timer *t, int scan_threads)
+{
+	git_config *cfg;
+	git_diff *diff;
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_int32(cfg, "core.scanThreads", scan_threads));
+	git_config_free(cfg);
+
+	perf__timer__start(t);
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, NULL, NULL));
+	perf__timer__stop(t);
+
+	cl_assert_equal_sz(0, git_diff_num_deltas(diff));
+	git_diff_free(diff);
+}
+
+void test_perf_scan__index_to_workdir(void)
+{
+	perf_timer t_setup = PERF_TIMER_INIT;
+	perf_timer t_serial = PERF_TIMER_INIT;
+	perf_timer t_prefetch = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(200000);
+
+	perf__timer__start(&t_setup);
+	g_repo = perf__make_worktree("scan", count, 20, true);
+	perf__timer__stop(&t_setup);
+
+	/* warm up the dentry cache so both runs see the same state */
+	timed_status(&t_serial, 0);
+	memset(&t_serial, 0, sizeof(t_serial));
+
+	timed_status(&t_serial, 0);
+	timed_status(&t_prefetch, 8);
+
+	perf__timer__report(&t_setup, "scan: setup (%d files)", (int)count);
+	perf__timer__report(&t_serial, "scan: index to workdir, serial");
+	perf__timer__report(&t_prefetch, "scan: index to workdir, 8 threads");
+}
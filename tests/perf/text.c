@@ -0,0 +1,91 @@
+#include "clar_libgit2.h"
+#include "buf_text.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+
+/* Time the text classification and line ending conversions that run on
+ * every blob in diff, checkout and add.
+ *
+ * Set GITTEST_PERF to run, and GITTEST_PERF_FILES to change the size of
+ * the buffers in MiB (64 by default).
+ */
+
+#define PERF_ROUNDS 4
+
+static git_buf g_lf = GIT_BUF_INIT, g_crlf = GIT_BUF_INIT;
+
+void test_perf_text__initialize(void)
+{
+	size_t size;
+	int line = 0;
+
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+
+	size = perf__worktree_size(64) * 1024 * 1024;
+
+	while (g_lf.size < size) {
+		cl_git_pass(git_buf_printf(&g_lf,
+			"\tline %d of some source file, with (a few) symbols;\n", line));
+		cl_git_pass(git_buf_printf(&g_crlf,
+			"\tline %d of some source file, with (a few) symbols;\r\n", line));
+		line++;
+	}
+}
+
+void test_perf_text__cleanup(void)
+{
+	git_buf_free(&g_lf);
+	git_buf_free(&g_crlf);
+}
+
+void test_perf_text__classify(void)
+{
+	perf_timer t_binary = PERF_TIMER_INIT;
+	perf_timer t_stats = PERF_TIMER_INIT;
+	git_buf_text_stats stats;
+	int i;
+
+	for (i = 0; i < PERF_ROUNDS; i++) {
+		perf__timer__start(&t_binary);
+		cl_assert(!git_buf_text_is_binary(&g_crlf));
+		perf__timer__stop(&t_binary);
+
+		perf__timer__start(&t_stats);
+		cl_assert(!git_buf_text_gather_stats(&stats, &g_crlf, false));
+		perf__timer__stop(&t_stats);
+	}
+
+	cl_assert_equal_i(stats.lf, stats.crlf);
+	cl_assert_equal_i(stats.cr, stats.crlf);
+
+	perf__timer__report(&t_binary, "text: is_binary (%d x %d bytes)",
+		PERF_ROUNDS, (int)g_crlf.size);
+	perf__timer__report(&t_stats, "text: gather_stats");
+}
+
+void test_perf_text__convert(void)
+{
+	perf_timer t_to_lf = PERF_TIMER_INIT;
+	perf_timer t_to_crlf = PERF_TIMER_INIT;
+	git_buf out = GIT_BUF_INIT;
+	int i;
+
+	for (i = 0; i < PERF_ROUNDS; i++) {
+		perf__timer__start(&t_to_lf);
+		cl_git_pass(git_buf_text_crlf_to_lf(&out, &g_crlf));
+		perf__timer__stop(&t_to_lf);
+		cl_assert_equal_sz(g_lf.size, out.size);
+
+		perf__timer__start(&t_to_crlf);
+		cl_git_pass(git_buf_text_lf_to_crlf(&out, &g_lf));
+		perf__timer__stop(&t_to_crlf);
+		cl_assert_equal_sz(g_crlf.size, out.size);
+	}
+
+	perf__timer__report(&t_to_lf, "text: crlf_to_lf (%d x %d bytes)",
+		PERF_ROUNDS, (int)g_crlf.size);
+	perf__timer__report(&t_to_crlf, "text: lf_to_crlf");
+
+	git_buf_free(&out);
+}
@@ -0,0 +1,85 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "helper__perf__worktree.h"
+#include "vector.h"
+#include "wildmatch.h"
+
+/* Compare p_fnmatch with compiled patterns, matching a mix of typical
+ * ignore and attribute patterns against generated paths.
+ *
+ * Set GITTEST_PERF to run, and GITTEST_PERF_FILES to change the number
+ * of paths (200k by default).
+ */
+
+static const char *patterns[] = {
+	"*.o", "*.[oa]", "build", "src/*.c", "doc/**/*.html",
+	"**/node_modules", "*~", ".*.sw[a-p]", "generated_*.h",
+	"lib/**/test/*", "a*b*c*d*e*f*g", "**/*.tmp/**",
+};
+
+void test_perf_wildmatch__initialize(void)
+{
+	if (!cl_is_env_set("GITTEST_PERF"))
+		cl_skip();
+}
+
+static void build_paths(git_vector *paths, size_t count)
+{
+	static const char *dirs[] = { "src", "doc/api/v1", "lib/x/test", "build" };
+	static const char *exts[] = { "c", "h", "o", "html", "tmp", "txt" };
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "%s/d%d/abcdefg_%d.%s",
+			dirs[i % ARRAY_SIZE(dirs)], (int)(i % 97), (int)i,
+			exts[i % ARRAY_SIZE(exts)]));
+		cl_git_pass(git_vector_insert(paths, git_buf_detach(&path)));
+	}
+}
+
+void test_perf_wildmatch__patterns(void)
+{
+	perf_timer t_fnmatch = PERF_TIMER_INIT;
+	perf_timer t_wildmatch = PERF_TIMER_INIT;
+	size_t count = perf__worktree_size(200000), i, p;
+	git_wildmatch *compiled[ARRAY_SIZE(patterns)];
+	git_vector paths = GIT_VECTOR_INIT;
+	size_t fnmatch_hits = 0, wildmatch_hits = 0;
+	int flags = FNM_PATHNAME | FNM_LEADING_DIR;
+	git_pool pool;
+	char *path;
+
+	git_pool_init(&pool, 1);
+	build_paths(&paths, count);
+
+	for (p = 0; p < ARRAY_SIZE(patterns); p++)
+		cl_git_pass(git_wildmatch_compile(
+			&compiled[p], &pool, patterns[p], 0));
+
+	perf__timer__start(&t_fnmatch);
+	git_vector_foreach(&paths, i, path) {
+		for (p = 0; p < ARRAY_SIZE(patterns); p++)
+			if (p_fnmatch(patterns[p], path, flags) == 0)
+				fnmatch_hits++;
+	}
+	perf__timer__stop(&t_fnmatch);
+
+	perf__timer__start(&t_wildmatch);
+	git_vector_foreach(&paths, i, path) {
+		for (p = 0; p < ARRAY_SIZE(patterns); p++)
+			if (git_wildmatch_match(compiled[p], path, flags) == 0)
+				wildmatch_hits++;
+	}
+	perf__timer__stop(&t_wildmatch);
+
+	cl_assert_equal_sz(fnmatch_hits, wildmatch_hits);
+
+	perf__timer__report(&t_fnmatch, "wildmatch: p_fnmatch (%d paths, %d patterns)",
+		(int)count, (int)ARRAY_SIZE(patterns));
+	perf__timer__report(&t_wildmatch, "wildmatch: compiled");
+
+	git_vector_free_deep(&paths);
+	git_pool_clear(&pool);
+}
@@ -2,6 +2,7 @@
 #include "iterator.h"
 #include "repository.h"
 #include "fileops.h"
+#include "pathspec.h"
 #include <stdarg.h>
 
 static git_repository *g_repo;
@@ -900,6 +901,84 @@ void test_repo_iterator__workdir_depth(void)
 	git_iterator_free(iter);
 }
 
+static void set_scan_threads(int threads)
+{
+	git_config *cfg;
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_int32(cfg, "core.scanThreads", threads));
+	git_config_free(cfg);
+}
+
+static void workdir_items(
+	git_buf *out, int threads, unsigned int flags,
+	const char *start, const char *end, size_t stop_after)
+{
+	git_iterator *iter;
+	git_iterator_options iter_opts = GIT_ITERATOR_OPTIONS_INIT;
+	const git_index_entry *entry;
+	size_t count = 0;
+	int error;
+
+	set_scan_threads(threads);
+
+	iter_opts.flags = flags;
+	cl_git_pass(git_iterator_for_workdir(&iter, g_repo, NULL, NULL, &iter_opts));
+
+	/* go part of the way, then start over within the range */
+	if (stop_after) {
+		while (count++ < stop_after && !git_iterator_advance(&entry, iter))
+			/* empty */;
+		cl_git_pass(git_iterator_reset(iter, start, end));
+	}
+
+	git_buf_clear(out);
+
+	while (!(error = git_iterator_advance(&entry, iter)))
+		cl_git_pass(git_buf_printf(out, "%s %07o %d\n",
+			entry->path, entry->mode, (int)entry->file_size));
+
+	cl_assert_equal_i(GIT_ITEROVER, error);
+	git_iterator_free(iter);
+}
+
+void test_repo_iterator__workdir_prefetched(void)
+{
+	git_buf serial = GIT_BUF_INIT, prefetched = GIT_BUF_INIT;
+	unsigned int flags[] = {
+		0,
+		GIT_ITERATOR_INCLUDE_TREES,
+		GIT_ITERATOR_IGNORE_CASE | GIT_ITERATOR_INCLUDE_TREES,
+		GIT_ITERATOR_DONT_IGNORE_CASE,
+	};
+	size_t i;
+
+	g_repo = cl_git_sandbox_init("icase");
+
+	build_workdir_tree("icase", 10, 10);
+	build_workdir_tree("icase/DIR01/sUB01", 50, 0);
+	build_workdir_tree("icase/dir02/sUB01", 50, 0);
+
+	for (i = 0; i < ARRAY_SIZE(flags); i++) {
+		workdir_items(&serial, 0, flags[i], NULL, NULL, 0);
+		workdir_items(&prefetched, 4, flags[i], NULL, NULL, 0);
+		cl_assert_equal_s(serial.ptr, prefetched.ptr);
+
+		/* what is read ahead for one range isn't used for another */
+		workdir_items(&serial, 0, flags[i], "DIR01", "dir02/sUB01/dir30", 40);
+		workdir_items(&prefetched, 4, flags[i], "DIR01", "dir02/sUB01/dir30", 40);
+		cl_assert_equal_s(serial.ptr, prefetched.ptr);
+	}
+
+	/* one thread is enough to get ahead */
+	workdir_items(&serial, 0, 0, NULL, NULL, 0);
+	workdir_items(&prefetched, 1, 0, NULL, NULL, 0);
+	cl_assert_equal_s(serial.ptr, prefetched.ptr);
+
+	git_buf_free(&serial);
+	git_buf_free(&prefetched);
+}
+
 void test_repo_iterator__fs(void)
 {
 	git_iterator *i;
@@ -1542,3 +1621,125 @@ void test_repo_iterator__treefilelist_icase(void)
 	git_vector_free(&filelist);
 	git_tree_free(tree);
 }
+
+static void iterator_for_kind(
+	git_iterator **out, int kind, git_iterator_options *i_opts)
+{
+	git_tree *tree;
+	git_index *index;
+
+	switch (kind) {
+	case GIT_ITERATOR_TYPE_TREE:
+		cl_git_pass(git_repository_head_tree(&tree, g_repo));
+		cl_git_pass(git_iterator_for_tree(out, tree, i_opts));
+		git_tree_free(tree);
+		break;
+	case GIT_ITERATOR_TYPE_INDEX:
+		cl_git_pass(git_repository_index(&index, g_repo));
+		cl_git_pass(git_iterator_for_index(out, index, i_opts));
+		git_index_free(index);
+		break;
+	default:
+		cl_git_pass(git_iterator_for_workdir(
+			out, g_repo, NULL, NULL, i_opts));
+		break;
+	}
+}
+
+/* advance into every tree; a tree with nothing to show may instead move
+ * on to what follows it, or to the end
+ */
+static void expect_advance_into_items(
+	git_iterator *i, const char **expected, int expected_count)
+{
+	const git_index_entry *entry;
+	int count = 0, error;
+
+	cl_git_pass(git_iterator_current(&entry, i));
+
+	while (entry != NULL) {
+		cl_assert(count < expected_count);
+		cl_assert_equal_s(expected[count++], entry->path);
+
+		if (entry->mode == GIT_FILEMODE_TREE) {
+			error = git_iterator_advance_into(&entry, i);
+
+			if (error == GIT_ENOTFOUND)
+				error = git_iterator_advance(&entry, i);
+		} else {
+			error = git_iterator_advance(&entry, i);
+		}
+
+		cl_assert(!error || error == GIT_ITEROVER);
+		if (error == GIT_ITEROVER)
+			entry = NULL;
+	}
+
+	cl_assert_equal_i(expected_count, count);
+}
+
+void test_repo_iterator__pathspec_trie(void)
+{
+	static const int kinds[] = {
+		GIT_ITERATOR_TYPE_TREE, GIT_ITERATOR_TYPE_INDEX,
+		GIT_ITERATOR_TYPE_WORKDIR
+	};
+	static const char *some[] = { "L/*", "k/[ab]", "zz/x" };
+	static const char *expect_some[] = {
+		"L/1", "L/B", "L/D", "L/a", "L/c",
+		"k/1", "k/B", "k/D", "k/a", "k/c",
+	};
+	static const char *none_below[] = { "L/q*", "a", "k/zz" };
+	static const char *expect_none_below[] = { "a" };
+	static const char *expect_none_below_trees[] = { "L/", "a", "k/" };
+	git_iterator *i;
+	git_iterator_options i_opts = GIT_ITERATOR_OPTIONS_INIT;
+	git_strarray paths;
+	git_pathspec ps;
+	size_t k;
+
+	g_repo = cl_git_sandbox_init("icase");
+
+	paths.strings = (char **)some;
+	paths.count = ARRAY_SIZE(some);
+	cl_git_pass(git_pathspec__init(&ps, &paths));
+
+	/* only the directories the pathspec reaches into are expanded */
+	i_opts.flags = GIT_ITERATOR_DONT_IGNORE_CASE;
+	i_opts.pathspec_trie = ps.trie;
+
+	for (k = 0; k < ARRAY_SIZE(kinds); ++k) {
+		iterator_for_kind(&i, kinds[k], &i_opts);
+		expect_iterator_items(i, 10, expect_some, 10, expect_some);
+		git_iterator_free(i);
+	}
+
+	git_pathspec__clear(&ps);
+
+	/* directories with nothing the pathspec can match are skipped, as if
+	 * they were empty, without stopping the iteration
+	 */
+	paths.strings = (char **)none_below;
+	paths.count = ARRAY_SIZE(none_below);
+	cl_git_pass(git_pathspec__init(&ps, &paths));
+	i_opts.pathspec_trie = ps.trie;
+
+	for (k = 0; k < ARRAY_SIZE(kinds); ++k) {
+		i_opts.flags = GIT_ITERATOR_DONT_IGNORE_CASE;
+		iterator_for_kind(&i, kinds[k], &i_opts);
+		expect_iterator_items(
+			i, 1, expect_none_below, 1, expect_none_below);
+		git_iterator_free(i);
+
+		/* the index only has the trees of the entries it keeps */
+		if (kinds[k] == GIT_ITERATOR_TYPE_INDEX)
+			continue;
+
+		i_opts.flags |= GIT_ITERATOR_DONT_AUTOEXPAND;
+		iterator_for_kind(&i, kinds[k], &i_opts);
+		expect_advance_into_items(i, expect_none_below_trees, 3);
+		git_iterator_free(i);
+	}
+
+	git_pathspec__clear(&ps);
+}
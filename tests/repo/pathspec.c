@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "git2/pathspec.h"
+#include "pathspec.h"
 
 static git_repository *g_repo;
 
@@ -383,3 +384,75 @@ void test_repo_pathspec__in_memory(void)
 
 	git_pathspec_free(ps);
 }
+
+static void assert_trie_matches_like_scan(git_pathspec *ps, const char *path)
+{
+	static const bool flags[][2] = {
+		{ false, false }, { false, true }, { true, false }, { true, true }
+	};
+	const char *scanned, *tried;
+	size_t scanned_at, tried_at, f;
+	bool result;
+
+	for (f = 0; f < ARRAY_SIZE(flags); ++f) {
+		result = git_pathspec__match(&ps->pathspec, NULL, path,
+			flags[f][0], flags[f][1], &scanned, &scanned_at);
+
+		cl_assert_equal_b(result, git_pathspec__match(
+			&ps->pathspec, ps->trie, path,
+			flags[f][0], flags[f][1], &tried, &tried_at));
+		cl_assert_equal_sz(scanned_at, tried_at);
+		cl_assert_equal_p(scanned, tried);
+
+		/* and no path that matches is skipped by the iterators */
+		if (scanned)
+			cl_assert(git_pathspec__trie_may_match(
+				ps->trie, path, strlen(path), false));
+	}
+}
+
+void test_repo_pathspec__trie(void)
+{
+	static char *strings[] = {
+		"one", "two*", "!three*", "x*four", "dir/", "dir/sub/*.c",
+		"Dir/x", "!dir/sub/skip.c", "a?c", "x[ab]x", "esc\\*", "",
+		"deep/er/still/file", "two/three"
+	};
+	static const char *paths[] = {
+		"one", "ONE", "one/file", "oneself", "two", "two.txt", "TWO/x",
+		"three", "three.txt", "!three", "!three/x", "xanything.four",
+		"dir", "dir/a", "DIR/x", "dir/sub/a.c", "dir/sub/skip.c",
+		"dir/sub/deeper/b.c", "abc", "aXc", "xax", "xbx", "xcx", "esc*",
+		"esc\\x", "deep", "deep/er", "deep/er/still/file/below",
+		"nomatch", "two/three", "!dir/sub/skip.c",
+	};
+	char *many[100];
+	git_strarray s = { strings, ARRAY_SIZE(strings) };
+	git_pathspec *ps;
+	size_t i;
+
+	cl_git_pass(git_pathspec_new(&ps, &s));
+
+	for (i = 0; i < ARRAY_SIZE(paths); ++i)
+		assert_trie_matches_like_scan(ps, paths[i]);
+
+	cl_assert(git_pathspec__trie_may_match(ps->trie, "dir/", 4, true));
+	cl_assert(git_pathspec__trie_may_match(ps->trie, "deep/er", 7, true));
+	cl_assert(!git_pathspec__trie_may_match(ps->trie, "deep/er", 7, false));
+	cl_assert(!git_pathspec__trie_may_match(ps->trie, "deep/no", 7, true));
+	cl_assert(!git_pathspec__trie_may_match(ps->trie, "nomatch", 7, true));
+
+	git_pathspec_free(ps);
+
+	/* with too many items that may match to collect, all are tried */
+	for (i = 0; i < ARRAY_SIZE(many); ++i)
+		many[i] = (i % 2) ? "t*" : "!two*";
+	s.strings = many;
+	s.count = ARRAY_SIZE(many);
+	cl_git_pass(git_pathspec_new(&ps, &s));
+
+	assert_trie_matches_like_scan(ps, "two");
+	assert_trie_matches_like_scan(ps, "three");
+
+	git_pathspec_free(ps);
+}
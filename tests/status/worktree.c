@@ -964,7 +964,8 @@ void test_status_worktree__update_stat_cache_0(void)
 	cl_git_pass(git_status_list_new(&status, repo, &opts));
 	check_status0(status);
 	cl_git_pass(git_status_list_get_perfdata(&perf, status));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(13 + 3 - 2, perf.stat_calls);
+	cl_assert_equal_sz(2 /* .git and subdir */, perf.stat_calls_avoided);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_status_list_free(status);
@@ -978,7 +979,8 @@ void test_status_worktree__update_stat_cache_0(void)
 	cl_git_pass(git_status_list_new(&status, repo, &opts));
 	check_status0(status);
 	cl_git_pass(git_status_list_get_perfdata(&perf, status));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(13 + 3 - 2, perf.stat_calls);
+	cl_assert_equal_sz(2 /* .git and subdir */, perf.stat_calls_avoided);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_status_list_free(status);
@@ -990,12 +992,51 @@ void test_status_worktree__update_stat_cache_0(void)
 	cl_git_pass(git_status_list_new(&status, repo, &opts));
 	check_status0(status);
 	cl_git_pass(git_status_list_get_perfdata(&perf, status));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(13 + 3 - 2, perf.stat_calls);
+	cl_assert_equal_sz(2 /* .git and subdir */, perf.stat_calls_avoided);
 	cl_assert_equal_sz(0, perf.oid_calculations);
 
 	git_status_list_free(status);
 }
 
+void test_status_worktree__avoids_stat_calls(void)
+{
+#ifdef GIT_WIN32
+	cl_skip();
+#else
+	git_repository *repo = cl_git_sandbox_init("status");
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	git_status_list *status;
+	git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
+
+	cl_must_pass(p_mkdir("status/untracked_dir", 0777));
+	cl_git_mkfile("status/untracked_dir/one", "one\n");
+	cl_git_mkfile("status/untracked_dir/two", "two\n");
+
+	/* without ignored files or untracked contents, the scan has no need
+	 * to lstat directories, ignored_file or anything in untracked_dir
+	 */
+	opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+
+	cl_git_pass(git_status_list_new(&status, repo, &opts));
+	cl_git_pass(git_status_list_get_perfdata(&perf, status));
+	cl_assert_equal_sz(13, perf.stat_calls);
+	cl_assert_equal_sz(
+		3 /* .gitted, subdir, untracked_dir */ + 1 /* ignored_file */ +
+		2 /* untracked_dir/one and two */, perf.stat_calls_avoided);
+
+	/* a version 1 struct has no room for the avoided calls */
+	memset(&perf, 0, sizeof(perf));
+	perf.version = 1;
+	perf.stat_calls_avoided = 42;
+	cl_git_pass(git_status_list_get_perfdata(&perf, status));
+	cl_assert_equal_sz(13, perf.stat_calls);
+	cl_assert_equal_sz(42, perf.stat_calls_avoided);
+
+	git_status_list_free(status);
+#endif
+}
+
 void test_status_worktree__unreadable(void)
 {
 #ifndef GIT_WIN32